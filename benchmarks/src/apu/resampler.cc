@@ -0,0 +1,60 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include <apu/resampler.h>
+}
+
+namespace apu_benchmarks
+{
+
+// Aligned for the vectorized kernels
+static struct resampler g_resampler;
+
+// Samples generated by the APU during a video frame, at 48kHz
+#define FRAME_SAMPLES 804
+
+/*
+ * Convert one frame of samples from 48kHz to 44.1kHz.
+ * Arguments: kernel, quality.
+ */
+static void Resample(benchmark::State &state)
+{
+    const auto kernel = static_cast<resampler_kernel>(state.range(0));
+    const auto quality = static_cast<resampler_quality>(state.range(1));
+
+    if (!resampler_set_kernel(kernel)) {
+        state.SkipWithError("Unsupported kernel");
+        return;
+    }
+
+    resampler_init(&g_resampler, 48000, 44100, quality);
+    state.SetLabel(resampler_kernel_name(kernel));
+
+    std::vector<i16> input(2 * FRAME_SAMPLES);
+    for (size_t i = 0; i < FRAME_SAMPLES; ++i)
+        input[2 * i] = input[2 * i + 1] = 16000 * std::sin(i / 10.0);
+    std::vector<i16> output(
+        2 * resampler_max_output(&g_resampler, FRAME_SAMPLES));
+
+    size_t generated = 0;
+    for (auto _ : state) {
+        generated += resampler_process(&g_resampler, input.data(),
+                                       FRAME_SAMPLES, output.data());
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    state.SetItemsProcessed(generated);
+    state.counters["time/sample"] = benchmark::Counter(
+        generated, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+BENCHMARK(Resample)
+    ->ArgNames({"kernel", "quality"})
+    ->ArgsProduct({{RESAMPLER_SCALAR, RESAMPLER_SSE2, RESAMPLER_AVX2,
+                    RESAMPLER_NEON},
+                   {RESAMPLER_LOW, RESAMPLER_MEDIUM, RESAMPLER_HIGH}});
+
+} // namespace apu_benchmarks
@@ -0,0 +1,63 @@
+// REG_ERR is also defined by the system headers
+#define REG_ERR REG_ERR_
+#include <benchmark/benchmark.h>
+#undef REG_ERR
+
+extern "C" {
+#include <cartridge/cartridge.h>
+#include <cartridge/memory.h>
+#include <utils/log.h>
+}
+
+#include "cartridges/cartridge.hxx"
+
+namespace cartridge_benchmarks
+{
+
+// 2 MiB ROM, 32 KiB RAM
+static CartridgeGenerator<1 << 21, 1 << 15> g_mbc1(MBC1);
+static CartridgeGenerator<1 << 21, 1 << 15> g_mbc3(MBC3);
+
+// Read the switchable ROM bank, selecting another bank every N reads
+template <u8 (*read)(u16), void (*write)(u16, u8), u8 banks>
+static void read_banked(benchmark::State &state, cartridge_t cart)
+{
+    const u64 reads_per_switch = state.range(0);
+    u64 reads = 0;
+    u8 bank = 1;
+
+    log_set_level(LOG_ERROR, false);
+    cartridge = cart;
+
+    for (auto _ : state) {
+        if (reads++ % reads_per_switch == 0) {
+            write(RAM_GATE, bank); // ROM bank register (0x2000-0x3FFF)
+            bank = bank % banks + 1;
+        }
+        benchmark::DoNotOptimize(read(ROM_BANK + (reads & 0x3FFF)));
+    }
+
+    state.SetItemsProcessed(reads);
+}
+
+/*
+ * Arguments: reads per bank switch.
+ */
+static void ReadMBC1(benchmark::State &state)
+{
+    read_banked<read_mbc1, write_mbc1, 0x1F>(state, g_mbc1.GetCart());
+}
+
+BENCHMARK(ReadMBC1)->Arg(1)->Arg(64)->Arg(4096);
+
+/*
+ * Arguments: reads per bank switch.
+ */
+static void ReadMBC3(benchmark::State &state)
+{
+    read_banked<read_mbc3, write_mbc3, 0x7F>(state, g_mbc3.GetCart());
+}
+
+BENCHMARK(ReadMBC3)->Arg(1)->Arg(64)->Arg(4096);
+
+} // namespace cartridge_benchmarks
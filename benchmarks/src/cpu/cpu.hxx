@@ -0,0 +1,59 @@
+// REG_ERR is also defined by the system headers
+#define REG_ERR REG_ERR_
+#include <benchmark/benchmark.h>
+#undef REG_ERR
+
+#include <vector>
+
+extern "C" {
+#include <apu/apu.h>
+#include <cpu/cpu.h>
+#include <cpu/memory.h>
+#include <cpu/serial.h>
+#include <cpu/timer.h>
+#include <ppu/ppu.h>
+#include <utils/log.h>
+}
+
+#include "cartridges/cartridge.hxx"
+
+namespace cpu_benchmarks
+{
+
+/// Programs are loaded into the WRAM, their data lives in the second bank
+#define PROGRAM_START 0xC000
+#define PROGRAM_END 0xCFFF
+#define DATA_START 0xD000
+
+/*
+ * Power on a DMG running a 32 KiB cartridge without MBC, with the PPU and
+ * the APU enabled so that every machine cycle costs what it does in a game.
+ */
+inline void reset_emulator()
+{
+    static CartridgeGenerator<1 << 15> generator(ROM_ONLY);
+
+    log_set_level(LOG_ERROR, false);
+
+    cartridge = generator.GetCart();
+    reset_cpu();
+    reset_timer();
+    reset_serial();
+    reset_apu();
+    reset_ppu();
+
+    g_cpu.registers.sp = 0xFFFE;
+    write_register_16bit(REG_BC, DATA_START + 0x100);
+    write_register_16bit(REG_DE, DATA_START + 0x200);
+    write_register_16bit(REG_HL, DATA_START);
+}
+
+/// Copy a program into the WRAM and jump to it
+inline void load_program(const std::vector<u8> &program)
+{
+    for (size_t i = 0; i < program.size(); ++i)
+        g_cpu.memory[PROGRAM_START + i] = program[i];
+    g_cpu.registers.pc = PROGRAM_START;
+}
+
+} // namespace cpu_benchmarks
@@ -0,0 +1,273 @@
+#include <map>
+#include <random>
+#include <string>
+
+#include "cpu.hxx"
+
+extern "C" {
+#include <cpu/instruction.h>
+#include <cpu/interrupt.h>
+}
+
+namespace cpu_benchmarks
+{
+
+/// Target of the CALL instructions of the branch mix
+#define SUBROUTINE 0xD800
+
+/// The instructions of a mix are picked among groups of instructions which
+/// leave the registers used as pointers (HL and SP) unchanged
+using Units = std::vector<std::vector<u8>>;
+
+static Units loads()
+{
+    Units units;
+
+    for (u8 opcode = 0x40; opcode < 0x60; ++opcode)
+        units.push_back({opcode}); // LD B/C/D/E,r
+    for (u8 opcode = 0x70; opcode < 0x80; ++opcode) {
+        if (opcode != 0x76) // HALT
+            units.push_back({opcode}); // LD (HL),r and LD A,r
+    }
+    for (u8 opcode : {0x06, 0x0E, 0x16, 0x1E, 0x3E, 0x36})
+        units.push_back({opcode, 0x42}); // LD r,d8
+
+    return units;
+}
+
+static Units alu()
+{
+    Units units;
+
+    for (u8 opcode = 0x80; opcode < 0xC0; ++opcode)
+        units.push_back({opcode}); // ALU A,r
+    for (u8 opcode : {0xC6, 0xCE, 0xD6, 0xDE, 0xE6, 0xEE, 0xF6, 0xFE})
+        units.push_back({opcode, 0x5A}); // ALU A,d8
+    for (u8 opcode : {0x3C, 0x3D, 0x27, 0x2F, 0x37, 0x3F})
+        units.push_back({opcode}); // INC A, DEC A, DAA, CPL, SCF, CCF
+
+    return units;
+}
+
+static Units memory()
+{
+    return {
+        {0x7E},             // LD A,(HL)
+        {0x77},             // LD (HL),A
+        {0x2A, 0x3A},       // LD A,(HL+); LD A,(HL-)
+        {0x22, 0x32},       // LD (HL+),A; LD (HL-),A
+        {0x34},             // INC (HL)
+        {0x35},             // DEC (HL)
+        {0xF0, 0x80},       // LDH A,(0xFF80)
+        {0xE0, 0x81},       // LDH (0xFF81),A
+        {0xFA, 0x10, 0xD0}, // LD A,(0xD010)
+        {0xEA, 0x11, 0xD0}, // LD (0xD011),A
+        {0xC5, 0xC1},       // PUSH BC; POP BC
+        {0xD5, 0xD1},       // PUSH DE; POP DE
+    };
+}
+
+static Units branches()
+{
+    return {
+        {0x18, 0x00},                             // JR +0
+        {0x20, 0x00},                             // JR NZ,+0
+        {0x38, 0x00},                             // JR C,+0
+        {0x3F},                                   // CCF
+        {0xB7},                                   // OR A
+        {0xCD, LSB(SUBROUTINE), MSB(SUBROUTINE)}, // CALL SUBROUTINE
+        {0xDC, LSB(SUBROUTINE), MSB(SUBROUTINE)}, // CALL C,SUBROUTINE
+        {0xFF},                                   // RST 0x38
+        {0xC3},                                   // JP next (see generate)
+    };
+}
+
+static const std::map<int, std::pair<const char *, Units (*)()>> g_mixes = {
+    {0, {"loads", loads}},
+    {1, {"alu", alu}},
+    {2, {"memory", memory}},
+    {3, {"branches", branches}},
+};
+
+// Fill the WRAM with random units, and loop back to its start
+static std::vector<u8> generate(const Units &units, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<size_t> pick(0, units.size() - 1);
+    std::vector<u8> program;
+
+    while (program.size() < PROGRAM_END - PROGRAM_START - 6) {
+        std::vector<u8> unit = units[pick(random)];
+        if (unit == std::vector<u8>{0xC3}) {
+            const u16 next = PROGRAM_START + program.size() + 3;
+            unit = {0xC3, (u8)LSB(next), (u8)MSB(next)};
+        }
+        program.insert(program.end(), unit.begin(), unit.end());
+    }
+
+    program.insert(program.end(), {0xC3, LSB(PROGRAM_START),
+                                   MSB(PROGRAM_START)}); // JP PROGRAM_START
+    return program;
+}
+
+/*
+ * Execute a random mix of instructions.
+ * Arguments: mix (loads, ALU, memory, branches, all of them).
+ */
+static void ExecuteInstruction(benchmark::State &state)
+{
+    Units units;
+
+    if (g_mixes.count(state.range(0))) {
+        const auto &mix = g_mixes.at(state.range(0));
+        state.SetLabel(mix.first);
+        units = mix.second();
+    } else {
+        state.SetLabel("all");
+        for (const auto &mix : g_mixes) {
+            const auto mix_units = mix.second.second();
+            units.insert(units.end(), mix_units.begin(), mix_units.end());
+        }
+    }
+
+    reset_emulator();
+    g_cartridge.rom[0x38] = 0xC9;    // RET
+    g_cpu.memory[SUBROUTINE] = 0xC9; // RET
+    load_program(generate(units, state.range(0)));
+
+    const u64 start = timer_get_cycles();
+    for (auto _ : state)
+        execute_instruction();
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["cycles"] = benchmark::Counter(
+        timer_get_cycles() - start, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(ExecuteInstruction)->DenseRange(0, g_mixes.size());
+
+// One opcode of each operand type
+static void OperandTypes(benchmark::internal::Benchmark *benchmark)
+{
+    std::map<operand_type, u8> opcodes;
+
+    reset_emulator();
+
+    for (int opcode = 0; opcode <= 0xFF; ++opcode) {
+        g_cpu.registers.pc = PROGRAM_START;
+        const struct instruction in = fetch_instruction(opcode);
+        if (in.instruction != IN_ERR && !opcodes.count(in.type))
+            opcodes[in.type] = opcode;
+    }
+
+    for (const auto &type : opcodes)
+        benchmark->Arg(type.second);
+}
+
+/*
+ * Decode an instruction whose opcode has already been read.
+ * Arguments: opcode, one for each operand type.
+ */
+static void FetchInstruction(benchmark::State &state)
+{
+    const u8 opcode = state.range(0);
+    const u8 bytes[3] = {opcode, 0x00, MSB(DATA_START)};
+    char name[32];
+
+    reset_emulator();
+    load_program({bytes[0], bytes[1], bytes[2]});
+    disassemble_instruction(bytes, name, sizeof(name));
+    state.SetLabel(name);
+
+    for (auto _ : state) {
+        g_cpu.registers.pc = PROGRAM_START + 1;
+        benchmark::DoNotOptimize(fetch_instruction(opcode));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(FetchInstruction)->Apply(OperandTypes);
+
+/*
+ * Execute CB prefixed instructions, the prefix having already been read.
+ * Arguments: group (rotations and shifts, BIT, RES, SET).
+ */
+static void CbExecuteInstruction(benchmark::State &state)
+{
+    static const char *groups[] = {"rotate", "bit", "res", "set"};
+    const int group = state.range(0);
+    std::mt19937 random(group);
+    std::uniform_int_distribution<int> pick(0x40 * group, 0x40 * group + 0x3F);
+    std::vector<u8> program(PROGRAM_END - PROGRAM_START);
+
+    for (auto &opcode : program)
+        opcode = pick(random);
+
+    reset_emulator();
+    load_program(program);
+    state.SetLabel(groups[group]);
+
+    for (auto _ : state) {
+        if (g_cpu.registers.pc == PROGRAM_END)
+            g_cpu.registers.pc = PROGRAM_START;
+        cb_execute_instruction();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(CbExecuteInstruction)->DenseRange(0, 3);
+
+/*
+ * Check for pending interrupts once per instruction, as the main loop does.
+ * Arguments: state (nothing requested, requested but masked by IME,
+ * dispatched).
+ */
+static void HandleInterrupts(benchmark::State &state)
+{
+    static const char *cases[] = {"idle", "masked", "dispatch"};
+    const int pending = state.range(0);
+
+    reset_emulator();
+    state.SetLabel(cases[pending]);
+    write_interrupt(IE_ADDRESS, 0x1F);
+    write_interrupt(IF_ADDRESS, 0x00);
+    interrupt_set_ime(false);
+    if (pending)
+        interrupt_request(IV_TIMA);
+
+    for (auto _ : state) {
+        if (pending == 2) {
+            interrupt_request(IV_TIMA);
+            interrupt_set_ime(true);
+            g_cpu.registers.sp = 0xFFFE;
+        }
+        benchmark::DoNotOptimize(handle_interrupts());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(HandleInterrupts)->DenseRange(0, 2);
+
+/*
+ * Advance the timer, and the components clocked alongside it.
+ * Arguments: machine cycles per call.
+ */
+static void TimerTicks(benchmark::State &state)
+{
+    const u8 ticks = state.range(0);
+
+    reset_emulator();
+    write_memory(0xFF07, 0x05); // TAC: enabled, increment every 4 cycles
+
+    for (auto _ : state)
+        timer_ticks(ticks);
+
+    state.SetItemsProcessed(state.iterations() * ticks);
+}
+
+BENCHMARK(TimerTicks)->Arg(1)->Arg(2)->Arg(4);
+
+} // namespace cpu_benchmarks
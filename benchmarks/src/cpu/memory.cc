@@ -0,0 +1,69 @@
+#include "cpu.hxx"
+
+namespace cpu_benchmarks
+{
+
+struct region {
+    const char *name;
+    u16 start;
+    u16 mask; ///< Accesses are spread over start..start+mask
+};
+
+static const struct region g_regions[] = {
+    {"rom0", 0x0200, 0xFF}, {"romx", 0x4200, 0xFF}, {"vram", 0x8000, 0xFF},
+    {"sram", 0xA000, 0xFF}, {"wram", 0xC000, 0xFF}, {"oam", 0xFE00, 0x7F},
+    {"io", 0xFF01, 0x00},   {"hram", 0xFF80, 0x3F}, {"ie", 0xFFFF, 0x00},
+};
+
+#define REGION_COUNT (sizeof(g_regions) / sizeof(*g_regions))
+
+// The LCD is turned off so that the VRAM and the OAM are always accessible
+static const struct region &setup(benchmark::State &state)
+{
+    const struct region &region = g_regions[state.range(0)];
+
+    reset_emulator();
+    write_memory(0xFF40, 0x00); // LCDC
+    state.SetLabel(region.name);
+
+    return region;
+}
+
+/*
+ * Read a byte through the bus.
+ * Arguments: memory region.
+ */
+static void ReadMemory(benchmark::State &state)
+{
+    const struct region &region = setup(state);
+    u16 offset = 0;
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(
+            read_memory(region.start + (offset++ & region.mask)));
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(ReadMemory)->DenseRange(0, REGION_COUNT - 1);
+
+/*
+ * Write a byte through the bus.
+ * Arguments: memory region.
+ */
+static void WriteMemory(benchmark::State &state)
+{
+    const struct region &region = setup(state);
+    u16 offset = 0;
+
+    for (auto _ : state) {
+        write_memory(region.start + (offset & region.mask), LSB(offset));
+        offset += 1;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(WriteMemory)->DenseRange(0, REGION_COUNT - 1);
+
+} // namespace cpu_benchmarks
@@ -0,0 +1,120 @@
+/**
+ * \file apu.h
+ * \brief Audio Processing Unit
+ *
+ * The APU generates the sound through 4 channels:
+ *
+ *  - Channel 1: square wave, with a frequency sweep
+ *  - Channel 2: square wave
+ *  - Channel 3: custom wave, read from the wave RAM
+ *  - Channel 4: noise, generated by a LFSR
+ *
+ * The channels are mixed into 2 stereo outputs (NR50, NR51).
+ *
+ * The APU is not stepped on each cycle. The elapsed time is only accumulated,
+ * and the channels are caught up when a sound register is accessed, or when
+ * the pending samples are flushed. Each change of a channel's output is then
+ * added as a band-limited step into a sample buffer at the output rate
+ * (see blip.h), so the cost only depends on the amount of transitions.
+ *
+ * \see apu_set_sample_callback
+ */
+
+#pragma once
+
+#include "utils/types.h"
+
+/// Frequency of the APU's clock (in Hz)
+#define APU_CLOCK_RATE 4194304
+/// Default output rate (in Hz)
+#define APU_SAMPLE_RATE 48000
+
+// Addresses of the different sound registers
+typedef enum apu_registers {
+    APU_NR10 = 0xFF10,
+    APU_NR11 = 0xFF11,
+    APU_NR12 = 0xFF12,
+    APU_NR13 = 0xFF13,
+    APU_NR14 = 0xFF14,
+    APU_NR21 = 0xFF16,
+    APU_NR22 = 0xFF17,
+    APU_NR23 = 0xFF18,
+    APU_NR24 = 0xFF19,
+    APU_NR30 = 0xFF1A,
+    APU_NR31 = 0xFF1B,
+    APU_NR32 = 0xFF1C,
+    APU_NR33 = 0xFF1D,
+    APU_NR34 = 0xFF1E,
+    APU_NR41 = 0xFF20,
+    APU_NR42 = 0xFF21,
+    APU_NR43 = 0xFF22,
+    APU_NR44 = 0xFF23,
+    APU_NR50 = 0xFF24,
+    APU_NR51 = 0xFF25,
+    APU_NR52 = 0xFF26,
+    APU_WAVE_START = 0xFF30,
+    APU_WAVE_END = 0xFF3F,
+} apu_registers;
+
+/// NR52 bits
+#define NR52_ENABLE 7
+
+/**
+ * \brief Receive the generated samples
+ *
+ * Samples are signed 16-bit, interleaved stereo (left first).
+ *
+ * \param samples_ptr The samples, only valid during the call
+ * \param count The number of stereo samples
+ */
+typedef void (*apu_sample_callback)(const i16 *samples_ptr, size_t count);
+
+/**
+ * \function reset_apu
+ * \brief Reset the APU to its state after the boot ROM
+ */
+void reset_apu();
+
+/**
+ * \function write_apu
+ * \brief Write into a sound register or the wave RAM
+ *
+ * \param address 16bit memory address between 0xFF10 - 0xFF3F
+ */
+void write_apu(u16 address, u8 data);
+
+/**
+ * \function read_apu
+ * \brief Read a sound register or the wave RAM
+ *
+ * Unused bits and registers read as 1.
+ *
+ * \param address 16bit memory address between 0xFF10 - 0xFF3F
+ */
+u8 read_apu(u16 address);
+
+/**
+ * \function apu_ticks
+ * \brief Advance the APU's clock by a given number of machine cycles
+ *
+ * The channels are not updated here, see the file's description.
+ */
+void apu_ticks(u8 ticks);
+
+/**
+ * \function apu_flush
+ * \brief Catch up with the current time, and output the pending samples
+ *
+ * Samples are also flushed automatically about once per video frame.
+ */
+void apu_flush();
+
+/**
+ * \function apu_set_sample_callback
+ * \brief Set the function called with the generated samples
+ *
+ * No samples are generated when the callback is NULL (default).
+ *
+ * \param sample_rate Output rate (in Hz), up to 192kHz
+ */
+void apu_set_sample_callback(apu_sample_callback callback, u32 sample_rate);
@@ -0,0 +1,81 @@
+/**
+ * \file blip.h
+ * \brief Band-limited synthesis buffer
+ *
+ * Signals are described by their transitions: each change of amplitude is
+ * added as a band-limited step, at the exact (sub-sample) time at which it
+ * happened, instead of sampling the signal at the output rate. This avoids the
+ * aliasing of naive sampling, for the cost of a few multiply-adds per
+ * transition.
+ *
+ * The buffer only stores the differences between consecutive samples, the
+ * output is their running sum, passed through a light high-pass filter to
+ * remove the DC offset.
+ *
+ * Times are expressed in clocks relative to the start of the current frame.
+ * The output is delayed by about BLIP_WIDTH / 2 samples.
+ */
+
+#pragma once
+
+#include "utils/types.h"
+
+/// Number of samples affected by a single step
+#define BLIP_WIDTH 16
+/// Maximum number of samples waiting inside a buffer
+#define BLIP_SIZE 4096
+
+struct blip {
+    u64 factor; ///< Samples per clock (32.32 fixed point)
+    u64 offset; ///< Position of the current frame (32.32 fixed point)
+    i32 integrator;
+    i32 buffer[BLIP_SIZE + BLIP_WIDTH];
+};
+
+/**
+ * \function blip_init
+ * \brief Initialize an empty buffer
+ *
+ * \param clock_rate Frequency of the clock used to express the times
+ * \param sample_rate Output rate
+ */
+void blip_init(struct blip *blip_ptr, u32 clock_rate, u32 sample_rate);
+
+/**
+ * \function blip_clear
+ * \brief Discard all the pending samples
+ */
+void blip_clear(struct blip *blip_ptr);
+
+/**
+ * \function blip_add_delta
+ * \brief Add a change of amplitude at a given time inside the current frame
+ */
+void blip_add_delta(struct blip *blip_ptr, u32 time, i32 delta);
+
+/**
+ * \function blip_end_frame
+ * \brief End the current frame, its samples become available
+ *
+ * \param time Length of the frame, the next one starts at this time
+ */
+void blip_end_frame(struct blip *blip_ptr, u32 time);
+
+/**
+ * \function blip_samples_avail
+ * \brief Number of samples that can be read
+ */
+u32 blip_samples_avail(const struct blip *blip_ptr);
+
+/**
+ * \function blip_read_samples
+ * \brief Read and remove samples from the buffer
+ *
+ * \param samples_ptr Output buffer
+ * \param count Maximum number of samples to read
+ * \param stereo Write samples into every other element of \c samples_ptr
+ *
+ * \return The number of samples read
+ */
+u32 blip_read_samples(struct blip *blip_ptr, i16 *samples_ptr, u32 count,
+                      bool stereo);
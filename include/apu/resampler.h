@@ -0,0 +1,121 @@
+/**
+ * \file resampler.h
+ * \brief Polyphase FIR sample rate converter
+ *
+ * Convert a stream of 16-bit stereo samples from one rate to another. Each
+ * output sample is the dot product of the surrounding input samples with one
+ * of the pre-computed phases of a windowed sinc filter. The dot products are
+ * vectorized (AVX2, SSE2 or NEON) when the host supports it.
+ *
+ * The conversion ratio can be adjusted by a small amount while running, for
+ * frontends that synchronize the emulation on the audio device (dynamic rate
+ * control).
+ */
+
+#pragma once
+
+#include "utils/types.h"
+
+/// Maximum number of filter taps (see resampler_quality)
+#define RESAMPLER_MAX_TAPS 32
+/// Number of sub-sample positions of the filter
+#define RESAMPLER_PHASES 256
+/// Input samples processed at once
+#define RESAMPLER_CHUNK 1024
+/// Maximum adjustment of the conversion ratio (+/- 0.5%)
+#define RESAMPLER_MAX_ADJUSTMENT 0.005
+
+/**
+ * \enum resampler_quality
+ * \brief Length of the filter, longer filters have a sharper cut-off
+ */
+typedef enum resampler_quality {
+    RESAMPLER_LOW = 0, ///< 8 taps
+    RESAMPLER_MEDIUM,  ///< 16 taps (default)
+    RESAMPLER_HIGH,    ///< 32 taps
+} resampler_quality;
+
+/**
+ * \enum resampler_kernel
+ * \brief Implementations of the dot product
+ */
+typedef enum resampler_kernel {
+    RESAMPLER_SCALAR = 0,
+    RESAMPLER_SSE2,
+    RESAMPLER_AVX2,
+    RESAMPLER_NEON,
+    RESAMPLER_KERNEL_COUNT,
+} resampler_kernel;
+
+struct resampler {
+    u8 taps;
+    u64 base_step; ///< Input samples per output sample (32.32 fixed point)
+    u64 step;      ///< Adjusted step
+    u64 position;  ///< Position of the next output inside the history
+
+    /// Input samples, one buffer per channel
+    float history[2][RESAMPLER_MAX_TAPS + RESAMPLER_CHUNK]
+        __attribute__((aligned(32)));
+    u16 count; ///< Number of samples inside the history
+
+    float coefficients[RESAMPLER_PHASES][RESAMPLER_MAX_TAPS]
+        __attribute__((aligned(32)));
+};
+
+/**
+ * \function resampler_init
+ * \brief Initialize an empty resampler
+ */
+void resampler_init(struct resampler *resampler_ptr, u32 input_rate,
+                    u32 output_rate, resampler_quality quality);
+
+/**
+ * \function resampler_set_adjustment
+ * \brief Adjust the conversion ratio
+ *
+ * \param adjustment Relative change of the output rate, clamped to
+ *                   +/- RESAMPLER_MAX_ADJUSTMENT. With a positive value, less
+ *                   samples are generated.
+ */
+void resampler_set_adjustment(struct resampler *resampler_ptr,
+                              double adjustment);
+
+/**
+ * \function resampler_max_output
+ * \brief Maximum number of samples generated for a given input
+ */
+size_t resampler_max_output(const struct resampler *resampler_ptr,
+                            size_t count);
+
+/**
+ * \function resampler_process
+ * \brief Convert a block of samples
+ *
+ * All the input samples are consumed, the last ones are kept until enough
+ * samples are available to compute the next outputs.
+ *
+ * \param input_ptr Interleaved stereo samples
+ * \param count Number of stereo input samples
+ * \param output_ptr Interleaved stereo samples, must be large enough to hold
+ *                   resampler_max_output(count) samples
+ *
+ * \return The number of stereo samples written into \c output_ptr
+ */
+size_t resampler_process(struct resampler *resampler_ptr, const i16 *input_ptr,
+                         size_t count, i16 *output_ptr);
+
+/**
+ * \function resampler_set_kernel
+ * \brief Force the implementation used by all the resamplers
+ *
+ * By default, the fastest one supported by the host is selected.
+ *
+ * \return false if the host does not support this implementation
+ */
+bool resampler_set_kernel(resampler_kernel kernel);
+
+/**
+ * \function resampler_kernel_name
+ * \brief Name of an implementation, for display purposes
+ */
+const char *resampler_kernel_name(resampler_kernel kernel);
@@ -0,0 +1,68 @@
+/**
+ * \file audio_out.h
+ * \brief Stream the generated sound into a file or a FIFO
+ *
+ * Samples are written as signed 16-bit little-endian stereo PCM, either inside
+ * a WAV file or without any header. They are generated at APU_SAMPLE_RATE, and
+ * converted when another rate is requested. For example, to play the output
+ * while emulating:
+ *
+ *     mkfifo /tmp/audio
+ *     ffplay -f s16le -ar 48000 -ac 2 /tmp/audio &
+ *     emu-gb --audio-out=/tmp/audio --audio-format=raw ROM
+ *
+ * The samples are written by a separate thread, in large batches. If the
+ * consumer is too slow, samples are dropped instead of slowing down the
+ * emulation.
+ */
+
+#pragma once
+
+#include "apu/resampler.h"
+#include "utils/types.h"
+
+/**
+ * \enum audio_format
+ * \brief The format of the output file
+ */
+typedef enum audio_format {
+    AUDIO_WAV = 0, ///< WAV header followed by the samples (default)
+    AUDIO_RAW,     ///< Samples only
+} audio_format;
+
+/**
+ * \struct audio_out_stats
+ * \brief Number of stereo samples written/dropped
+ */
+struct audio_out_stats {
+    u32 written_samples;
+    u32 dropped_samples; ///< The consumer was lagging behind
+};
+
+/**
+ * \function audio_out_open
+ * \brief Start streaming the generated samples into a file
+ *
+ * The sizes inside the WAV header are only known once the output is closed.
+ * They are left to their maximum value when the output cannot be rewound
+ * (FIFO), which most readers interpret as an unknown length.
+ *
+ * Opening a FIFO blocks until a consumer opens it for reading.
+ *
+ * \param rate The sample rate of the output, up to 4 * APU_SAMPLE_RATE
+ * \param quality The quality of the conversion, when rate != APU_SAMPLE_RATE
+ */
+void audio_out_open(const char *path, audio_format format, u32 rate,
+                    resampler_quality quality);
+
+/**
+ * \function audio_out_close
+ * \brief Write the pending samples and close the output
+ */
+void audio_out_close();
+
+/**
+ * \function audio_out_get_stats
+ * \brief Get the number of samples written/dropped so far
+ */
+struct audio_out_stats audio_out_get_stats();
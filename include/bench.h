@@ -0,0 +1,82 @@
+/**
+ * \file bench.h
+ * \brief Measure the throughput of the emulator (--bench)
+ *
+ * The emulation runs without any log or output until it has emulated a given
+ * number of machine cycles or frames, or until it stops by itself. The host
+ * time is measured from the end of the setup, and a report is printed on
+ * exit:
+ *
+ * - emulated clock rate (MHz) and speed relative to the real hardware
+ * - machine cycles and instructions per host second
+ * - host nanoseconds per instruction
+ * - peak resident memory
+ *
+ * The same figures can be written into a JSON file, to be archived and
+ * compared across builds.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "cpu/cpu.h"
+#include "cpu/timer.h"
+#include "ppu/ppu.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+/// Set while the benchmark is running
+extern bool g_bench_enabled;
+
+/// Number of instructions executed since the start of the benchmark
+extern u64 g_bench_instructions;
+
+/// Stop the emulation after this many machine cycles, 0 for no limit
+extern u64 g_bench_cycles;
+
+/// Stop the emulation after this many frames, 0 for no limit
+extern u32 g_bench_frames;
+
+/**
+ * \function bench_start
+ * \brief Start measuring, the limits are counted from the last reset
+ *
+ * \param rom Path of the cartridge, only used in the report
+ * \param cycles Number of machine cycles to emulate, 0 for no limit
+ * \param frames Number of frames to emulate, 0 for no limit
+ * \param json_path Where to write the results, NULL to only print them
+ */
+void bench_start(const char *rom, u64 cycles, u32 frames,
+                 const char *json_path);
+
+/**
+ * \function bench_stop
+ * \brief Print the results, and write them into the JSON file if any
+ */
+void bench_stop(void);
+
+/**
+ * \function bench_count_instruction
+ * \brief Called by the main loop after each executed instruction
+ */
+ALWAYS_INLINE void bench_count_instruction(void)
+{
+    if (g_bench_enabled)
+        g_bench_instructions += 1;
+}
+
+/**
+ * \function bench_step
+ * \brief Stop the emulation once a limit has been reached, called once per
+ * iteration of the main loop
+ */
+ALWAYS_INLINE void bench_step(void)
+{
+    if (!g_bench_enabled)
+        return;
+
+    if ((g_bench_cycles && timer_get_cycles() >= g_bench_cycles) ||
+        (g_bench_frames && g_ppu.frame >= g_bench_frames))
+        g_cpu.is_running = false;
+}
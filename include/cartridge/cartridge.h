@@ -167,6 +167,15 @@ bool load_cartridge(char *path);
  */
 void cartridge_info();
 
+/**
+ * \brief The ROM bank mapped at the given address
+ *
+ * Addresses outside of the switchable ROM area are reported in bank 0.
+ * Only the main ROM bank register is taken into account, the additional bits
+ * of the MBC1 are ignored.
+ */
+u16 cartridge_rom_bank(u16 address);
+
 /**
  * \copydoc read_memory
  */
@@ -170,9 +170,35 @@ struct instruction {
 #define OPCODE_P(_opcode) (((_opcode) >> 4) & 0x03)
 #define OPCODE_FLAG(_opcode) (OPCODE_Y(_opcode) & 0x03)
 
+/*
+ * The type of an instruction, as found in the opcode table.
+ */
+struct in_type {
+    in_name name;
+    operand_type type;
+    u8 cycle_count;
+    u8 cycle_count_false; // For conditional jumps
+};
+
+/// The instructions for each opcode, unused opcodes are set to ERR_OPERAND
+extern struct in_type g_opcodes[256];
+
 struct instruction fetch_instruction(u8 opcode);
 void display_instruction(struct instruction in);
 
+/*
+ * Mnemonic of an instruction (e.g. "LD")
+ */
+const char *instruction_name(in_name name);
+
+/*
+ * Write the instruction starting with the given bytes into a buffer, without
+ * accessing the memory or the registers (e.g. "LD A, 0x42").
+ *
+ * Returns the length of the instruction in bytes (between 1 and 3).
+ */
+u8 disassemble_instruction(const u8 bytes[3], char *buffer, size_t size);
+
 /*
  * The following part of the file is centered around the CB prefixed
  * instructions. CB prefixed instructions are instructions with a 2 bytes long
@@ -0,0 +1,99 @@
+/**
+ * \file profiler.h
+ * \brief Attribute the emulated cycles to the guest code
+ *
+ * The cycle counter is sampled once every `period` machine cycles: the cycles
+ * elapsed since the previous sample are attributed to the instruction that
+ * was executing when the period expired (bank:PC), to its mnemonic and to the
+ * current call stack.
+ *
+ * The call stack follows CALL, RST, RET, RETI and the interrupts. Frames are
+ * matched using the stack pointer, so that the routines leaving through a
+ * POP or by reloading SP do not corrupt it.
+ *
+ * The results are written by profiler_stop(): the call stacks in the
+ * collapsed format ("root;caller;callee cycles", as read by flamegraph.pl
+ * or speedscope), and a report of the most expensive functions, locations
+ * and instructions through the logs.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "cpu/timer.h"
+#include "utils/instrument.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+/// Default number of machine cycles between two samples
+#define PROFILER_DEFAULT_PERIOD 64
+
+/// Default number of lines of each section of the report
+#define PROFILER_DEFAULT_TOP 20
+
+/// Set while profiling
+extern bool g_profiler_enabled;
+
+/// Cycle of the next sample
+extern u64 g_profiler_next_sample;
+
+/**
+ * \function profiler_start
+ * \brief Start profiling
+ *
+ * \param path Where to write the collapsed stacks, NULL to only log the report
+ * \param period Number of machine cycles between two samples
+ * \param top Number of lines of each section of the report
+ */
+void profiler_start(const char *path, u64 period, unsigned top);
+
+/**
+ * \function profiler_stop
+ * \brief Stop profiling, write the collapsed stacks and log the report
+ */
+void profiler_stop(void);
+
+/**
+ * \function profiler_write_stacks
+ * \brief Write the collapsed stacks into a file
+ * \return Whether the file could be written
+ */
+bool profiler_write_stacks(const char *path);
+
+/// Called by the inline functions below
+void profiler_sample(u16 pc);
+void profiler_enter(u16 address);
+void profiler_leave(void);
+
+/**
+ * \function profiler_step
+ * \brief Take a sample if needed, once an instruction has been executed
+ * \param pc The address of the instruction
+ */
+ALWAYS_INLINE void profiler_step(u16 pc)
+{
+    if (EMUGB_INSTRUMENT && g_profiler_enabled &&
+        timer_get_cycles() >= g_profiler_next_sample)
+        profiler_sample(pc);
+}
+
+/**
+ * \function profiler_call
+ * \brief Enter a routine (CALL, RST or interrupt), after pushing PC
+ */
+ALWAYS_INLINE void profiler_call(u16 address)
+{
+    if (EMUGB_INSTRUMENT && g_profiler_enabled)
+        profiler_enter(address);
+}
+
+/**
+ * \function profiler_return
+ * \brief Leave a routine (RET or RETI), after popping PC
+ */
+ALWAYS_INLINE void profiler_return(void)
+{
+    if (EMUGB_INSTRUMENT && g_profiler_enabled)
+        profiler_leave();
+}
@@ -0,0 +1,129 @@
+/**
+ * \file recorder.h
+ * \brief Keep the last executed instructions and memory writes, to be dumped
+ *        when the emulator crashes
+ *
+ * The recorder is enabled in instrumented builds (see utils/instrument.h):
+ * recording an instruction only copies the registers into a fixed-size ring
+ * buffer, without any allocation or formatting. The content of the buffers
+ * is written into a report once recorder_start() has been called, on fatal
+ * errors (FATAL_ERROR, ASSERT_MSG, ...) and when receiving a fatal signal
+ * (SIGSEGV, SIGABRT, ...). No report is written if no instruction has been
+ * recorded yet.
+ */
+
+#pragma once
+
+#include "cpu/cpu.h"
+#include "cpu/timer.h"
+#include "utils/instrument.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+/// Number of instructions kept, must be a power of 2
+#define RECORDER_INSTRUCTIONS 1024
+
+/// Number of memory writes kept, must be a power of 2
+#define RECORDER_WRITES 256
+
+struct recorder_instruction {
+    u64 cycle;
+    struct cpu_registers registers; ///< Before executing the instruction
+    u8 bytes[3];                    ///< Opcode and operands, as executed
+    u8 length;                      ///< Number of bytes fetched so far
+};
+
+struct recorder_write {
+    u64 cycle;
+    u16 address;
+    u8 value;
+};
+
+/**
+ * \struct recorder
+ * \brief Ring buffers of the last instructions and memory writes
+ */
+extern struct recorder {
+    struct recorder_instruction instructions[RECORDER_INSTRUCTIONS];
+    struct recorder_write writes[RECORDER_WRITES];
+    u64 instruction_count; ///< Total number of recorded instructions
+    u64 write_count;       ///< Total number of recorded writes
+} g_recorder;
+
+/**
+ * \function recorder_start
+ * \brief Write a report on fatal errors and signals
+ *
+ * \param path The destination of the report, NULL to use
+ *             "emu-gb-crash-<pid>.log" inside the working directory
+ */
+void recorder_start(const char *path);
+
+/**
+ * \function recorder_dump
+ * \brief Write the content of the recorder into the report
+ *
+ * Only async-signal-safe functions are used to write the report, but the
+ * instructions are disassembled using snprintf. The report only contains what
+ * was recorded, the emulated memory is never read.
+ *
+ * \param reason Written at the start of the report
+ */
+void recorder_dump(const char *reason);
+
+/**
+ * \function recorder_instruction
+ * \brief Record the state of the CPU, once an opcode has been fetched
+ */
+ALWAYS_INLINE void recorder_instruction(u8 opcode)
+{
+    if (!EMUGB_INSTRUMENT)
+        return;
+
+    const u64 index = g_recorder.instruction_count++;
+    struct recorder_instruction *entry_ptr =
+        &g_recorder.instructions[index & (RECORDER_INSTRUCTIONS - 1)];
+
+    entry_ptr->cycle = timer_get_cycles();
+    entry_ptr->registers = g_cpu.registers;
+    entry_ptr->registers.pc -= 1; // The opcode has already been fetched
+    entry_ptr->bytes[0] = opcode;
+    entry_ptr->bytes[1] = 0;
+    entry_ptr->bytes[2] = 0;
+    entry_ptr->length = 1;
+}
+
+/**
+ * \function recorder_operand
+ * \brief Record an operand of the current instruction, once it was fetched
+ */
+ALWAYS_INLINE void recorder_operand(u8 value)
+{
+    if (!EMUGB_INSTRUMENT)
+        return;
+
+    struct recorder_instruction *entry_ptr =
+        &g_recorder.instructions[(g_recorder.instruction_count - 1) &
+                                 (RECORDER_INSTRUCTIONS - 1)];
+
+    if (entry_ptr->length < sizeof(entry_ptr->bytes))
+        entry_ptr->bytes[entry_ptr->length++] = value;
+}
+
+/**
+ * \function recorder_write
+ * \brief Record a write on the memory bus
+ */
+ALWAYS_INLINE void recorder_write(u16 address, u8 value)
+{
+    if (!EMUGB_INSTRUMENT)
+        return;
+
+    const u64 index = g_recorder.write_count++;
+    struct recorder_write *entry_ptr =
+        &g_recorder.writes[index & (RECORDER_WRITES - 1)];
+
+    entry_ptr->cycle = timer_get_cycles();
+    entry_ptr->address = address;
+    entry_ptr->value = value;
+}
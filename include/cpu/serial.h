@@ -0,0 +1,126 @@
+/**
+ * \file serial.h
+ * \brief Serial port
+ *
+ * The serial port exchanges one byte at a time with another device through
+ * the link cable: while the 8 bits of SB are shifted out, the 8 bits sent by
+ * the other side are shifted in. One of both sides (the master) drives the
+ * clock, the other one (external clock) only waits for the transfer to happen.
+ *
+ * A transfer driven by the internal clock lasts SERIAL_TRANSFER_CYCLES. Once
+ * it is done, SC's transfer bit is cleared and the SERIAL interrupt is
+ * requested. When nothing is plugged into the port, 0xFF is received.
+ *
+ * The other device is reached at transfer boundaries and polled at least once
+ * every SERIAL_BIT_CYCLES, through the callbacks of a serial_link.
+ *
+ * \see serial_set_link
+ */
+
+#pragma once
+
+#include "utils/types.h"
+
+/// Addresses of the serial registers
+typedef enum serial_registers {
+    SERIAL_SB = 0xFF01, ///< Transferred byte
+    SERIAL_SC = 0xFF02, ///< Transfer control
+} serial_registers;
+
+/// SC bits
+#define SC_CLOCK 0    ///< 1: internal clock (master)
+#define SC_TRANSFER 7 ///< 1: transfer requested or in progress
+
+/// Duration of a bit transfer at 8192Hz, in machine cycles
+#define SERIAL_BIT_CYCLES 128
+#define SERIAL_TRANSFER_CYCLES (8 * SERIAL_BIT_CYCLES)
+
+/**
+ * \struct serial_link
+ * \brief Device plugged into the serial port
+ */
+struct serial_link {
+    /**
+     * Announce a transfer driven by our internal clock, when it starts.
+     */
+    void (*start)(u8 data);
+
+    /**
+     * Exchange a byte with the other device, at the end of a transfer driven
+     * by our internal clock.
+     *
+     * \return The byte sent by the other device
+     */
+    u8 (*exchange)(u8 data);
+
+    /**
+     * Let the other device perform the transfers it drives (using
+     * serial_receive).
+     *
+     * \return The number of cycles until the next call, at most
+     * SERIAL_BIT_CYCLES
+     */
+    u16 (*poll)(void);
+};
+
+/**
+ * \brief Called when a transfer is started using the internal clock
+ * \param data The byte being sent
+ */
+typedef void (*serial_transfer_callback)(u8 data);
+
+/**
+ * \function reset_serial
+ * \brief Reset the serial port to its state after the boot ROM
+ */
+void reset_serial();
+
+/**
+ * \function serial_set_link
+ * \brief Plug a device into the serial port, NULL to unplug it
+ */
+void serial_set_link(const struct serial_link *link_ptr);
+
+/**
+ * \function serial_set_transfer_callback
+ * \brief Watch the bytes sent by the CPU, NULL to stop watching them
+ *
+ * The callback is only called when SC is written, it has no cost on the rest
+ * of the emulation.
+ */
+void serial_set_transfer_callback(serial_transfer_callback callback);
+
+/**
+ * \function serial_receive
+ * \brief Perform a transfer driven by the other device's clock
+ *
+ * The transfer only happens if one was requested using the external clock,
+ * 0xFF is sent back otherwise.
+ *
+ * \param data The byte sent by the other device
+ * \return The byte sent back
+ */
+u8 serial_receive(u8 data);
+
+/**
+ * \function serial_ticks
+ * \brief Advance the serial port by a certain amount of machine cycles
+ */
+void serial_ticks(u8 ticks);
+
+/**
+ * \function write_serial
+ * \brief write an 8bit value into the serial registers.
+ *
+ * \param address 16bit memory address (0xFF01 or 0xFF02)
+ * \param val 8bit value
+ */
+void write_serial(u16 address, u8 data);
+
+/**
+ * \function read_serial
+ * \brief read a 8bit value from the serial registers.
+ * \param address 16bit memory address (0xFF01 or 0xFF02)
+ * \see read_memory
+ */
+u8 read_serial(u16 address);
@@ -0,0 +1,45 @@
+/**
+ * \file symbols.h
+ * \brief Name the guest code using RGBDS symbol files
+ *
+ * rgblink writes one "BANK:ADDRESS Name" line per label into the symbol file
+ * (-n option). Addresses are named after the closest preceding label of the
+ * same bank and memory region ("Main.loop+0x3").
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "utils/types.h"
+
+/**
+ * \function symbols_load
+ * \brief Load the labels of an RGBDS symbol file, replacing the previous ones
+ * \return Whether the file could be read
+ */
+bool symbols_load(const char *path);
+
+/**
+ * \function symbols_clear
+ * \brief Forget all the loaded labels
+ */
+void symbols_clear(void);
+
+/**
+ * \function symbols_find
+ * \brief Find the label of an address
+ *
+ * \param bank The ROM bank, only used for addresses between 0x4000 and 0x7FFF
+ * \param offset_ptr Set to the distance between the label and the address
+ * \return NULL if the address is not preceded by a label
+ */
+const char *symbols_find(u16 bank, u16 address, u16 *offset_ptr);
+
+/**
+ * \function symbols_format
+ * \brief Write the name of an address ("Label", "Label+0x12" or "01:4567")
+ * \return The length of the name, as snprintf
+ */
+int symbols_format(u16 bank, u16 address, char *buffer, size_t size);
@@ -8,6 +8,12 @@
 // 0xABCC.
 #define TIMER_DIV_DEFAULT 0xABCC
 
+/// Clock rate of the CPU, in Hz (4 clocks per machine cycle)
+#define CPU_CLOCK_RATE 4194304
+
+/// Machine cycles per emulated second
+#define CPU_CYCLES_PER_SECOND (CPU_CLOCK_RATE / 4)
+
 // Addresses of the different timer registers
 typedef enum timer_registers {
     TIMER_UNKNOWN = 0x0000,
@@ -17,6 +23,19 @@ typedef enum timer_registers {
     TIMER_TAC = 0xFF07,
 } timer_registers;
 
+/**
+ * \struct timer
+ * \brief Internal state of the timer, only exposed to read the cycle counter
+ *        from the hot paths (see timer_get_cycles)
+ */
+extern struct timer {
+    u16 div;
+    u8 tima;
+    u8 tma;
+    u8 tac;
+    u64 cycles; ///< Machine cycles since the last reset
+} g_timer;
+
 /**
  * \function reset_timer
  * \brief Reset the internal timer to its default state
@@ -40,6 +59,15 @@ void write_timer(u16 address, u8 data);
  */
 u8 read_timer(u16 address);
 
+/**
+ * \function timer_get_cycles
+ * \brief Number of machine cycles elapsed since the timer was reset
+ */
+ALWAYS_INLINE u64 timer_get_cycles()
+{
+    return g_timer.cycles;
+}
+
 /**
  * \function timer_ticks
  * \brief Add a certain amount of cycles to the CPU internal timer
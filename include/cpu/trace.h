@@ -0,0 +1,94 @@
+/**
+ * \file trace.h
+ * \brief Record the state of the CPU before each instruction
+ *
+ * Unlike the traces displayed through the logs (--trace), these traces are
+ * meant to be compared against other emulators, or processed by tools. They
+ * are formatted without any call to the C library, and written through a
+ * large buffer.
+ *
+ * Doctor traces follow the format used by gameboy-doctor, one line per
+ * instruction:
+ *
+ *     A:01 F:B0 B:00 C:13 D:00 E:D8 H:01 L:4D SP:FFFE PC:0100 PCMEM:00,C3,13,02
+ *
+ * Binary traces are made of a header followed by fixed-size records, they are
+ * meant to stay enabled during long runs and to be decoded offline by
+ * emu-gb-trace.
+ *
+ * \see https://github.com/robert/gameboy-doctor
+ */
+
+#pragma once
+
+#include "utils/types.h"
+
+/**
+ * \enum trace_format
+ * \brief The format of the traces
+ */
+typedef enum trace_format {
+    TRACE_TEXT = 0, ///< Human readable, through the logs (default)
+    TRACE_DOCTOR,   ///< gameboy-doctor logs
+    TRACE_BINARY,   ///< Fixed-size records, see trace_record
+} trace_format;
+
+/// Identifies binary traces, followed by the version of the format
+#define TRACE_MAGIC "EMUGBTRC"
+#define TRACE_VERSION 1
+
+/**
+ * \struct trace_header
+ * \brief Written once at the start of binary traces
+ */
+struct trace_header {
+    char magic[8]; ///< TRACE_MAGIC, without the terminating null byte
+    u32 version;
+    u32 record_size; ///< sizeof(struct trace_record)
+};
+
+/**
+ * \struct trace_record
+ * \brief The state of the CPU before an instruction, in host byte order
+ */
+struct trace_record {
+    u64 cycle; ///< Machine cycles elapsed before the instruction
+    u16 pc;
+    u16 bank; ///< ROM bank mapped at PC
+    u16 af;
+    u16 bc;
+    u16 de;
+    u16 hl;
+    u16 sp;
+    u8 bytes[3]; ///< Memory at PC (the instruction may be shorter)
+    u8 ime;
+    u8 reserved[4];
+};
+
+/// Set while a trace is being recorded (doctor or binary)
+extern bool g_trace_enabled;
+
+/// Set by --trace, display each instruction through the logs
+extern bool g_trace_text;
+
+/**
+ * \function trace_open
+ * \brief Start recording traces into a file
+ *
+ * \param path The destination file, NULL for the standard output (the logs
+ *             are then written to the standard error)
+ * \param format Any format but TRACE_TEXT
+ */
+void trace_open(const char *path, trace_format format);
+
+/**
+ * \function trace_close
+ * \brief Write the pending traces and close the output
+ */
+void trace_close();
+
+/**
+ * \function trace_instruction
+ * \brief Record the state of the CPU, before executing the next instruction
+ */
+void trace_instruction();
@@ -0,0 +1,68 @@
+/**
+ * \file link.h
+ * \brief Link cable between two emulators
+ *
+ * Both ends of the cable are plugged into the same file, which is mapped into
+ * the memory of both processes. Each side writes the bytes it sends into its
+ * own lock-free queue inside this mapping. For example, to link two games:
+ *
+ *     emu-gb --link=/tmp/cable ROM &
+ *     emu-gb --link=/tmp/cable ROM
+ *
+ * Both emulators run in lockstep on a shared clock, the machine cycles of the
+ * first side plugged in, which the second side joins when it is plugged: a
+ * side waits for the other one when it gets more than half a transfer ahead. The side driving a transfer
+ * announces it when it starts, with the cycle of the cable's clock at which
+ * it started. The other side answers once its own clock reaches the end of
+ * the transfer, so that both sides exchange their bytes at the same cycle,
+ * whatever the speed of the host.
+ *
+ * If the other side is gone, or its clock did not move for a second, the
+ * transfer receives 0xFF and the lockstep stops until it moves again.
+ *
+ * Every machine lives inside the global state of its process, hence the two
+ * ends of the cable cannot belong to the same process.
+ */
+
+#pragma once
+
+#include "utils/types.h"
+
+/**
+ * \struct link_stats
+ * \brief Number of bytes exchanged through the cable
+ */
+struct link_stats {
+    u32 sent_bytes;     ///< Transfers driven by this side
+    u32 received_bytes; ///< Transfers driven by the other side
+};
+
+/**
+ * \function link_open
+ * \brief Plug the serial port into one end of the cable
+ *
+ * The file is created if it does not exist. The first process to open it
+ * takes one end of the cable, the second one the other end. An end whose
+ * process died without unplugging it (SIGKILL, crash) is free again.
+ */
+void link_open(const char *path);
+
+/**
+ * \function link_close
+ * \brief Unplug the serial port from the cable
+ *
+ * The other side receives 0xFF from then on, as if nothing was plugged.
+ */
+void link_close();
+
+/**
+ * \function link_connected
+ * \brief Check whether a process is plugged into the other end of the cable
+ */
+bool link_connected();
+
+/**
+ * \function link_get_stats
+ * \brief Get the number of bytes exchanged so far
+ */
+struct link_stats link_get_stats();
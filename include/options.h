@@ -2,7 +2,13 @@
 
 #include <stdbool.h>
 
+#include "apu/resampler.h"
+#include "audio_out.h"
+#include "cpu/trace.h"
+#include "ppu/ppu.h"
 #include "utils/log.h"
+#include "utils/types.h"
+#include "video_out.h"
 
 /// The number of expected arguments
 #define GBEMU_NB_ARGS 1
@@ -10,9 +16,34 @@
 struct options {
     char *args[GBEMU_NB_ARGS];
     bool trace;
+    trace_format trace_format;
+    const char *trace_out; ///< NULL for the standard output
     log_level log_level;
     bool exit_infinite_loop;
     bool blargg;
+    bool stop_on_result;
+    const char *link; ///< NULL if disabled
+    const char *crash_report; ///< NULL for the default path
+    ppu_engine_type ppu_engine;
+    unsigned frameskip;
+    const char *video_out; ///< NULL if disabled
+    video_format video_format;
+    const char *audio_out; ///< NULL if disabled
+    audio_format audio_format;
+    unsigned audio_rate;
+    resampler_quality audio_quality;
+    const char *profile; ///< NULL if disabled
+    u64 profile_period;
+    unsigned profile_top;
+    const char *symbols; ///< NULL for the default path
+    bool host_timers;
+    const char *host_timers_csv; ///< NULL if disabled
+    const char *perf_counters; ///< NULL if disabled
+    u64 perf_period; ///< 0 to sample once per frame
+    bool bench;
+    u64 bench_cycles; ///< 0 for no limit
+    u32 bench_frames; ///< 0 for no limit
+    const char *bench_json; ///< NULL if disabled
 };
 
 /**
@@ -0,0 +1,67 @@
+/**
+ * \file perf_counters.h
+ * \brief Read the host's hardware counters while emulating
+ *
+ * A group of Linux perf_event counters (instructions, cycles, L1 data cache
+ * read misses and branch misses) measures the emulation thread, in user
+ * space only. The main loop samples the group at the end of each emulated
+ * frame, or every N emulated machine cycles, and writes one CSV line per
+ * sample:
+ *
+ *     sample,frame,guest_cycles,instructions,cycles,l1d_misses,branch_misses
+ *
+ * Values are the differences since the previous sample, scaled if the kernel
+ * had to multiplex the counters. The counters which cannot be opened on the
+ * host (virtual machines, perf_event_paranoid) are left empty.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "cpu/timer.h"
+#include "ppu/ppu.h"
+#include "utils/instrument.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+/// Set while the counters are running
+extern bool g_perf_counters_enabled;
+
+/// Machine cycles between two samples, 0 to sample once per frame
+extern u64 g_perf_counters_period;
+
+/// Cycle of the next sample (period), or frame of the last one (per frame)
+extern u64 g_perf_counters_next;
+
+/**
+ * \function perf_counters_open
+ * \brief Start counting and write the samples into a CSV file
+ *
+ * \param period Number of machine cycles between two samples, 0 for frames
+ * \return Whether at least one counter could be opened
+ */
+bool perf_counters_open(const char *path, u64 period);
+
+/**
+ * \function perf_counters_close
+ * \brief Write the last sample, close the CSV and log the totals
+ */
+void perf_counters_close(void);
+
+/// Called by perf_counters_step
+void perf_counters_sample(void);
+
+/**
+ * \function perf_counters_step
+ * \brief Take a sample if needed, called once per iteration of the main loop
+ */
+ALWAYS_INLINE void perf_counters_step(void)
+{
+    if (!EMUGB_INSTRUMENT || !g_perf_counters_enabled)
+        return;
+
+    if (g_perf_counters_period ? timer_get_cycles() >= g_perf_counters_next
+                               : g_ppu.frame != g_perf_counters_next)
+        perf_counters_sample();
+}
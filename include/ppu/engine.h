@@ -0,0 +1,172 @@
+/**
+ * \file engine.h
+ * \brief Rendering engines of the PPU
+ *
+ * This file contains declarations shared between the different rendering
+ * engines. It should not be included outside of the PPU.
+ *
+ * \see ppu.h
+ */
+
+#pragma once
+
+#include "cpu/cpu.h"
+#include "ppu/ppu.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+/// Minimum duration of the pixel transfer (mode 3), in dots
+#define TRANSFER_DOTS 172
+/// Duration of the OAM scan (mode 2), in dots
+#define OAM_SCAN_DOTS 80
+
+/**
+ * \struct ppu_engine
+ * \brief Operations implemented by a rendering engine
+ */
+struct ppu_engine {
+    /// Called when the PPU enters mode 3 on a visible line
+    void (*start_transfer)(void);
+
+    /**
+     * Run the pixel transfer for at most \c dots dots.
+     * Set \c done_ptr once all the pixels of the line have been output.
+     *
+     * \return The number of dots actually consumed
+     */
+    u16 (*transfer)(u16 dots, bool *done_ptr);
+
+    /**
+     * Duration of the current line's pixel transfer, in dots.
+     * Used instead of \c transfer when the line is not composed.
+     */
+    u16 (*transfer_dots)(void);
+
+    /// Optional: wait until all the pixels of the started lines are output
+    void (*sync)(void);
+
+    /// Lines are drawn asynchronously, the engine calls \c ppu_frame_done
+    /// itself once the last line of a frame is drawn.
+    bool async;
+};
+
+/// Draw whole scanlines at once
+extern const struct ppu_engine g_line_engine;
+/// Dot-accurate pixel FIFO
+extern const struct ppu_engine g_fifo_engine;
+/// Draw whole scanlines at once, on a separate thread
+extern const struct ppu_engine g_thread_engine;
+
+/// Report a completely drawn frame
+void ppu_frame_done();
+
+/**
+ * \brief Select the sprites of the current line (mode 2)
+ *
+ * Fill \c g_ppu.sprites with the (at most 10) sprites that intersect the
+ * current line, ordered by decreasing drawing priority.
+ */
+void oam_scan();
+
+/// Force the sprites of all the lines to be selected again on the next scan
+void oam_invalidate();
+
+/**
+ * \struct ppu_line
+ * \brief Everything needed to draw a scanline with the scanline renderer
+ *
+ * The state is captured when entering mode 3, so that the line can be drawn
+ * later on (or on another thread).
+ */
+struct ppu_line {
+    u8 ly;
+    u8 lcdc;
+    u8 scx;
+    u8 scy;
+    u8 wx;
+    u8 bgp;
+    u8 obp0;
+    u8 obp1;
+    u8 window_line;
+    bool window; ///< The window is visible on this line
+    u8 sprite_count;
+    struct ppu_sprite sprites[LINE_SPRITE_COUNT];
+};
+
+/**
+ * \brief Capture the state of the current line
+ *
+ * Advances the internal line counter of the window if it is visible.
+ */
+void ppu_line_snapshot(struct ppu_line *line_ptr);
+
+/**
+ * \brief Draw a scanline
+ *
+ * \param line_ptr The state of the PPU at the start of the line
+ * \param vram_ptr The VRAM pages, as they were at the start of the line
+ * \param pixels_ptr The line's LCD_WIDTH pixels
+ */
+void render_line(const struct ppu_line *line_ptr, const u8 *const *vram_ptr,
+                 u8 *pixels_ptr);
+
+/// Read a byte from the VRAM, bypassing the CPU access restrictions
+ALWAYS_INLINE u8 read_vram(u16 address)
+{
+    return g_cpu.memory[address];
+}
+
+/// Read a byte from a paged copy of the VRAM
+ALWAYS_INLINE u8 read_vram_page(const u8 *const *vram_ptr, u16 address)
+{
+    address -= VRAM_START;
+    return vram_ptr[address / VRAM_PAGE_SIZE][address % VRAM_PAGE_SIZE];
+}
+
+/// Height of the sprites (8 or 16 pixels), depending on LCDC
+ALWAYS_INLINE u8 sprite_height(u8 lcdc)
+{
+    return BIT(lcdc, LCDC_OBJ_SIZE) ? 16 : 8;
+}
+
+/// Address of a background/window tile's row, depending on the addressing mode
+ALWAYS_INLINE u16 bg_tile_address(u8 lcdc, u8 tile, u8 row)
+{
+    if (BIT(lcdc, LCDC_TILE_DATA))
+        return VRAM_START + tile * 16 + row * 2;
+    return 0x9000 + (i8)tile * 16 + row * 2;
+}
+
+/// Address of the row of a sprite that intersects the given line
+ALWAYS_INLINE u16 sprite_tile_address(u8 lcdc, u8 ly,
+                                      const struct ppu_sprite *sprite_ptr)
+{
+    const u8 height = sprite_height(lcdc);
+    u8 row = ly + 16 - sprite_ptr->y;
+    u8 tile = sprite_ptr->tile;
+
+    if (BIT(sprite_ptr->flags, OBJ_Y_FLIP))
+        row = height - 1 - row;
+    if (height == 16)
+        tile &= 0xFE;
+
+    return VRAM_START + tile * 16 + row * 2;
+}
+
+/// Color index (0-3) of the nth pixel (from the left) of a tile's row
+ALWAYS_INLINE u8 tile_pixel(u8 low, u8 high, u8 n)
+{
+    return (BIT(high, 7 - n) << 1) | BIT(low, 7 - n);
+}
+
+/// Apply a palette (BGP, OBP0, OBP1) to a color index
+ALWAYS_INLINE u8 palette_shade(u8 palette, u8 color)
+{
+    return (palette >> (color * 2)) & 0x3;
+}
+
+/// Map address of the tile at the given position in the BG or window map
+ALWAYS_INLINE u16 tile_map_address(bool high_map, u8 x, u8 y)
+{
+    return (high_map ? 0x9C00 : 0x9800) + (y / 8) * 32 + x;
+}
@@ -0,0 +1,321 @@
+/**
+ * \file ppu.h
+ * \brief Picture Processing Unit
+ *
+ * The PPU draws the picture on the LCD screen, one scanline after the other.
+ * Each scanline lasts 456 dots (4 dots per machine cycle), during which the
+ * PPU goes through the following modes:
+ *
+ *  - Mode 2: OAM scan, select the sprites that are visible on the line
+ *  - Mode 3: Pixel transfer, output the line's pixels to the LCD
+ *  - Mode 0: Horizontal blank, wait until the end of the line
+ *
+ * Once the 144 visible lines are drawn, the PPU enters the vertical blank
+ * period (Mode 1) for 10 more lines before starting a new frame.
+ *
+ * Three rendering engines are available to perform the pixel transfer:
+ *
+ *  - fast: the whole line is drawn at once when entering mode 3
+ *  - accurate: a dot-accurate model of the pixel FIFO and its fetcher
+ *  - threaded: same as fast, but the line is drawn later on by a render
+ *    thread, from a snapshot of the registers and the VRAM
+ *
+ * All engines share the same VRAM/OAM and register state, the engine can
+ * thus be changed at any frame boundary.
+ *
+ * The composition of the pixels can also be skipped on frames that are not
+ * consumed. The PPU still goes through all of its modes on skipped frames, so
+ * that the timing seen by the CPU (LY, STAT, interrupts, memory locking) is
+ * left untouched.
+ *
+ * \see ppu_set_engine ppu_set_frameskip
+ */
+
+#pragma once
+
+#include "utils/macro.h"
+#include "utils/types.h"
+
+/// Size of the LCD screen (in pixels)
+#define LCD_WIDTH 160
+#define LCD_HEIGHT 144
+
+/// Video memory areas
+#define VRAM_START 0x8000
+#define VRAM_END 0x9FFF
+#define OAM_START 0xFE00
+#define OAM_END 0xFE9F
+
+/// The VRAM is split into pages to track modifications
+#define VRAM_PAGE_SIZE 0x400
+#define VRAM_PAGES ((VRAM_END - VRAM_START + 1) / VRAM_PAGE_SIZE)
+
+/// Number of sprites inside the OAM
+#define OAM_SPRITE_COUNT 40
+/// Maximum number of sprites that can be drawn on a single line
+#define LINE_SPRITE_COUNT 10
+
+/// Number of dots (PPU clocks) in a machine cycle
+#define DOTS_PER_CYCLE 4
+#define DOTS_PER_LINE 456
+#define LINES_PER_FRAME 154
+
+// Addresses of the different LCD registers
+typedef enum ppu_registers {
+    PPU_UNKNOWN = 0x0000,
+    PPU_LCDC = 0xFF40,
+    PPU_STAT = 0xFF41,
+    PPU_SCY = 0xFF42,
+    PPU_SCX = 0xFF43,
+    PPU_LY = 0xFF44,
+    PPU_LYC = 0xFF45,
+    PPU_DMA = 0xFF46,
+    PPU_BGP = 0xFF47,
+    PPU_OBP0 = 0xFF48,
+    PPU_OBP1 = 0xFF49,
+    PPU_WY = 0xFF4A,
+    PPU_WX = 0xFF4B,
+} ppu_registers;
+
+/// LCDC bits
+#define LCDC_BG_ENABLE 0
+#define LCDC_OBJ_ENABLE 1
+#define LCDC_OBJ_SIZE 2
+#define LCDC_BG_MAP 3
+#define LCDC_TILE_DATA 4
+#define LCDC_WINDOW_ENABLE 5
+#define LCDC_WINDOW_MAP 6
+#define LCDC_ENABLE 7
+
+/// STAT bits
+#define STAT_LYC_EQUAL 2
+#define STAT_HBLANK_INT 3
+#define STAT_VBLANK_INT 4
+#define STAT_OAM_INT 5
+#define STAT_LYC_INT 6
+
+/// Sprite attribute flags (4th byte of an OAM entry)
+#define OBJ_PALETTE 4
+#define OBJ_X_FLIP 5
+#define OBJ_Y_FLIP 6
+#define OBJ_PRIORITY 7
+
+/**
+ * \enum ppu_mode
+ * \brief The different PPU modes, as reported in the STAT register
+ */
+typedef enum ppu_mode {
+    PPU_HBLANK = 0,
+    PPU_VBLANK = 1,
+    PPU_OAM_SCAN = 2,
+    PPU_TRANSFER = 3,
+} ppu_mode;
+
+/**
+ * \enum ppu_engine_type
+ * \brief The available rendering engines
+ */
+typedef enum ppu_engine_type {
+    PPU_ENGINE_FAST = 0, ///< Whole scanline rendered at once (default)
+    PPU_ENGINE_ACCURATE, ///< Dot-accurate pixel FIFO
+    PPU_ENGINE_THREADED, ///< Scanlines drawn by a separate thread
+} ppu_engine_type;
+
+/**
+ * \struct ppu_sprite
+ * \brief An entry of the Object Attribute Memory (0xFE00 - 0xFE9F)
+ */
+struct ppu_sprite {
+    u8 y;     ///< Vertical position + 16
+    u8 x;     ///< Horizontal position + 8
+    u8 tile;  ///< Tile index (always uses the 0x8000 addressing mode)
+    u8 flags; ///< Attributes, \see OBJ_PALETTE
+};
+
+/**
+ * \struct ppu_stats
+ * \brief Amount of rendering work done/skipped since the last reset
+ */
+struct ppu_stats {
+    u32 rendered_frames;
+    u32 skipped_frames;
+    u32 skipped_lines; ///< Visible lines whose pixels were not composed
+    u32 dropped_lines; ///< Lines not drawn because the render thread lagged
+};
+
+struct gb_ppu {
+    // LCD registers
+    u8 lcdc;
+    u8 stat;
+    u8 scy;
+    u8 scx;
+    u8 ly;
+    u8 lyc;
+    u8 dma;
+    u8 bgp;
+    u8 obp0;
+    u8 obp1;
+    u8 wy;
+    u8 wx;
+
+    ppu_mode mode;
+    u16 dot; ///< Current dot inside the scanline (0 - 455)
+
+    /// Internal line counter of the window, only incremented on the lines
+    /// where the window was actually drawn.
+    u8 window_line;
+    bool window_triggered; ///< WY matched LY during the current frame
+
+    /// Current state of the STAT interrupt line. The LCD interrupt is only
+    /// requested on a rising edge.
+    bool stat_line;
+
+    /// Sprites selected during the current line's OAM scan, ordered by
+    /// decreasing priority (X coordinate, then OAM order)
+    struct ppu_sprite sprites[LINE_SPRITE_COUNT];
+    u8 sprite_count;
+
+    /// Number of frames completed since the last reset
+    u32 frame;
+
+    /// The LCD screen. Each pixel is a shade between 0 (white) and 3 (black).
+    /// \warning Call \c ppu_sync before reading it when using the threaded
+    /// engine.
+    u8 framebuffer[LCD_HEIGHT][LCD_WIDTH];
+
+    /// Incremented each time the CPU modifies the OAM
+    u32 oam_generation;
+    u8 vram_dirty; ///< Mask of the VRAM pages modified since the last line
+
+    ppu_engine_type engine;
+    ppu_engine_type next_engine; ///< Engine to use starting next frame
+
+    /// Only compose one frame every \c frameskip frames (0 and 1: all frames)
+    u16 frameskip;
+    bool frame_requested; ///< Compose the next frame regardless of frameskip
+    bool render;          ///< Pixels of the current frame are being composed
+
+    struct ppu_stats stats;
+};
+
+// The actual PPU of the Game Boy
+extern struct gb_ppu g_ppu;
+
+/**
+ * \brief Function called each time a frame has been completely drawn
+ *
+ * \param framebuffer_ptr The LCD_HEIGHT x LCD_WIDTH shades of the frame
+ *
+ * \warning When using the threaded engine, the function is called from the
+ * render thread.
+ */
+typedef void (*ppu_frame_callback)(const u8 *framebuffer_ptr);
+
+/**
+ * \function reset_ppu
+ * \brief Reset the PPU to its state after the boot ROM
+ */
+void reset_ppu();
+
+/**
+ * \function ppu_ticks
+ * \brief Advance the PPU by a certain amount of machine cycles
+ */
+void ppu_ticks(u8 ticks);
+
+/**
+ * \function ppu_set_engine
+ * \brief Select the rendering engine
+ *
+ * The change takes effect at the start of the next frame (or on reset).
+ */
+void ppu_set_engine(ppu_engine_type engine);
+
+/**
+ * \function ppu_set_frameskip
+ * \brief Only compose the pixels of one frame every \c frameskip frames
+ *
+ * The framebuffer keeps the content of the last composed frame.
+ * Setting it to 0 or 1 composes every frame (default).
+ */
+void ppu_set_frameskip(u16 frameskip);
+
+/**
+ * \function ppu_request_frame
+ * \brief Compose the next frame, even if it should be skipped
+ */
+void ppu_request_frame();
+
+/**
+ * \function ppu_set_frame_callback
+ * \brief Register a function to be called on each drawn frame
+ *
+ * Skipped frames (\see ppu_set_frameskip) are not reported.
+ */
+void ppu_set_frame_callback(ppu_frame_callback callback);
+
+/**
+ * \function ppu_sync
+ * \brief Wait until all the lines started so far have been drawn
+ *
+ * Only the threaded engine draws lines asynchronously, this function returns
+ * immediately with the other ones.
+ */
+void ppu_sync();
+
+/**
+ * \function write_ppu
+ * \brief write an 8bit value into the LCD registers.
+ *
+ * \param address 16bit memory address between 0xFF40 - 0xFF4B
+ * \param val 8bit value
+ */
+void write_ppu(u16 address, u8 data);
+
+/**
+ * \function read_ppu
+ * \brief read a 8bit value from the LCD registers.
+ * \param address 16bit memory address between 0xFF40 - 0xFF4B
+ * \see read_memory
+ */
+u8 read_ppu(u16 address);
+
+/**
+ * \function ppu_vram_accessible
+ * \brief Whether the CPU can currently access the VRAM
+ *
+ * The VRAM cannot be accessed while the PPU is transferring pixels.
+ */
+ALWAYS_INLINE bool ppu_vram_accessible()
+{
+    return !BIT(g_ppu.lcdc, LCDC_ENABLE) || g_ppu.mode != PPU_TRANSFER;
+}
+
+/**
+ * \function ppu_vram_written
+ * \brief Keep track of the modifications of the VRAM
+ */
+ALWAYS_INLINE void ppu_vram_written(u16 address)
+{
+    g_ppu.vram_dirty |= 1 << ((address - VRAM_START) / VRAM_PAGE_SIZE);
+}
+
+/**
+ * \function ppu_oam_accessible
+ * \brief Whether the CPU can currently access the OAM
+ *
+ * The OAM cannot be accessed during the OAM scan and the pixel transfer.
+ */
+ALWAYS_INLINE bool ppu_oam_accessible()
+{
+    return !BIT(g_ppu.lcdc, LCDC_ENABLE) || g_ppu.mode < PPU_OAM_SCAN;
+}
+
+/**
+ * \function ppu_oam_written
+ * \brief Keep track of the modifications of the OAM
+ */
+ALWAYS_INLINE void ppu_oam_written()
+{
+    g_ppu.oam_generation += 1;
+}
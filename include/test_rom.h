@@ -2,7 +2,47 @@
 
 /*
  * This file is only useful to test roms from Blargg's testuite
+ *
+ * The test roms print their results on the serial port. The bytes are captured
+ * when the transfer starts, and the output is logged one line at a time.
  */
 
-void test_rom_update();
-void test_rom_print();
+#include "utils/types.h"
+
+/**
+ * \enum test_rom_result
+ * \brief Result printed by the test rom so far
+ */
+typedef enum test_rom_result {
+    TEST_ROM_RUNNING = 0,
+    TEST_ROM_PASSED,
+    TEST_ROM_FAILED,
+} test_rom_result;
+
+/**
+ * \function test_rom_start
+ * \brief Start capturing the output of the test rom
+ *
+ * \param stop_on_result Stop the CPU once "Passed" or "Failed" is printed
+ */
+void test_rom_start(bool stop_on_result);
+
+/**
+ * \function test_rom_stop
+ * \brief Stop capturing, and log the last line if it is incomplete
+ */
+void test_rom_stop();
+
+/**
+ * \function test_rom_get_result
+ * \brief Get the result printed by the test rom so far
+ */
+test_rom_result test_rom_get_result();
+
+/**
+ * \function test_rom_output
+ * \brief Get the whole output captured so far (not NUL terminated)
+ *
+ * \param size_ptr Set to the size of the output
+ */
+const char *test_rom_output(size_t *size_ptr);
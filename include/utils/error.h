@@ -6,15 +6,33 @@
 
 #define NOT_IMPLEMENTED(...) log_err("Not implemented: %s", __VA_ARGS__)
 
-#define FATAL_ERROR(...)      \
-    do {                      \
-        log_err(__VA_ARGS__); \
-        exit(1);              \
+/**
+ * \brief Called once the message of a fatal error has been logged, before
+ *        exiting (e.g. to save the state of the emulator)
+ * \param reason The message of the error
+ */
+typedef void (*fatal_error_handler)(const char *reason);
+
+/**
+ * \brief Set the function called on fatal errors, NULL to remove it
+ */
+void set_fatal_error_handler(fatal_error_handler handler);
+
+/**
+ * \brief Log an error message, call the fatal error handler then exit
+ * \see FATAL_ERROR
+ */
+__attribute__((noreturn, format(printf, 1, 2))) void
+fatal_error(const char *fmt, ...);
+
+#define FATAL_ERROR(...)          \
+    do {                          \
+        fatal_error(__VA_ARGS__); \
     } while (0)
 
 #define ASSERT_NOT_REACHED()                                         \
     do {                                                             \
-        FATAL_ERROR("Unreachable code reached: %s:%s", __FUNCTION__, \
+        FATAL_ERROR("Unreachable code reached: %s:%d", __FUNCTION__, \
                     __LINE__);                                       \
     } while (0)
 
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include "utils/types.h"
+
+/**
+ * \brief Write the whole content of the given buffers into a file
+ *
+ * Partial writes are resumed, and interrupted calls restarted. The content of
+ * \c iov_ptr is modified.
+ *
+ * \param fd The destination file
+ * \param iov_ptr The buffers to write, in order
+ * \param count The number of buffers
+ *
+ * \return false if an error occurred (errno is set)
+ */
+bool write_all(int fd, struct iovec *iov_ptr, int count);
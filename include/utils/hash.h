@@ -0,0 +1,16 @@
+#pragma once
+
+#include "utils/types.h"
+
+/**
+ * \brief Compute a fast non-cryptographic 64-bit hash of a buffer
+ *
+ * Inspired by xxHash: the buffer is consumed 32 bytes at a time by 4
+ * independent multiply-rotate accumulators, and the final value goes through
+ * an avalanche step. It is meant to compare framebuffers or memory dumps, at
+ * several GB/s.
+ *
+ * \param data_ptr The buffer to hash
+ * \param size The size of the buffer, in bytes
+ */
+u64 hash64(const void *data_ptr, size_t size);
@@ -0,0 +1,28 @@
+/**
+ * \file instrument.h
+ * \brief Build-time switch of the diagnostic code
+ *
+ * The counters, profilers, execution traces and the crash recorder are only
+ * built when EMUGB_INSTRUMENT is set to 1 (the default). Production builds
+ * can set it to 0 (CMake option EMUGB_INSTRUMENT, make INSTRUMENT=0) to
+ * remove their hooks from the hot paths entirely.
+ *
+ * Prefer testing EMUGB_INSTRUMENT inside a regular if statement over using
+ * the preprocessor, so that the disabled code is still compiled.
+ */
+
+#pragma once
+
+#ifndef EMUGB_INSTRUMENT
+#define EMUGB_INSTRUMENT 1
+#endif
+
+/*
+ * The host timers (utils/timing.h) hook the hottest functions of every
+ * subsystem, they cost a few percents even when not used. They are only
+ * built when EMUGB_HOST_TIMERS is set to 1 (CMake option EMUGB_HOST_TIMERS,
+ * make HOST_TIMERS=1).
+ */
+#ifndef EMUGB_HOST_TIMERS
+#define EMUGB_HOST_TIMERS 0
+#endif
@@ -1,5 +1,24 @@
+/**
+ * \file log.h
+ * \brief Logging functions
+ *
+ * Messages are not formatted by the calling thread: the format string and the
+ * arguments are copied into a ring buffer owned by the thread, and a
+ * background thread formats and writes them in order. Logging therefore only
+ * costs a copy to the emulator, even at the trace level.
+ *
+ * The format string must be a string literal (it is formatted later), the
+ * arguments are copied, including the strings.
+ *
+ * The messages less important than EMUGB_MIN_LOG_LEVEL (CMake option of the
+ * same name, make MIN_LOG_LEVEL=...) are removed at compile time, along with
+ * the evaluation of their arguments.
+ */
+
 #pragma once
 
+#include <stdbool.h>
+
 /**
  * \enum log_level
  * \brief The different log levels available
@@ -9,21 +28,87 @@ typedef enum {
     LOG_TRACE,    ///< Traces of the program execution
     LOG_WARNING,  ///< Warning
     LOG_ERROR,    ///< Error
+    LOG_NONE,     ///< Only used to disable all the levels, see log_set_level
 } log_level;
 
+// Importance of the levels, used to set EMUGB_MIN_LOG_LEVEL
+#define LOG_PRIORITY_TRACE 0
+#define LOG_PRIORITY_INFO 1
+#define LOG_PRIORITY_WARNING 2
+#define LOG_PRIORITY_ERROR 3
+#define LOG_PRIORITY_NONE 4
+
+#ifndef EMUGB_MIN_LOG_LEVEL
+#define EMUGB_MIN_LOG_LEVEL LOG_PRIORITY_TRACE
+#endif
+
+/// Traces are the least important messages
+#define LOG_PRIORITY(level_)                     \
+    ((level_) == LOG_TRACE  ? LOG_PRIORITY_TRACE \
+     : (level_) == LOG_INFO ? LOG_PRIORITY_INFO  \
+                            : (int)(level_))
+
+/// Whether messages of a given level are compiled in
+#define LOG_COMPILED(level_) (LOG_PRIORITY(level_) >= EMUGB_MIN_LOG_LEVEL)
+
+/// One bit per enabled level, see log_set_level
+extern unsigned g_log_mask;
+
+/// Whether messages of a given level are currently output
+#define LOG_ENABLED(level_) \
+    (LOG_COMPILED(level_) && (g_log_mask & (1U << (level_))))
+
+/**
+ * \brief Select the messages that are output
+ * \param level Do not output messages of lower importance, LOG_NONE to only
+ *              output the traces (if enabled)
+ * \param traces Output the traces, whatever the level
+ */
+void log_set_level(log_level level, bool traces);
+
+/**
+ * \brief Queue a formatted message, without checking its level
+ * \param level The log's importance level
+ * \param color The color code of the message's prefix
+ * \param msg The formatted message
+ */
+__attribute__((format(printf, 3, 4))) void
+log_message(log_level level, const char *color, const char *msg, ...);
+
+/**
+ * \brief Write the queued messages and stop the logging thread
+ *
+ * The messages logged afterwards are written synchronously. Called on exit.
+ */
+void log_stop(void);
+
+/// The color code associated with each level
+extern const char *g_level_colors[];
+
 /**
  * \brief Log a formatted message to the console
  * \param level The log's importance level
  * \param msg The formatted message
  */
-void log_print(log_level level, const char *msg, ...);
+#define log_print(level_, ...)                                           \
+    do {                                                                 \
+        if (LOG_ENABLED(level_))                                         \
+            log_message((level_), g_level_colors[(level_)], __VA_ARGS__); \
+    } while (0)
 
 /**
  * \brief Log a formatted message to the console using a specific color code
+ *
+ * The message has the same importance as LOG_INFO.
+ *
  * \param color The message's prefix's color code
  * \param msg The formatted message
  */
-void log_color(const char *color, const char *msg, ...);
+#define log_color(color_, ...)                                \
+    do {                                                      \
+        if (LOG_ENABLED(LOG_INFO))                            \
+            log_message(LOG_INFO, (color_), __VA_ARGS__);     \
+    } while (0)
 
 // NOLINTBEGIN (readability-identifier-naming)
 #define log_info(...) log_print(LOG_INFO, __VA_ARGS__)
@@ -35,6 +35,14 @@
 // value is between a and b
 #define BETWEEN(x_, a_, b_) ((x_) >= (a_) && (x_) <= (b_))
 
+// minimum/maximum of two values
+#ifndef MIN
+#define MIN(a_, b_) ((a_) < (b_) ? (a_) : (b_))
+#endif
+#ifndef MAX
+#define MAX(a_, b_) ((a_) > (b_) ? (a_) : (b_))
+#endif
+
 // value is in interval [a;b[
 #define IN_RANGE(x_, a_, b_) ((x_) >= (a_) && (x_) < ((b_)-1))
 
@@ -0,0 +1,154 @@
+/**
+ * \file timing.h
+ * \brief Measure the host time spent inside each subsystem
+ *
+ * The hot functions of each subsystem open a scope (TIMING_SCOPE) for their
+ * whole body. Scopes nest: the time spent inside a nested scope is only
+ * attributed to the innermost one, so that the shares of all the zones add
+ * up to the time spent emulating. Anything outside of a scope is attributed
+ * to TIMING_MAIN (the main loop).
+ *
+ * Time is read with rdtsc on x86, CLOCK_MONOTONIC elsewhere. Each transition
+ * between two zones reads the clock once, this overhead is estimated when
+ * starting and included into the report.
+ *
+ * Only the thread which called timing_start() is measured. The scopes are
+ * only compiled if EMUGB_HOST_TIMERS is 1, see utils/instrument.h.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#include "utils/instrument.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+typedef enum timing_zone {
+    TIMING_MAIN = 0,    ///< Main loop, anything outside of the other zones
+    TIMING_DECODE,      ///< Instruction decoding (fetch_instruction)
+    TIMING_EXECUTE,     ///< Dispatch and execution of the instructions
+    TIMING_BUS,         ///< Memory accesses (read_memory, write_memory)
+    TIMING_CARTRIDGE,   ///< Cartridge and MBC accesses
+    TIMING_TIMER,       ///< Timer and clocking of the other components
+    TIMING_INTERRUPTS,  ///< Interrupt dispatch (handle_interrupts)
+    TIMING_PPU,         ///< Picture processing unit
+    TIMING_APU,         ///< Audio processing unit
+    TIMING_LOG,         ///< Logging (producer side)
+    TIMING_ZONE_COUNT,
+} timing_zone;
+
+/// Maximum number of nested scopes, deeper ones are ignored
+#define TIMING_MAX_DEPTH 32
+
+struct timing {
+    bool enabled;
+    u8 depth;
+    u8 stack[TIMING_MAX_DEPTH]; ///< The zones of the opened scopes
+    u64 last;                   ///< Time of the last transition
+    u64 ticks[TIMING_ZONE_COUNT];
+    u64 calls[TIMING_ZONE_COUNT];
+};
+
+extern __thread struct timing g_timing;
+
+/**
+ * \function timing_start
+ * \brief Start measuring the current thread
+ * \param path Where to write the per-frame CSV, NULL to only log the report
+ * \return Whether the CSV file could be opened
+ */
+bool timing_start(const char *path);
+
+/**
+ * \function timing_stop
+ * \brief Stop measuring, close the CSV and log the report
+ */
+void timing_stop(void);
+
+/// Called by timing_frame
+void timing_write_frame(u32 frame);
+
+/**
+ * \function timing_zone_name
+ * \brief Name of a zone, as used by the report and the CSV header
+ */
+const char *timing_zone_name(timing_zone zone);
+
+/**
+ * \function timing_now
+ * \brief Read the clock used for the measurements
+ */
+ALWAYS_INLINE u64 timing_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/**
+ * \function timing_enter
+ * \brief Open a scope, prefer TIMING_SCOPE
+ * \return Whether the scope must be closed using timing_leave()
+ */
+ALWAYS_INLINE bool timing_enter(timing_zone zone)
+{
+    if (!EMUGB_HOST_TIMERS || !g_timing.enabled ||
+        g_timing.depth == TIMING_MAX_DEPTH)
+        return false;
+
+    const u64 now = timing_now();
+    g_timing.ticks[g_timing.stack[g_timing.depth - 1]] += now - g_timing.last;
+    g_timing.last = now;
+    g_timing.stack[g_timing.depth++] = zone;
+    g_timing.calls[zone] += 1;
+    return true;
+}
+
+/**
+ * \function timing_leave
+ * \brief Close the innermost scope
+ */
+ALWAYS_INLINE void timing_leave(void)
+{
+    const u64 now = timing_now();
+    g_timing.ticks[g_timing.stack[--g_timing.depth]] += now - g_timing.last;
+    g_timing.last = now;
+}
+
+/// Cleanup function of TIMING_SCOPE
+ALWAYS_INLINE void timing_leave_scope(const bool *entered_ptr)
+{
+    if (EMUGB_HOST_TIMERS && *entered_ptr)
+        timing_leave();
+}
+
+/**
+ * \brief Attribute the time spent until the end of the current block to a zone
+ *
+ * The scope is closed automatically when leaving the block, whichever way.
+ */
+#define TIMING_SCOPE(zone)                                                   \
+    __attribute__((cleanup(timing_leave_scope))) const bool timing_scope_ = \
+        timing_enter(zone)
+
+/**
+ * \function timing_frame
+ * \brief Write the times of the frame which just ended into the CSV
+ * \param frame The index of the frame
+ */
+ALWAYS_INLINE void timing_frame(u32 frame)
+{
+    if (EMUGB_HOST_TIMERS && g_timing.enabled)
+        timing_write_frame(frame);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "utils/macro.h"
+#include "utils/types.h"
+
+/// Size of the buffer, the content is written once it is full
+#define WRITER_BUFFER_SIZE (1 << 20)
+
+/**
+ * \struct writer
+ * \brief Large buffered output, for data produced at a high rate (traces)
+ *
+ * Records are formatted directly inside the buffer:
+ *
+ *     u8 *record_ptr = writer_reserve(&writer, RECORD_SIZE);
+ *     ...
+ *     writer_commit(&writer, RECORD_SIZE);
+ */
+struct writer {
+    int fd;
+    bool failed; ///< An error occurred, stop writing
+    size_t used;
+    u8 *buffer;
+};
+
+/**
+ * \brief Open the output of a writer
+ * \param path The destination file, NULL for the standard output. The rest
+ *             of the process's standard output is then redirected to the
+ *             standard error, so that it does not mix with the records.
+ * \return false if the file could not be opened (errno is set)
+ */
+bool writer_open(struct writer *writer_ptr, const char *path);
+
+/**
+ * \brief Write the content of the buffer and close the output
+ */
+void writer_close(struct writer *writer_ptr);
+
+/**
+ * \brief Write the content of the buffer
+ */
+void writer_flush(struct writer *writer_ptr);
+
+/**
+ * \brief Get room for \c size bytes at the end of the buffer
+ * \param size At most WRITER_BUFFER_SIZE
+ */
+ALWAYS_INLINE u8 *writer_reserve(struct writer *writer_ptr, size_t size)
+{
+    if (writer_ptr->used + size > WRITER_BUFFER_SIZE)
+        writer_flush(writer_ptr);
+    return writer_ptr->buffer + writer_ptr->used;
+}
+
+/**
+ * \brief Add the \c size bytes written after writer_reserve to the output
+ */
+ALWAYS_INLINE void writer_commit(struct writer *writer_ptr, size_t size)
+{
+    writer_ptr->used += size;
+}
@@ -0,0 +1,55 @@
+/**
+ * \file video_out.h
+ * \brief Stream the drawn frames into a file or a FIFO
+ *
+ * Frames are written as raw LCD_WIDTH x LCD_HEIGHT images, one byte per
+ * pixel, without any header. For example, to encode the output:
+ *
+ *     mkfifo /tmp/video
+ *     ffmpeg -f rawvideo -pix_fmt gray -s 160x144 -r 59.73 -i /tmp/video a.mp4
+ *     emu-gb --video-out=/tmp/video ROM
+ *
+ * The frames are written by a separate thread. If the consumer is too slow,
+ * frames are dropped instead of slowing down the emulation.
+ */
+
+#pragma once
+
+#include "utils/types.h"
+
+/**
+ * \enum video_format
+ * \brief The format of the pixels inside the output
+ */
+typedef enum video_format {
+    VIDEO_GRAY = 0, ///< 8-bit grayscale, 0 being black (default)
+    VIDEO_SHADES,   ///< Raw shades, from 0 (white) to 3 (black)
+} video_format;
+
+/**
+ * \struct video_out_stats
+ */
+struct video_out_stats {
+    u32 written_frames;
+    u32 dropped_frames; ///< The consumer was lagging behind
+};
+
+/**
+ * \function video_out_open
+ * \brief Start streaming the drawn frames into a file
+ *
+ * Opening a FIFO blocks until a consumer opens it for reading.
+ */
+void video_out_open(const char *path, video_format format);
+
+/**
+ * \function video_out_close
+ * \brief Write the pending frames and close the output
+ */
+void video_out_close();
+
+/**
+ * \function video_out_get_stats
+ * \brief Get the amount of frames written/dropped so far
+ */
+struct video_out_stats video_out_get_stats();
@@ -0,0 +1,36 @@
+#!/bin/sh
+
+# Training workload of the profile-guided build (emu-gb-pgo, make pgo).
+#
+# The instrumented emulator runs every test rom and every synthetic workload,
+# each one for a fixed budget of emulated cycles so that the profile does not
+# depend on the speed of the machine.
+#
+# USAGE: pgo-training.sh <emulator> <romgen> [cycles]
+
+RED='\033[0;31m'
+NC='\033[0m' # No color
+
+EMULATOR="$1"
+ROMGEN="$2"
+CYCLES="${3:-10000000}"
+TEST_ROM_DIR="$(dirname "$0")/../tests/roms"
+
+if [ ! -x "$EMULATOR" ] || [ ! -x "$ROMGEN" ]; then
+    printf "${RED}USAGE${NC}: pgo-training.sh <emulator> <romgen> [cycles]\n"
+    exit 127
+fi
+
+WORKLOAD_DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORKLOAD_DIR"' EXIT
+
+"$ROMGEN" --output "$WORKLOAD_DIR" > /dev/null || exit 1
+
+for rom in "$TEST_ROM_DIR"/*.gb "$WORKLOAD_DIR"/*.gb; do
+    echo "Training on $(basename "$rom")"
+    # A failing rom still exercises the hot paths, ignore the exit status
+    "$EMULATOR" --silent --stop-on-result --cycles="$CYCLES" "$rom" \
+        > /dev/null 2>&1
+done
+
+exit 0
@@ -1,59 +1,28 @@
 #!/bin/sh
 
 RED='\033[0;31m'
-GREEN='\033[0;32m'
 NC='\033[0m' # No color
 
-TEST_ROM_DIR="./tests/blargg/cpu_instrs/individual"
-OUT_FILE="/tmp/blargg.out"
+TEST_ROM_DIR="./tests/roms"
+# Full blargg suite, cloned by the CI (see .github/workflows/blargg.yml)
+BLARGG_DIR="./tests/blargg/cpu_instrs/individual"
+RUNNER="build/emu-gb-conformance"
 
-if [[ ! -f build/emu-gb ]]; then
-    echo -e "$RED<!> Couldn't find executable (build/emu-gb) <!>$NC"
+if [ ! -f "$RUNNER" ]; then
+    printf "$RED<!> Couldn't find executable ($RUNNER) <!>$NC\n"
     exit 127
 fi
 
-if [[ ! -d $TEST_ROM_DIR ]]; then
-    echo -e "$RED<!> Couldn't find test binaries (in $TEST_ROM_DIR) <!>$NC"
+if [ ! -d "$TEST_ROM_DIR" ]; then
+    printf "$RED<!> Couldn't find test binaries (in $TEST_ROM_DIR) <!>$NC\n"
     exit 127
 fi
 
-[[ -d /tmp ]] || mkdir -p /tmp
-
-run_test_rom() {
-    local FILENAME=$(basename "$1")
-
-    printf "%-30s" "${FILENAME}"
-
-    timeout 5 ./build/emu-gb --blargg --exit-infinite-loop "$1" &> "$OUT_FILE"
-
-    if [ $? == 124 ]; then
-        printf "${RED}Inconclusive${NC}\n"
-        return 1
-    else
-        grep 'Passed' "$OUT_FILE" &> /dev/null
-        if [ $? == 0 ]; then
-            printf "${GREEN}Passed${NC}\n"
-            return 0
-        else
-            printf "${RED}Failed${NC}\n"
-            return 1
-        fi
-    fi
-}
-
-main() {
-    local failed_test=0
-
-    for test_rom in ${TEST_ROM_DIR}/*.gb; do
-        run_test_rom "$test_rom"
-
-        if [ $? != 0 ]; then
-            failed_test=1
-        fi
-    done
-
-    return $failed_test
-}
-
-main
+# Each rom is given a fixed budget of emulated cycles, the results do not
+# depend on the load of the machine.
+if [ -d "$BLARGG_DIR" ]; then
+    ./$RUNNER "$TEST_ROM_DIR" "$BLARGG_DIR"
+else
+    ./$RUNNER "$TEST_ROM_DIR"
+fi
 exit $?
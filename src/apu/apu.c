@@ -0,0 +1,583 @@
+#include "apu/apu.h"
+
+#include <string.h>
+
+#include "apu/blip.h"
+#include "utils/error.h"
+#include "utils/macro.h"
+#include "utils/timing.h"
+
+/// Number of APU clocks in a machine cycle
+#define CLOCKS_PER_CYCLE 4
+/// The frame sequencer is clocked at 512Hz
+#define SEQUENCER_PERIOD (APU_CLOCK_RATE / 512)
+/// Samples are flushed once per video frame
+#define FRAME_CLOCKS 70224
+
+/// Amplitude of a single channel at its maximum volume, once mixed.
+/// 4 channels at full volume (x8) must fit into a signed 16-bit sample.
+#define CHANNEL_AMPLITUDE 64
+
+/// Registers are laid out in blocks of 5 (NRx0 - NRx4), one per channel
+#define NR(channel_, n_) g_apu.registers[(channel_)*5 + (n_)]
+#define REGISTER(address_) g_apu.registers[(address_)-APU_NR10]
+
+enum apu_channels { SQUARE1 = 0, SQUARE2, WAVE, NOISE, CHANNEL_COUNT };
+
+struct apu_channel {
+    bool enabled;
+    bool dac; ///< A disabled DAC outputs 0 whatever the channel does
+    u16 length;
+
+    // Volume envelope (not used by the wave channel)
+    u8 volume;
+    u8 envelope_timer;
+
+    u32 next;    ///< Time of the next step of the waveform
+    u8 position; ///< Current step of the duty cycle/wave
+
+    // Current contribution to each output
+    i32 left;
+    i32 right;
+};
+
+static struct gb_apu {
+    u8 registers[APU_WAVE_END - APU_NR10 + 1];
+    struct apu_channel channels[CHANNEL_COUNT];
+
+    struct {
+        bool enabled;
+        u8 timer;
+        u16 shadow; ///< Frequency used for the computations
+    } sweep;
+    u16 lfsr;
+
+    u32 clock;         ///< Current time, since the start of the frame
+    u32 time;          ///< Time up to which the channels have been run
+    u32 sequencer;     ///< Time of the frame sequencer's next step
+    u8 sequencer_step; ///< 0-7
+
+    apu_sample_callback callback;
+    struct blip blips[2]; ///< Left and right outputs
+} g_apu;
+
+// Duty cycles of the square channels, one bit per step
+static const u8 g_duty_cycles[] = {0x80, 0x81, 0xE1, 0x7E};
+
+// Bits that always read as 1, from 0xFF10 to 0xFF2F
+static const u8 g_read_masks[] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, // NR10 - NR14
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF, // NR20 - NR24
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF, // NR30 - NR34
+    0xFF, 0xFF, 0x00, 0x00, 0xBF, // NR40 - NR44
+    0x00, 0x00, 0x70,             // NR50 - NR52
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static bool apu_enabled()
+{
+    return BIT(REGISTER(APU_NR52), NR52_ENABLE);
+}
+
+static u16 frequency(u8 channel)
+{
+    return NR(channel, 3) | ((NR(channel, 4) & 0x7) << 8);
+}
+
+static u32 channel_period(u8 channel)
+{
+    static const u8 divisors[] = {8, 16, 32, 48, 64, 80, 96, 112};
+
+    switch (channel) {
+    case SQUARE1:
+    case SQUARE2:
+        return (2048 - frequency(channel)) * 4;
+    case WAVE:
+        return (2048 - frequency(channel)) * 2;
+    default:
+        return divisors[NR(NOISE, 3) & 0x7] << (NR(NOISE, 3) >> 4);
+    }
+}
+
+// Output of the channel, between 0 and 15
+static u8 channel_output(u8 channel)
+{
+    const struct apu_channel *channel_ptr = &g_apu.channels[channel];
+
+    if (!channel_ptr->enabled)
+        return 0;
+
+    switch (channel) {
+    case SQUARE1:
+    case SQUARE2:
+        if (!BIT(g_duty_cycles[NR(channel, 1) >> 6], channel_ptr->position))
+            return 0;
+        return channel_ptr->volume;
+
+    case WAVE: {
+        const u8 shift = (NR(WAVE, 2) >> 5) & 0x3;
+        u8 sample = REGISTER(APU_WAVE_START + channel_ptr->position / 2);
+        sample = (channel_ptr->position & 1) ? sample & 0xF : sample >> 4;
+        return shift ? sample >> (shift - 1) : 0;
+    }
+
+    default:
+        return (g_apu.lfsr & 1) ? 0 : channel_ptr->volume;
+    }
+}
+
+// Whether the output of the channel can change during its next steps
+static bool channel_audible(u8 channel)
+{
+    const struct apu_channel *channel_ptr = &g_apu.channels[channel];
+
+    if (!g_apu.callback || !channel_ptr->enabled || !channel_ptr->dac)
+        return false;
+    if (!channel_ptr->left && !channel_ptr->right)
+        return false;
+    if (channel == WAVE)
+        return (NR(WAVE, 2) >> 5) & 0x3;
+
+    return channel_ptr->volume != 0;
+}
+
+/*
+ * Compute the contribution of the channel to each output, and add the
+ * difference with the previous one into the sample buffers.
+ */
+static void update_output(u8 channel, u32 time)
+{
+    struct apu_channel *channel_ptr = &g_apu.channels[channel];
+    const u8 nr50 = REGISTER(APU_NR50);
+    const u8 nr51 = REGISTER(APU_NR51);
+
+    // The DAC converts 0-15 into an analog signal centered on 0
+    i32 level = 0;
+    if (channel_ptr->dac)
+        level = (2 * channel_output(channel) - 15) * CHANNEL_AMPLITUDE;
+
+    const i32 left = BIT(nr51, channel + 4) ? level * (((nr50 >> 4) & 7) + 1)
+                                             : 0;
+    const i32 right = BIT(nr51, channel) ? level * ((nr50 & 7) + 1) : 0;
+
+    if (g_apu.callback) {
+        if (left != channel_ptr->left)
+            blip_add_delta(&g_apu.blips[0], time, left - channel_ptr->left);
+        if (right != channel_ptr->right)
+            blip_add_delta(&g_apu.blips[1], time, right - channel_ptr->right);
+    }
+
+    channel_ptr->left = left;
+    channel_ptr->right = right;
+}
+
+static void disable_channel(u8 channel, u32 time)
+{
+    g_apu.channels[channel].enabled = false;
+    update_output(channel, time);
+}
+
+static void step_channel(u8 channel)
+{
+    struct apu_channel *channel_ptr = &g_apu.channels[channel];
+
+    if (channel != NOISE) {
+        channel_ptr->position += 1;
+        channel_ptr->position %= (channel == WAVE) ? 32 : 8;
+        return;
+    }
+
+    const u16 feedback = (g_apu.lfsr ^ (g_apu.lfsr >> 1)) & 1;
+    g_apu.lfsr = (g_apu.lfsr >> 1) | (feedback << 14);
+    if (BIT(NR(NOISE, 3), 3)) // 7-bit mode
+        g_apu.lfsr = (g_apu.lfsr & ~(1 << 6)) | (feedback << 6);
+}
+
+/*
+ * Run the channel's waveform until the given time.
+ *
+ * When the output cannot change (muted, or nobody listening), the steps are
+ * skipped all at once. The noise's LFSR is not clocked in that case, its
+ * sequence is pseudo-random anyway.
+ */
+static void run_channel(u8 channel, u32 end)
+{
+    struct apu_channel *channel_ptr = &g_apu.channels[channel];
+
+    if (channel_ptr->next >= end)
+        return;
+
+    const u32 period = channel_period(channel);
+
+    if (!channel_audible(channel)) {
+        const u32 steps = (end - channel_ptr->next - 1) / period + 1;
+        if (channel != NOISE)
+            channel_ptr->position =
+                (channel_ptr->position + steps) % ((channel == WAVE) ? 32 : 8);
+        channel_ptr->next += steps * period;
+        return;
+    }
+
+    while (channel_ptr->next < end) {
+        step_channel(channel);
+        update_output(channel, channel_ptr->next);
+        channel_ptr->next += period;
+    }
+}
+
+static void clock_length(u8 channel, u32 time)
+{
+    struct apu_channel *channel_ptr = &g_apu.channels[channel];
+
+    if (!BIT(NR(channel, 4), 6) || !channel_ptr->length)
+        return;
+
+    if (--channel_ptr->length == 0)
+        disable_channel(channel, time);
+}
+
+static void clock_envelope(u8 channel, u32 time)
+{
+    struct apu_channel *channel_ptr = &g_apu.channels[channel];
+    const u8 period = NR(channel, 2) & 0x7;
+    const bool increase = BIT(NR(channel, 2), 3);
+
+    if (!period)
+        return;
+    if (channel_ptr->envelope_timer > 1) {
+        channel_ptr->envelope_timer -= 1;
+        return;
+    }
+
+    channel_ptr->envelope_timer = period;
+
+    if (increase && channel_ptr->volume < 15)
+        channel_ptr->volume += 1;
+    else if (!increase && channel_ptr->volume > 0)
+        channel_ptr->volume -= 1;
+    else
+        return;
+
+    update_output(channel, time);
+}
+
+// Compute the next frequency of the sweep, disable channel 1 on overflow
+static u16 sweep_frequency(u32 time)
+{
+    const u8 nr10 = NR(SQUARE1, 0);
+    const u16 delta = g_apu.sweep.shadow >> (nr10 & 0x7);
+    const u16 frequency =
+        BIT(nr10, 3) ? g_apu.sweep.shadow - delta : g_apu.sweep.shadow + delta;
+
+    if (frequency > 2047)
+        disable_channel(SQUARE1, time);
+
+    return frequency;
+}
+
+static void clock_sweep(u32 time)
+{
+    const u8 nr10 = NR(SQUARE1, 0);
+    const u8 period = (nr10 >> 4) & 0x7;
+
+    if (--g_apu.sweep.timer)
+        return;
+
+    g_apu.sweep.timer = period ? period : 8;
+    if (!g_apu.sweep.enabled || !period)
+        return;
+
+    const u16 frequency = sweep_frequency(time);
+    if (frequency <= 2047 && (nr10 & 0x7)) {
+        g_apu.sweep.shadow = frequency;
+        NR(SQUARE1, 3) = LSB(frequency);
+        NR(SQUARE1, 4) = (NR(SQUARE1, 4) & ~0x7) | MSB(frequency);
+        sweep_frequency(time); // Overflow check with the new frequency
+    }
+}
+
+/*
+ * The frame sequencer generates the low frequency clocks:
+ *
+ *  - length counters: 256Hz (even steps)
+ *  - frequency sweep: 128Hz (steps 2 and 6)
+ *  - volume envelopes: 64Hz (step 7)
+ *
+ * It is free-running, instead of being derived from the DIV register.
+ */
+static void clock_sequencer(u32 time)
+{
+    const u8 step = g_apu.sequencer_step;
+
+    if (step % 2 == 0)
+        for (u8 channel = 0; channel < CHANNEL_COUNT; ++channel)
+            clock_length(channel, time);
+
+    if (step == 2 || step == 6)
+        clock_sweep(time);
+
+    if (step == 7) {
+        clock_envelope(SQUARE1, time);
+        clock_envelope(SQUARE2, time);
+        clock_envelope(NOISE, time);
+    }
+
+    g_apu.sequencer_step = (step + 1) % 8;
+}
+
+static void run_channels(u32 end)
+{
+    for (u8 channel = 0; channel < CHANNEL_COUNT; ++channel)
+        run_channel(channel, end);
+}
+
+// Catch up with the given time
+static void run_until(u32 end)
+{
+    if (!apu_enabled()) {
+        g_apu.time = end;
+        return;
+    }
+
+    while (g_apu.sequencer <= end) {
+        run_channels(g_apu.sequencer);
+        clock_sequencer(g_apu.sequencer);
+        g_apu.sequencer += SEQUENCER_PERIOD;
+    }
+
+    run_channels(end);
+    g_apu.time = end;
+}
+
+static void trigger(u8 channel, u32 time)
+{
+    struct apu_channel *channel_ptr = &g_apu.channels[channel];
+
+    channel_ptr->enabled = channel_ptr->dac;
+    if (!channel_ptr->length)
+        channel_ptr->length = (channel == WAVE) ? 256 : 64;
+
+    channel_ptr->next = time + channel_period(channel);
+    channel_ptr->volume = NR(channel, 2) >> 4;
+    channel_ptr->envelope_timer = NR(channel, 2) & 0x7;
+
+    switch (channel) {
+    case SQUARE1: {
+        const u8 nr10 = NR(SQUARE1, 0);
+        const u8 period = (nr10 >> 4) & 0x7;
+        g_apu.sweep.shadow = frequency(SQUARE1);
+        g_apu.sweep.timer = period ? period : 8;
+        g_apu.sweep.enabled = period || (nr10 & 0x7);
+        if (nr10 & 0x7)
+            sweep_frequency(time);
+        break;
+    }
+    case WAVE:
+        channel_ptr->position = 0;
+        break;
+    case NOISE:
+        g_apu.lfsr = 0x7FFF;
+        break;
+    }
+
+    update_output(channel, time);
+}
+
+static void write_channel(u8 channel, u8 n, u8 data, u32 time)
+{
+    struct apu_channel *channel_ptr = &g_apu.channels[channel];
+
+    switch (n) {
+    case 0:
+        if (channel == WAVE) {
+            channel_ptr->dac = BIT(data, 7);
+            if (!channel_ptr->dac)
+                disable_channel(WAVE, time);
+        }
+        break;
+
+    case 1:
+        if (channel == WAVE)
+            channel_ptr->length = 256 - data;
+        else
+            channel_ptr->length = 64 - (data & 0x3F);
+        break;
+
+    case 2:
+        if (channel != WAVE) {
+            channel_ptr->dac = (data & 0xF8) != 0;
+            if (!channel_ptr->dac)
+                disable_channel(channel, time);
+        } else {
+            update_output(WAVE, time); // Output level
+        }
+        break;
+
+    case 4:
+        if (BIT(data, 7))
+            trigger(channel, time);
+        break;
+
+    default:
+        // The new frequency is used when the period timer is reloaded
+        break;
+    }
+}
+
+static void set_power(bool enabled, u32 time)
+{
+    if (enabled == apu_enabled())
+        return;
+
+    if (!enabled) {
+        // All the registers are cleared, except for the wave RAM
+        memset(g_apu.registers, 0, APU_NR52 - APU_NR10);
+        for (u8 channel = 0; channel < CHANNEL_COUNT; ++channel) {
+            g_apu.channels[channel].dac = false;
+            g_apu.channels[channel].length = 0;
+            disable_channel(channel, time);
+        }
+        REGISTER(APU_NR52) = 0;
+        return;
+    }
+
+    for (u8 channel = 0; channel < CHANNEL_COUNT; ++channel)
+        g_apu.channels[channel].next = time + channel_period(channel);
+    g_apu.sequencer = time + SEQUENCER_PERIOD;
+    g_apu.sequencer_step = 0;
+    REGISTER(APU_NR52) = 1 << NR52_ENABLE;
+}
+
+void write_apu(u16 address, u8 data)
+{
+    TIMING_SCOPE(TIMING_APU);
+
+    const u32 time = g_apu.clock;
+
+    run_until(time);
+
+    if (address >= APU_WAVE_START) {
+        REGISTER(address) = data;
+        return;
+    }
+
+    if (address == APU_NR52) {
+        set_power(BIT(data, NR52_ENABLE), time);
+        return;
+    }
+
+    // Registers are read-only while the APU is off
+    if (!apu_enabled())
+        return;
+
+    REGISTER(address) = data;
+
+    if (address < APU_NR50) {
+        const u8 index = address - APU_NR10;
+        write_channel(index / 5, index % 5, data, time);
+        return;
+    }
+
+    // NR50, NR51: the mix changed
+    if (address <= APU_NR51) {
+        for (u8 channel = 0; channel < CHANNEL_COUNT; ++channel)
+            update_output(channel, time);
+    }
+}
+
+u8 read_apu(u16 address)
+{
+    if (address >= APU_WAVE_START)
+        return REGISTER(address);
+
+    if (address == APU_NR52) {
+        // Channels could have been disabled since the last access
+        run_until(g_apu.clock);
+
+        u8 status = REGISTER(APU_NR52) | g_read_masks[APU_NR52 - APU_NR10];
+        for (u8 channel = 0; channel < CHANNEL_COUNT; ++channel)
+            status |= g_apu.channels[channel].enabled << channel;
+        return status;
+    }
+
+    return REGISTER(address) | g_read_masks[address - APU_NR10];
+}
+
+void apu_ticks(u8 ticks)
+{
+    TIMING_SCOPE(TIMING_APU);
+
+    g_apu.clock += ticks * CLOCKS_PER_CYCLE;
+
+    if (g_apu.clock >= FRAME_CLOCKS)
+        apu_flush();
+}
+
+void apu_flush()
+{
+    static i16 samples[BLIP_SIZE * 2];
+    const u32 time = g_apu.clock;
+
+    run_until(time);
+
+    if (g_apu.callback) {
+        blip_end_frame(&g_apu.blips[0], time);
+        blip_end_frame(&g_apu.blips[1], time);
+
+        const u32 count = blip_samples_avail(&g_apu.blips[0]);
+        blip_read_samples(&g_apu.blips[0], samples, count, true);
+        blip_read_samples(&g_apu.blips[1], samples + 1, count, true);
+
+        if (count)
+            g_apu.callback(samples, count);
+    }
+
+    // Start a new frame, all the times are relative to its start
+    for (u8 channel = 0; channel < CHANNEL_COUNT; ++channel) {
+        struct apu_channel *channel_ptr = &g_apu.channels[channel];
+        channel_ptr->next -= MIN(channel_ptr->next, time);
+    }
+    g_apu.sequencer -= MIN(g_apu.sequencer, time);
+    g_apu.clock = 0;
+    g_apu.time = 0;
+}
+
+void apu_set_sample_callback(apu_sample_callback callback, u32 sample_rate)
+{
+    apu_flush();
+
+    g_apu.callback = callback;
+    if (!callback)
+        return;
+
+    ASSERT_MSG(sample_rate && sample_rate <= 192000,
+               "Unsupported sample rate: %u", sample_rate);
+
+    blip_init(&g_apu.blips[0], APU_CLOCK_RATE, sample_rate);
+    blip_init(&g_apu.blips[1], APU_CLOCK_RATE, sample_rate);
+}
+
+void reset_apu()
+{
+    // Register values after the boot ROM (DMG), from NR10 to NR51
+    static const u8 registers[] = {
+        0x80, 0xBF, 0xF3, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F,
+        0xFF, 0x9F, 0xFF, 0xBF, 0xFF, 0xFF, 0x00, 0x00, 0xBF, 0x77, 0xF3,
+    };
+
+    apu_flush();
+
+    memset(g_apu.channels, 0, sizeof(g_apu.channels));
+    memset(&g_apu.sweep, 0, sizeof(g_apu.sweep));
+    memcpy(g_apu.registers, registers, sizeof(registers));
+    REGISTER(APU_NR52) = 0;
+    set_power(true, 0);
+
+    // The boot sound is still playing on channel 1, at volume 0
+    g_apu.channels[SQUARE1].dac = true;
+    g_apu.channels[SQUARE1].enabled = true;
+    g_apu.lfsr = 0x7FFF;
+
+    for (u8 channel = 0; channel < CHANNEL_COUNT; ++channel)
+        update_output(channel, 0);
+}
@@ -0,0 +1,149 @@
+#include "apu/blip.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "utils/error.h"
+#include "utils/macro.h"
+
+/// Number of sub-sample positions of a step
+#define PHASE_BITS 5
+#define PHASES (1 << PHASE_BITS)
+
+/// Precision of the kernel, and of the stored differences
+#define DELTA_BITS 15
+/// Cut-off frequency of the high-pass filter
+#define BASS_SHIFT 9
+
+/// Cut-off of the low-pass filter, relative to the Nyquist frequency
+#define CUTOFF 0.9
+
+static i16 g_kernel[PHASES][BLIP_WIDTH];
+static bool g_kernel_ready = false;
+
+/*
+ * Band-limited impulse: windowed sinc, centered on 0.
+ * Its integral is 1 over [-BLIP_WIDTH / 2; BLIP_WIDTH / 2].
+ */
+static double impulse(double x)
+{
+    const double half = BLIP_WIDTH / 2;
+
+    if (fabs(x) >= half)
+        return 0;
+
+    const double window = 0.42 + 0.5 * cos(M_PI * x / half) +
+                          0.08 * cos(2 * M_PI * x / half); // Blackman
+    const double angle = M_PI * CUTOFF * x;
+    const double sinc = x == 0 ? 1 : sin(angle) / angle;
+
+    return CUTOFF * sinc * window;
+}
+
+/*
+ * Each entry of the kernel is the difference between two consecutive samples
+ * of a band-limited step, i.e. the integral of the impulse between them.
+ */
+static void init_kernel()
+{
+    const int steps = 16; // Integration steps per sample
+
+    for (int phase = 0; phase < PHASES; ++phase) {
+        const double offset = (double)phase / PHASES;
+        double taps[BLIP_WIDTH];
+        double total = 0;
+
+        for (int i = 0; i < BLIP_WIDTH; ++i) {
+            const double start = i - BLIP_WIDTH / 2 - offset;
+            taps[i] = 0;
+            for (int step = 0; step < steps; ++step)
+                taps[i] += impulse(start + (step + 0.5) / steps) / steps;
+            total += taps[i];
+        }
+
+        // The step must have exactly the requested height once rounded
+        i32 sum = 0;
+        int center = 0;
+        for (int i = 0; i < BLIP_WIDTH; ++i) {
+            g_kernel[phase][i] = lround(taps[i] / total * (1 << DELTA_BITS));
+            sum += g_kernel[phase][i];
+            if (g_kernel[phase][i] > g_kernel[phase][center])
+                center = i;
+        }
+        g_kernel[phase][center] += (1 << DELTA_BITS) - sum;
+    }
+
+    g_kernel_ready = true;
+}
+
+void blip_init(struct blip *blip_ptr, u32 clock_rate, u32 sample_rate)
+{
+    if (!g_kernel_ready)
+        init_kernel();
+
+    blip_ptr->factor = ((u64)sample_rate << 32) / clock_rate;
+    blip_clear(blip_ptr);
+}
+
+void blip_clear(struct blip *blip_ptr)
+{
+    blip_ptr->offset = 0;
+    blip_ptr->integrator = 0;
+    memset(blip_ptr->buffer, 0, sizeof(blip_ptr->buffer));
+}
+
+void blip_add_delta(struct blip *blip_ptr, u32 time, i32 delta)
+{
+    const u64 position = blip_ptr->offset + time * blip_ptr->factor;
+    const u32 index = position >> 32;
+    const u8 phase = (position >> (32 - PHASE_BITS)) & (PHASES - 1);
+
+    ASSERT_MSG(index < BLIP_SIZE, "Sample buffer overflow");
+
+    i32 *out_ptr = &blip_ptr->buffer[index];
+    const i16 *kernel_ptr = g_kernel[phase];
+    for (u8 i = 0; i < BLIP_WIDTH; ++i)
+        out_ptr[i] += kernel_ptr[i] * delta;
+}
+
+void blip_end_frame(struct blip *blip_ptr, u32 time)
+{
+    blip_ptr->offset += time * blip_ptr->factor;
+    ASSERT_MSG(blip_samples_avail(blip_ptr) <= BLIP_SIZE,
+               "Sample buffer overflow");
+}
+
+u32 blip_samples_avail(const struct blip *blip_ptr)
+{
+    return blip_ptr->offset >> 32;
+}
+
+u32 blip_read_samples(struct blip *blip_ptr, i16 *samples_ptr, u32 count,
+                      bool stereo)
+{
+    const u32 avail = blip_samples_avail(blip_ptr);
+    const u8 step = stereo ? 2 : 1;
+    i32 sum = blip_ptr->integrator;
+
+    count = MIN(count, avail);
+
+    for (u32 i = 0; i < count; ++i) {
+        sum += blip_ptr->buffer[i];
+
+        i32 sample = sum >> DELTA_BITS;
+        samples_ptr[i * step] = MAX(MIN(sample, INT16_MAX), INT16_MIN);
+
+        sum -= sample * (1 << (DELTA_BITS - BASS_SHIFT));
+    }
+
+    blip_ptr->integrator = sum;
+
+    // Move the remaining samples (and the tail of the last steps) to the front
+    const u32 remaining = avail - count + BLIP_WIDTH;
+    memmove(blip_ptr->buffer, &blip_ptr->buffer[count],
+            remaining * sizeof(*blip_ptr->buffer));
+    memset(&blip_ptr->buffer[remaining], 0, count * sizeof(*blip_ptr->buffer));
+    blip_ptr->offset -= (u64)count << 32;
+
+    return count;
+}
@@ -0,0 +1,335 @@
+#include "apu/resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RESAMPLER_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "utils/macro.h"
+
+/// Cut-off of the low-pass filter, relative to the lowest Nyquist frequency
+#define CUTOFF 0.9
+
+#define PHASE_BITS 8
+_Static_assert(RESAMPLER_PHASES == 1 << PHASE_BITS, "Invalid phase count");
+
+/// Dot product of both channels' history with the coefficients of a phase
+typedef void (*dot_product)(const float *left_ptr, const float *right_ptr,
+                            const float *coefficients_ptr, u8 taps,
+                            float *sums_ptr);
+
+/// Compute all the outputs available inside the history
+typedef size_t (*convert_history)(struct resampler *resampler_ptr,
+                                  i16 *output_ptr);
+
+static inline i16 to_sample(float value)
+{
+    value = MAX(MIN(value, INT16_MAX), INT16_MIN);
+    return value + (value < 0 ? -0.5f : 0.5f);
+}
+
+/*
+ * Shared by all the implementations. It is inlined inside each of them, so
+ * that the dot product is inlined as well.
+ */
+static ALWAYS_INLINE size_t convert(struct resampler *resampler_ptr,
+                                    i16 *output_ptr, dot_product dot)
+{
+    const float *left_ptr = resampler_ptr->history[0];
+    const float *right_ptr = resampler_ptr->history[1];
+    const u8 taps = resampler_ptr->taps;
+    const u16 count = resampler_ptr->count;
+    const u64 step = resampler_ptr->step;
+    u64 position = resampler_ptr->position;
+    size_t generated = 0;
+
+    while ((position >> 32) + taps <= count) {
+        const u32 index = position >> 32;
+        const u16 phase =
+            (position >> (32 - PHASE_BITS)) & (RESAMPLER_PHASES - 1);
+        float sums[2];
+
+        dot(&left_ptr[index], &right_ptr[index],
+            resampler_ptr->coefficients[phase], taps, sums);
+        output_ptr[2 * generated] = to_sample(sums[0]);
+        output_ptr[2 * generated + 1] = to_sample(sums[1]);
+
+        generated += 1;
+        position += step;
+    }
+
+    resampler_ptr->position = position;
+    return generated;
+}
+
+static inline void dot_scalar(const float *left_ptr, const float *right_ptr,
+                              const float *coefficients_ptr, u8 taps,
+                              float *sums_ptr)
+{
+    float left = 0;
+    float right = 0;
+
+    for (u8 i = 0; i < taps; ++i) {
+        left += left_ptr[i] * coefficients_ptr[i];
+        right += right_ptr[i] * coefficients_ptr[i];
+    }
+
+    sums_ptr[0] = left;
+    sums_ptr[1] = right;
+}
+
+static size_t convert_scalar(struct resampler *resampler_ptr, i16 *output_ptr)
+{
+    return convert(resampler_ptr, output_ptr, dot_scalar);
+}
+
+#ifdef RESAMPLER_X86
+
+static inline void dot_sse2(const float *left_ptr, const float *right_ptr,
+                            const float *coefficients_ptr, u8 taps,
+                            float *sums_ptr)
+{
+    __m128 left = _mm_setzero_ps();
+    __m128 right = _mm_setzero_ps();
+
+    for (u8 i = 0; i < taps; i += 4) {
+        const __m128 coefficients = _mm_load_ps(coefficients_ptr + i);
+        left = _mm_add_ps(left,
+                          _mm_mul_ps(_mm_loadu_ps(left_ptr + i), coefficients));
+        right = _mm_add_ps(
+            right, _mm_mul_ps(_mm_loadu_ps(right_ptr + i), coefficients));
+    }
+
+    // Horizontal sums: [l0+l1, r0+r1, l2+l3, r2+r3] -> [l, r]
+    const __m128 low = _mm_unpacklo_ps(left, right);
+    const __m128 high = _mm_unpackhi_ps(left, right);
+    const __m128 pairs = _mm_add_ps(low, high);
+    const __m128 sums = _mm_add_ps(pairs, _mm_movehl_ps(pairs, pairs));
+
+    _mm_storel_pi((__m64 *)sums_ptr, sums);
+}
+
+static size_t convert_sse2(struct resampler *resampler_ptr, i16 *output_ptr)
+{
+    return convert(resampler_ptr, output_ptr, dot_sse2);
+}
+
+__attribute__((target("avx2"))) static inline void
+dot_avx2(const float *left_ptr, const float *right_ptr,
+         const float *coefficients_ptr, u8 taps, float *sums_ptr)
+{
+    __m256 left = _mm256_setzero_ps();
+    __m256 right = _mm256_setzero_ps();
+
+    for (u8 i = 0; i < taps; i += 8) {
+        const __m256 coefficients = _mm256_load_ps(coefficients_ptr + i);
+        left = _mm256_add_ps(
+            left, _mm256_mul_ps(_mm256_loadu_ps(left_ptr + i), coefficients));
+        right = _mm256_add_ps(
+            right, _mm256_mul_ps(_mm256_loadu_ps(right_ptr + i), coefficients));
+    }
+
+    const __m128 left_half = _mm_add_ps(_mm256_castps256_ps128(left),
+                                        _mm256_extractf128_ps(left, 1));
+    const __m128 right_half = _mm_add_ps(_mm256_castps256_ps128(right),
+                                         _mm256_extractf128_ps(right, 1));
+    const __m128 low = _mm_unpacklo_ps(left_half, right_half);
+    const __m128 high = _mm_unpackhi_ps(left_half, right_half);
+    const __m128 pairs = _mm_add_ps(low, high);
+    const __m128 sums = _mm_add_ps(pairs, _mm_movehl_ps(pairs, pairs));
+
+    _mm_storel_pi((__m64 *)sums_ptr, sums);
+}
+
+__attribute__((target("avx2"))) static size_t
+convert_avx2(struct resampler *resampler_ptr, i16 *output_ptr)
+{
+    return convert(resampler_ptr, output_ptr, dot_avx2);
+}
+
+#elif defined(__ARM_NEON)
+
+static inline void dot_neon(const float *left_ptr, const float *right_ptr,
+                            const float *coefficients_ptr, u8 taps,
+                            float *sums_ptr)
+{
+    float32x4_t left = vdupq_n_f32(0);
+    float32x4_t right = vdupq_n_f32(0);
+
+    for (u8 i = 0; i < taps; i += 4) {
+        const float32x4_t coefficients = vld1q_f32(coefficients_ptr + i);
+        left = vmlaq_f32(left, vld1q_f32(left_ptr + i), coefficients);
+        right = vmlaq_f32(right, vld1q_f32(right_ptr + i), coefficients);
+    }
+
+    const float32x2_t sums =
+        vpadd_f32(vadd_f32(vget_low_f32(left), vget_high_f32(left)),
+                  vadd_f32(vget_low_f32(right), vget_high_f32(right)));
+
+    vst1_f32(sums_ptr, sums);
+}
+
+static size_t convert_neon(struct resampler *resampler_ptr, i16 *output_ptr)
+{
+    return convert(resampler_ptr, output_ptr, dot_neon);
+}
+
+#endif
+
+static convert_history g_convert = NULL;
+
+bool resampler_set_kernel(resampler_kernel kernel)
+{
+    switch (kernel) {
+    case RESAMPLER_SCALAR:
+        g_convert = convert_scalar;
+        return true;
+#ifdef RESAMPLER_X86
+    case RESAMPLER_SSE2:
+        if (!__builtin_cpu_supports("sse2"))
+            return false;
+        g_convert = convert_sse2;
+        return true;
+    case RESAMPLER_AVX2:
+        if (!__builtin_cpu_supports("avx2"))
+            return false;
+        g_convert = convert_avx2;
+        return true;
+#elif defined(__ARM_NEON)
+    case RESAMPLER_NEON:
+        g_convert = convert_neon;
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+const char *resampler_kernel_name(resampler_kernel kernel)
+{
+    static const char *names[] = {
+        [RESAMPLER_SCALAR] = "scalar",
+        [RESAMPLER_SSE2] = "sse2",
+        [RESAMPLER_AVX2] = "avx2",
+        [RESAMPLER_NEON] = "neon",
+    };
+
+    return kernel < RESAMPLER_KERNEL_COUNT ? names[kernel] : "unknown";
+}
+
+// Select the fastest implementation supported by the host
+static void select_kernel()
+{
+    for (int kernel = RESAMPLER_KERNEL_COUNT - 1; kernel >= 0; --kernel)
+        if (resampler_set_kernel(kernel))
+            return;
+}
+
+/*
+ * Windowed sinc (Blackman), sampled at each tap for all the sub-sample
+ * positions. Each phase is normalized to keep a unity gain.
+ */
+static void init_coefficients(struct resampler *resampler_ptr, double cutoff)
+{
+    const u8 taps = resampler_ptr->taps;
+    const double half = taps / 2;
+
+    memset(resampler_ptr->coefficients, 0,
+           sizeof(resampler_ptr->coefficients));
+
+    for (u16 phase = 0; phase < RESAMPLER_PHASES; ++phase) {
+        float *coefficients_ptr = resampler_ptr->coefficients[phase];
+        const double offset = (double)phase / RESAMPLER_PHASES;
+        double total = 0;
+
+        for (u8 i = 0; i < taps; ++i) {
+            const double x = i - (half - 1) - offset;
+            const double angle = M_PI * cutoff * x;
+            const double sinc = x == 0 ? 1 : sin(angle) / angle;
+            const double window = 0.42 + 0.5 * cos(M_PI * x / half) +
+                                  0.08 * cos(2 * M_PI * x / half);
+            coefficients_ptr[i] = sinc * window;
+            total += coefficients_ptr[i];
+        }
+
+        for (u8 i = 0; i < taps; ++i)
+            coefficients_ptr[i] /= total;
+    }
+}
+
+void resampler_init(struct resampler *resampler_ptr, u32 input_rate,
+                    u32 output_rate, resampler_quality quality)
+{
+    static const u8 taps[] = {
+        [RESAMPLER_LOW] = 8,
+        [RESAMPLER_MEDIUM] = 16,
+        [RESAMPLER_HIGH] = 32,
+    };
+
+    if (!g_convert)
+        select_kernel();
+
+    resampler_ptr->taps = taps[quality];
+    resampler_ptr->base_step = ((u64)input_rate << 32) / output_rate;
+    resampler_ptr->step = resampler_ptr->base_step;
+    resampler_ptr->position = 0;
+    resampler_ptr->count = 0;
+
+    // Remove what cannot be represented at the lowest rate
+    const double ratio = (double)output_rate / input_rate;
+    init_coefficients(resampler_ptr, CUTOFF * MIN(ratio, 1.0));
+}
+
+void resampler_set_adjustment(struct resampler *resampler_ptr,
+                              double adjustment)
+{
+    adjustment = MAX(MIN(adjustment, RESAMPLER_MAX_ADJUSTMENT),
+                     -RESAMPLER_MAX_ADJUSTMENT);
+    resampler_ptr->step = resampler_ptr->base_step * (1 + adjustment);
+}
+
+size_t resampler_max_output(const struct resampler *resampler_ptr,
+                            size_t count)
+{
+    const u64 min_step =
+        resampler_ptr->base_step * (1 - RESAMPLER_MAX_ADJUSTMENT);
+    return ((count + resampler_ptr->count) << 32) / min_step + 1;
+}
+
+size_t resampler_process(struct resampler *resampler_ptr, const i16 *input_ptr,
+                         size_t count, i16 *output_ptr)
+{
+    float *left_ptr = resampler_ptr->history[0];
+    float *right_ptr = resampler_ptr->history[1];
+    size_t generated = 0;
+
+    while (count) {
+        const u16 chunk = MIN(count, RESAMPLER_CHUNK);
+
+        for (u16 i = 0; i < chunk; ++i) {
+            left_ptr[resampler_ptr->count + i] = input_ptr[2 * i];
+            right_ptr[resampler_ptr->count + i] = input_ptr[2 * i + 1];
+        }
+        resampler_ptr->count += chunk;
+        input_ptr += 2 * chunk;
+        count -= chunk;
+
+        generated += g_convert(resampler_ptr, &output_ptr[2 * generated]);
+
+        // Only keep the samples needed by the next outputs
+        const u64 position = resampler_ptr->position;
+        const u32 consumed = MIN(position >> 32, resampler_ptr->count);
+        const u16 kept = resampler_ptr->count - consumed;
+        memmove(left_ptr, &left_ptr[consumed], kept * sizeof(*left_ptr));
+        memmove(right_ptr, &right_ptr[consumed], kept * sizeof(*right_ptr));
+        resampler_ptr->count = kept;
+        resampler_ptr->position = position - ((u64)consumed << 32);
+    }
+
+    return generated;
+}
@@ -0,0 +1,276 @@
+#include "audio_out.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apu/apu.h"
+#include "utils/error.h"
+#include "utils/file.h"
+#include "utils/log.h"
+#include "utils/macro.h"
+
+/// Stereo samples inside the ring (power of 2), about 1.4s at 48kHz
+#define RING_SIZE (1 << 16)
+/// Wake the writer thread up once this many samples are waiting (~170ms)
+#define BATCH_SIZE (1 << 13)
+
+/// Highest output rate, relative to APU_SAMPLE_RATE
+#define MAX_RATIO 4
+/// Stereo samples converted at once
+#define RESAMPLED_SIZE (2 * MAX_RATIO * RESAMPLER_CHUNK)
+
+#define SAMPLE_SIZE (2 * sizeof(i16))
+#define WAV_HEADER_SIZE 44
+
+#define CACHE_LINE 64
+
+static struct audio_out {
+    int fd;
+    bool failed; ///< An error occurred, stop writing
+    audio_format format;
+    u32 rate;
+
+    bool resample; ///< Convert the samples before writing them
+    struct resampler resampler;
+    i16 resampled[RESAMPLED_SIZE][2];
+
+    // Sample ring, the samples between tail and head are waiting to be written.
+    // They are stored already serialized (little-endian).
+    u8 ring[RING_SIZE][SAMPLE_SIZE];
+    u32 head __attribute__((aligned(CACHE_LINE))); ///< Written by the APU
+    u32 tail __attribute__((aligned(CACHE_LINE))); ///< Written by the writer
+
+    struct audio_out_stats stats;
+
+    bool sleeping;
+    bool closing;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} g_audio = {
+    .fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static void write_u16(u8 *buffer_ptr, u16 value)
+{
+    buffer_ptr[0] = LSB(value);
+    buffer_ptr[1] = MSB(value);
+}
+
+static void write_u32(u8 *buffer_ptr, u32 value)
+{
+    write_u16(buffer_ptr, value & 0xFFFF);
+    write_u16(buffer_ptr + 2, value >> 16);
+}
+
+// Canonical 44 bytes header: RIFF chunk, fmt sub-chunk and data sub-chunk
+static void wav_header(u8 *header_ptr, u32 rate, u32 data_size)
+{
+    memcpy(header_ptr, "RIFF", 4);
+    write_u32(header_ptr + 4, data_size + WAV_HEADER_SIZE - 8);
+    memcpy(header_ptr + 8, "WAVEfmt ", 8);
+    write_u32(header_ptr + 16, 16);          // Size of the fmt sub-chunk
+    write_u16(header_ptr + 20, 1);           // PCM
+    write_u16(header_ptr + 22, 2);           // Channels
+    write_u32(header_ptr + 24, rate);
+    write_u32(header_ptr + 28, rate * SAMPLE_SIZE);
+    write_u16(header_ptr + 32, SAMPLE_SIZE); // Block align
+    write_u16(header_ptr + 34, 16);          // Bits per sample
+    memcpy(header_ptr + 36, "data", 4);
+    write_u32(header_ptr + 40, data_size);
+}
+
+// Write all the ready samples at once
+static void write_samples(u32 tail, u32 head)
+{
+    const u32 start = tail % RING_SIZE;
+    const u32 count = head - tail;
+    const u32 first = MIN(count, RING_SIZE - start);
+    struct iovec iov[2] = {
+        {g_audio.ring[start], first * SAMPLE_SIZE},
+        {g_audio.ring[0], (count - first) * SAMPLE_SIZE},
+    };
+
+    if (!g_audio.failed && !write_all(g_audio.fd, iov, first < count ? 2 : 1)) {
+        log_err("Failed to write audio output: %s", strerror(errno));
+        g_audio.failed = true;
+    }
+}
+
+static void *writer_loop(void *arg)
+{
+    (void)arg;
+
+    while (true) {
+        const u32 tail = g_audio.tail;
+        const u32 head = __atomic_load_n(&g_audio.head, __ATOMIC_ACQUIRE);
+
+        if (head - tail >= BATCH_SIZE) {
+            write_samples(tail, head);
+            if (!g_audio.failed)
+                __atomic_add_fetch(&g_audio.stats.written_samples, head - tail,
+                                   __ATOMIC_RELAXED);
+            __atomic_store_n(&g_audio.tail, head, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        pthread_mutex_lock(&g_audio.lock);
+        __atomic_store_n(&g_audio.sleeping, true, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&g_audio.head, __ATOMIC_SEQ_CST) - tail <
+                BATCH_SIZE &&
+            !g_audio.closing)
+            pthread_cond_wait(&g_audio.wake, &g_audio.lock);
+        __atomic_store_n(&g_audio.sleeping, false, __ATOMIC_RELAXED);
+        const bool closing = g_audio.closing;
+        pthread_mutex_unlock(&g_audio.lock);
+
+        if (closing)
+            break;
+    }
+
+    // Write what is left
+    const u32 head = __atomic_load_n(&g_audio.head, __ATOMIC_ACQUIRE);
+    if (head != g_audio.tail) {
+        write_samples(g_audio.tail, head);
+        if (!g_audio.failed)
+            g_audio.stats.written_samples += head - g_audio.tail;
+        g_audio.tail = head;
+    }
+
+    return NULL;
+}
+
+static void push_ring(const i16 *samples_ptr, size_t count)
+{
+    const u32 head = g_audio.head;
+    const u32 tail = __atomic_load_n(&g_audio.tail, __ATOMIC_ACQUIRE);
+    const u32 pushed = MIN(count, RING_SIZE - (head - tail));
+
+    g_audio.stats.dropped_samples += count - pushed;
+
+    for (u32 i = 0; i < pushed; ++i) {
+        u8 *sample_ptr = g_audio.ring[(head + i) % RING_SIZE];
+        write_u16(sample_ptr, samples_ptr[2 * i]);
+        write_u16(sample_ptr + 2, samples_ptr[2 * i + 1]);
+    }
+
+    __atomic_store_n(&g_audio.head, head + pushed, __ATOMIC_SEQ_CST);
+
+    if (head + pushed - tail >= BATCH_SIZE &&
+        __atomic_load_n(&g_audio.sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&g_audio.lock);
+        pthread_cond_signal(&g_audio.wake);
+        pthread_mutex_unlock(&g_audio.lock);
+    }
+}
+
+// Called by the APU once per frame, must never block
+static void push_samples(const i16 *samples_ptr, size_t count)
+{
+    if (!g_audio.resample) {
+        push_ring(samples_ptr, count);
+        return;
+    }
+
+    while (count) {
+        const size_t chunk = MIN(count, RESAMPLER_CHUNK);
+
+        ASSERT_MSG(resampler_max_output(&g_audio.resampler, chunk) <=
+                       RESAMPLED_SIZE,
+                   "Audio conversion buffer overflow");
+
+        const size_t generated = resampler_process(
+            &g_audio.resampler, samples_ptr, chunk, g_audio.resampled[0]);
+        push_ring(g_audio.resampled[0], generated);
+
+        samples_ptr += 2 * chunk;
+        count -= chunk;
+    }
+}
+
+void audio_out_open(const char *path, audio_format format, u32 rate,
+                    resampler_quality quality)
+{
+    ASSERT_MSG(rate <= MAX_RATIO * APU_SAMPLE_RATE,
+               "Unsupported audio output rate: %u", rate);
+
+    g_audio.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (g_audio.fd < 0)
+        FATAL_ERROR("Failed to open audio output '%s': %s", path,
+                    strerror(errno));
+
+    g_audio.format = format;
+    g_audio.rate = rate;
+    g_audio.failed = false;
+    g_audio.closing = false;
+    g_audio.stats = (struct audio_out_stats){0};
+
+    g_audio.resample = rate != APU_SAMPLE_RATE;
+    if (g_audio.resample)
+        resampler_init(&g_audio.resampler, APU_SAMPLE_RATE, rate, quality);
+
+    if (format == AUDIO_WAV) {
+        u8 header[WAV_HEADER_SIZE];
+        struct iovec iov = {header, sizeof(header)};
+        wav_header(header, rate,
+                   UINT32_MAX - WAV_HEADER_SIZE); // Unknown size
+        if (!write_all(g_audio.fd, &iov, 1))
+            FATAL_ERROR("Failed to write audio output '%s': %s", path,
+                        strerror(errno));
+    }
+
+    // Report errors through writev when the consumer closes the FIFO
+    signal(SIGPIPE, SIG_IGN);
+
+    if (pthread_create(&g_audio.thread, NULL, writer_loop, NULL))
+        FATAL_ERROR("Failed to start the audio output thread");
+
+    apu_set_sample_callback(push_samples, APU_SAMPLE_RATE);
+}
+
+void audio_out_close()
+{
+    if (g_audio.fd < 0)
+        return;
+
+    // Flush the samples still inside the APU
+    apu_set_sample_callback(NULL, 0);
+
+    pthread_mutex_lock(&g_audio.lock);
+    g_audio.closing = true;
+    pthread_cond_signal(&g_audio.wake);
+    pthread_mutex_unlock(&g_audio.lock);
+
+    pthread_join(g_audio.thread, NULL);
+
+    // Now that the size is known, rewrite the header (if possible)
+    const u64 data_size = (u64)g_audio.stats.written_samples * SAMPLE_SIZE;
+    if (g_audio.format == AUDIO_WAV && !g_audio.failed &&
+        data_size <= UINT32_MAX - WAV_HEADER_SIZE) {
+        u8 header[WAV_HEADER_SIZE];
+        wav_header(header, g_audio.rate, data_size);
+        if (pwrite(g_audio.fd, header, sizeof(header), 0) < 0 &&
+            errno != ESPIPE)
+            log_err("Failed to update the WAV header: %s", strerror(errno));
+    }
+
+    close(g_audio.fd);
+    g_audio.fd = -1;
+}
+
+struct audio_out_stats audio_out_get_stats()
+{
+    struct audio_out_stats stats;
+
+    stats.written_samples =
+        __atomic_load_n(&g_audio.stats.written_samples, __ATOMIC_RELAXED);
+    stats.dropped_samples = g_audio.stats.dropped_samples;
+
+    return stats;
+}
@@ -0,0 +1,191 @@
+#include "bench.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "apu/apu.h"
+#include "utils/instrument.h"
+#include "utils/log.h"
+
+bool g_bench_enabled = false;
+u64 g_bench_instructions = 0;
+u64 g_bench_cycles = 0;
+u32 g_bench_frames = 0;
+
+static struct bench {
+    const char *rom;
+    const char *json_path; ///< NULL if disabled
+    u64 start_ns;
+    u64 start_cycles;
+    u32 start_frame;
+} g_bench;
+
+/// Results, computed once the emulation has stopped
+struct bench_results {
+    u64 cycles;
+    u32 frames;
+    u64 instructions;
+    u64 host_ns;
+    double emulated_seconds;
+    double cycles_per_second;
+    double instructions_per_second;
+    double emulated_mhz;
+    double realtime_speed;
+    double ns_per_instruction;
+    long peak_rss_kib;
+};
+
+static const char *g_engine_names[] = {
+    [PPU_ENGINE_FAST] = "fast",
+    [PPU_ENGINE_ACCURATE] = "accurate",
+    [PPU_ENGINE_THREADED] = "threaded",
+};
+
+static u64 now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+void bench_start(const char *rom, u64 cycles, u32 frames,
+                 const char *json_path)
+{
+    g_bench.rom = rom;
+    g_bench.json_path = json_path;
+    g_bench.start_cycles = timer_get_cycles();
+    g_bench.start_frame = g_ppu.frame;
+
+    g_bench_cycles = cycles;
+    g_bench_frames = frames;
+    g_bench_instructions = 0;
+    g_bench_enabled = true;
+
+    g_bench.start_ns = now_ns();
+}
+
+static struct bench_results compute_results(u64 host_ns)
+{
+    struct bench_results results = {
+        .cycles = timer_get_cycles() - g_bench.start_cycles,
+        .frames = g_ppu.frame - g_bench.start_frame,
+        .instructions = g_bench_instructions,
+        .host_ns = host_ns,
+    };
+    const double host_seconds = host_ns ? host_ns / 1e9 : 1e-9;
+    struct rusage usage;
+
+    // The clock runs 4 times faster than the machine cycles
+    results.emulated_seconds = 4.0 * results.cycles / APU_CLOCK_RATE;
+    results.cycles_per_second = results.cycles / host_seconds;
+    results.instructions_per_second = results.instructions / host_seconds;
+    results.emulated_mhz = 4.0 * results.cycles_per_second / 1e6;
+    results.realtime_speed = results.emulated_seconds / host_seconds;
+    results.ns_per_instruction =
+        results.instructions ? (double)host_ns / results.instructions : 0.0;
+
+    // Kilobytes on Linux
+    results.peak_rss_kib =
+        getrusage(RUSAGE_SELF, &usage) ? -1 : usage.ru_maxrss;
+
+    return results;
+}
+
+static void print_results(const struct bench_results *results_ptr)
+{
+    printf("Benchmark: %s\n", g_bench.rom);
+    printf("  Emulated     %llu machine cycles, %u frames, %llu "
+           "instructions (%.2fs)\n",
+           (unsigned long long)results_ptr->cycles, results_ptr->frames,
+           (unsigned long long)results_ptr->instructions,
+           results_ptr->emulated_seconds);
+    printf("  Host time    %.3fs\n", results_ptr->host_ns / 1e9);
+    printf("  Speed        %.2f MHz, %.2fx real time\n",
+           results_ptr->emulated_mhz, results_ptr->realtime_speed);
+    printf("  Throughput   %.2f M cycles/s, %.2f M instructions/s\n",
+           results_ptr->cycles_per_second / 1e6,
+           results_ptr->instructions_per_second / 1e6);
+    printf("  Cost         %.2f ns/instruction\n",
+           results_ptr->ns_per_instruction);
+    printf("  Peak RSS     %ld KiB\n", results_ptr->peak_rss_kib);
+}
+
+static void write_json_string(FILE *file_ptr, const char *string)
+{
+    fputc('"', file_ptr);
+
+    for (; *string; ++string) {
+        const unsigned char c = *string;
+        if (c == '"' || c == '\\')
+            fprintf(file_ptr, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(file_ptr, "\\u%04x", c);
+        else
+            fputc(c, file_ptr);
+    }
+
+    fputc('"', file_ptr);
+}
+
+static void write_json(const struct bench_results *results_ptr)
+{
+    FILE *file_ptr = fopen(g_bench.json_path, "w");
+    char date[32];
+    const time_t now = time(NULL);
+
+    if (!file_ptr) {
+        log_err("Failed to open '%s': %s", g_bench.json_path,
+                strerror(errno));
+        return;
+    }
+
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(file_ptr, "{\n  \"rom\": ");
+    write_json_string(file_ptr, g_bench.rom);
+    fprintf(file_ptr, ",\n  \"date\": \"%s\",\n", date);
+
+    fprintf(file_ptr, "  \"build\": {\n    \"compiler\": ");
+    write_json_string(file_ptr, __VERSION__);
+    fprintf(file_ptr,
+            ",\n    \"instrument\": %d,\n    \"host_timers\": %d,\n"
+            "    \"min_log_level\": %d\n  },\n",
+            EMUGB_INSTRUMENT, EMUGB_HOST_TIMERS, EMUGB_MIN_LOG_LEVEL);
+    fprintf(file_ptr, "  \"ppu_engine\": \"%s\",\n  \"frameskip\": %u,\n",
+            g_engine_names[g_ppu.engine], g_ppu.frameskip);
+
+    fprintf(file_ptr,
+            "  \"cycles\": %llu,\n  \"frames\": %u,\n"
+            "  \"instructions\": %llu,\n  \"host_ns\": %llu,\n",
+            (unsigned long long)results_ptr->cycles, results_ptr->frames,
+            (unsigned long long)results_ptr->instructions,
+            (unsigned long long)results_ptr->host_ns);
+    fprintf(file_ptr,
+            "  \"emulated_seconds\": %.6f,\n  \"emulated_mhz\": %.4f,\n"
+            "  \"realtime_speed\": %.4f,\n  \"cycles_per_second\": %.1f,\n"
+            "  \"instructions_per_second\": %.1f,\n"
+            "  \"ns_per_instruction\": %.4f,\n  \"peak_rss_kib\": %ld\n}\n",
+            results_ptr->emulated_seconds, results_ptr->emulated_mhz,
+            results_ptr->realtime_speed, results_ptr->cycles_per_second,
+            results_ptr->instructions_per_second,
+            results_ptr->ns_per_instruction, results_ptr->peak_rss_kib);
+
+    fclose(file_ptr);
+}
+
+void bench_stop(void)
+{
+    if (!g_bench_enabled)
+        return;
+
+    const u64 host_ns = now_ns() - g_bench.start_ns;
+    g_bench_enabled = false;
+
+    const struct bench_results results = compute_results(host_ns);
+    print_results(&results);
+    if (g_bench.json_path)
+        write_json(&results);
+}
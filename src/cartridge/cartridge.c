@@ -12,14 +12,15 @@
 
 struct cartridge g_cartridge;
 
+// Same checksum as the boot ROM, computed over the bytes 0x0134-0x014C
 static bool verify_header_checksum(struct cartridge cart)
 {
-    unsigned char sum = 0;
+    u8 checksum = 0;
 
-    for (u16 i = 0; i <= 0x014C; ++i)
-        sum -= cart.rom[i] - 1;
+    for (u16 i = 0x0134; i <= 0x014C; ++i)
+        checksum = checksum - cart.rom[i] - 1;
 
-    return sum == 0;
+    return checksum == HEADER(cart)->header_checksum;
 }
 
 /* Checking if an MBC1 cartridge contains multiple games.
@@ -128,7 +129,7 @@ bool load_cartridge(char *path)
 
     g_cartridge.ram = malloc(g_cartridge.ram_size ? g_cartridge.ram_size : 1);
 
-    if (verify_header_checksum(g_cartridge)) {
+    if (!verify_header_checksum(g_cartridge)) {
         FATAL_ERROR("Failed to load cartridge: Invalid checksum");
     }
 
@@ -191,6 +192,15 @@ static const char *g_rom_types[] = {
     "MBC7+SENSOR+RUMBLE+RAM+BATTERY",
 };
 
+u16 cartridge_rom_bank(u16 address)
+{
+    if (address < ROM_BANK || address >= ROM_BANK_SWITCHABLE)
+        return 0;
+
+    // A bank register set to 0 reads as if it was set to 1
+    return MAX(g_chip_registers.rom_bank, 1);
+}
+
 void cartridge_info()
 {
     struct cartridge_header *header_ptr = HEADER(g_cartridge);
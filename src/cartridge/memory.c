@@ -6,11 +6,14 @@
 #include "cartridge/memory.h"
 #include "utils/log.h"
 #include "utils/macro.h"
+#include "utils/timing.h"
 
 struct chip_registers_t g_chip_registers = {0, 1, 0, false};
 
 u8 read_cartridge(u16 address)
 {
+    TIMING_SCOPE(TIMING_CARTRIDGE);
+
     struct cartridge_header *rom_ptr = HEADER(g_cartridge);
 
     if (rom_ptr->type == ROM_ONLY) {
@@ -39,6 +42,8 @@ u16 read_cartridge_16bit(u16 address)
 
 void write_cartridge(u16 address, u8 data)
 {
+    TIMING_SCOPE(TIMING_CARTRIDGE);
+
     struct cartridge_header *rom_ptr = HEADER(g_cartridge);
 
     if (rom_ptr->type == ROM_ONLY) {
@@ -4,11 +4,14 @@
 
 #include "cpu/flag.h"
 #include "cpu/interrupt.h"
+#include "cpu/profiler.h"
+#include "cpu/recorder.h"
 #include "cpu/stack.h"
 #include "cpu/timer.h"
 #include "options.h"
 #include "utils/error.h"
 #include "utils/log.h"
+#include "utils/timing.h"
 
 #define INSTRUCTION(_name) static u8 _name(struct instruction in)
 
@@ -16,7 +19,7 @@ typedef u8 (*in_handler)(struct instruction);
 
 INSTRUCTION(invalid)
 {
-    FATAL_ERROR("\nInvalid instruction: " HEX8, read_memory(in.pc));
+    FATAL_ERROR("Invalid instruction: " HEX8, read_memory(in.pc));
     exit(-1);
 }
 
@@ -56,6 +59,7 @@ INSTRUCTION(call)
     timer_tick();
     stack_push_16bit(read_register_16bit(REG_PC));
     write_register_16bit(REG_PC, in.address);
+    profiler_call(in.address);
     return in.cycle_count;
 }
 
@@ -70,6 +74,7 @@ INSTRUCTION(ret)
     const u16 pc = stack_pop_16bit();
     timer_tick();
     write_register_16bit(REG_PC, pc);
+    profiler_return();
     return in.cycle_count;
 }
 
@@ -79,6 +84,7 @@ INSTRUCTION(reti)
     timer_tick();
     write_register_16bit(REG_PC, pc);
     interrupt_set_ime(true);
+    profiler_return();
     return in.cycle_count;
 }
 
@@ -87,6 +93,7 @@ INSTRUCTION(rst)
     timer_tick();
     stack_push_16bit(read_register_16bit(REG_PC));
     write_register_16bit(REG_PC, in.data);
+    profiler_call(in.data);
     return in.cycle_count;
 }
 
@@ -552,7 +559,11 @@ static in_handler g_instruction_handlers[] = {
 
 u8 execute_instruction()
 {
+    TIMING_SCOPE(TIMING_EXECUTE);
+
     u8 opcode = fetch_opcode();
+    recorder_instruction(opcode);
+
     struct instruction in = fetch_instruction(opcode);
 
     return g_instruction_handlers[in.instruction](in);
@@ -1,5 +1,6 @@
 #include "cpu/flag.h"
 #include "cpu/instruction.h"
+#include "cpu/recorder.h"
 #include "utils/log.h"
 #include "utils/macro.h"
 
@@ -16,6 +17,7 @@ typedef u8 (*cb_handler)(struct cb_instruction);
 static struct cb_instruction fetch_cb_instruction()
 {
     u8 opcode = fetch_opcode();
+    recorder_operand(opcode);
     u8 z = OPCODE_Z(opcode);
     struct cb_instruction cb;
 
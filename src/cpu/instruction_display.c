@@ -1,10 +1,7 @@
-#define _GNU_SOURCE // needed for asprintf
-
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "cpu/instruction.h"
-#include "options.h"
 #include "utils/log.h"
 #include "utils/macro.h"
 
@@ -24,184 +21,325 @@ char *g_condition_names[] = {"NZ", "Z", "NC", "C", "???"};
 char *g_register_names[] = {"A",  "F",  "B",  "C",  "D",  "E",  "H",  "L",
                             "PC", "SP", "AF", "BC", "DE", "HL", "???"};
 
-void display_instruction(struct instruction in)
+const char *instruction_name(in_name name)
 {
-    if (get_options()->trace == false)
-        return;
+    return g_instruction_names[name];
+}
 
-    char *line_ptr = NULL;
-    char *operands_ptr = NULL;
+void display_instruction(struct instruction in)
+{
+    char operands[32];
 
     switch (in.type) {
     case R16:
     case R8:
-        asprintf(&operands_ptr, "%s", g_register_names[in.reg1]);
+        snprintf(operands, sizeof(operands), "%s", g_register_names[in.reg1]);
         break;
 
     case FLAG:
-        asprintf(&operands_ptr, "%s, ", in.condition ? "TRUE" : "FALSE");
+        snprintf(operands, sizeof(operands), "%s, ",
+                 in.condition ? "TRUE" : "FALSE");
         break;
 
     case FLAG_S8:
-        asprintf(&operands_ptr, "%s, %i", in.condition ? "TRUE" : "FALSE",
-                 (i8)in.data);
+        snprintf(operands, sizeof(operands), "%s, %i",
+                 in.condition ? "TRUE" : "FALSE", (i8)in.data);
         break;
 
     case S8:
-        asprintf(&operands_ptr, "%i", (i8)in.data);
+        snprintf(operands, sizeof(operands), "%i", (i8)in.data);
         break;
 
     case FLAG_A16:
-        asprintf(&operands_ptr, "%s, " HEX, in.condition ? "TRUE" : "FALSE",
-                 in.address);
+        snprintf(operands, sizeof(operands), "%s, " HEX,
+                 in.condition ? "TRUE" : "FALSE", in.address);
         break;
 
     case A16:
-        asprintf(&operands_ptr, HEX, in.address);
+        snprintf(operands, sizeof(operands), HEX, in.address);
         break;
 
     case HL_REL:
-        asprintf(&operands_ptr, "(HL)");
+        snprintf(operands, sizeof(operands), "(HL)");
         break;
 
     case RST:
-        asprintf(&operands_ptr, HEX, in.data);
+        snprintf(operands, sizeof(operands), HEX, in.data);
         break;
 
     case R8_R8:
-        asprintf(&operands_ptr, "%s, %s", g_register_names[in.reg1],
-                 g_register_names[in.reg2]);
+        snprintf(operands, sizeof(operands), "%s, %s",
+                 g_register_names[in.reg1], g_register_names[in.reg2]);
         break;
 
     case R8_D8:
-        asprintf(&operands_ptr, "%s, " HEX8, g_register_names[in.reg1],
-                 in.data);
+        snprintf(operands, sizeof(operands), "%s, " HEX8,
+                 g_register_names[in.reg1], in.data);
         break;
 
     case R8_HL_REL:
-        asprintf(&operands_ptr, "%s, (HL) (=" HEX8 ")",
+        snprintf(operands, sizeof(operands), "%s, (HL) (=" HEX8 ")",
                  g_register_names[in.reg1], in.data);
         break;
 
     case A_R16_REL:
-        asprintf(&operands_ptr, "A, " HEX8, in.data);
+        snprintf(operands, sizeof(operands), "A, " HEX8, in.data);
         break;
 
     case A_D16_REL:
-        asprintf(&operands_ptr, "A, " HEX, in.data);
+        snprintf(operands, sizeof(operands), "A, " HEX, in.data);
         break;
 
     case HL_REL_R8:
-        asprintf(&operands_ptr, "(HL), %s", g_register_names[in.reg1]);
+        snprintf(operands, sizeof(operands), "(HL), %s",
+                 g_register_names[in.reg1]);
         break;
 
     case HL_REL_D8:
-        asprintf(&operands_ptr, "(HL), " HEX8, in.data);
+        snprintf(operands, sizeof(operands), "(HL), " HEX8, in.data);
         break;
 
     case R16_REL_A:
-        asprintf(&operands_ptr, HEX ", A", in.address);
+        snprintf(operands, sizeof(operands), HEX ", A", in.address);
         break;
 
     case D16_REL_A:
-        asprintf(&operands_ptr, "(" HEX "), A", in.address);
+        snprintf(operands, sizeof(operands), "(" HEX "), A", in.address);
         break;
 
     case R16_D16:
-        asprintf(&operands_ptr, "%s, " HEX, g_register_names[in.reg1], in.data);
+        snprintf(operands, sizeof(operands), "%s, " HEX,
+                 g_register_names[in.reg1], in.data);
         break;
 
     case D16_REL_SP:
-        asprintf(&operands_ptr, "(" HEX "), SP", in.data);
+        snprintf(operands, sizeof(operands), "(" HEX "), SP", in.data);
         break;
 
     case SP_HL:
-        asprintf(&operands_ptr, "SP, HL");
+        snprintf(operands, sizeof(operands), "SP, HL");
         break;
 
     case HLI_A:
-        asprintf(&operands_ptr, "(HL+), A");
+        snprintf(operands, sizeof(operands), "(HL+), A");
         break;
 
     case HLD_A:
-        asprintf(&operands_ptr, "(HL-), A");
+        snprintf(operands, sizeof(operands), "(HL-), A");
         break;
 
     case A_HLI:
-        asprintf(&operands_ptr, "A, (HL+)");
+        snprintf(operands, sizeof(operands), "A, (HL+)");
         break;
 
     case A_HLD:
-        asprintf(&operands_ptr, "A, (HL-)");
+        snprintf(operands, sizeof(operands), "A, (HL-)");
         break;
 
     case A_C_REL:
-        asprintf(&operands_ptr, "A, (C)");
+        snprintf(operands, sizeof(operands), "A, (C)");
         break;
 
     case A_D8_REL:
-        asprintf(&operands_ptr, "A, " HEX8, in.data);
+        snprintf(operands, sizeof(operands), "A, " HEX8, in.data);
         break;
 
     case C_REL_A:
-        asprintf(&operands_ptr, "(C), A");
+        snprintf(operands, sizeof(operands), "(C), A");
         break;
 
     case D8_REL_A:
-        asprintf(&operands_ptr, "(" HEX8 "), A", in.address);
+        snprintf(operands, sizeof(operands), "(" HEX8 "), A", in.address);
         break;
 
     case A_R8:
-        asprintf(&operands_ptr, "A, %s", g_register_names[in.reg2]);
+        snprintf(operands, sizeof(operands), "A, %s",
+                 g_register_names[in.reg2]);
         break;
 
     case A_D8:
-        asprintf(&operands_ptr, "A, " HEX8, in.data);
+        snprintf(operands, sizeof(operands), "A, " HEX8, in.data);
         break;
 
     case A_HL_REL:
-        asprintf(&operands_ptr, "A, (HL)");
+        snprintf(operands, sizeof(operands), "A, (HL)");
         break;
 
     case NO_OPERAND:
     default:
-        asprintf(&operands_ptr, "   ");
+        snprintf(operands, sizeof(operands), "   ");
         break;
     }
 
-// might be useful later ... we never know
-#if 1
-    char *registers_ptr = NULL;
-    char *parameters_ptr = NULL;
-    char *opcode_ptr = NULL;
-
-    // print instruction's name
-    asprintf(&opcode_ptr, "[" HEX "] %-4.4s ", in.pc,
-             g_instruction_names[in.instruction]);
-
-    // print 3 bytes at pc address: opcode + operands
-    asprintf(&parameters_ptr, "(%02X %02X %02X) ", read_memory(in.pc),
-             read_memory(in.pc + 1), read_memory(in.pc + 2));
-
-    // print content of the registers
-    asprintf(&registers_ptr, "AF=" HEX " BC=" HEX " DE=" HEX " HL=" HEX,
-             read_register_16bit(REG_AF), read_register_16bit(REG_BC),
-             read_register_16bit(REG_DE), read_register_16bit(REG_HL));
-
-    asprintf(&line_ptr, "%s%-15.32s%s%s", opcode_ptr, operands_ptr,
-             parameters_ptr, registers_ptr);
-
-    free(opcode_ptr);
-    free(operands_ptr);
-    free(parameters_ptr);
-    free(registers_ptr);
-#else
-    // print instruction's name
-    asprintf(&line, "[" HEX "] %-4.4s %s \t(" HEX8 ")", in.pc,
-             instruction_names[in.instruction], operands, read_memory(in.pc));
-    free(operands);
-#endif
+    log_trace("[" HEX "] %-4.4s %-15.32s(%02X %02X %02X) AF=" HEX " BC=" HEX
+              " DE=" HEX " HL=" HEX,
+              in.pc, g_instruction_names[in.instruction], operands,
+              read_memory(in.pc), read_memory(in.pc + 1),
+              read_memory(in.pc + 2), read_register_16bit(REG_AF),
+              read_register_16bit(REG_BC), read_register_16bit(REG_DE),
+              read_register_16bit(REG_HL));
+}
+
+static const char *g_r8_names[] = {"B", "C", "D", "E", "H", "L", "(HL)", "A"};
+static const char *g_r16_names[] = {"BC", "DE", "HL", "SP"};
+static const char *g_r16_stack_names[] = {"BC", "DE", "HL", "AF"};
+
+static const char *g_cb_rotation_names[] = {
+    "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL",
+};
+static const char *g_cb_names[] = {"", "BIT", "RES", "SET"};
+
+static u8 disassemble_cb(u8 opcode, char *buffer, size_t size)
+{
+    const char *reg = g_r8_names[OPCODE_Z(opcode)];
+
+    if (OPCODE_X(opcode) == CB_ROT)
+        snprintf(buffer, size, "%-4s %s",
+                 g_cb_rotation_names[OPCODE_Y(opcode)], reg);
+    else
+        snprintf(buffer, size, "%-4s %u, %s", g_cb_names[OPCODE_X(opcode)],
+                 OPCODE_Y(opcode), reg);
+
+    return 2;
+}
+
+u8 disassemble_instruction(const u8 bytes[3], char *buffer, size_t size)
+{
+    const u8 opcode = bytes[0];
+    const struct in_type type = g_opcodes[opcode];
+    const u8 d8 = bytes[1];
+    const u16 d16 = bytes[1] | (bytes[2] << 8);
+    const char *name = g_instruction_names[type.name];
+    const char *flag = g_condition_names[OPCODE_FLAG(opcode)];
+    const char *r8 = g_r8_names[OPCODE_Y(opcode)];
+    const char *r16 = g_r16_names[OPCODE_P(opcode)];
+
+    switch (type.type) {
+    case NO_OPERAND:
+        if (type.name == IN_CB)
+            return disassemble_cb(bytes[1], buffer, size);
+        snprintf(buffer, size, "%s", name);
+        return 1;
+
+    case R8:
+        snprintf(buffer, size, "%-4s %s", name, r8);
+        return 1;
+    case R16:
+        if (type.name == IN_PUSH || type.name == IN_POP)
+            r16 = g_r16_stack_names[OPCODE_P(opcode)];
+        snprintf(buffer, size, "%-4s %s", name, r16);
+        return 1;
+    case A16:
+        snprintf(buffer, size, "%-4s " HEX16, name, d16);
+        return 3;
+    case HL_REL:
+        snprintf(buffer, size, "%-4s (HL)", name);
+        return 1;
+    case S8:
+        snprintf(buffer, size, "%-4s %i", name, (i8)d8);
+        return 2;
+    case FLAG:
+        snprintf(buffer, size, "%-4s %s", name, flag);
+        return 1;
+    case RST:
+        snprintf(buffer, size, "%-4s " HEX8, name, OPCODE_Y(opcode) << 3);
+        return 1;
+    case D8:
+        snprintf(buffer, size, "%-4s " HEX8, name, d8);
+        return 2;
 
-    log_trace(line_ptr);
-    free(line_ptr);
+    case FLAG_A16:
+        snprintf(buffer, size, "%-4s %s, " HEX16, name, flag, d16);
+        return 3;
+    case FLAG_S8:
+        snprintf(buffer, size, "%-4s %s, %i", name, flag, (i8)d8);
+        return 2;
+    case R8_R8:
+        snprintf(buffer, size, "%-4s %s, %s", name, r8,
+                 g_r8_names[OPCODE_Z(opcode)]);
+        return 1;
+    case R8_D8:
+        snprintf(buffer, size, "%-4s %s, " HEX8, name, r8, d8);
+        return 2;
+    case R8_HL_REL:
+        snprintf(buffer, size, "%-4s %s, (HL)", name, r8);
+        return 1;
+    case A_R16_REL:
+        snprintf(buffer, size, "%-4s A, (%s)", name, r16);
+        return 1;
+    case A_D16_REL:
+        snprintf(buffer, size, "%-4s A, (" HEX16 ")", name, d16);
+        return 3;
+    case R16_D16:
+        snprintf(buffer, size, "%-4s %s, " HEX16, name, r16, d16);
+        return 3;
+    case SP_HL:
+        snprintf(buffer, size, "%-4s SP, HL", name);
+        return 1;
+    case SP_S8:
+        snprintf(buffer, size, "%-4s SP, %i", name, (i8)d8);
+        return 2;
+    case A_HLD:
+        snprintf(buffer, size, "%-4s A, (HL-)", name);
+        return 1;
+    case A_HLI:
+        snprintf(buffer, size, "%-4s A, (HL+)", name);
+        return 1;
+    case A_C_REL:
+        snprintf(buffer, size, "%-4s A, (C)", name);
+        return 1;
+    case A_D8_REL:
+        snprintf(buffer, size, "%-4s A, (" HEX8 ")", name, d8);
+        return 2;
+    case A_R8:
+        snprintf(buffer, size, "%-4s A, %s", name,
+                 g_r8_names[OPCODE_Z(opcode)]);
+        return 1;
+    case A_D8:
+        snprintf(buffer, size, "%-4s A, " HEX8, name, d8);
+        return 2;
+    case A_HL_REL:
+        snprintf(buffer, size, "%-4s A, (HL)", name);
+        return 1;
+    case HL_R16:
+        snprintf(buffer, size, "%-4s HL, %s", name, r16);
+        return 1;
+    case HL_S8:
+        snprintf(buffer, size, "%-4s HL, SP%+i", name, (i8)d8);
+        return 2;
+
+    case HL_REL_R8:
+        snprintf(buffer, size, "%-4s (HL), %s", name,
+                 g_r8_names[OPCODE_Z(opcode)]);
+        return 1;
+    case HL_REL_D8:
+        snprintf(buffer, size, "%-4s (HL), " HEX8, name, d8);
+        return 2;
+    case R16_REL_A:
+        snprintf(buffer, size, "%-4s (%s), A", name, r16);
+        return 1;
+    case D16_REL_A:
+        snprintf(buffer, size, "%-4s (" HEX16 "), A", name, d16);
+        return 3;
+    case D16_REL_SP:
+        snprintf(buffer, size, "%-4s (" HEX16 "), SP", name, d16);
+        return 3;
+    case HLD_A:
+        snprintf(buffer, size, "%-4s (HL-), A", name);
+        return 1;
+    case HLI_A:
+        snprintf(buffer, size, "%-4s (HL+), A", name);
+        return 1;
+    case C_REL_A:
+        snprintf(buffer, size, "%-4s (C), A", name);
+        return 1;
+    case D8_REL_A:
+        snprintf(buffer, size, "%-4s (" HEX8 "), A", name, d8);
+        return 2;
+
+    case ERR_OPERAND:
+    default:
+        snprintf(buffer, size, "DB   " HEX8, opcode);
+        return 1;
+    }
 }
@@ -3,21 +3,20 @@
 #include "cpu/flag.h"
 #include "cpu/instruction.h"
 #include "cpu/memory.h"
+#include "cpu/recorder.h"
 #include "cpu/timer.h"
+#include "cpu/trace.h"
 #include "utils/error.h"
+#include "utils/log.h"
 #include "utils/macro.h"
-
-struct in_type {
-    in_name name;
-    operand_type type;
-    u8 cycle_count;
-    u8 cycle_count_false; // For conditional jumps
-};
+#include "utils/timing.h"
 
 static u8 read_8bit_data()
 {
     timer_tick();
-    return read_memory(g_cpu.registers.pc++);
+    const u8 data = read_memory(g_cpu.registers.pc++);
+    recorder_operand(data);
+    return data;
 }
 
 static u16 read_16bit_data()
@@ -110,7 +109,7 @@ static bool read_flag(u8 flag_code)
  * For a more detailed list:
  *  - https://www.pastraiser.com/cpu/gameboy/gameboy_opcodes.html
  */
-struct in_type g_opcodes[] = {
+struct in_type g_opcodes[256] = {
     // First row: 0x0
     [0x00] = {IN_NOP, NO_OPERAND, 1},
     [0x01] = {IN_LD, R16_D16, 3},
@@ -349,6 +348,7 @@ struct in_type g_opcodes[] = {
     [0xD0] = {IN_RET, FLAG, 5, 2},
     [0xD1] = {IN_POP, R16, 3},
     [0xD2] = {IN_JP, FLAG_A16, 4, 3},
+    [0xD3] = {IN_ERR, ERR_OPERAND, 1},
     [0xD4] = {IN_CALL, FLAG_A16, 6, 3},
     [0xD5] = {IN_PUSH, R16, 4},
     [0xD6] = {IN_SUB, A_D8, 2},
@@ -356,7 +356,9 @@ struct in_type g_opcodes[] = {
     [0xD8] = {IN_RET, FLAG, 5, 2},
     [0xD9] = {IN_RETI, NO_OPERAND, 4},
     [0xDA] = {IN_JP, FLAG_A16, 4, 3},
+    [0xDB] = {IN_ERR, ERR_OPERAND, 1},
     [0xDC] = {IN_CALL, FLAG_A16, 6, 3},
+    [0xDD] = {IN_ERR, ERR_OPERAND, 1},
     [0xDE] = {IN_SBC, A_D8, 2},
     [0xDF] = {IN_RST, RST, 4},
 
@@ -364,12 +366,17 @@ struct in_type g_opcodes[] = {
     [0xE0] = {IN_LDH, D8_REL_A, 3},
     [0xE1] = {IN_POP, R16, 3},
     [0xE2] = {IN_LDH, C_REL_A, 2},
+    [0xE3] = {IN_ERR, ERR_OPERAND, 1},
+    [0xE4] = {IN_ERR, ERR_OPERAND, 1},
     [0xE5] = {IN_PUSH, R16, 4},
     [0xE6] = {IN_AND, A_D8, 2},
     [0xE7] = {IN_RST, RST, 4},
     [0xE8] = {IN_ADD, SP_S8, 4},
     [0xE9] = {IN_JP, HL_REL, 1},
     [0xEA] = {IN_LD, D16_REL_A, 4},
+    [0xEB] = {IN_ERR, ERR_OPERAND, 1},
+    [0xEC] = {IN_ERR, ERR_OPERAND, 1},
+    [0xED] = {IN_ERR, ERR_OPERAND, 1},
     [0xEE] = {IN_XOR, A_D8, 2},
     [0xEF] = {IN_RST, RST, 4},
 
@@ -378,6 +385,7 @@ struct in_type g_opcodes[] = {
     [0xF1] = {IN_POP, R16, 3},
     [0xF2] = {IN_LDH, A_C_REL, 2},
     [0xF3] = {IN_DI, NO_OPERAND, 1},
+    [0xF4] = {IN_ERR, ERR_OPERAND, 1},
     [0xF5] = {IN_PUSH, R16, 4},
     [0xF6] = {IN_OR, A_D8, 2},
     [0xF7] = {IN_RST, RST, 4},
@@ -385,6 +393,8 @@ struct in_type g_opcodes[] = {
     [0xF9] = {IN_LD, SP_HL, 2},
     [0xFA] = {IN_LD, A_D16_REL, 4},
     [0xFB] = {IN_EI, NO_OPERAND, 1},
+    [0xFC] = {IN_ERR, ERR_OPERAND, 1},
+    [0xFD] = {IN_ERR, ERR_OPERAND, 1},
     [0xFE] = {IN_CP, A_D8, 2},
     [0xFF] = {IN_RST, RST, 4},
 };
@@ -395,6 +405,8 @@ struct in_type g_opcodes[] = {
  */
 struct instruction fetch_instruction(u8 opcode)
 {
+    TIMING_SCOPE(TIMING_DECODE);
+
     u16 pc = read_register_16bit(REG_PC);
     struct in_type type = g_opcodes[opcode];
     struct instruction in = {IN_ERR, ERR_OPERAND, REG_ERR, REG_ERR, 0xdead};
@@ -613,9 +625,8 @@ struct instruction fetch_instruction(u8 opcode)
         break;
     }
 
-#ifdef NDEBUG
-    display_instruction(in);
-#endif
+    if (LOG_COMPILED(LOG_TRACE) && g_trace_text)
+        display_instruction(in);
 
     return in;
 }
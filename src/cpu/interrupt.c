@@ -2,10 +2,12 @@
 
 #include "cpu/cpu.h"
 #include "cpu/memory.h"
+#include "cpu/profiler.h"
 #include "cpu/stack.h"
 #include "cpu/timer.h"
 #include "utils/error.h"
 #include "utils/log.h"
+#include "utils/timing.h"
 
 #define FLAG(_int) (1 << ((_int)-0x40) / 8)
 #define NAME(_int) g_interrupt_names[((_int)-0x40) / 8]
@@ -84,11 +86,14 @@ static inline void handle_interrupt(interrupt_vector interrupt)
     stack_push_16bit(read_register_16bit(REG_PC)); // 2 timer ticks
     timer_tick();
     write_register_16bit(REG_PC, interrupt);
+    profiler_call(interrupt);
 }
 
 // TODO: verify clock cycles
 u8 handle_interrupts()
 {
+    TIMING_SCOPE(TIMING_INTERRUPTS);
+
     for (interrupt_vector i = IV_VBLANK; i <= IV_JOYPAD; i += 0x8) {
         if (interrupt_is_set(i) && interrupt_is_enabled(i)) {
             /* Exit halt mode regardless of the value inside IME */
@@ -3,14 +3,21 @@
 #include "cartridge/cartridge.h"
 #include "cpu/cpu.h"
 #include "cpu/interrupt.h"
+#include "cpu/recorder.h"
 #include "io.h"
+#include "ppu/ppu.h"
 #include "utils/log.h"
 #include "utils/macro.h"
+#include "utils/timing.h"
 
 bool g_ram_access = false;
 
 void write_memory(u16 address, u8 val)
 {
+    TIMING_SCOPE(TIMING_BUS);
+
+    recorder_write(address, val);
+
     if (address < ROM_BANK_SWITCHABLE) {
         write_cartridge(address, val);
     }
@@ -19,6 +26,21 @@ void write_memory(u16 address, u8 val)
         write_io(address, val);
     }
 
+    // Video memory is locked while being used by the PPU
+    else if (BETWEEN(address, VRAM_START, VRAM_END)) {
+        if (ppu_vram_accessible()) {
+            g_cpu.memory[address] = val;
+            ppu_vram_written(address);
+        }
+    }
+
+    else if (BETWEEN(address, OAM_START, OAM_END)) {
+        if (ppu_oam_accessible()) {
+            g_cpu.memory[address] = val;
+            ppu_oam_written();
+        }
+    }
+
     else if (address == INTERRUPT_ENABLE_FLAGS) {
         write_interrupt(address, val);
     }
@@ -37,6 +59,8 @@ void write_memory_16bit(u16 address, u16 val)
 
 u8 read_memory(u16 address)
 {
+    TIMING_SCOPE(TIMING_BUS);
+
     if (address < ROM_BANK_SWITCHABLE) {
         return read_cartridge(address);
     }
@@ -49,6 +73,15 @@ u8 read_memory(u16 address)
         return read_interrupt(address);
     }
 
+    // Video memory is locked while being used by the PPU
+    if (BETWEEN(address, VRAM_START, VRAM_END) && !ppu_vram_accessible()) {
+        return 0xFF;
+    }
+
+    if (BETWEEN(address, OAM_START, OAM_END) && !ppu_oam_accessible()) {
+        return 0xFF;
+    }
+
     // log_warn("Reading from an unsupported range: " HEX16, address);
 
     return g_cpu.memory[address];
@@ -56,6 +89,8 @@ u8 read_memory(u16 address)
 
 u16 read_memory_16bit(u16 address)
 {
+    TIMING_SCOPE(TIMING_BUS);
+
     if (address < ROM_BANK_SWITCHABLE) {
         return read_cartridge_16bit(address);
     }
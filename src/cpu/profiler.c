@@ -0,0 +1,451 @@
+#include "cpu/profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cartridge/cartridge.h"
+#include "cpu/cpu.h"
+#include "cpu/instruction.h"
+#include "cpu/memory.h"
+#include "cpu/symbols.h"
+#include "utils/error.h"
+#include "utils/log.h"
+
+/// Deeper calls are attributed to the deepest frame
+#define MAX_DEPTH 256
+
+#define NAME_SIZE 96
+
+/// The call tree's root, the code running outside of any known routine
+#define ROOT_NODE 0
+#define ROOT_FUNCTION 0xFFFFFFFF
+
+/// Cycles spent halted are attributed to a pseudo-instruction
+#define INSTRUCTION_HALTED (IN_XOR + 1)
+#define NB_INSTRUCTIONS (INSTRUCTION_HALTED + 1)
+
+bool g_profiler_enabled = false;
+u64 g_profiler_next_sample = 0;
+
+/// Cycles attributed to a location or a function
+struct counter {
+    u32 key; ///< BANK:ADDRESS
+    bool used;
+    unsigned active; ///< Number of occurrences in the current call stack
+    u64 cycles;      ///< Self cycles
+    u64 total;       ///< Including the called routines
+};
+
+/// Open addressing hash table of counters
+struct counters {
+    struct counter *entries;
+    size_t capacity; ///< Power of 2
+    size_t count;
+};
+
+/// A routine, and the call stack leading to it
+struct node {
+    u32 function; ///< BANK:ADDRESS of its first instruction
+    u32 parent;
+    u32 child; ///< First child, 0 if none
+    u32 sibling;
+    u64 self;
+    u64 total; ///< Computed when writing the report
+};
+
+struct frame {
+    u16 sp; ///< Where the return address is stored
+    u32 node;
+};
+
+static struct profiler {
+    const char *path;
+    u64 period;
+    unsigned top;
+
+    u64 start;
+    u64 last_sample;
+    u64 samples;
+
+    struct counters locations;
+    u64 instructions[NB_INSTRUCTIONS];
+
+    struct node *nodes;
+    size_t nb_nodes;
+    size_t capacity;
+
+    struct frame frames[MAX_DEPTH];
+    unsigned depth;
+    u32 current; ///< Node of the deepest frame
+} g_profiler;
+
+static inline u32 code_key(u16 address)
+{
+    return (u32)cartridge_rom_bank(address) << 16 | address;
+}
+
+static void format_function(u32 key, char *buffer, size_t size)
+{
+    if (key == ROOT_FUNCTION)
+        snprintf(buffer, size, "root");
+    else
+        symbols_format(key >> 16, key & 0xFFFF, buffer, size);
+}
+
+#pragma region counters
+
+static inline size_t counter_index(const struct counters *counters_ptr,
+                                   u32 key)
+{
+    return ((key * 0x9E3779B97F4A7C15ULL) >> 32) &
+           (counters_ptr->capacity - 1);
+}
+
+static void counters_grow(struct counters *counters_ptr)
+{
+    const struct counters old = *counters_ptr;
+
+    counters_ptr->capacity = MAX(old.capacity * 2, 4096);
+    counters_ptr->entries =
+        calloc(counters_ptr->capacity, sizeof(*counters_ptr->entries));
+    if (!counters_ptr->entries)
+        FATAL_ERROR("Failed to allocate the profiler's counters");
+
+    for (size_t i = 0; i < old.capacity; ++i) {
+        if (!old.entries[i].used)
+            continue;
+        size_t index = counter_index(counters_ptr, old.entries[i].key);
+        while (counters_ptr->entries[index].used)
+            index = (index + 1) & (counters_ptr->capacity - 1);
+        counters_ptr->entries[index] = old.entries[i];
+    }
+
+    free(old.entries);
+}
+
+static struct counter *counters_get(struct counters *counters_ptr, u32 key)
+{
+    if (2 * (counters_ptr->count + 1) > counters_ptr->capacity)
+        counters_grow(counters_ptr);
+
+    size_t index = counter_index(counters_ptr, key);
+    while (counters_ptr->entries[index].used) {
+        if (counters_ptr->entries[index].key == key)
+            return &counters_ptr->entries[index];
+        index = (index + 1) & (counters_ptr->capacity - 1);
+    }
+
+    struct counter *counter_ptr = &counters_ptr->entries[index];
+    counter_ptr->key = key;
+    counter_ptr->used = true;
+    counters_ptr->count += 1;
+    return counter_ptr;
+}
+
+static void counters_free(struct counters *counters_ptr)
+{
+    free(counters_ptr->entries);
+    memset(counters_ptr, 0, sizeof(*counters_ptr));
+}
+
+#pragma endregion counters
+
+#pragma region call_stack
+
+static u32 child_node(u32 parent, u32 function)
+{
+    for (u32 child = g_profiler.nodes[parent].child; child;
+         child = g_profiler.nodes[child].sibling)
+        if (g_profiler.nodes[child].function == function)
+            return child;
+
+    if (g_profiler.nb_nodes == g_profiler.capacity) {
+        g_profiler.capacity = MAX(g_profiler.capacity * 2, 1024);
+        g_profiler.nodes = realloc(
+            g_profiler.nodes, g_profiler.capacity * sizeof(*g_profiler.nodes));
+        if (!g_profiler.nodes)
+            FATAL_ERROR("Failed to allocate the profiler's call tree");
+    }
+
+    const u32 child = g_profiler.nb_nodes++;
+    g_profiler.nodes[child] = (struct node){
+        .function = function,
+        .parent = parent,
+        .sibling = g_profiler.nodes[parent].child,
+    };
+    g_profiler.nodes[parent].child = child;
+
+    return child;
+}
+
+// Drop the frames whose return address was stored at or below an address
+static void unwind(u16 sp)
+{
+    while (g_profiler.depth &&
+           g_profiler.frames[g_profiler.depth - 1].sp <= sp)
+        g_profiler.depth -= 1;
+
+    g_profiler.current = g_profiler.depth
+                           ? g_profiler.frames[g_profiler.depth - 1].node
+                           : ROOT_NODE;
+}
+
+void profiler_enter(u16 address)
+{
+    const u16 sp = g_cpu.registers.sp;
+
+    // The return address just pushed replaced the ones of these frames
+    unwind(sp);
+
+    if (g_profiler.depth == MAX_DEPTH)
+        return;
+
+    const u32 node = child_node(g_profiler.current, code_key(address));
+    g_profiler.frames[g_profiler.depth++] = (struct frame){sp, node};
+    g_profiler.current = node;
+}
+
+void profiler_leave(void)
+{
+    // The return address was stored right below the current stack pointer
+    unwind(g_cpu.registers.sp - 1);
+}
+
+#pragma endregion call_stack
+
+void profiler_sample(u16 pc)
+{
+    const u64 cycles = timer_get_cycles();
+    const u64 elapsed = cycles - g_profiler.last_sample;
+
+    g_profiler.last_sample = cycles;
+    g_profiler_next_sample = cycles + g_profiler.period;
+
+    if (!elapsed)
+        return;
+
+    const unsigned instruction = g_cpu.halt
+                                   ? INSTRUCTION_HALTED
+                                   : g_opcodes[read_memory(pc)].name;
+
+    g_profiler.samples += 1;
+    g_profiler.instructions[instruction] += elapsed;
+    g_profiler.nodes[g_profiler.current].self += elapsed;
+    counters_get(&g_profiler.locations, code_key(pc))->cycles += elapsed;
+}
+
+void profiler_start(const char *path, u64 period, unsigned top)
+{
+    free(g_profiler.nodes);
+    counters_free(&g_profiler.locations);
+    memset(&g_profiler, 0, sizeof(g_profiler));
+
+    g_profiler.path = path;
+    g_profiler.period = MAX(period, 1);
+    g_profiler.top = top;
+
+    g_profiler.capacity = 1024;
+    g_profiler.nodes = calloc(g_profiler.capacity, sizeof(*g_profiler.nodes));
+    if (!g_profiler.nodes)
+        FATAL_ERROR("Failed to allocate the profiler's call tree");
+    g_profiler.nodes[ROOT_NODE].function = ROOT_FUNCTION;
+    g_profiler.nb_nodes = 1;
+
+    g_profiler.start = timer_get_cycles();
+    g_profiler.last_sample = g_profiler.start;
+    g_profiler_next_sample = g_profiler.start + g_profiler.period;
+    g_profiler_enabled = true;
+}
+
+#pragma region output
+
+static bool write_stack(FILE *file_ptr, u32 node)
+{
+    u32 path[MAX_DEPTH + 1];
+    unsigned depth = 0;
+    char name[NAME_SIZE];
+
+    for (u32 i = node; i != ROOT_NODE; i = g_profiler.nodes[i].parent)
+        path[depth++] = i;
+
+    fputs("root", file_ptr);
+    while (depth--) {
+        format_function(g_profiler.nodes[path[depth]].function, name,
+                        sizeof(name));
+        fprintf(file_ptr, ";%s", name);
+    }
+
+    return fprintf(file_ptr, " %llu\n",
+                   (unsigned long long)g_profiler.nodes[node].self) > 0;
+}
+
+bool profiler_write_stacks(const char *path)
+{
+    FILE *file_ptr = fopen(path, "w");
+    bool success = file_ptr != NULL;
+
+    if (!file_ptr)
+        return false;
+
+    for (u32 node = 0; node < g_profiler.nb_nodes && success; ++node)
+        if (g_profiler.nodes[node].self)
+            success = write_stack(file_ptr, node);
+
+    return !fclose(file_ptr) && success;
+}
+
+// Self cycles are counted once per node, total cycles once per stack
+static void count_functions(struct counters *functions_ptr, u32 node)
+{
+    const struct node *node_ptr = &g_profiler.nodes[node];
+    struct counter *counter_ptr = counters_get(functions_ptr,
+                                               node_ptr->function);
+
+    counter_ptr->cycles += node_ptr->self;
+    if (!counter_ptr->active)
+        counter_ptr->total += node_ptr->total;
+    counter_ptr->active += 1;
+
+    for (u32 child = node_ptr->child; child;
+         child = g_profiler.nodes[child].sibling)
+        count_functions(functions_ptr, child);
+
+    // The counters may have moved while counting the children
+    counters_get(functions_ptr, node_ptr->function)->active -= 1;
+}
+
+static int compare_counters(const void *lhs, const void *rhs)
+{
+    const struct counter *lhs_ptr = lhs;
+    const struct counter *rhs_ptr = rhs;
+
+    return (lhs_ptr->cycles < rhs_ptr->cycles) -
+           (lhs_ptr->cycles > rhs_ptr->cycles);
+}
+
+// Sort the counters by decreasing number of cycles, inside the table itself
+static size_t sort_counters(struct counters *counters_ptr)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < counters_ptr->capacity; ++i)
+        if (counters_ptr->entries[i].used)
+            counters_ptr->entries[count++] = counters_ptr->entries[i];
+
+    qsort(counters_ptr->entries, count, sizeof(*counters_ptr->entries),
+          compare_counters);
+    return count;
+}
+
+static inline double percent(u64 cycles, u64 total)
+{
+    return total ? 100.0 * cycles / total : 0;
+}
+
+static void report_functions(u64 total)
+{
+    struct counters functions = {0};
+    char name[NAME_SIZE];
+
+    // Children are always created after their parent
+    for (u32 node = g_profiler.nb_nodes; node-- > 0;) {
+        struct node *node_ptr = &g_profiler.nodes[node];
+        node_ptr->total += node_ptr->self;
+        if (node != ROOT_NODE)
+            g_profiler.nodes[node_ptr->parent].total += node_ptr->total;
+    }
+
+    count_functions(&functions, ROOT_NODE);
+    const size_t count = sort_counters(&functions);
+
+    log_info("Functions:        self              total");
+    for (size_t i = 0; i < MIN(count, g_profiler.top); ++i) {
+        const struct counter *counter_ptr = &functions.entries[i];
+        format_function(counter_ptr->key, name, sizeof(name));
+        log_info("%12llu %5.1f%% %12llu %5.1f%%  %s",
+                 (unsigned long long)counter_ptr->cycles,
+                 percent(counter_ptr->cycles, total),
+                 (unsigned long long)counter_ptr->total,
+                 percent(counter_ptr->total, total), name);
+    }
+
+    counters_free(&functions);
+}
+
+static void report_locations(u64 total)
+{
+    const size_t count = sort_counters(&g_profiler.locations);
+    char name[NAME_SIZE];
+
+    log_info("Locations:");
+    for (size_t i = 0; i < MIN(count, g_profiler.top); ++i) {
+        const struct counter *counter_ptr = &g_profiler.locations.entries[i];
+        const u16 bank = counter_ptr->key >> 16;
+        const u16 address = counter_ptr->key & 0xFFFF;
+
+        // Only display the address once if it has no label
+        name[0] = '\0';
+        if (symbols_find(bank, address, NULL))
+            symbols_format(bank, address, name, sizeof(name));
+        log_info("%12llu %5.1f%%  %02X:%04X  %s",
+                 (unsigned long long)counter_ptr->cycles,
+                 percent(counter_ptr->cycles, total), bank, address, name);
+    }
+
+    // The table is not usable anymore once sorted
+    counters_free(&g_profiler.locations);
+}
+
+static void report_instructions(u64 total)
+{
+    struct counters instructions = {0};
+
+    for (unsigned i = 0; i < NB_INSTRUCTIONS; ++i)
+        if (g_profiler.instructions[i])
+            counters_get(&instructions, i)->cycles =
+                g_profiler.instructions[i];
+
+    const size_t count = sort_counters(&instructions);
+
+    log_info("Instructions:");
+    for (size_t i = 0; i < MIN(count, g_profiler.top); ++i) {
+        const struct counter *counter_ptr = &instructions.entries[i];
+        log_info("%12llu %5.1f%%  %s",
+                 (unsigned long long)counter_ptr->cycles,
+                 percent(counter_ptr->cycles, total),
+                 counter_ptr->key == INSTRUCTION_HALTED
+                     ? "(halted)"
+                     : instruction_name(counter_ptr->key));
+    }
+
+    counters_free(&instructions);
+}
+
+void profiler_stop(void)
+{
+    if (!g_profiler_enabled)
+        return;
+
+    // Attribute the cycles elapsed since the last sample
+    profiler_sample(g_cpu.registers.pc);
+    g_profiler_enabled = false;
+
+    const u64 total = g_profiler.last_sample - g_profiler.start;
+
+    if (g_profiler.path) {
+        if (profiler_write_stacks(g_profiler.path))
+            log_info("Profile written into '%s'", g_profiler.path);
+        else
+            log_err("Failed to write the profile into '%s'", g_profiler.path);
+    }
+
+    log_info("Profile: %llu cycles, %llu samples (one every %llu cycles)",
+             (unsigned long long)total, (unsigned long long)g_profiler.samples,
+             (unsigned long long)g_profiler.period);
+    report_functions(total);
+    report_locations(total);
+    report_instructions(total);
+}
+
+#pragma endregion output
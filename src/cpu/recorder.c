@@ -0,0 +1,183 @@
+#include "cpu/recorder.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu/instruction.h"
+#include "cpu/interrupt.h"
+#include "utils/error.h"
+#include "utils/log.h"
+
+#define LINE_SIZE 160
+
+struct recorder g_recorder;
+
+static char g_report_path[256];
+static volatile sig_atomic_t g_dumped = 0;
+
+/// The handlers run on their own stack, in case the stack overflowed
+static u8 g_signal_stack[1 << 16];
+
+static const int g_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+static const char *g_signal_names[] = {
+    [SIGSEGV] = "SIGSEGV", [SIGBUS] = "SIGBUS", [SIGILL] = "SIGILL",
+    [SIGFPE] = "SIGFPE",   [SIGABRT] = "SIGABRT",
+};
+
+static void write_line(int fd, const char *line)
+{
+    size_t length = strlen(line);
+
+    while (length) {
+        const ssize_t written = write(fd, line, length);
+        if (written <= 0)
+            return;
+        line += written;
+        length -= written;
+    }
+}
+
+static void dump_instructions(int fd)
+{
+    const u64 count = g_recorder.instruction_count;
+    const u64 first = count > RECORDER_INSTRUCTIONS
+                        ? count - RECORDER_INSTRUCTIONS
+                        : 0;
+    char line[LINE_SIZE];
+
+    snprintf(line, sizeof(line),
+             "\nLast %llu instructions (%llu executed):\n"
+             "               cycle    PC  instruction          "
+             "AF   BC   DE   HL   SP\n",
+             (unsigned long long)(count - first), (unsigned long long)count);
+    write_line(fd, line);
+
+    for (u64 i = first; i < count; ++i) {
+        const struct recorder_instruction *entry_ptr =
+            &g_recorder.instructions[i & (RECORDER_INSTRUCTIONS - 1)];
+        const struct cpu_registers *registers_ptr = &entry_ptr->registers;
+        const u16 pc = registers_ptr->pc;
+        char disassembly[32];
+
+        disassemble_instruction(entry_ptr->bytes, disassembly,
+                                sizeof(disassembly));
+
+        snprintf(line, sizeof(line),
+                 "%20llu  %04X  %-20s %02X%02X %02X%02X %02X%02X %02X%02X "
+                 "%04X\n",
+                 (unsigned long long)entry_ptr->cycle, pc, disassembly,
+                 registers_ptr->a, registers_ptr->f, registers_ptr->b,
+                 registers_ptr->c, registers_ptr->d, registers_ptr->e,
+                 registers_ptr->h, registers_ptr->l, registers_ptr->sp);
+        write_line(fd, line);
+    }
+}
+
+static void dump_writes(int fd)
+{
+    const u64 count = g_recorder.write_count;
+    const u64 first = count > RECORDER_WRITES ? count - RECORDER_WRITES : 0;
+    char line[LINE_SIZE];
+
+    snprintf(line, sizeof(line),
+             "\nLast %llu memory writes (%llu in total):\n"
+             "               cycle  address  value\n",
+             (unsigned long long)(count - first), (unsigned long long)count);
+    write_line(fd, line);
+
+    for (u64 i = first; i < count; ++i) {
+        const struct recorder_write *entry_ptr =
+            &g_recorder.writes[i & (RECORDER_WRITES - 1)];
+        snprintf(line, sizeof(line), "%20llu     %04X     %02X\n",
+                 (unsigned long long)entry_ptr->cycle, entry_ptr->address,
+                 entry_ptr->value);
+        write_line(fd, line);
+    }
+}
+
+void recorder_dump(const char *reason)
+{
+    const struct cpu_registers *registers_ptr = &g_cpu.registers;
+    char line[LINE_SIZE];
+
+    // Nothing to report, the emulation has not started yet
+    if (!g_recorder.instruction_count)
+        return;
+
+    // A fatal error may be raised while dumping the report
+    if (g_dumped)
+        return;
+    g_dumped = 1;
+
+    const int fd = open(g_report_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+
+    // The reason may not fit inside a line
+    write_line(fd, "emu-gb crash report\nReason: ");
+    write_line(fd, reason);
+
+    snprintf(line, sizeof(line),
+             "\nCycle: %llu\n"
+             "Registers: AF=%02X%02X BC=%02X%02X DE=%02X%02X HL=%02X%02X "
+             "SP=%04X PC=%04X IME=%d HALT=%d\n",
+             (unsigned long long)timer_get_cycles(), registers_ptr->a,
+             registers_ptr->f, registers_ptr->b, registers_ptr->c,
+             registers_ptr->d, registers_ptr->e, registers_ptr->h,
+             registers_ptr->l, registers_ptr->sp, registers_ptr->pc,
+             interrupt_get_ime(), g_cpu.halt);
+    write_line(fd, line);
+
+    dump_instructions(fd);
+    dump_writes(fd);
+
+    close(fd);
+}
+
+static void dump_on_fatal_error(const char *reason)
+{
+    recorder_dump(reason);
+    log_err("Crash report written into '%s'", g_report_path);
+}
+
+static void dump_on_signal(int signal)
+{
+    static const char message[] = "Fatal signal, crash report written\n";
+
+    recorder_dump(g_signal_names[signal]);
+    write_line(STDERR_FILENO, message);
+
+    // The default action was restored (SA_RESETHAND)
+    raise(signal);
+}
+
+void recorder_start(const char *path)
+{
+    if (path)
+        snprintf(g_report_path, sizeof(g_report_path), "%s", path);
+    else
+        snprintf(g_report_path, sizeof(g_report_path),
+                 "emu-gb-crash-%d.log", (int)getpid());
+
+    set_fatal_error_handler(dump_on_fatal_error);
+
+    const stack_t stack = {
+        .ss_sp = g_signal_stack,
+        .ss_size = sizeof(g_signal_stack),
+    };
+    if (sigaltstack(&stack, NULL) < 0)
+        log_warn("Failed to set the signal stack, stack overflows will not "
+                 "be reported");
+
+    struct sigaction action = {
+        .sa_handler = dump_on_signal,
+        .sa_flags = SA_RESETHAND | SA_ONSTACK,
+    };
+    sigemptyset(&action.sa_mask);
+
+    for (size_t i = 0; i < sizeof(g_signals) / sizeof(*g_signals); ++i)
+        sigaction(g_signals[i], &action, NULL);
+}
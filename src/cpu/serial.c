@@ -0,0 +1,117 @@
+#include "cpu/serial.h"
+
+#include "cpu/interrupt.h"
+#include "utils/log.h"
+#include "utils/macro.h"
+
+/// Unused bits of SC, always read as 1
+#define SC_UNUSED 0x7E
+
+static struct serial {
+    u8 sb;
+    u8 sc;
+    u16 cycles; ///< Remaining cycles of the internal transfer, 0 if none
+    u16 poll_cycles; ///< Remaining cycles until the link is polled
+    const struct serial_link *link_ptr;
+    serial_transfer_callback callback;
+} g_serial;
+
+void reset_serial()
+{
+    g_serial.sb = 0x00;
+    g_serial.sc = 0x00;
+    g_serial.cycles = 0;
+    g_serial.poll_cycles = 0;
+}
+
+void serial_set_link(const struct serial_link *link_ptr)
+{
+    g_serial.link_ptr = link_ptr;
+    g_serial.poll_cycles = 0;
+}
+
+void serial_set_transfer_callback(serial_transfer_callback callback)
+{
+    g_serial.callback = callback;
+}
+
+static void end_transfer(u8 received)
+{
+    g_serial.sb = received;
+    g_serial.sc &= ~(1 << SC_TRANSFER);
+    interrupt_request(IV_SERIAL);
+}
+
+u8 serial_receive(u8 data)
+{
+    const u8 sent = g_serial.sb;
+
+    if (!BIT(g_serial.sc, SC_TRANSFER) || BIT(g_serial.sc, SC_CLOCK))
+        return 0xFF;
+
+    end_transfer(data);
+    return sent;
+}
+
+void serial_ticks(u8 ticks)
+{
+    const struct serial_link *link_ptr = g_serial.link_ptr;
+
+    if (link_ptr) {
+        if (g_serial.poll_cycles > ticks)
+            g_serial.poll_cycles -= ticks;
+        else
+            g_serial.poll_cycles = link_ptr->poll();
+    }
+
+    if (!g_serial.cycles)
+        return;
+
+    if (g_serial.cycles > ticks) {
+        g_serial.cycles -= ticks;
+        return;
+    }
+
+    g_serial.cycles = 0;
+    end_transfer(link_ptr ? link_ptr->exchange(g_serial.sb) : 0xFF);
+}
+
+void write_serial(u16 address, u8 data)
+{
+    switch ((serial_registers)address) {
+    case SERIAL_SB:
+        g_serial.sb = data;
+        break;
+    case SERIAL_SC:
+        g_serial.sc = data & ~SC_UNUSED;
+        // Only the master clocks the transfer, the other side waits for it
+        if (BIT(data, SC_TRANSFER) && BIT(data, SC_CLOCK)) {
+            g_serial.cycles = SERIAL_TRANSFER_CYCLES;
+            if (g_serial.link_ptr)
+                g_serial.link_ptr->start(g_serial.sb);
+            if (g_serial.callback)
+                g_serial.callback(g_serial.sb);
+        } else {
+            g_serial.cycles = 0;
+        }
+        break;
+
+    default:
+        log_warn("Invalid serial write: (" HEX16 "). Skipping", address);
+        break;
+    }
+}
+
+u8 read_serial(u16 address)
+{
+    switch ((serial_registers)address) {
+    case SERIAL_SB:
+        return g_serial.sb;
+    case SERIAL_SC:
+        return g_serial.sc | SC_UNUSED;
+
+    default:
+        log_warn("Invalid serial read: (" HEX16 "). Skipping", address);
+        return 0xFF;
+    }
+}
@@ -0,0 +1,143 @@
+#include "cpu/symbols.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/log.h"
+#include "utils/macro.h"
+
+#define NAME_SIZE 64
+
+struct symbol {
+    u32 key; ///< See symbol_key
+    char name[NAME_SIZE];
+};
+
+static struct symbols {
+    struct symbol *symbols; ///< Sorted by key
+    size_t count;
+    size_t capacity;
+} g_symbols;
+
+// Only the switchable ROM bank is taken into account, the other regions are
+// either not banked or not executed from (VRAM, SRAM, WRAM on the DMG)
+static inline u32 symbol_key(u16 bank, u16 address)
+{
+    if (!BETWEEN(address, 0x4000, 0x7FFF))
+        bank = 0;
+    return (u32)bank << 16 | address;
+}
+
+// ROM banks are 16KiB wide, the other memory areas 8KiB (VRAM, SRAM, WRAM)
+static inline u32 symbol_region(u32 key)
+{
+    return key & ((key & 0x8000) ? 0xFFFFE000 : 0xFFFFC000);
+}
+
+static int compare_symbols(const void *lhs, const void *rhs)
+{
+    const struct symbol *lhs_ptr = lhs;
+    const struct symbol *rhs_ptr = rhs;
+
+    return (lhs_ptr->key > rhs_ptr->key) - (lhs_ptr->key < rhs_ptr->key);
+}
+
+void symbols_clear(void)
+{
+    free(g_symbols.symbols);
+    memset(&g_symbols, 0, sizeof(g_symbols));
+}
+
+static bool add_symbol(u16 bank, u16 address, const char *name)
+{
+    if (g_symbols.count == g_symbols.capacity) {
+        const size_t capacity = MAX(g_symbols.capacity * 2, 256);
+        struct symbol *symbols =
+            realloc(g_symbols.symbols, capacity * sizeof(*symbols));
+        if (!symbols)
+            return false;
+        g_symbols.symbols = symbols;
+        g_symbols.capacity = capacity;
+    }
+
+    struct symbol *symbol_ptr = &g_symbols.symbols[g_symbols.count++];
+    symbol_ptr->key = symbol_key(bank, address);
+    snprintf(symbol_ptr->name, sizeof(symbol_ptr->name), "%s", name);
+    return true;
+}
+
+bool symbols_load(const char *path)
+{
+    FILE *file_ptr = fopen(path, "r");
+    char line[256];
+
+    if (!file_ptr)
+        return false;
+
+    symbols_clear();
+
+    while (fgets(line, sizeof(line), file_ptr)) {
+        unsigned bank;
+        unsigned address;
+        char name[NAME_SIZE];
+
+        // Comments start with ';'
+        if (sscanf(line, "%x:%x %63s", &bank, &address, name) != 3)
+            continue;
+        if (bank > 0xFFFF || address > 0xFFFF)
+            continue;
+        if (!add_symbol(bank, address, name))
+            break;
+    }
+
+    fclose(file_ptr);
+
+    qsort(g_symbols.symbols, g_symbols.count, sizeof(*g_symbols.symbols),
+          compare_symbols);
+
+    log_info("Loaded %zu symbols from '%s'", g_symbols.count, path);
+    return true;
+}
+
+const char *symbols_find(u16 bank, u16 address, u16 *offset_ptr)
+{
+    const u32 key = symbol_key(bank, address);
+    size_t low = 0;
+    size_t high = g_symbols.count;
+
+    // Last symbol whose key is lower or equal
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (g_symbols.symbols[middle].key <= key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (!low)
+        return NULL;
+
+    const struct symbol *symbol_ptr = &g_symbols.symbols[low - 1];
+
+    // Do not name an address after a label of another bank or region
+    if (symbol_region(symbol_ptr->key) != symbol_region(key))
+        return NULL;
+
+    if (offset_ptr)
+        *offset_ptr = key - symbol_ptr->key;
+    return symbol_ptr->name;
+}
+
+int symbols_format(u16 bank, u16 address, char *buffer, size_t size)
+{
+    u16 offset;
+    const char *name = symbols_find(bank, address, &offset);
+
+    if (!name)
+        return snprintf(buffer, size, "%02X:%04X",
+                        BETWEEN(address, 0x4000, 0x7FFF) ? bank : 0, address);
+    if (!offset)
+        return snprintf(buffer, size, "%s", name);
+    return snprintf(buffer, size, "%s+0x%X", name, offset);
+}
@@ -2,27 +2,27 @@
 
 #include <stdio.h>
 
+#include "apu/apu.h"
 #include "cpu/cpu.h"
 #include "cpu/interrupt.h"
 #include "cpu/memory.h"
+#include "cpu/serial.h"
+#include "ppu/ppu.h"
 #include "utils/error.h"
 #include "utils/log.h"
 #include "utils/macro.h"
+#include "utils/timing.h"
 
 #define CLOCKS_PER_CYCLE 4
 
 static bool g_tima_overflow = false;
 
-struct timer {
-    u16 div;
-    u8 tima;
-    u8 tma;
-    u8 tac;
-} g_timer;
+struct timer g_timer;
 
 void reset_timer()
 {
     g_timer.div = TIMER_DIV_DEFAULT;
+    g_timer.cycles = 0;
 }
 
 void write_timer(u16 address, u8 data)
@@ -76,11 +76,19 @@ static u16 g_freq_divider[] = {1024, 16, 64, 256};
 
 void timer_ticks(u8 ticks)
 {
+    TIMING_SCOPE(TIMING_TIMER);
+
     u16 div = g_timer.div;
     u8 tac = read_timer(TIMER_TAC);
 
     // update DIV's 16bit value
     g_timer.div += ticks;
+    g_timer.cycles += ticks;
+
+    // The PPU, the APU and the serial port are clocked alongside the timer
+    ppu_ticks(ticks);
+    apu_ticks(ticks);
+    serial_ticks(ticks);
 
     // delayed IE
     if (g_cpu.ime_scheduled) {
@@ -0,0 +1,151 @@
+#include "cpu/trace.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "cartridge/cartridge.h"
+#include "cpu/cpu.h"
+#include "cpu/interrupt.h"
+#include "cpu/memory.h"
+#include "cpu/timer.h"
+#include "utils/error.h"
+#include "utils/macro.h"
+#include "utils/writer.h"
+
+/// Longest line, including the new line character
+#define DOCTOR_LINE_SIZE 74
+
+_Static_assert(sizeof(struct trace_record) == 32, "Unexpected record size");
+
+bool g_trace_enabled = false;
+bool g_trace_text = false;
+
+static struct trace {
+    trace_format format;
+    struct writer writer;
+} g_trace;
+
+static const char g_digits[] = "0123456789ABCDEF";
+
+static ALWAYS_INLINE char *write_hex8(char *out_ptr, u8 value)
+{
+    out_ptr[0] = g_digits[value >> 4];
+    out_ptr[1] = g_digits[value & 0xF];
+    return out_ptr + 2;
+}
+
+static ALWAYS_INLINE char *write_hex16(char *out_ptr, u16 value)
+{
+    return write_hex8(write_hex8(out_ptr, MSB(value)), LSB(value));
+}
+
+static ALWAYS_INLINE char *write_field8(char *out_ptr, const char *name,
+                                        u8 value)
+{
+    while (*name)
+        *out_ptr++ = *name++;
+    out_ptr = write_hex8(out_ptr, value);
+    *out_ptr = ' ';
+    return out_ptr + 1;
+}
+
+static void trace_doctor()
+{
+    const struct cpu_registers *registers_ptr = &g_cpu.registers;
+    const u16 pc = registers_ptr->pc;
+    char *line_ptr =
+        (char *)writer_reserve(&g_trace.writer, DOCTOR_LINE_SIZE);
+    char *out_ptr = line_ptr;
+
+    out_ptr = write_field8(out_ptr, "A:", registers_ptr->a);
+    out_ptr = write_field8(out_ptr, "F:", registers_ptr->f);
+    out_ptr = write_field8(out_ptr, "B:", registers_ptr->b);
+    out_ptr = write_field8(out_ptr, "C:", registers_ptr->c);
+    out_ptr = write_field8(out_ptr, "D:", registers_ptr->d);
+    out_ptr = write_field8(out_ptr, "E:", registers_ptr->e);
+    out_ptr = write_field8(out_ptr, "H:", registers_ptr->h);
+    out_ptr = write_field8(out_ptr, "L:", registers_ptr->l);
+
+    memcpy(out_ptr, "SP:", 3);
+    out_ptr = write_hex16(out_ptr + 3, registers_ptr->sp);
+    memcpy(out_ptr, " PC:", 4);
+    out_ptr = write_hex16(out_ptr + 4, pc);
+    memcpy(out_ptr, " PCMEM:", 7);
+    out_ptr += 7;
+
+    for (u8 i = 0; i < 4; ++i) {
+        out_ptr = write_hex8(out_ptr, read_memory(pc + i));
+        *out_ptr++ = i < 3 ? ',' : '\n';
+    }
+
+    writer_commit(&g_trace.writer, out_ptr - line_ptr);
+}
+
+static void trace_binary()
+{
+    const struct cpu_registers *registers_ptr = &g_cpu.registers;
+    const u16 pc = registers_ptr->pc;
+    struct trace_record *record_ptr = (struct trace_record *)writer_reserve(
+        &g_trace.writer, sizeof(struct trace_record));
+
+    record_ptr->cycle = timer_get_cycles();
+    record_ptr->pc = pc;
+    record_ptr->bank = cartridge_rom_bank(pc);
+    record_ptr->af = (registers_ptr->a << 8) | registers_ptr->f;
+    record_ptr->bc = (registers_ptr->b << 8) | registers_ptr->c;
+    record_ptr->de = (registers_ptr->d << 8) | registers_ptr->e;
+    record_ptr->hl = (registers_ptr->h << 8) | registers_ptr->l;
+    record_ptr->sp = registers_ptr->sp;
+    record_ptr->bytes[0] = read_memory(pc);
+    record_ptr->bytes[1] = read_memory(pc + 1);
+    record_ptr->bytes[2] = read_memory(pc + 2);
+    record_ptr->ime = interrupt_get_ime();
+    memset(record_ptr->reserved, 0, sizeof(record_ptr->reserved));
+
+    writer_commit(&g_trace.writer, sizeof(struct trace_record));
+}
+
+void trace_open(const char *path, trace_format format)
+{
+    ASSERT_MSG(format != TRACE_TEXT, "Text traces are written to the logs");
+
+    if (!writer_open(&g_trace.writer, path))
+        FATAL_ERROR("Failed to open trace output '%s': %s", path,
+                    strerror(errno));
+
+    g_trace.format = format;
+    g_trace_enabled = true;
+
+    if (format == TRACE_BINARY) {
+        struct trace_header *header_ptr = (struct trace_header *)writer_reserve(
+            &g_trace.writer, sizeof(struct trace_header));
+        memcpy(header_ptr->magic, TRACE_MAGIC, sizeof(header_ptr->magic));
+        header_ptr->version = TRACE_VERSION;
+        header_ptr->record_size = sizeof(struct trace_record);
+        writer_commit(&g_trace.writer, sizeof(struct trace_header));
+    }
+}
+
+void trace_close()
+{
+    if (!g_trace_enabled)
+        return;
+
+    g_trace_enabled = false;
+    writer_close(&g_trace.writer);
+}
+
+void trace_instruction()
+{
+    switch (g_trace.format) {
+    case TRACE_DOCTOR:
+        trace_doctor();
+        break;
+    case TRACE_BINARY:
+        trace_binary();
+        break;
+
+    default:
+        ASSERT_NOT_REACHED();
+    }
+}
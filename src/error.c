@@ -0,0 +1,31 @@
+#include "utils/error.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static fatal_error_handler g_fatal_error_handler = NULL;
+
+void set_fatal_error_handler(fatal_error_handler handler)
+{
+    g_fatal_error_handler = handler;
+}
+
+void fatal_error(const char *fmt, ...)
+{
+    char reason[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(reason, sizeof(reason), fmt, args);
+    va_end(args);
+
+    log_err("%s", reason);
+
+    // Only called once, the handler may fail too
+    fatal_error_handler handler = g_fatal_error_handler;
+    g_fatal_error_handler = NULL;
+    if (handler)
+        handler(reason);
+
+    exit(1);
+}
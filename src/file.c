@@ -0,0 +1,29 @@
+#include "utils/file.h"
+
+#include <errno.h>
+#include <string.h>
+
+bool write_all(int fd, struct iovec *iov_ptr, int count)
+{
+    while (count) {
+        ssize_t written = writev(fd, iov_ptr, count);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        // Partial write, skip what has already been written
+        while (count && (size_t)written >= iov_ptr[0].iov_len) {
+            written -= iov_ptr[0].iov_len;
+            memmove(iov_ptr, iov_ptr + 1, --count * sizeof(*iov_ptr));
+        }
+        if (count) {
+            iov_ptr[0].iov_base = (u8 *)iov_ptr[0].iov_base + written;
+            iov_ptr[0].iov_len -= written;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,59 @@
+#include "utils/hash.h"
+
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+
+#define ROTL64(x_, n_) (((x_) << (n_)) | ((x_) >> (64 - (n_))))
+
+static inline u64 read64(const u8 *data_ptr)
+{
+    u64 value;
+    memcpy(&value, data_ptr, sizeof(value)); // Unaligned access
+    return value;
+}
+
+static inline u64 round64(u64 acc, u64 lane)
+{
+    acc += lane * PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline u64 avalanche(u64 hash)
+{
+    hash ^= hash >> 37;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+u64 hash64(const void *data_ptr, size_t size)
+{
+    const u8 *bytes_ptr = data_ptr;
+    u64 acc[4] = {PRIME64_1 + PRIME64_2, PRIME64_2, 0, -PRIME64_1};
+    u64 hash;
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        acc[0] = round64(acc[0], read64(bytes_ptr + i));
+        acc[1] = round64(acc[1], read64(bytes_ptr + i + 8));
+        acc[2] = round64(acc[2], read64(bytes_ptr + i + 16));
+        acc[3] = round64(acc[3], read64(bytes_ptr + i + 24));
+    }
+
+    hash = ROTL64(acc[0], 1) + ROTL64(acc[1], 7) + ROTL64(acc[2], 12) +
+           ROTL64(acc[3], 18);
+    hash += size * PRIME64_3;
+
+    for (; i + 8 <= size; i += 8)
+        hash = ROTL64(hash ^ round64(0, read64(bytes_ptr + i)), 27) *
+               PRIME64_1;
+
+    for (; i < size; ++i)
+        hash = ROTL64(hash ^ (bytes_ptr[i] * PRIME64_3), 11) * PRIME64_1;
+
+    return avalanche(hash);
+}
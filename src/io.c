@@ -1,19 +1,37 @@
 #include "io.h"
 
+#include "apu/apu.h"
 #include "cpu/cpu.h"
 #include "cpu/interrupt.h"
+#include "cpu/serial.h"
 #include "cpu/timer.h"
 #include "options.h"
+#include "ppu/ppu.h"
 #include "utils/log.h"
 #include "utils/macro.h"
 
 void write_io(u16 address, u8 data)
 {
+    if (BETWEEN(address, SERIAL_SB, SERIAL_SC)) {
+        write_serial(address, data);
+        return;
+    }
+
     if (BETWEEN(address, TIMER_DIV, TIMER_TAC)) {
         write_timer(address, data);
         return;
     }
 
+    if (BETWEEN(address, PPU_LCDC, PPU_WX)) {
+        write_ppu(address, data);
+        return;
+    }
+
+    if (BETWEEN(address, APU_NR10, APU_WAVE_END)) {
+        write_apu(address, data);
+        return;
+    }
+
     switch (address) {
     case IF_ADDRESS:
         write_interrupt(IF_ADDRESS, data);
@@ -27,10 +45,22 @@ void write_io(u16 address, u8 data)
 
 u8 read_io(u16 address)
 {
+    if (BETWEEN(address, SERIAL_SB, SERIAL_SC)) {
+        return read_serial(address);
+    }
+
     if (BETWEEN(address, TIMER_DIV, TIMER_TAC)) {
         return read_timer(address);
     }
 
+    if (BETWEEN(address, PPU_LCDC, PPU_WX)) {
+        return read_ppu(address);
+    }
+
+    if (BETWEEN(address, APU_NR10, APU_WAVE_END)) {
+        return read_apu(address);
+    }
+
     switch (address) {
     case IF_ADDRESS:
         return read_interrupt(IF_ADDRESS);
@@ -0,0 +1,392 @@
+#include "link.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu/serial.h"
+#include "cpu/timer.h"
+#include "utils/error.h"
+#include "utils/log.h"
+#include "utils/macro.h"
+
+/// Messages inside each queue (power of 2), at most 2 are in flight
+#define QUEUE_SIZE 16
+
+#define CACHE_LINE 64
+
+/// Iterations of the wait loops between two checks of the other side
+#define CHECK_PERIOD 256
+/// Stop waiting for the other side if its clock did not move for 1s
+#define STALL_TIMEOUT_NS 1000000000ULL
+
+/// Maximum advance of one side over the other. A transfer is announced when
+/// it starts, the other side must receive it before the transfer ends: this
+/// leaves SERIAL_BIT_CYCLES for the polling period of the receiver.
+#define LOCKSTEP_CYCLES (SERIAL_TRANSFER_CYCLES / 2)
+
+/// Type of the messages
+typedef enum link_message_type {
+    LINK_TRANSFER = 1, ///< Transfer started by the side driving it
+    LINK_REPLY,        ///< Byte sent back by the other side
+} link_message_type;
+
+struct link_message {
+    u64 time; ///< Cycle of the cable's clock at which the message was sent
+    u8 type;
+    u8 data;
+};
+
+// Written by one side, read by the other
+struct link_queue {
+    u64 time __attribute__((aligned(CACHE_LINE))); ///< Clock of the sender
+    u32 head __attribute__((aligned(CACHE_LINE))); ///< Written by the sender
+    u32 tail __attribute__((aligned(CACHE_LINE))); ///< Written by the receiver
+    struct link_message messages[QUEUE_SIZE];
+};
+
+// Content of the shared file
+struct link_cable {
+    pid_t owners[2]; ///< Process plugged into each side, 0 if free
+    struct link_queue queues[2];
+};
+
+static struct link {
+    int fd;
+    struct link_cable *cable_ptr;
+    u8 side;
+    struct link_queue *out_ptr;
+    struct link_queue *in_ptr;
+    u64 offset; ///< From our machine cycles to the cable's clock
+
+    bool started; ///< Our transfer was announced to the other side
+    bool replied;
+    u8 reply;
+
+    bool pending; ///< The other side drives a transfer
+    u8 pending_data;
+    u64 pending_time; ///< End of the transfer, on the cable's clock
+
+    bool stalled; ///< The other side stopped at stalled_time
+    u64 stalled_time;
+    u64 wait_time; ///< Clock of the other side when it last moved
+    u64 wait_start_ns;
+
+    struct link_stats stats;
+} g_link = {
+    .fd = -1,
+};
+
+static u64 now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+// A process killed without unplugging itself (SIGKILL, crash) leaves its pid
+static bool owner_alive(pid_t pid)
+{
+    return pid && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static bool peer_plugged()
+{
+    return owner_alive(__atomic_load_n(
+        &g_link.cable_ptr->owners[!g_link.side], __ATOMIC_ACQUIRE));
+}
+
+// Both sides count the machine cycles since the first one was plugged
+static u64 link_time(void)
+{
+    return timer_get_cycles() + g_link.offset;
+}
+
+static u64 peer_time(void)
+{
+    return __atomic_load_n(&g_link.in_ptr->time, __ATOMIC_ACQUIRE);
+}
+
+static void publish(u64 time)
+{
+    __atomic_store_n(&g_link.out_ptr->time, time, __ATOMIC_RELEASE);
+}
+
+static void push(link_message_type type, u8 data, u64 time)
+{
+    struct link_queue *queue_ptr = g_link.out_ptr;
+    const u32 head = queue_ptr->head;
+
+    // Each side waits for the reply before sending another transfer
+    ASSERT_MSG(head - __atomic_load_n(&queue_ptr->tail, __ATOMIC_ACQUIRE) <
+                   QUEUE_SIZE,
+               "Link cable queue overflow");
+
+    queue_ptr->messages[head % QUEUE_SIZE] = (struct link_message){
+        .time = time,
+        .type = type,
+        .data = data,
+    };
+    __atomic_store_n(&queue_ptr->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static bool pop(struct link_message *message_ptr)
+{
+    struct link_queue *queue_ptr = g_link.in_ptr;
+    const u32 tail = queue_ptr->tail;
+
+    if (__atomic_load_n(&queue_ptr->head, __ATOMIC_ACQUIRE) == tail)
+        return false;
+
+    *message_ptr = queue_ptr->messages[tail % QUEUE_SIZE];
+    __atomic_store_n(&queue_ptr->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Read the messages of the other side. The transfers it drives use our
+// serial port's external clock, they are answered once our clock reaches
+// their end.
+static void receive(u64 now)
+{
+    struct link_message message;
+
+    while (pop(&message)) {
+        switch ((link_message_type)message.type) {
+        case LINK_TRANSFER:
+            g_link.pending = true;
+            g_link.pending_data = message.data;
+            g_link.pending_time = message.time + SERIAL_TRANSFER_CYCLES;
+            break;
+        case LINK_REPLY:
+            g_link.replied = true;
+            g_link.reply = message.data;
+            break;
+        }
+    }
+
+    if (g_link.pending && g_link.pending_time <= now) {
+        g_link.pending = false;
+        push(LINK_REPLY, serial_receive(g_link.pending_data),
+             g_link.pending_time);
+        g_link.stats.received_bytes += 1;
+    }
+}
+
+// The other side is plugged and its clock moves
+static bool peer_running(void)
+{
+    if (!peer_plugged())
+        return false;
+    if (g_link.stalled && peer_time() == g_link.stalled_time)
+        return false;
+
+    g_link.stalled = false;
+    return true;
+}
+
+static void begin_wait(void)
+{
+    g_link.wait_time = peer_time();
+    g_link.wait_start_ns = now_ns();
+}
+
+// Called by the wait loops, false once the other side is gone or stuck
+static bool keep_waiting(u32 spins)
+{
+    sched_yield();
+
+    if (spins % CHECK_PERIOD)
+        return true;
+    if (!peer_plugged())
+        return false;
+
+    const u64 time = peer_time();
+    if (time != g_link.wait_time) {
+        begin_wait();
+        return true;
+    }
+
+    if (now_ns() - g_link.wait_start_ns < STALL_TIMEOUT_NS)
+        return true;
+
+    log_warn("Link cable: the other side is not running anymore");
+    g_link.stalled = true;
+    g_link.stalled_time = time;
+    return false;
+}
+
+// Do not run ahead of the other side by more than LOCKSTEP_CYCLES
+static void lockstep(u64 now)
+{
+    publish(now);
+
+    if (!peer_running())
+        return;
+
+    begin_wait();
+    for (u32 spins = 1; peer_time() + LOCKSTEP_CYCLES < now; ++spins) {
+        receive(now);
+        if (!keep_waiting(spins))
+            return;
+    }
+}
+
+static void link_start(u8 data)
+{
+    const u64 now = link_time();
+
+    g_link.replied = false;
+    g_link.started = peer_running();
+    if (!g_link.started)
+        return;
+
+    // Sent before our clock moves past the start of the transfer
+    push(LINK_TRANSFER, data, now);
+    g_link.stats.sent_bytes += 1;
+}
+
+static u8 link_exchange(u8 data)
+{
+    const u64 now = link_time();
+
+    // The byte was sent when the transfer started
+    (void)data;
+
+    if (!g_link.started)
+        return 0xFF;
+    g_link.started = false;
+
+    // The other side answers once its clock reaches ours
+    receive(now);
+    if (!g_link.replied && peer_running()) {
+        publish(now);
+        begin_wait();
+        for (u32 spins = 1; keep_waiting(spins); ++spins) {
+            receive(now);
+            if (g_link.replied)
+                break;
+        }
+    }
+
+    // Sent right before the other side unplugged
+    receive(now);
+    return g_link.replied ? g_link.reply : 0xFF;
+}
+
+static u16 link_poll(void)
+{
+    const u64 now = link_time();
+
+    receive(now);
+    lockstep(now);
+
+    // Answer the transfer of the other side at the exact cycle it ends
+    if (g_link.pending && g_link.pending_time > now)
+        return MIN(g_link.pending_time - now, SERIAL_BIT_CYCLES);
+    return SERIAL_BIT_CYCLES;
+}
+
+static const struct serial_link g_serial_link = {
+    .start = link_start,
+    .exchange = link_exchange,
+    .poll = link_poll,
+};
+
+void link_open(const char *path)
+{
+    g_link.fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (g_link.fd < 0)
+        FATAL_ERROR("Failed to open link cable '%s': %s", path,
+                    strerror(errno));
+
+    // Both sides may create the file at the same time. A new file is zeroed,
+    // an existing one keeps the state of its last users (see below).
+    if (ftruncate(g_link.fd, sizeof(struct link_cable)) < 0)
+        FATAL_ERROR("Failed to resize link cable '%s': %s", path,
+                    strerror(errno));
+
+    g_link.cable_ptr = mmap(NULL, sizeof(struct link_cable),
+                            PROT_READ | PROT_WRITE, MAP_SHARED, g_link.fd, 0);
+    if (g_link.cable_ptr == MAP_FAILED)
+        FATAL_ERROR("Failed to map link cable '%s': %s", path,
+                    strerror(errno));
+
+    // Take the first free end of the cable, or one whose owner is dead
+    const pid_t pid = getpid();
+    pid_t *owners = g_link.cable_ptr->owners;
+    u8 side = 0;
+    pid_t owner;
+
+    while (true) {
+        owner = __atomic_load_n(&owners[side], __ATOMIC_ACQUIRE);
+        if (!owner_alive(owner) &&
+            __atomic_compare_exchange_n(&owners[side], &owner, pid, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            break;
+        if (++side == 2)
+            FATAL_ERROR("Link cable '%s' is already in use", path);
+    }
+
+    g_link.side = side;
+    g_link.out_ptr = &g_link.cable_ptr->queues[side];
+    g_link.in_ptr = &g_link.cable_ptr->queues[!side];
+
+    // Drop what the previous user of this end had sent
+    __atomic_store_n(&g_link.out_ptr->head,
+                     __atomic_load_n(&g_link.out_ptr->tail, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+
+    // Unplug the other end if its owner died, and drop what it had sent
+    owner = __atomic_load_n(&owners[!side], __ATOMIC_ACQUIRE);
+    if (owner && !owner_alive(owner) &&
+        __atomic_compare_exchange_n(&owners[!side], &owner, 0, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        __atomic_store_n(&g_link.in_ptr->tail,
+                         __atomic_load_n(&g_link.in_ptr->head,
+                                         __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELEASE);
+
+    g_link.started = false;
+    g_link.pending = false;
+    g_link.stalled = false;
+
+    // Join the clock of the other side if it is already running
+    g_link.offset = 0;
+    if (peer_plugged())
+        g_link.offset = peer_time() - timer_get_cycles();
+    publish(link_time());
+
+    log_info("Link cable: plugged into side %u", g_link.side);
+
+    serial_set_link(&g_serial_link);
+}
+
+void link_close()
+{
+    if (g_link.fd < 0)
+        return;
+
+    serial_set_link(NULL);
+
+    __atomic_store_n(&g_link.cable_ptr->owners[g_link.side], 0,
+                     __ATOMIC_RELEASE);
+
+    munmap(g_link.cable_ptr, sizeof(struct link_cable));
+    close(g_link.fd);
+    g_link.fd = -1;
+}
+
+bool link_connected()
+{
+    return g_link.fd >= 0 && peer_plugged();
+}
+
+struct link_stats link_get_stats()
+{
+    return g_link.stats;
+}
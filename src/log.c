@@ -1,15 +1,29 @@
 #include "utils/log.h"
 
-#define _GNU_SOURCE // needed for asprintf
-
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "options.h"
+#include "utils/macro.h"
+#include "utils/timing.h"
+#include "utils/types.h"
 
 #define COLOR_RESET "\033[0m"
 
+/// Size of the ring buffer of each thread, must be a power of 2
+#define RING_SIZE (1 << 18)
+
+/// Maximum size of the arguments of a message, long strings are truncated
+#define ARGS_SIZE 512
+
+/// Maximum size of a formatted message
+#define LINE_SIZE 1024
+
+#define ALIGN(size_) (((size_) + 7) & ~(size_t)7)
+
 const char *g_level_colors[] = {
     [LOG_INFO] = "\033[1;34m",    // cyan
     [LOG_TRACE] = "\033[1;30m",   // dark grey
@@ -17,44 +31,853 @@ const char *g_level_colors[] = {
     [LOG_ERROR] = "\033[1;31m",   // red
 };
 
-void log_print(log_level level, const char *fmt, ...)
+unsigned g_log_mask =
+    (1U << LOG_INFO) | (1U << LOG_WARNING) | (1U << LOG_ERROR);
+
+typedef enum record_kind {
+    RECORD_MESSAGE,
+    RECORD_PADDING, ///< Skip until the end of the buffer
+} record_kind;
+
+/// Header of the records, followed by the arguments of the message
+struct record {
+    u32 size; ///< Including the header and the arguments, aligned
+    u8 kind;
+    u8 level;
+    u64 sequence; ///< Order of the messages between the threads
+    const char *color;
+    const char *fmt;
+};
+
+/// Written by a single thread, read by the logging thread
+struct ring {
+    u8 *buffer;
+    u64 head;
+    u64 tail;
+    struct ring *next;
+};
+
+typedef enum logger_state {
+    LOGGER_IDLE,    ///< Started on the first message
+    LOGGER_RUNNING, ///< Messages are written by the logging thread
+    LOGGER_STOPPED, ///< Messages are written synchronously
+} logger_state;
+
+static struct logger {
+    logger_state state;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool sleeping;
+    bool stopping;
+    u64 sequence;
+    struct ring *rings; ///< Only ever grows, protected by lock
+} g_logger = {
+    .state = LOGGER_IDLE,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread struct ring *g_ring = NULL;
+
+void log_set_level(log_level level, bool traces)
 {
-    const struct options *opt_ptr = get_options();
+    unsigned mask = 0;
+
+    for (log_level i = LOG_INFO; i <= LOG_ERROR; ++i)
+        if (i != LOG_TRACE && i >= level)
+            mask |= 1U << i;
+    if (traces)
+        mask |= 1U << LOG_TRACE;
+
+    g_log_mask = mask;
+}
+
+#pragma region format
+
+/// Arguments types, as read by va_arg
+typedef enum argument_type {
+    ARG_NONE, ///< "%%"
+    ARG_INT,
+    ARG_LONG,
+    ARG_LONG_LONG,
+    ARG_SIZE,
+    ARG_DOUBLE,
+    ARG_LONG_DOUBLE,
+    ARG_STRING,
+    ARG_POINTER,
+} argument_type;
+
+/// A single conversion specification ("%-08.3lx")
+struct conversion {
+    const char *start;
+    size_t length;
+    bool left;   ///< '-' flag
+    bool zero;   ///< '0' flag
+    bool simple; ///< No '+', ' ' or '#' flag
+    bool star_width;
+    bool star_precision;
+    int width;     ///< -1 if none
+    int precision; ///< -1 if none
+    int shorts;    ///< Number of 'h' length modifiers
+    argument_type type;
+    char specifier;
+};
+
+static int read_number(const char **ptr)
+{
+    int number = 0;
+
+    while (**ptr >= '0' && **ptr <= '9') {
+        number = number * 10 + (**ptr - '0');
+        *ptr += 1;
+    }
 
-    // Don't output if the importance level is lower than the one requested
-    // Except if expecially specified (traces)
-    if (level == LOG_TRACE) {
-        if (!get_options()->trace)
-            return;
-    } else if (level < opt_ptr->log_level) {
+    return number;
+}
+
+// Find the next conversion, return the text preceding it (up to the end)
+static size_t next_conversion(const char *fmt, struct conversion *conv_ptr)
+{
+    const char *percent = strchr(fmt, '%');
+
+    if (!percent) {
+        conv_ptr->start = NULL;
+        return strlen(fmt);
+    }
+
+    const char *ptr = percent + 1;
+    conv_ptr->start = percent;
+    conv_ptr->left = false;
+    conv_ptr->zero = false;
+    conv_ptr->simple = true;
+    conv_ptr->star_width = false;
+    conv_ptr->star_precision = false;
+    conv_ptr->width = -1;
+    conv_ptr->precision = -1;
+    conv_ptr->shorts = 0;
+
+    for (; *ptr && strchr("-+ #0", *ptr); ++ptr) {
+        conv_ptr->left |= *ptr == '-';
+        conv_ptr->zero |= *ptr == '0';
+        conv_ptr->simple &= *ptr == '-' || *ptr == '0';
+    }
+
+    if (*ptr == '*') {
+        conv_ptr->star_width = true;
+        ptr += 1;
+    } else if (*ptr >= '0' && *ptr <= '9') {
+        conv_ptr->width = read_number(&ptr);
+    }
+
+    if (*ptr == '.') {
+        ptr += 1;
+        if (*ptr == '*') {
+            conv_ptr->star_precision = true;
+            ptr += 1;
+        } else {
+            conv_ptr->precision = read_number(&ptr);
+        }
+    }
+
+    int longs = 0;
+    bool size = false;
+    bool long_double = false;
+    for (; strchr("hlLzjt", *ptr) && *ptr; ++ptr) {
+        longs += *ptr == 'l';
+        conv_ptr->shorts += *ptr == 'h';
+        size |= *ptr == 'z' || *ptr == 'j' || *ptr == 't';
+        long_double |= *ptr == 'L';
+    }
+
+    conv_ptr->specifier = *ptr;
+    switch (*ptr) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        conv_ptr->type = size         ? ARG_SIZE
+                       : longs >= 2   ? ARG_LONG_LONG
+                       : longs == 1   ? ARG_LONG
+                                      : ARG_INT;
+        break;
+    case 'c':
+        conv_ptr->type = ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        conv_ptr->type = long_double ? ARG_LONG_DOUBLE : ARG_DOUBLE;
+        break;
+    case 's':
+        conv_ptr->type = ARG_STRING;
+        break;
+    case 'p':
+    case 'n':
+        conv_ptr->type = ARG_POINTER;
+        break;
+    default: // "%%", or an invalid conversion written as is
+        conv_ptr->type = ARG_NONE;
+        break;
+    }
+
+    conv_ptr->length = (*ptr ? ptr + 1 : ptr) - percent;
+    return percent - fmt;
+}
+
+struct arguments {
+    u8 *data;
+    size_t size;
+    size_t used;
+    bool full; ///< The remaining arguments are not copied
+};
+
+static void push_argument(struct arguments *args_ptr, const void *value,
+                          size_t size)
+{
+    if (args_ptr->full || args_ptr->used + ALIGN(size) > args_ptr->size) {
+        args_ptr->full = true;
         return;
     }
 
+    memcpy(args_ptr->data + args_ptr->used, value, size);
+    args_ptr->used += ALIGN(size);
+}
+
+static void push_string(struct arguments *args_ptr, const char *string,
+                        int precision)
+{
+    if (!string)
+        string = "(null)";
+
+    const size_t left = args_ptr->size - args_ptr->used;
+    const size_t max = precision < 0 ? SIZE_MAX : (size_t)precision;
+    size_t length = strnlen(string, max);
+
+    if (args_ptr->full || left < 8) {
+        args_ptr->full = true;
+        return;
+    }
+
+    length = MIN(length, left - 1);
+    memcpy(args_ptr->data + args_ptr->used, string, length);
+    args_ptr->data[args_ptr->used + length] = '\0';
+    args_ptr->used += ALIGN(length + 1);
+}
+
+// Copy the arguments, following the conversions of the format string
+static size_t copy_arguments(const char *fmt, va_list args, u8 *data,
+                             size_t size)
+{
+    struct arguments arguments = {data, size, 0, false};
+    struct conversion conv;
+
+    while (fmt += next_conversion(fmt, &conv), conv.start) {
+        fmt += conv.length;
+
+        int precision = -1;
+        if (conv.star_width) {
+            const int width = va_arg(args, int);
+            push_argument(&arguments, &width, sizeof(width));
+        }
+        if (conv.star_precision) {
+            precision = va_arg(args, int);
+            push_argument(&arguments, &precision, sizeof(precision));
+        }
+
+        switch (conv.type) {
+        case ARG_NONE:
+            break;
+        case ARG_INT: {
+            const int value = va_arg(args, int);
+            push_argument(&arguments, &value, sizeof(value));
+            break;
+        }
+        case ARG_LONG: {
+            const long value = va_arg(args, long);
+            push_argument(&arguments, &value, sizeof(value));
+            break;
+        }
+        case ARG_LONG_LONG: {
+            const long long value = va_arg(args, long long);
+            push_argument(&arguments, &value, sizeof(value));
+            break;
+        }
+        case ARG_SIZE: {
+            const size_t value = va_arg(args, size_t);
+            push_argument(&arguments, &value, sizeof(value));
+            break;
+        }
+        case ARG_DOUBLE: {
+            const double value = va_arg(args, double);
+            push_argument(&arguments, &value, sizeof(value));
+            break;
+        }
+        case ARG_LONG_DOUBLE: {
+            const long double value = va_arg(args, long double);
+            push_argument(&arguments, &value, sizeof(value));
+            break;
+        }
+        case ARG_STRING:
+            push_string(&arguments, va_arg(args, const char *), precision);
+            break;
+        case ARG_POINTER: {
+            const void *value = va_arg(args, void *);
+            push_argument(&arguments, &value, sizeof(value));
+            break;
+        }
+        }
+    }
+
+    return arguments.used;
+}
+
+// Read back an argument written by push_argument
+#define POP_ARGUMENT(type_, data_ptr_)                \
+    ({                                                \
+        type_ value_;                                 \
+        memcpy(&value_, (data_ptr_), sizeof(value_)); \
+        (data_ptr_) += ALIGN(sizeof(value_));         \
+        value_;                                       \
+    })
+
+// Format a single conversion, with 0 to 2 leading integers (width and
+// precision)
+#define FORMAT_CONVERSION(out_, size_, spec_, stars_, star_values_, value_) \
+    ((stars_) == 0   ? snprintf((out_), (size_), (spec_), (value_))         \
+     : (stars_) == 1 ? snprintf((out_), (size_), (spec_),                   \
+                                (star_values_)[0], (value_))                \
+                     : snprintf((out_), (size_), (spec_),                   \
+                                (star_values_)[0], (star_values_)[1],       \
+                                (value_)))
+
+/// A formatted message, truncated once full
+struct line {
+    char *data;
+    size_t size;
+    size_t used;
+};
+
+static void line_append(struct line *line_ptr, const char *string,
+                        size_t length)
+{
+    length = MIN(length, line_ptr->size - line_ptr->used);
+    memcpy(line_ptr->data + line_ptr->used, string, length);
+    line_ptr->used += length;
+}
+
+static void line_fill(struct line *line_ptr, char c, int count)
+{
+    const size_t length =
+        MIN((size_t)MAX(count, 0), line_ptr->size - line_ptr->used);
+    memset(line_ptr->data + line_ptr->used, c, length);
+    line_ptr->used += length;
+}
+
+// Append a padded string, the precision has already been applied
+static void line_pad(struct line *line_ptr, const struct conversion *conv_ptr,
+                     int width, const char *string, size_t length)
+{
+    const int padding = width - (int)length;
+
+    if (!conv_ptr->left)
+        line_fill(line_ptr, ' ', padding);
+    line_append(line_ptr, string, length);
+    if (conv_ptr->left)
+        line_fill(line_ptr, ' ', padding);
+}
+
+// The integer conversions without the '+', ' ' and '#' flags, which are the
+// vast majority of the messages, are formatted without going through printf
+static void line_integer(struct line *line_ptr,
+                         const struct conversion *conv_ptr, int width,
+                         int precision, long long value)
+{
+    const bool is_signed =
+        conv_ptr->specifier == 'd' || conv_ptr->specifier == 'i';
+    const unsigned base = is_signed || conv_ptr->specifier == 'u' ? 10 : 16;
+    const char *digits = conv_ptr->specifier == 'X' ? "0123456789ABCDEF"
+                                                    : "0123456789abcdef";
+    bool negative = false;
+
+    // Apply the length modifier, as va_arg would have
+    if (conv_ptr->shorts == 1)
+        value = is_signed ? (short)value : (unsigned short)value;
+    else if (conv_ptr->shorts >= 2)
+        value = is_signed ? (signed char)value : (unsigned char)value;
+    else if (conv_ptr->type == ARG_INT && !is_signed)
+        value = (unsigned)value;
+    unsigned long long magnitude = value;
+
+    if (is_signed && value < 0) {
+        negative = true;
+        magnitude = -(unsigned long long)value;
+    }
+
+    char buffer[24];
+    int length = 0;
+    while (magnitude) {
+        buffer[sizeof(buffer) - ++length] = digits[magnitude % base];
+        magnitude /= base;
+    }
+
+    // Zero is written with no digit when the precision is 0
+    const int nb_digits = MAX(length, precision < 0 ? 1 : precision);
+    const int padding = width - nb_digits - negative;
+    const bool zeros = conv_ptr->zero && !conv_ptr->left && precision < 0;
+
+    if (!conv_ptr->left && !zeros)
+        line_fill(line_ptr, ' ', padding);
+    if (negative)
+        line_append(line_ptr, "-", 1);
+    if (zeros)
+        line_fill(line_ptr, '0', padding);
+    line_fill(line_ptr, '0', nb_digits - length);
+    line_append(line_ptr, buffer + sizeof(buffer) - length, length);
+    if (conv_ptr->left)
+        line_fill(line_ptr, ' ', padding);
+}
+
+static bool is_integer(char specifier)
+{
+    return specifier == 'd' || specifier == 'i' || specifier == 'u' ||
+           specifier == 'x' || specifier == 'X';
+}
+
+static size_t format_message(const struct record *record_ptr, char *data,
+                             size_t size)
+{
+    const u8 *data_ptr = (const u8 *)(record_ptr + 1);
+    const u8 *end_ptr = (const u8 *)record_ptr + record_ptr->size;
+    const char *fmt = record_ptr->fmt;
+    struct conversion conv;
+
+    // Leave room for the new line
+    struct line line = {data, size - 1, 0};
+
+    while (line.used < line.size) {
+        const size_t text = next_conversion(fmt, &conv);
+
+        line_append(&line, fmt, text);
+        fmt += text;
+
+        if (!conv.start)
+            break;
+        fmt += conv.length;
+
+        // Some arguments were not copied
+        if (data_ptr >= end_ptr && conv.type != ARG_NONE)
+            break;
+
+        int stars[2] = {0};
+        const int nb_stars = conv.star_width + conv.star_precision;
+        for (int i = 0; i < nb_stars; ++i)
+            stars[i] = POP_ARGUMENT(int, data_ptr);
+
+        int width = conv.star_width ? stars[0] : conv.width;
+        int precision = conv.star_precision ? stars[nb_stars - 1]
+                                            : conv.precision;
+        if (conv.star_width && width < 0) {
+            conv.left = true;
+            width = -width;
+        }
+        precision = MAX(precision, -1);
+
+        if (conv.simple && is_integer(conv.specifier)) {
+            long long value;
+            switch (conv.type) {
+            case ARG_INT:
+                value = POP_ARGUMENT(int, data_ptr);
+                break;
+            case ARG_LONG:
+                value = POP_ARGUMENT(long, data_ptr);
+                break;
+            default:
+                value = POP_ARGUMENT(long long, data_ptr);
+                break;
+            }
+            line_integer(&line, &conv, width, precision, value);
+            continue;
+        }
+
+        if (conv.simple && conv.type == ARG_STRING) {
+            const char *string = (const char *)data_ptr;
+            const size_t length = strlen(string);
+            data_ptr += ALIGN(length + 1);
+            line_pad(&line, &conv, width, string,
+                     precision < 0 ? length : MIN(length, (size_t)precision));
+            continue;
+        }
+
+        if (conv.simple && conv.specifier == 'c') {
+            const char c = POP_ARGUMENT(int, data_ptr);
+            line_pad(&line, &conv, width, &c, 1);
+            continue;
+        }
+
+        // Rare conversions go through printf
+        char spec[32];
+        snprintf(spec, sizeof(spec), "%.*s", (int)MIN(conv.length, 31),
+                 conv.start);
+
+        char *out = line.data + line.used;
+        const size_t left = line.size - line.used + 1;
+        int written = 0;
+
+        switch (conv.type) {
+        case ARG_NONE:
+            written = snprintf(out, left, "%s",
+                               conv.specifier == '%' ? "%" : spec);
+            break;
+        case ARG_INT:
+            written = FORMAT_CONVERSION(out, left, spec, nb_stars, stars,
+                                        POP_ARGUMENT(int, data_ptr));
+            break;
+        case ARG_LONG:
+            written = FORMAT_CONVERSION(out, left, spec, nb_stars, stars,
+                                        POP_ARGUMENT(long, data_ptr));
+            break;
+        case ARG_LONG_LONG:
+            written = FORMAT_CONVERSION(out, left, spec, nb_stars, stars,
+                                        POP_ARGUMENT(long long, data_ptr));
+            break;
+        case ARG_SIZE:
+            written = FORMAT_CONVERSION(out, left, spec, nb_stars, stars,
+                                        POP_ARGUMENT(size_t, data_ptr));
+            break;
+        case ARG_DOUBLE:
+            written = FORMAT_CONVERSION(out, left, spec, nb_stars, stars,
+                                        POP_ARGUMENT(double, data_ptr));
+            break;
+        case ARG_LONG_DOUBLE:
+            written = FORMAT_CONVERSION(out, left, spec, nb_stars, stars,
+                                        POP_ARGUMENT(long double, data_ptr));
+            break;
+        case ARG_STRING: {
+            const char *string = (const char *)data_ptr;
+            data_ptr += ALIGN(strlen(string) + 1);
+            written = FORMAT_CONVERSION(out, left, spec, nb_stars, stars,
+                                        string);
+            break;
+        }
+        case ARG_POINTER: {
+            const void *pointer = POP_ARGUMENT(void *, data_ptr);
+            // The address of "%n" does not exist anymore
+            if (conv.specifier != 'n')
+                written = FORMAT_CONVERSION(out, left, spec, nb_stars, stars,
+                                            pointer);
+            break;
+        }
+        }
+
+        line.used += MIN((size_t)MAX(written, 0), line.size - line.used);
+    }
+
+    line.data[line.used] = '\n';
+    return line.used + 1;
+}
+
+#ifdef UNIT_TEST
+// Format a message the same way as the logging thread, including the new line
+size_t log_format(char *data, size_t size, const char *fmt, ...)
+{
+    u8 buffer[sizeof(struct record) + ARGS_SIZE] __attribute__((aligned(8)));
+    struct record *record_ptr = (struct record *)buffer;
     va_list args;
+
     va_start(args, fmt);
+    record_ptr->size = sizeof(struct record) +
+                       copy_arguments(fmt, args, (u8 *)(record_ptr + 1),
+                                      ARGS_SIZE);
+    va_end(args);
+    record_ptr->fmt = fmt;
 
-    FILE *stream_ptr = (level) >= LOG_WARNING ? stderr : stdout;
+    return format_message(record_ptr, data, size);
+}
+#endif
+
+#pragma endregion format
 
-    char *log_ptr = NULL;
-    asprintf(&log_ptr, "%s| %s%s\n", g_level_colors[level], COLOR_RESET, fmt);
+#pragma region logging_thread
+
+static void write_record(const struct record *record_ptr)
+{
+    FILE *stream_ptr = record_ptr->level >= LOG_WARNING ? stderr : stdout;
+    char line[LINE_SIZE];
 
-    vfprintf(stream_ptr, log_ptr, args);
-    free(log_ptr);
+    const size_t length = format_message(record_ptr, line, sizeof(line));
+    fprintf(stream_ptr, "%s| %s%.*s", record_ptr->color, COLOR_RESET,
+            (int)length, line);
 }
 
-void log_color(const char *color, const char *fmt, ...)
+// The next record of a ring, NULL if it is empty
+static const struct record *peek_record(struct ring *ring_ptr)
 {
-    // Don't output if the importance level is lower than the one requested.
-    // As the level is not specified, default to LOG_INFO
-    if (get_options()->log_level > LOG_INFO)
+    while (true) {
+        const u64 head = __atomic_load_n(&ring_ptr->head, __ATOMIC_ACQUIRE);
+        if (head == ring_ptr->tail)
+            return NULL;
+
+        const struct record *record_ptr =
+            (const struct record *)(ring_ptr->buffer +
+                                    (ring_ptr->tail & (RING_SIZE - 1)));
+        if (record_ptr->kind == RECORD_MESSAGE)
+            return record_ptr;
+
+        __atomic_store_n(&ring_ptr->tail, ring_ptr->tail + record_ptr->size,
+                         __ATOMIC_RELEASE);
+    }
+}
+
+// Write the oldest message of all threads, return false if there are none
+static bool write_next_record(void)
+{
+    struct ring *oldest_ptr = NULL;
+    const struct record *oldest_record_ptr = NULL;
+    struct ring *rings = __atomic_load_n(&g_logger.rings, __ATOMIC_ACQUIRE);
+
+    for (struct ring *ring_ptr = rings; ring_ptr; ring_ptr = ring_ptr->next) {
+        const struct record *record_ptr = peek_record(ring_ptr);
+        if (!record_ptr)
+            continue;
+        if (!oldest_record_ptr ||
+            record_ptr->sequence < oldest_record_ptr->sequence) {
+            oldest_ptr = ring_ptr;
+            oldest_record_ptr = record_ptr;
+        }
+    }
+
+    if (!oldest_ptr)
+        return false;
+
+    write_record(oldest_record_ptr);
+    __atomic_store_n(&oldest_ptr->tail,
+                     oldest_ptr->tail + oldest_record_ptr->size,
+                     __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool rings_empty(void)
+{
+    struct ring *rings = __atomic_load_n(&g_logger.rings, __ATOMIC_ACQUIRE);
+
+    for (struct ring *ring_ptr = rings; ring_ptr; ring_ptr = ring_ptr->next)
+        if (__atomic_load_n(&ring_ptr->head, __ATOMIC_SEQ_CST) !=
+            __atomic_load_n(&ring_ptr->tail, __ATOMIC_ACQUIRE))
+            return false;
+
+    return true;
+}
+
+static void *logging_loop(void *arg)
+{
+    (void)arg;
+
+    while (true) {
+        if (write_next_record())
+            continue;
+
+        fflush(stdout);
+        fflush(stderr);
+
+        pthread_mutex_lock(&g_logger.lock);
+        __atomic_store_n(&g_logger.sleeping, true, __ATOMIC_SEQ_CST);
+        if (rings_empty() && !g_logger.stopping)
+            pthread_cond_wait(&g_logger.wake, &g_logger.lock);
+        __atomic_store_n(&g_logger.sleeping, false, __ATOMIC_RELAXED);
+        const bool stopping = g_logger.stopping;
+        pthread_mutex_unlock(&g_logger.lock);
+
+        if (stopping && rings_empty())
+            break;
+    }
+
+    return NULL;
+}
+
+static void wake_logger(void)
+{
+    if (__atomic_load_n(&g_logger.sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&g_logger.lock);
+        pthread_cond_signal(&g_logger.wake);
+        pthread_mutex_unlock(&g_logger.lock);
+    }
+}
+
+// Write the pending messages before forking, so that they are not duplicated
+static void before_fork(void)
+{
+    if (g_logger.state != LOGGER_RUNNING)
         return;
 
+    while (!rings_empty()) {
+        wake_logger();
+        sched_yield();
+    }
+}
+
+// The logging thread does not exist inside the child
+static void after_fork_child(void)
+{
+    if (g_logger.state == LOGGER_RUNNING)
+        g_logger.state = LOGGER_STOPPED;
+
+    pthread_mutex_init(&g_logger.lock, NULL);
+    pthread_cond_init(&g_logger.wake, NULL);
+}
+
+static void start_logger(void)
+{
+    pthread_mutex_lock(&g_logger.lock);
+
+    if (g_logger.state == LOGGER_IDLE) {
+        if (pthread_create(&g_logger.thread, NULL, logging_loop, NULL)) {
+            g_logger.state = LOGGER_STOPPED;
+        } else {
+            g_logger.state = LOGGER_RUNNING;
+            pthread_atfork(before_fork, NULL, after_fork_child);
+            atexit(log_stop);
+        }
+    }
+
+    pthread_mutex_unlock(&g_logger.lock);
+}
+
+void log_stop(void)
+{
+    if (g_logger.state != LOGGER_RUNNING)
+        return;
+
+    // The messages logged from now on are written synchronously
+    __atomic_store_n(&g_logger.state, LOGGER_STOPPED, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&g_logger.lock);
+    g_logger.stopping = true;
+    pthread_cond_signal(&g_logger.wake);
+    pthread_mutex_unlock(&g_logger.lock);
+
+    pthread_join(g_logger.thread, NULL);
+
+    // Records queued by a thread that saw the logger running at the last
+    // moment
+    while (write_next_record())
+        ;
+}
+
+#pragma endregion logging_thread
+
+#pragma region producer
+
+static struct ring *get_ring(void)
+{
+    if (g_ring)
+        return g_ring;
+
+    struct ring *ring_ptr = calloc(1, sizeof(*ring_ptr));
+    if (!ring_ptr)
+        return NULL;
+    ring_ptr->buffer = malloc(RING_SIZE);
+    if (!ring_ptr->buffer) {
+        free(ring_ptr);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_logger.lock);
+    ring_ptr->next = g_logger.rings;
+    __atomic_store_n(&g_logger.rings, ring_ptr, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_logger.lock);
+
+    g_ring = ring_ptr;
+    return ring_ptr;
+}
+
+// Find room for a record, NULL if the ring is full
+static struct record *reserve_record(struct ring *ring_ptr, size_t size)
+{
+    const u64 head = ring_ptr->head;
+    const u64 tail = __atomic_load_n(&ring_ptr->tail, __ATOMIC_ACQUIRE);
+    const size_t offset = head & (RING_SIZE - 1);
+    const size_t padding = offset + size > RING_SIZE ? RING_SIZE - offset : 0;
+
+    if (RING_SIZE - (head - tail) < padding + size)
+        return NULL;
+
+    // Records are never split, skip the end of the buffer
+    if (padding) {
+        struct record *padding_ptr =
+            (struct record *)(ring_ptr->buffer + offset);
+        padding_ptr->size = padding;
+        padding_ptr->kind = RECORD_PADDING;
+        __atomic_store_n(&ring_ptr->head, head + padding, __ATOMIC_RELEASE);
+        return (struct record *)ring_ptr->buffer;
+    }
+
+    return (struct record *)(ring_ptr->buffer + offset);
+}
+
+static void print_message(log_level level, const char *color, const char *fmt,
+                          va_list args)
+{
+    FILE *stream_ptr = level >= LOG_WARNING ? stderr : stdout;
+
+    fprintf(stream_ptr, "%s| %s", color, COLOR_RESET);
+    vfprintf(stream_ptr, fmt, args);
+    fputc('\n', stream_ptr);
+}
+
+void log_message(log_level level, const char *color, const char *fmt, ...)
+{
+    TIMING_SCOPE(TIMING_LOG);
+
+    u8 arguments[ARGS_SIZE] __attribute__((aligned(8)));
+    struct ring *ring_ptr = NULL;
     va_list args;
+
+    if (g_logger.state == LOGGER_IDLE)
+        start_logger();
+    if (g_logger.state == LOGGER_RUNNING)
+        ring_ptr = get_ring();
+
     va_start(args, fmt);
 
-    char *log_ptr = NULL;
-    asprintf(&log_ptr, "%s| %s%s\n", color, COLOR_RESET, fmt);
+    if (!ring_ptr) {
+        print_message(level, color, fmt, args);
+        va_end(args);
+        return;
+    }
+
+    const size_t arguments_size =
+        copy_arguments(fmt, args, arguments, sizeof(arguments));
+    va_end(args);
+
+    const size_t size = sizeof(struct record) + arguments_size;
+    struct record *record_ptr;
+
+    // Messages are never dropped, wait for the logging thread to catch up
+    while (!(record_ptr = reserve_record(ring_ptr, size))) {
+        wake_logger();
+        sched_yield();
+    }
+
+    record_ptr->size = size;
+    record_ptr->kind = RECORD_MESSAGE;
+    record_ptr->level = level;
+    record_ptr->sequence =
+        __atomic_fetch_add(&g_logger.sequence, 1, __ATOMIC_RELAXED);
+    record_ptr->color = color;
+    record_ptr->fmt = fmt;
+    memcpy(record_ptr + 1, arguments, arguments_size);
 
-    vfprintf(stdout, log_ptr, args);
-    free(log_ptr);
+    // The record is at the head, after the padding if any
+    __atomic_store_n(&ring_ptr->head, ring_ptr->head + size, __ATOMIC_SEQ_CST);
+    wake_logger();
 }
+
+#pragma endregion producer
@@ -1,39 +1,209 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "apu/apu.h"
+#include "audio_out.h"
+#include "bench.h"
 #include "cartridge/cartridge.h"
 #include "cpu/cpu.h"
 #include "cpu/instruction.h"
 #include "cpu/interrupt.h"
+#include "cpu/profiler.h"
+#include "cpu/recorder.h"
+#include "cpu/serial.h"
+#include "cpu/symbols.h"
 #include "cpu/timer.h"
+#include "cpu/trace.h"
+#include "link.h"
 #include "options.h"
+#include "perf_counters.h"
+#include "ppu/ppu.h"
 #include "test_rom.h"
+#include "utils/instrument.h"
 #include "utils/log.h"
 #include "utils/macro.h"
+#include "utils/timing.h"
+#include "video_out.h"
+
+// Called on exit, the emulation can be stopped from anywhere (FATAL_ERROR)
+static void print_ppu_stats(void)
+{
+    log_info("PPU: %u frames drawn, %u skipped (%u lines), %u lines dropped",
+             g_ppu.stats.rendered_frames, g_ppu.stats.skipped_frames,
+             g_ppu.stats.skipped_lines, g_ppu.stats.dropped_lines);
+}
+
+static void close_audio_out(void)
+{
+    audio_out_close();
+
+    const struct audio_out_stats stats = audio_out_get_stats();
+    log_info("Audio output: %u samples written, %u dropped",
+             stats.written_samples, stats.dropped_samples);
+}
+
+static void close_trace(void)
+{
+    trace_close();
+}
+
+static void stop_profiler(void)
+{
+    profiler_stop();
+}
+
+// rgblink writes the symbols next to the ROM by default
+static void load_symbols(const char *path, const char *rom)
+{
+    char default_path[4096];
+
+    if (path) {
+        if (!symbols_load(path))
+            log_warn("Failed to load the symbols from '%s'", path);
+        return;
+    }
+
+    const char *extension = strrchr(rom, '.');
+    if (!extension || strchr(extension, '/'))
+        extension = rom + strlen(rom);
+
+    snprintf(default_path, sizeof(default_path), "%.*s.sym",
+             (int)(extension - rom), rom);
+    symbols_load(default_path);
+}
+
+static void close_perf_counters(void)
+{
+    perf_counters_close();
+}
+
+static void stop_timing(void)
+{
+    timing_stop();
+}
+
+static void stop_bench(void)
+{
+    bench_stop();
+}
+
+static void stop_test_rom(void)
+{
+    test_rom_stop();
+}
+
+static void close_link(void)
+{
+    link_close();
+
+    const struct link_stats stats = link_get_stats();
+    log_info("Link cable: %u bytes sent, %u received", stats.sent_bytes,
+             stats.received_bytes);
+}
+
+static void close_video_out(void)
+{
+    video_out_close();
+
+    const struct video_out_stats stats = video_out_get_stats();
+    log_info("Video output: %u frames written, %u dropped",
+             stats.written_frames, stats.dropped_frames);
+}
 
 int main(int argc, char **argv)
 {
     const struct options *options_ptr = parse_options(argc, argv);
 
+    // Opened first, the traces may take over the standard output
+    g_trace_text = options_ptr->trace;
+    if (options_ptr->trace_format != TRACE_TEXT) {
+        trace_open(options_ptr->trace_out, options_ptr->trace_format);
+        atexit(close_trace);
+    }
+
     load_cartridge(options_ptr->args[0]);
-    cartridge_info();
+    if (!options_ptr->bench)
+        cartridge_info();
 
     reset_cpu();
     reset_timer();
+    reset_serial();
+    reset_apu();
+
+    if (options_ptr->profile) {
+        load_symbols(options_ptr->symbols, options_ptr->args[0]);
+        profiler_start(options_ptr->profile, options_ptr->profile_period,
+                       options_ptr->profile_top);
+        atexit(stop_profiler);
+    }
+
+    if (options_ptr->blargg) {
+        test_rom_start(options_ptr->stop_on_result);
+        atexit(stop_test_rom);
+    }
+
+    if (options_ptr->link) {
+        link_open(options_ptr->link);
+        atexit(close_link);
+    }
+
+    if (options_ptr->audio_out) {
+        audio_out_open(options_ptr->audio_out, options_ptr->audio_format,
+                       options_ptr->audio_rate, options_ptr->audio_quality);
+        atexit(close_audio_out);
+    }
+
+    ppu_set_engine(options_ptr->ppu_engine);
+    ppu_set_frameskip(options_ptr->frameskip);
+    if (options_ptr->frameskip > 1)
+        atexit(print_ppu_stats);
+
+    if (options_ptr->video_out) {
+        video_out_open(options_ptr->video_out, options_ptr->video_format);
+        atexit(close_video_out);
+    }
+    reset_ppu();
+
+    if (options_ptr->perf_counters &&
+        perf_counters_open(options_ptr->perf_counters,
+                           options_ptr->perf_period))
+        atexit(close_perf_counters);
+
+    // Started last, so that the setup is not measured
+    if (EMUGB_HOST_TIMERS && options_ptr->host_timers &&
+        timing_start(options_ptr->host_timers_csv))
+        atexit(stop_timing);
+
+    // The limits also apply without --bench, only the report is skipped
+    if (options_ptr->bench || options_ptr->bench_cycles ||
+        options_ptr->bench_frames) {
+        bench_start(options_ptr->args[0], options_ptr->bench_cycles,
+                    options_ptr->bench_frames, options_ptr->bench_json);
+        if (options_ptr->bench)
+            atexit(stop_bench);
+    }
+
+    // Armed last, the errors raised by the setup do not need a report
+    recorder_start(options_ptr->crash_report);
 
     while (g_cpu.is_running) {
+        const u16 pc = g_cpu.registers.pc;
+
         if (g_cpu.halt) {
             timer_tick();
         } else {
+            if (EMUGB_INSTRUMENT && g_trace_enabled)
+                trace_instruction();
             execute_instruction();
+            bench_count_instruction();
         }
 
         handle_interrupts();
-
-        if (options_ptr->blargg) {
-            test_rom_update();
-            test_rom_print();
-        }
+        profiler_step(pc);
+        perf_counters_step();
+        bench_step();
     }
 
-    return 0;
+    return test_rom_get_result() == TEST_ROM_FAILED;
 }
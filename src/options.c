@@ -12,15 +12,45 @@
 #include <argp.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "apu/apu.h"
+#include "cpu/profiler.h"
+#include "utils/instrument.h"
+
 inline struct options *get_options(void)
 {
     static struct options options = {
         .log_level = LOG_INFO,
         .trace = false,
+        .trace_format = TRACE_TEXT,
+        .trace_out = NULL,
         .blargg = false,
+        .stop_on_result = false,
         .exit_infinite_loop = false,
+        .link = NULL,
+        .crash_report = NULL,
+        .ppu_engine = PPU_ENGINE_FAST,
+        .frameskip = 0,
+        .video_out = NULL,
+        .video_format = VIDEO_GRAY,
+        .audio_out = NULL,
+        .audio_format = AUDIO_WAV,
+        .audio_rate = APU_SAMPLE_RATE,
+        .audio_quality = RESAMPLER_MEDIUM,
+        .profile = NULL,
+        .profile_period = PROFILER_DEFAULT_PERIOD,
+        .profile_top = PROFILER_DEFAULT_TOP,
+        .symbols = NULL,
+        .host_timers = false,
+        .host_timers_csv = NULL,
+        .perf_counters = NULL,
+        .perf_period = 0,
+        .bench = false,
+        .bench_cycles = 0,
+        .bench_frames = 0,
+        .bench_json = NULL,
     };
 
     return &options;
@@ -28,6 +58,32 @@ inline struct options *get_options(void)
 
 #define STR_EQ(str1, str2) !strcmp((str1), (str2))
 
+// Options that only have a long version
+enum long_options {
+    OPT_TRACE_FORMAT = 0x100,
+    OPT_TRACE_OUT,
+    OPT_STOP_ON_RESULT,
+    OPT_LINK,
+    OPT_CRASH_REPORT,
+    OPT_VIDEO_OUT,
+    OPT_VIDEO_FORMAT,
+    OPT_AUDIO_OUT,
+    OPT_AUDIO_FORMAT,
+    OPT_AUDIO_RATE,
+    OPT_AUDIO_QUALITY,
+    OPT_PROFILE,
+    OPT_PROFILE_PERIOD,
+    OPT_PROFILE_TOP,
+    OPT_SYMBOLS,
+    OPT_HOST_TIMERS,
+    OPT_PERF_COUNTERS,
+    OPT_PERF_PERIOD,
+    OPT_BENCH,
+    OPT_CYCLES,
+    OPT_FRAMES,
+    OPT_BENCH_JSON,
+};
+
 static error_t parse_opt(int key, char *value, struct argp_state *state)
 {
     struct options *arguments_ptr = state->input;
@@ -36,15 +92,171 @@ static error_t parse_opt(int key, char *value, struct argp_state *state)
     case 't':
         arguments_ptr->trace = true;
         break;
+    case OPT_TRACE_FORMAT:
+        if (STR_EQ(value, "text"))
+            arguments_ptr->trace = true;
+        else if (STR_EQ(value, "doctor"))
+            arguments_ptr->trace_format = TRACE_DOCTOR;
+        else if (STR_EQ(value, "binary"))
+            arguments_ptr->trace_format = TRACE_BINARY;
+        else
+            argp_error(state, "Invalid argument for option --trace-format: %s",
+                       value);
+        break;
+    case OPT_TRACE_OUT:
+        arguments_ptr->trace_out = value;
+        break;
     case 'x':
         arguments_ptr->exit_infinite_loop = true;
         break;
     case 'b':
         arguments_ptr->blargg = true;
         break;
+    case OPT_STOP_ON_RESULT:
+        arguments_ptr->blargg = true;
+        arguments_ptr->stop_on_result = true;
+        break;
+    case OPT_LINK:
+        arguments_ptr->link = value;
+        break;
+    case OPT_CRASH_REPORT:
+        arguments_ptr->crash_report = value;
+        break;
+
+    case 'p':
+        if (STR_EQ(value, "fast"))
+            arguments_ptr->ppu_engine = PPU_ENGINE_FAST;
+        else if (STR_EQ(value, "accurate"))
+            arguments_ptr->ppu_engine = PPU_ENGINE_ACCURATE;
+        else if (STR_EQ(value, "threaded"))
+            arguments_ptr->ppu_engine = PPU_ENGINE_THREADED;
+        else
+            argp_error(state, "Invalid argument for option --ppu: %s", value);
+        break;
+    case 'f': {
+        char *end_ptr;
+        const unsigned long frameskip = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || frameskip > UINT16_MAX)
+            argp_error(state, "Invalid argument for option --frameskip: %s",
+                       value);
+        arguments_ptr->frameskip = frameskip;
+        break;
+    }
+    case OPT_VIDEO_OUT:
+        arguments_ptr->video_out = value;
+        break;
+    case OPT_VIDEO_FORMAT:
+        if (STR_EQ(value, "gray"))
+            arguments_ptr->video_format = VIDEO_GRAY;
+        else if (STR_EQ(value, "shades"))
+            arguments_ptr->video_format = VIDEO_SHADES;
+        else
+            argp_error(state, "Invalid argument for option --video-format: %s",
+                       value);
+        break;
+    case OPT_AUDIO_OUT:
+        arguments_ptr->audio_out = value;
+        break;
+    case OPT_AUDIO_FORMAT:
+        if (STR_EQ(value, "wav"))
+            arguments_ptr->audio_format = AUDIO_WAV;
+        else if (STR_EQ(value, "raw"))
+            arguments_ptr->audio_format = AUDIO_RAW;
+        else
+            argp_error(state, "Invalid argument for option --audio-format: %s",
+                       value);
+        break;
+    case OPT_AUDIO_RATE: {
+        char *end_ptr;
+        const unsigned long rate = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || rate < 8000 || rate > 192000)
+            argp_error(state, "Invalid argument for option --audio-rate: %s",
+                       value);
+        arguments_ptr->audio_rate = rate;
+        break;
+    }
+    case OPT_AUDIO_QUALITY:
+        if (STR_EQ(value, "low"))
+            arguments_ptr->audio_quality = RESAMPLER_LOW;
+        else if (STR_EQ(value, "medium"))
+            arguments_ptr->audio_quality = RESAMPLER_MEDIUM;
+        else if (STR_EQ(value, "high"))
+            arguments_ptr->audio_quality = RESAMPLER_HIGH;
+        else
+            argp_error(state, "Invalid argument for option --audio-quality: %s",
+                       value);
+        break;
+
+    case OPT_PROFILE:
+        arguments_ptr->profile = value;
+        break;
+    case OPT_PROFILE_PERIOD: {
+        char *end_ptr;
+        const unsigned long period = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || period == 0)
+            argp_error(state,
+                       "Invalid argument for option --profile-period: %s",
+                       value);
+        arguments_ptr->profile_period = period;
+        break;
+    }
+    case OPT_PROFILE_TOP: {
+        char *end_ptr;
+        const unsigned long top = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || top > UINT16_MAX)
+            argp_error(state, "Invalid argument for option --profile-top: %s",
+                       value);
+        arguments_ptr->profile_top = top;
+        break;
+    }
+    case OPT_SYMBOLS:
+        arguments_ptr->symbols = value;
+        break;
+    case OPT_HOST_TIMERS:
+        arguments_ptr->host_timers = true;
+        arguments_ptr->host_timers_csv = value;
+        break;
+    case OPT_PERF_COUNTERS:
+        arguments_ptr->perf_counters = value;
+        break;
+    case OPT_PERF_PERIOD: {
+        char *end_ptr;
+        const unsigned long period = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0')
+            argp_error(state, "Invalid argument for option --perf-period: %s",
+                       value);
+        arguments_ptr->perf_period = period;
+        break;
+    }
+    case OPT_BENCH:
+        arguments_ptr->bench = true;
+        break;
+    case OPT_CYCLES: {
+        char *end_ptr;
+        const unsigned long long cycles = strtoull(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || cycles == 0)
+            argp_error(state, "Invalid argument for option --cycles: %s",
+                       value);
+        arguments_ptr->bench_cycles = cycles;
+        break;
+    }
+    case OPT_FRAMES: {
+        char *end_ptr;
+        const unsigned long frames = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || frames == 0 ||
+            frames > UINT32_MAX)
+            argp_error(state, "Invalid argument for option --frames: %s",
+                       value);
+        arguments_ptr->bench_frames = frames;
+        break;
+    }
+    case OPT_BENCH_JSON:
+        arguments_ptr->bench = true;
+        arguments_ptr->bench_json = value;
+        break;
 
     case 's':
-        arguments_ptr->log_level = -1;
+        arguments_ptr->log_level = LOG_NONE;
         break;
     case 'l':
         if (STR_EQ(value, "TRACE"))
@@ -69,6 +281,12 @@ static error_t parse_opt(int key, char *value, struct argp_state *state)
     case ARGP_KEY_END:
         if (state->arg_num < GBEMU_NB_ARGS)
             argp_usage(state);
+        // The benchmark must stop by itself to print its results
+        if (arguments_ptr->bench && !arguments_ptr->bench_cycles &&
+            !arguments_ptr->bench_frames && !arguments_ptr->stop_on_result &&
+            !arguments_ptr->exit_infinite_loop)
+            argp_error(state, "--bench requires --cycles, --frames, "
+                              "--stop-on-result or --exit-infinite-loop");
         break;
 
     default:
@@ -83,10 +301,23 @@ static char g_args_doc[] = "CARTRIDGE";
 
 #define LOG_GROUP 0
 #define RUNTIME_GROUP 1
+#define VIDEO_GROUP 2
+#define AUDIO_GROUP 3
+#define PROFILE_GROUP 4
+#define BENCH_GROUP 5
 
 static struct argp_option g_long_options[] = {
     // Log related
     {"trace", 't', 0, 0, "Output traces during execution", LOG_GROUP},
+    {"trace-format", OPT_TRACE_FORMAT, "FORMAT", 0,
+     "Format of the traces: 'text' (same as --trace), 'doctor' "
+     "(gameboy-doctor logs, one line per instruction) or 'binary' (compact "
+     "records, decoded with emu-gb-trace)",
+     LOG_GROUP},
+    {"trace-out", OPT_TRACE_OUT, "FILE", 0,
+     "Write the doctor or binary traces into a file instead of the standard "
+     "output",
+     LOG_GROUP},
     {"log-level", 'l', "LEVEL", 0, "Do not output logs of lower importance",
      LOG_GROUP},
     {"silent", 's', 0, 0, "Do not show any log", LOG_GROUP},
@@ -94,8 +325,89 @@ static struct argp_option g_long_options[] = {
     // Runtime
     {"blargg", 'b', 0, 0, "Display the result of blargg's test roms",
      RUNTIME_GROUP},
+    {"stop-on-result", OPT_STOP_ON_RESULT, 0, 0,
+     "Same as --blargg, but stop once the test rom prints 'Passed' or "
+     "'Failed'. Exit with a non-zero status if it failed",
+     RUNTIME_GROUP},
     {"exit-infinite-loop", 'x', 0, 0,
      "Stop execution when encountering an infinite JR loop", RUNTIME_GROUP},
+    {"link", OPT_LINK, "FILE", 0,
+     "Plug the serial port into a link cable shared with another emulator",
+     RUNTIME_GROUP},
+    {"crash-report", OPT_CRASH_REPORT, "FILE", 0,
+     "Where to write the last instructions and memory writes if the emulator "
+     "crashes (default: emu-gb-crash-<pid>.log)",
+     RUNTIME_GROUP},
+
+    // Video
+    {"ppu", 'p', "ENGINE", 0,
+     "Rendering engine: 'fast' (scanline, default), 'accurate' (pixel FIFO) "
+     "or 'threaded' (scanline, on a separate thread)",
+     VIDEO_GROUP},
+    {"frameskip", 'f', "N", 0,
+     "Only draw one frame every N frames, the PPU timings are left unchanged",
+     VIDEO_GROUP},
+    {"video-out", OPT_VIDEO_OUT, "FILE", 0,
+     "Stream the raw frames (160x144, 1 byte per pixel) into a file or FIFO",
+     VIDEO_GROUP},
+    {"video-format", OPT_VIDEO_FORMAT, "FORMAT", 0,
+     "Pixel format of the video output: 'gray' (8-bit grayscale, default) or "
+     "'shades' (0-3, 0 being white)",
+     VIDEO_GROUP},
+
+    // Audio
+    {"audio-out", OPT_AUDIO_OUT, "FILE", 0,
+     "Stream the sound (16-bit stereo PCM) into a file or FIFO",
+     AUDIO_GROUP},
+    {"audio-format", OPT_AUDIO_FORMAT, "FORMAT", 0,
+     "Format of the audio output: 'wav' (default) or 'raw' (samples only)",
+     AUDIO_GROUP},
+    {"audio-rate", OPT_AUDIO_RATE, "HZ", 0,
+     "Sample rate of the audio output (default: 48000)", AUDIO_GROUP},
+    {"audio-quality", OPT_AUDIO_QUALITY, "QUALITY", 0,
+     "Quality of the sample rate conversion: 'low', 'medium' (default) or "
+     "'high'",
+     AUDIO_GROUP},
+
+    // Profiling
+    {"profile", OPT_PROFILE, "FILE", 0,
+     "Profile the guest code: write its call stacks into a file (collapsed "
+     "format, for flame graphs) and log the most expensive routines",
+     PROFILE_GROUP},
+    {"profile-period", OPT_PROFILE_PERIOD, "CYCLES", 0,
+     "Number of machine cycles between two samples (default: 64)",
+     PROFILE_GROUP},
+    {"profile-top", OPT_PROFILE_TOP, "N", 0,
+     "Number of lines of each section of the report (default: 20)",
+     PROFILE_GROUP},
+    {"symbols", OPT_SYMBOLS, "FILE", 0,
+     "RGBDS symbol file used to name the guest code (default: the cartridge "
+     "path with a .sym extension, if it exists)",
+     PROFILE_GROUP},
+    {"host-timers", OPT_HOST_TIMERS, "CSV", OPTION_ARG_OPTIONAL,
+     "Measure the host time spent inside each subsystem: log a report on "
+     "exit, and write the times of each frame into a CSV file",
+     PROFILE_GROUP},
+    {"perf-counters", OPT_PERF_COUNTERS, "CSV", 0,
+     "Count the host instructions, cycles, L1D misses and branch misses "
+     "(Linux perf events) and write them into a CSV file, once per frame",
+     PROFILE_GROUP},
+    {"perf-period", OPT_PERF_PERIOD, "CYCLES", 0,
+     "Sample the host counters every N machine cycles instead of once per "
+     "frame",
+     PROFILE_GROUP},
+
+    // Benchmark
+    {"bench", OPT_BENCH, 0, 0,
+     "Measure the speed of the emulator: run without any log, then print the "
+     "emulated clock rate, the instructions per second and the peak memory",
+     BENCH_GROUP},
+    {"bench-json", OPT_BENCH_JSON, "FILE", 0,
+     "Same as --bench, and also write the results into a JSON file",
+     BENCH_GROUP},
+    {"cycles", OPT_CYCLES, "N", 0, "Stop after N machine cycles",
+     BENCH_GROUP},
+    {"frames", OPT_FRAMES, "N", 0, "Stop after N frames", BENCH_GROUP},
 
     {0},
 };
@@ -107,5 +419,29 @@ struct options *parse_options(int argc, char **argv)
 
     argp_parse(&argp, argc, argv, 0, 0, arguments_ptr);
 
+    // The benchmark would otherwise measure the logs
+    if (arguments_ptr->bench) {
+        arguments_ptr->log_level = LOG_NONE;
+        arguments_ptr->trace = false;
+    }
+
+    log_set_level(arguments_ptr->log_level, arguments_ptr->trace);
+
+    if (arguments_ptr->trace && !LOG_COMPILED(LOG_TRACE))
+        log_warn("Traces are not available in this build "
+                 "(EMUGB_MIN_LOG_LEVEL)");
+    if (arguments_ptr->profile && !EMUGB_INSTRUMENT)
+        log_warn("The profiler is not available in this build "
+                 "(EMUGB_INSTRUMENT)");
+    if (arguments_ptr->perf_counters && !EMUGB_INSTRUMENT)
+        log_warn("The host counters are not available in this build "
+                 "(EMUGB_INSTRUMENT)");
+    if (arguments_ptr->host_timers && !EMUGB_HOST_TIMERS)
+        log_warn("The host timers are not available in this build "
+                 "(EMUGB_HOST_TIMERS)");
+    if (arguments_ptr->trace_format != TRACE_TEXT && !EMUGB_INSTRUMENT)
+        log_warn("Execution traces are not available in this build "
+                 "(EMUGB_INSTRUMENT)");
+
     return get_options();
 }
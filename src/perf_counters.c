@@ -0,0 +1,298 @@
+#include "perf_counters.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "utils/log.h"
+
+typedef enum perf_counter {
+    PERF_INSTRUCTIONS = 0,
+    PERF_CYCLES,
+    PERF_L1D_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT,
+} perf_counter;
+
+static const char *g_counter_names[PERF_COUNTER_COUNT] = {
+    [PERF_INSTRUCTIONS] = "instructions",
+    [PERF_CYCLES] = "cycles",
+    [PERF_L1D_MISSES] = "l1d_misses",
+    [PERF_BRANCH_MISSES] = "branch_misses",
+};
+
+bool g_perf_counters_enabled = false;
+u64 g_perf_counters_period = 0;
+u64 g_perf_counters_next = 0;
+
+static struct perf_counters {
+    int fds[PERF_COUNTER_COUNT]; ///< -1 if the counter is not available
+    int leader;                  ///< The first opened counter
+    u8 slots[PERF_COUNTER_COUNT]; ///< Position inside the group's values
+    u8 opened;
+
+    FILE *csv_ptr;
+    u64 samples;
+    u64 totals[PERF_COUNTER_COUNT]; ///< Scaled values at the last sample
+    u64 cycles;                     ///< Machine cycle of the last sample
+    u32 frame;                      ///< Frame of the last sample
+    u64 start_cycles;
+    u32 start_frame;
+} g_perf;
+
+#ifdef __linux__
+
+static int open_counter(perf_counter counter, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.disabled = group_fd == -1; // The whole group is enabled at once
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (counter) {
+    case PERF_INSTRUCTIONS:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_CYCLES:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D |
+                      PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                      PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        break;
+    case PERF_BRANCH_MISSES:
+    default:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+
+    // Only the calling thread, on any CPU
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void control_group(unsigned long request)
+{
+    ioctl(g_perf.leader, request, PERF_IOC_FLAG_GROUP);
+}
+
+#define CONTROL_RESET PERF_EVENT_IOC_RESET
+#define CONTROL_ENABLE PERF_EVENT_IOC_ENABLE
+#define CONTROL_DISABLE PERF_EVENT_IOC_DISABLE
+
+#else
+
+static int open_counter(perf_counter counter, int group_fd)
+{
+    (void)counter;
+    (void)group_fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+static void control_group(unsigned long request)
+{
+    (void)request;
+}
+
+#define CONTROL_RESET 0
+#define CONTROL_ENABLE 0
+#define CONTROL_DISABLE 0
+
+#endif
+
+static void close_counters(void)
+{
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; ++counter) {
+        if (g_perf.fds[counter] >= 0)
+            close(g_perf.fds[counter]);
+        g_perf.fds[counter] = -1;
+    }
+
+    g_perf.leader = -1;
+    g_perf.opened = 0;
+}
+
+// Read the values of the whole group, scaled if they were multiplexed
+static bool read_counters(u64 values[PERF_COUNTER_COUNT])
+{
+    // nr, time_enabled, time_running, values[nr]
+    u64 group[3 + PERF_COUNTER_COUNT];
+
+    const ssize_t size = read(g_perf.leader, group, sizeof(group));
+    if (size < (ssize_t)(3 * sizeof(u64)) || group[0] != g_perf.opened)
+        return false;
+
+    const u64 enabled = group[1];
+    const u64 running = group[2];
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; ++counter) {
+        if (g_perf.fds[counter] < 0)
+            continue;
+        const u64 value = group[3 + g_perf.slots[counter]];
+        values[counter] = (running == enabled || !running)
+                            ? value
+                            : (u64)((double)value * enabled / running);
+    }
+
+    return true;
+}
+
+static void schedule_next_sample(void)
+{
+    g_perf_counters_next = g_perf_counters_period
+                             ? g_perf.cycles + g_perf_counters_period
+                             : g_perf.frame;
+}
+
+bool perf_counters_open(const char *path, u64 period)
+{
+    if (!EMUGB_INSTRUMENT)
+        return false;
+
+    memset(&g_perf, 0, sizeof(g_perf));
+    g_perf.leader = -1;
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; ++counter) {
+        g_perf.fds[counter] = open_counter(counter, g_perf.leader);
+        if (g_perf.fds[counter] < 0) {
+            log_warn("Host counter '%s' is not available: %s",
+                     g_counter_names[counter], strerror(errno));
+            continue;
+        }
+        if (g_perf.leader < 0)
+            g_perf.leader = g_perf.fds[counter];
+        g_perf.slots[counter] = g_perf.opened++;
+    }
+
+    if (!g_perf.opened)
+        return false;
+
+    g_perf.csv_ptr = fopen(path, "w");
+    if (!g_perf.csv_ptr) {
+        log_err("Failed to open the host counters output '%s': %s", path,
+                strerror(errno));
+        close_counters();
+        return false;
+    }
+
+    fprintf(g_perf.csv_ptr, "sample,frame,guest_cycles");
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; ++counter)
+        fprintf(g_perf.csv_ptr, ",%s", g_counter_names[counter]);
+    fputc('\n', g_perf.csv_ptr);
+
+    g_perf.cycles = g_perf.start_cycles = timer_get_cycles();
+    g_perf.frame = g_perf.start_frame = g_ppu.frame;
+    g_perf_counters_period = period;
+    schedule_next_sample();
+
+    control_group(CONTROL_RESET);
+    control_group(CONTROL_ENABLE);
+    g_perf_counters_enabled = true;
+
+    return true;
+}
+
+void perf_counters_sample(void)
+{
+    u64 values[PERF_COUNTER_COUNT];
+    const u64 cycles = timer_get_cycles();
+
+    // Do not count the time spent writing the sample
+    control_group(CONTROL_DISABLE);
+
+    if (!read_counters(values)) {
+        log_err("Failed to read the host counters, stopping them");
+        g_perf_counters_enabled = false;
+        return;
+    }
+
+    fprintf(g_perf.csv_ptr, "%llu,%u,%llu", (unsigned long long)g_perf.samples,
+            g_perf.frame, (unsigned long long)(cycles - g_perf.cycles));
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; ++counter) {
+        if (g_perf.fds[counter] < 0) {
+            fputc(',', g_perf.csv_ptr);
+            continue;
+        }
+        fprintf(g_perf.csv_ptr, ",%llu",
+                (unsigned long long)(values[counter] - g_perf.totals[counter]));
+        g_perf.totals[counter] = values[counter];
+    }
+    fputc('\n', g_perf.csv_ptr);
+
+    g_perf.samples += 1;
+    g_perf.cycles = cycles;
+    g_perf.frame = g_ppu.frame;
+    schedule_next_sample();
+
+    control_group(CONTROL_ENABLE);
+}
+
+// Events per thousand host instructions
+static double per_kilo_instructions(perf_counter counter)
+{
+    const u64 instructions = g_perf.totals[PERF_INSTRUCTIONS];
+
+    if (g_perf.fds[PERF_INSTRUCTIONS] < 0 || !instructions)
+        return 0.0;
+    return 1000.0 * g_perf.totals[counter] / instructions;
+}
+
+void perf_counters_close(void)
+{
+    if (!g_perf.csv_ptr)
+        return;
+
+    // Last (partial) interval
+    if (g_perf_counters_enabled)
+        perf_counters_sample();
+
+    g_perf_counters_enabled = false;
+    fclose(g_perf.csv_ptr);
+    g_perf.csv_ptr = NULL;
+
+    const u64 cycles = g_perf.cycles - g_perf.start_cycles;
+    const u32 frames = g_perf.frame - g_perf.start_frame;
+
+    log_info("Host counters: %llu samples, %llu guest cycles, %u frames",
+             (unsigned long long)g_perf.samples, (unsigned long long)cycles,
+             frames);
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; ++counter) {
+        if (g_perf.fds[counter] < 0)
+            continue;
+        log_info("%-14s %16llu  %10.1f/frame  %8.2f/guest cycle",
+                 g_counter_names[counter],
+                 (unsigned long long)g_perf.totals[counter],
+                 frames ? (double)g_perf.totals[counter] / frames : 0.0,
+                 cycles ? (double)g_perf.totals[counter] / cycles : 0.0);
+    }
+
+    if (g_perf.fds[PERF_INSTRUCTIONS] >= 0 && g_perf.fds[PERF_CYCLES] >= 0 &&
+        g_perf.totals[PERF_CYCLES])
+        log_info("IPC: %.2f", (double)g_perf.totals[PERF_INSTRUCTIONS] /
+                                  g_perf.totals[PERF_CYCLES]);
+    if (g_perf.fds[PERF_L1D_MISSES] >= 0)
+        log_info("L1D misses: %.2f per 1000 instructions",
+                 per_kilo_instructions(PERF_L1D_MISSES));
+    if (g_perf.fds[PERF_BRANCH_MISSES] >= 0)
+        log_info("Branch misses: %.2f per 1000 instructions",
+                 per_kilo_instructions(PERF_BRANCH_MISSES));
+
+    close_counters();
+}
@@ -0,0 +1,354 @@
+/**
+ * \file fifo.c
+ * \brief Dot-accurate pixel FIFO renderer
+ *
+ * Model the pixel transfer (mode 3) the way the hardware does it: a fetcher
+ * reads the background/window tiles 8 pixels at a time and pushes them into
+ * the background FIFO, which shifts one pixel out to the LCD each dot.
+ * Sprites are fetched into a separate FIFO and mixed with the background at
+ * output time.
+ *
+ * The duration of the pixel transfer thus depends on the content of the line:
+ *
+ *  - SCX % 8 pixels are discarded at the start of the line (1 dot each)
+ *  - The fetcher restarts when reaching the window (6 dots)
+ *  - Fetching a sprite stalls the FIFO (6 dots)
+ *
+ * Registers are read when the hardware would: SCX/SCY and the LCDC maps when
+ * fetching a tile, the palettes when outputting a pixel. Mid-scanline
+ * register writes are thus visible.
+ *
+ * For more details:
+ *  - https://gbdev.io/pandocs/pixel_fifo.html
+ *  - doc/The Cycle-Accurate Game Boy Docs.pdf
+ */
+
+#include "ppu/engine.h"
+#include "ppu/ppu.h"
+#include "utils/macro.h"
+
+/// The hardware fetches the first tile of each line twice, the first one
+/// being thrown away.
+#define FETCHER_STARTUP_DOTS 6
+/// Duration of a sprite fetch, during which the FIFO is stalled.
+#define SPRITE_FETCH_DOTS 6
+/// Time lost restarting the fetcher when reaching the window.
+#define WINDOW_FETCH_DOTS 6
+
+#define BG_FIFO_SIZE 16
+#define OBJ_FIFO_SIZE 8
+
+typedef enum fetcher_step {
+    FETCH_TILE,
+    FETCH_LOW,
+    FETCH_HIGH,
+    FETCH_PUSH,
+} fetcher_step;
+
+struct obj_pixel {
+    u8 color; ///< Color index, 0 if transparent
+    u8 flags; ///< Attributes of the sprite the pixel belongs to
+};
+
+static struct pixel_fifo {
+    // Background FIFO (color indexes)
+    u8 bg[BG_FIFO_SIZE];
+    u8 bg_head;
+    u8 bg_size;
+
+    // Sprite FIFO, always aligned on the head of the background FIFO
+    struct obj_pixel obj[OBJ_FIFO_SIZE];
+    u8 obj_head;
+
+    // Background/window fetcher
+    struct {
+        fetcher_step step;
+        u8 ticks; ///< Each step (except for PUSH) takes 2 dots
+        u8 x;     ///< Tile column, relative to the start of the BG/window
+        bool window;
+        u8 tile;
+        u8 low;
+        u8 high;
+    } fetcher;
+
+    u8 lx;       ///< Number of pixels output on the current line
+    u8 discard;  ///< Pixels to discard before outputting (fine scrolling)
+    u8 stall;    ///< Dots remaining before the FIFO can shift again
+    u16 fetched; ///< Mask of the selected sprites that were already fetched
+    bool window; ///< The window was drawn on this line
+} g_fifo;
+
+static void start_transfer()
+{
+    g_fifo.bg_head = 0;
+    g_fifo.bg_size = 0;
+    g_fifo.obj_head = 0;
+    for (u8 i = 0; i < OBJ_FIFO_SIZE; ++i)
+        g_fifo.obj[i].color = 0;
+
+    g_fifo.fetcher.step = FETCH_TILE;
+    g_fifo.fetcher.ticks = 0;
+    g_fifo.fetcher.x = 0;
+    g_fifo.fetcher.window = false;
+
+    g_fifo.lx = 0;
+    g_fifo.discard = g_ppu.scx & 7;
+    g_fifo.stall = FETCHER_STARTUP_DOTS;
+    g_fifo.fetched = 0;
+    g_fifo.window = false;
+}
+
+static void fetch_tile()
+{
+    u8 x;
+    u8 y;
+    bool high_map;
+
+    if (g_fifo.fetcher.window) {
+        x = g_fifo.fetcher.x;
+        y = g_ppu.window_line;
+        high_map = BIT(g_ppu.lcdc, LCDC_WINDOW_MAP);
+    } else {
+        x = ((g_ppu.scx / 8) + g_fifo.fetcher.x) & 0x1F;
+        y = g_ppu.ly + g_ppu.scy;
+        high_map = BIT(g_ppu.lcdc, LCDC_BG_MAP);
+    }
+
+    g_fifo.fetcher.tile = read_vram(tile_map_address(high_map, x, y));
+}
+
+static u16 fetcher_row_address()
+{
+    const u8 y = g_fifo.fetcher.window ? g_ppu.window_line
+                                       : (u8)(g_ppu.ly + g_ppu.scy);
+    return bg_tile_address(g_ppu.lcdc, g_fifo.fetcher.tile, y & 7);
+}
+
+static void fetcher_push()
+{
+    // The fetcher can only push a whole tile into an empty FIFO
+    if (g_fifo.bg_size)
+        return;
+
+    for (u8 n = 0; n < 8; ++n) {
+        u8 color = tile_pixel(g_fifo.fetcher.low, g_fifo.fetcher.high, n);
+        if (!BIT(g_ppu.lcdc, LCDC_BG_ENABLE))
+            color = 0;
+        g_fifo.bg[(g_fifo.bg_head + n) % BG_FIFO_SIZE] = color;
+    }
+
+    g_fifo.bg_size = 8;
+    g_fifo.fetcher.x += 1;
+    g_fifo.fetcher.step = FETCH_TILE;
+}
+
+static void fetcher_tick()
+{
+    if (g_fifo.fetcher.step == FETCH_PUSH) {
+        fetcher_push();
+        return;
+    }
+
+    if (++g_fifo.fetcher.ticks < 2)
+        return;
+
+    g_fifo.fetcher.ticks = 0;
+
+    switch (g_fifo.fetcher.step) {
+    case FETCH_TILE:
+        fetch_tile();
+        g_fifo.fetcher.step = FETCH_LOW;
+        break;
+    case FETCH_LOW:
+        g_fifo.fetcher.low = read_vram(fetcher_row_address());
+        g_fifo.fetcher.step = FETCH_HIGH;
+        break;
+    case FETCH_HIGH:
+        g_fifo.fetcher.high = read_vram(fetcher_row_address() + 1);
+        g_fifo.fetcher.step = FETCH_PUSH;
+        break;
+    case FETCH_PUSH:
+    default:
+        break;
+    }
+}
+
+/*
+ * When reaching the window, the background FIFO is cleared and the fetcher
+ * restarts from the first tile of the window.
+ */
+static void check_window()
+{
+    if (g_fifo.fetcher.window || !BIT(g_ppu.lcdc, LCDC_WINDOW_ENABLE) ||
+        !BIT(g_ppu.lcdc, LCDC_BG_ENABLE) || !g_ppu.window_triggered ||
+        g_fifo.lx + 7 < g_ppu.wx)
+        return;
+
+    g_fifo.bg_size = 0;
+    g_fifo.fetcher.window = true;
+    g_fifo.fetcher.x = 0;
+    g_fifo.fetcher.ticks = 0;
+    g_fifo.fetcher.step = FETCH_TILE;
+    g_fifo.window = true;
+
+    // The window starts partially off-screen when WX < 7
+    if (g_ppu.wx < 7)
+        g_fifo.discard = 7 - g_ppu.wx;
+}
+
+/*
+ * Merge the sprite's row into the sprite FIFO.
+ * Pixels already occupied by a previous sprite keep their value: sprites are
+ * fetched by increasing X coordinate, then OAM order, which matches the
+ * priority rules of the DMG.
+ */
+static void fetch_sprite(const struct ppu_sprite *sprite_ptr)
+{
+    const u16 address = sprite_tile_address(g_ppu.lcdc, g_ppu.ly, sprite_ptr);
+    const u8 low = read_vram(address);
+    const u8 high = read_vram(address + 1);
+
+    // Sprites partially off-screen on the left side
+    const u8 skip = sprite_ptr->x < 8 ? 8 - sprite_ptr->x : 0;
+
+    for (u8 n = skip; n < 8; ++n) {
+        struct obj_pixel *pixel_ptr =
+            &g_fifo.obj[(g_fifo.obj_head + n - skip) % OBJ_FIFO_SIZE];
+        const u8 color = tile_pixel(
+            low, high, BIT(sprite_ptr->flags, OBJ_X_FLIP) ? 7 - n : n);
+
+        if (pixel_ptr->color == 0 && color != 0) {
+            pixel_ptr->color = color;
+            pixel_ptr->flags = sprite_ptr->flags;
+        }
+    }
+}
+
+/*
+ * Check whether a sprite starts at the current pixel.
+ * If one does, fetch it and stall the FIFO for the duration of the fetch.
+ */
+static bool check_sprites()
+{
+    if (!BIT(g_ppu.lcdc, LCDC_OBJ_ENABLE) || !g_fifo.bg_size || g_fifo.discard)
+        return false;
+
+    for (u8 i = 0; i < g_ppu.sprite_count; ++i) {
+        const struct ppu_sprite *sprite_ptr = &g_ppu.sprites[i];
+
+        if (g_fifo.fetched & (1 << i))
+            continue;
+        if (sprite_ptr->x == 0 || sprite_ptr->x >= LCD_WIDTH + 8)
+            continue;
+        if (MAX(sprite_ptr->x, 8) - 8 != g_fifo.lx)
+            continue;
+
+        g_fifo.fetched |= 1 << i;
+        fetch_sprite(sprite_ptr);
+        g_fifo.stall = SPRITE_FETCH_DOTS - 1; // Including the current dot
+        return true;
+    }
+
+    return false;
+}
+
+static void shift_pixel()
+{
+    if (!g_fifo.bg_size)
+        return;
+
+    const u8 bg = g_fifo.bg[g_fifo.bg_head];
+    const struct obj_pixel obj = g_fifo.obj[g_fifo.obj_head];
+
+    g_fifo.bg_head = (g_fifo.bg_head + 1) % BG_FIFO_SIZE;
+    g_fifo.bg_size -= 1;
+    g_fifo.obj[g_fifo.obj_head].color = 0;
+    g_fifo.obj_head = (g_fifo.obj_head + 1) % OBJ_FIFO_SIZE;
+
+    if (g_fifo.discard) {
+        g_fifo.discard -= 1;
+        return;
+    }
+
+    u8 shade;
+    if (obj.color && !(BIT(obj.flags, OBJ_PRIORITY) && bg)) {
+        const u8 palette =
+            BIT(obj.flags, OBJ_PALETTE) ? g_ppu.obp1 : g_ppu.obp0;
+        shade = palette_shade(palette, obj.color);
+    } else {
+        shade = BIT(g_ppu.lcdc, LCDC_BG_ENABLE) ? palette_shade(g_ppu.bgp, bg)
+                                                : 0;
+    }
+
+    g_ppu.framebuffer[g_ppu.ly][g_fifo.lx++] = shade;
+}
+
+/*
+ * Run the pixel transfer for a single dot.
+ * Return whether the whole line has been output.
+ */
+static bool transfer_dot()
+{
+    if (g_fifo.stall) {
+        g_fifo.stall -= 1;
+        return false;
+    }
+
+    check_window();
+    fetcher_tick();
+
+    if (check_sprites())
+        return false;
+
+    shift_pixel();
+
+    if (g_fifo.lx < LCD_WIDTH)
+        return false;
+
+    if (g_fifo.window)
+        g_ppu.window_line += 1;
+
+    return true;
+}
+
+static u16 transfer(u16 dots, bool *done_ptr)
+{
+    for (u16 dot = 1; dot <= dots; ++dot) {
+        if (transfer_dot()) {
+            *done_ptr = true;
+            return dot;
+        }
+    }
+
+    return dots;
+}
+
+/*
+ * Compute the duration of the line from the same penalties that running the
+ * FIFO would incur, without fetching anything.
+ */
+static u16 transfer_dots()
+{
+    u16 dots = TRANSFER_DOTS + (g_ppu.scx & 7);
+
+    if (BIT(g_ppu.lcdc, LCDC_WINDOW_ENABLE) &&
+        BIT(g_ppu.lcdc, LCDC_BG_ENABLE) && g_ppu.window_triggered &&
+        g_ppu.wx < LCD_WIDTH + 7)
+        dots += WINDOW_FETCH_DOTS;
+
+    if (!BIT(g_ppu.lcdc, LCDC_OBJ_ENABLE))
+        return dots;
+
+    for (u8 i = 0; i < g_ppu.sprite_count; ++i) {
+        if (g_ppu.sprites[i].x && g_ppu.sprites[i].x < LCD_WIDTH + 8)
+            dots += SPRITE_FETCH_DOTS;
+    }
+
+    return dots;
+}
+
+const struct ppu_engine g_fifo_engine = {
+    .start_transfer = start_transfer,
+    .transfer = transfer,
+    .transfer_dots = transfer_dots,
+};
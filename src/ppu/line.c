@@ -0,0 +1,195 @@
+/**
+ * \file line.c
+ * \brief Scanline renderer
+ *
+ * Draw the whole line at once when entering the pixel transfer, using the
+ * registers' value at that time. Mid-scanline register writes are not
+ * visible, and the pixel transfer always lasts the minimum 172 dots.
+ *
+ * This is the default engine, accurate enough for most games.
+ */
+
+#include "ppu/engine.h"
+#include "ppu/ppu.h"
+#include "utils/macro.h"
+
+struct obj_pixel {
+    u8 color; ///< Color index, 0 if transparent
+    u8 flags; ///< Attributes of the sprite the pixel belongs to
+};
+
+// Color indexes of the background/window and sprites for the current line
+static u8 g_bg_line[LCD_WIDTH];
+static struct obj_pixel g_obj_line[LCD_WIDTH];
+
+// The pages of the VRAM, when drawing directly from the CPU's memory
+static const u8 *const g_vram_pages[VRAM_PAGES] = {
+    &g_cpu.memory[VRAM_START + 0 * VRAM_PAGE_SIZE],
+    &g_cpu.memory[VRAM_START + 1 * VRAM_PAGE_SIZE],
+    &g_cpu.memory[VRAM_START + 2 * VRAM_PAGE_SIZE],
+    &g_cpu.memory[VRAM_START + 3 * VRAM_PAGE_SIZE],
+    &g_cpu.memory[VRAM_START + 4 * VRAM_PAGE_SIZE],
+    &g_cpu.memory[VRAM_START + 5 * VRAM_PAGE_SIZE],
+    &g_cpu.memory[VRAM_START + 6 * VRAM_PAGE_SIZE],
+    &g_cpu.memory[VRAM_START + 7 * VRAM_PAGE_SIZE],
+};
+
+static void render_background(const struct ppu_line *line_ptr,
+                              const u8 *const *vram_ptr, u8 *bg_ptr)
+{
+    const bool high_map = BIT(line_ptr->lcdc, LCDC_BG_MAP);
+    const u8 y = line_ptr->ly + line_ptr->scy;
+    u8 scrolled_x = line_ptr->scx;
+    u8 low = 0;
+    u8 high = 0;
+
+    for (u8 x = 0; x < LCD_WIDTH; ++x, ++scrolled_x) {
+        if (x == 0 || (scrolled_x & 7) == 0) {
+            const u8 tile = read_vram_page(
+                vram_ptr, tile_map_address(high_map, scrolled_x / 8, y));
+            const u16 address = bg_tile_address(line_ptr->lcdc, tile, y & 7);
+            low = read_vram_page(vram_ptr, address);
+            high = read_vram_page(vram_ptr, address + 1);
+        }
+        bg_ptr[x] = tile_pixel(low, high, scrolled_x & 7);
+    }
+}
+
+static void render_window(const struct ppu_line *line_ptr,
+                          const u8 *const *vram_ptr, u8 *bg_ptr)
+{
+    const bool high_map = BIT(line_ptr->lcdc, LCDC_WINDOW_MAP);
+    const u8 y = line_ptr->window_line;
+    const i16 start = line_ptr->wx - 7;
+    u8 low = 0;
+    u8 high = 0;
+
+    if (!line_ptr->window)
+        return;
+
+    for (i16 x = MAX(start, 0); x < LCD_WIDTH; ++x) {
+        const u8 window_x = x - start;
+        if (x == MAX(start, 0) || (window_x & 7) == 0) {
+            const u8 tile = read_vram_page(
+                vram_ptr, tile_map_address(high_map, window_x / 8, y));
+            const u16 address = bg_tile_address(line_ptr->lcdc, tile, y & 7);
+            low = read_vram_page(vram_ptr, address);
+            high = read_vram_page(vram_ptr, address + 1);
+        }
+        bg_ptr[x] = tile_pixel(low, high, window_x & 7);
+    }
+}
+
+static void render_sprites(const struct ppu_line *line_ptr,
+                           const u8 *const *vram_ptr, struct obj_pixel *obj_ptr)
+{
+    for (u8 x = 0; x < LCD_WIDTH; ++x)
+        obj_ptr[x].color = 0;
+
+    if (!BIT(line_ptr->lcdc, LCDC_OBJ_ENABLE))
+        return;
+
+    // Sprites are ordered by decreasing priority
+    for (u8 i = 0; i < line_ptr->sprite_count; ++i) {
+        const struct ppu_sprite *sprite_ptr = &line_ptr->sprites[i];
+        const u16 address =
+            sprite_tile_address(line_ptr->lcdc, line_ptr->ly, sprite_ptr);
+        const u8 low = read_vram_page(vram_ptr, address);
+        const u8 high = read_vram_page(vram_ptr, address + 1);
+
+        for (u8 n = 0; n < 8; ++n) {
+            const i16 x = sprite_ptr->x - 8 + n;
+            if (x < 0 || x >= LCD_WIDTH || obj_ptr[x].color)
+                continue;
+
+            const u8 color = tile_pixel(
+                low, high, BIT(sprite_ptr->flags, OBJ_X_FLIP) ? 7 - n : n);
+            if (color) {
+                obj_ptr[x].color = color;
+                obj_ptr[x].flags = sprite_ptr->flags;
+            }
+        }
+    }
+}
+
+void render_line(const struct ppu_line *line_ptr, const u8 *const *vram_ptr,
+                 u8 *pixels_ptr)
+{
+    const bool bg_enabled = BIT(line_ptr->lcdc, LCDC_BG_ENABLE);
+
+    if (bg_enabled) {
+        render_background(line_ptr, vram_ptr, g_bg_line);
+        render_window(line_ptr, vram_ptr, g_bg_line);
+    } else {
+        for (u8 x = 0; x < LCD_WIDTH; ++x)
+            g_bg_line[x] = 0;
+    }
+
+    render_sprites(line_ptr, vram_ptr, g_obj_line);
+
+    for (u8 x = 0; x < LCD_WIDTH; ++x) {
+        const struct obj_pixel obj = g_obj_line[x];
+        const u8 bg = g_bg_line[x];
+
+        if (obj.color && !(BIT(obj.flags, OBJ_PRIORITY) && bg)) {
+            const u8 palette =
+                BIT(obj.flags, OBJ_PALETTE) ? line_ptr->obp1 : line_ptr->obp0;
+            pixels_ptr[x] = palette_shade(palette, obj.color);
+        } else {
+            pixels_ptr[x] = bg_enabled ? palette_shade(line_ptr->bgp, bg) : 0;
+        }
+    }
+}
+
+void ppu_line_snapshot(struct ppu_line *line_ptr)
+{
+    line_ptr->ly = g_ppu.ly;
+    line_ptr->lcdc = g_ppu.lcdc;
+    line_ptr->scx = g_ppu.scx;
+    line_ptr->scy = g_ppu.scy;
+    line_ptr->wx = g_ppu.wx;
+    line_ptr->bgp = g_ppu.bgp;
+    line_ptr->obp0 = g_ppu.obp0;
+    line_ptr->obp1 = g_ppu.obp1;
+
+    line_ptr->window_line = g_ppu.window_line;
+    line_ptr->window = BIT(g_ppu.lcdc, LCDC_BG_ENABLE) &&
+                       BIT(g_ppu.lcdc, LCDC_WINDOW_ENABLE) &&
+                       g_ppu.window_triggered && g_ppu.wx < LCD_WIDTH + 7;
+    if (line_ptr->window)
+        g_ppu.window_line += 1;
+
+    line_ptr->sprite_count = g_ppu.sprite_count;
+    for (u8 i = 0; i < g_ppu.sprite_count; ++i)
+        line_ptr->sprites[i] = g_ppu.sprites[i];
+}
+
+static void start_transfer()
+{
+    struct ppu_line line;
+
+    ppu_line_snapshot(&line);
+    render_line(&line, g_vram_pages, g_ppu.framebuffer[g_ppu.ly]);
+}
+
+static u16 transfer(u16 dots, bool *done_ptr)
+{
+    const u16 left = OAM_SCAN_DOTS + TRANSFER_DOTS - g_ppu.dot;
+
+    if (dots < left)
+        return dots;
+
+    *done_ptr = true;
+    return left;
+}
+
+static u16 transfer_dots()
+{
+    return TRANSFER_DOTS;
+}
+
+const struct ppu_engine g_line_engine = {
+    .start_transfer = start_transfer,
+    .transfer = transfer,
+    .transfer_dots = transfer_dots,
+};
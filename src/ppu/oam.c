@@ -0,0 +1,83 @@
+/**
+ * \file oam.c
+ * \brief OAM scan (mode 2)
+ *
+ * Instead of going through the 40 entries of the OAM on each line, the
+ * sprites of all the visible lines are selected at once and kept inside an
+ * index. The index is only rebuilt when the content of the OAM (CPU write,
+ * DMA) or the height of the sprites changes.
+ */
+
+#include "cpu/cpu.h"
+#include "ppu/engine.h"
+#include "ppu/ppu.h"
+#include "utils/macro.h"
+
+static struct sprite_index {
+    /// Sprites selected for each line, by decreasing drawing priority
+    struct ppu_sprite sprites[LCD_HEIGHT][LINE_SPRITE_COUNT];
+    u8 count[LCD_HEIGHT];
+
+    // State of the PPU when the index was built
+    u32 oam_generation;
+    u8 height;
+    bool valid;
+} g_index;
+
+/*
+ * On DMG, the sprite with the smallest X coordinate has priority. When X
+ * coordinates are equal, the first sprite in OAM wins.
+ */
+static void sort_sprites(struct ppu_sprite *sprites_ptr, u8 count)
+{
+    for (u8 i = 1; i < count; ++i) {
+        const struct ppu_sprite sprite = sprites_ptr[i];
+        u8 j = i;
+        for (; j > 0 && sprites_ptr[j - 1].x > sprite.x; --j)
+            sprites_ptr[j] = sprites_ptr[j - 1];
+        sprites_ptr[j] = sprite;
+    }
+}
+
+static void build_index()
+{
+    const struct ppu_sprite *oam_ptr =
+        (struct ppu_sprite *)&g_cpu.memory[OAM_START];
+    const u8 height = sprite_height(g_ppu.lcdc);
+
+    for (u8 line = 0; line < LCD_HEIGHT; ++line)
+        g_index.count[line] = 0;
+
+    // Only the first 10 sprites (in OAM order) are selected on each line
+    for (u8 i = 0; i < OAM_SPRITE_COUNT; ++i) {
+        const i16 top = oam_ptr[i].y - 16;
+        for (i16 line = MAX(top, 0); line < MIN(top + height, LCD_HEIGHT);
+             ++line) {
+            if (g_index.count[line] < LINE_SPRITE_COUNT)
+                g_index.sprites[line][g_index.count[line]++] = oam_ptr[i];
+        }
+    }
+
+    for (u8 line = 0; line < LCD_HEIGHT; ++line)
+        sort_sprites(g_index.sprites[line], g_index.count[line]);
+
+    g_index.oam_generation = g_ppu.oam_generation;
+    g_index.height = height;
+    g_index.valid = true;
+}
+
+void oam_invalidate()
+{
+    g_index.valid = false;
+}
+
+void oam_scan()
+{
+    if (!g_index.valid || g_index.oam_generation != g_ppu.oam_generation ||
+        g_index.height != sprite_height(g_ppu.lcdc))
+        build_index();
+
+    g_ppu.sprite_count = g_index.count[g_ppu.ly];
+    for (u8 i = 0; i < g_ppu.sprite_count; ++i)
+        g_ppu.sprites[i] = g_index.sprites[g_ppu.ly][i];
+}
@@ -1 +1,374 @@
+/**
+ * \file ppu.c
+ * \brief PPU state machine and LCD registers
+ *
+ * The rendering itself (mode 3) is delegated to the selected engine.
+ *
+ * \see engine.h
+ */
+
+#include "ppu/ppu.h"
+
+#include <string.h>
+
+#include "cpu/cpu.h"
+#include "cpu/interrupt.h"
 #include "cpu/memory.h"
+#include "ppu/engine.h"
+#include "utils/log.h"
+#include "utils/macro.h"
+#include "utils/timing.h"
+
+struct gb_ppu g_ppu;
+
+static const struct ppu_engine *g_engines[] = {
+    [PPU_ENGINE_FAST] = &g_line_engine,
+    [PPU_ENGINE_ACCURATE] = &g_fifo_engine,
+    [PPU_ENGINE_THREADED] = &g_thread_engine,
+};
+
+static const struct ppu_engine *g_engine = &g_line_engine;
+
+/// Duration of the pixel transfer for lines that are not composed
+static u16 g_skipped_transfer_dots;
+
+static ppu_frame_callback g_frame_callback = NULL;
+
+/*
+ * The STAT interrupt is requested on the rising edge of the OR'ed value of
+ * all the enabled STAT conditions. This means that if a condition is still
+ * active when a new one becomes true, no interrupt is requested (STAT
+ * blocking).
+ */
+static void update_stat()
+{
+    const bool lyc_equal = g_ppu.ly == g_ppu.lyc;
+    bool line = false;
+
+    line |= BIT(g_ppu.stat, STAT_LYC_INT) && lyc_equal;
+    line |= BIT(g_ppu.stat, STAT_HBLANK_INT) && g_ppu.mode == PPU_HBLANK;
+    line |= BIT(g_ppu.stat, STAT_VBLANK_INT) && g_ppu.mode == PPU_VBLANK;
+    line |= BIT(g_ppu.stat, STAT_OAM_INT) && g_ppu.mode == PPU_OAM_SCAN;
+
+    if (line && !g_ppu.stat_line)
+        interrupt_request(IV_LCD);
+
+    g_ppu.stat_line = line;
+}
+
+static void set_mode(ppu_mode mode)
+{
+    g_ppu.mode = mode;
+    update_stat();
+}
+
+void ppu_set_engine(ppu_engine_type engine)
+{
+    g_ppu.next_engine = engine;
+}
+
+void ppu_set_frameskip(u16 frameskip)
+{
+    g_ppu.frameskip = frameskip;
+}
+
+void ppu_request_frame()
+{
+    g_ppu.frame_requested = true;
+}
+
+void ppu_set_frame_callback(ppu_frame_callback callback)
+{
+    g_frame_callback = callback;
+}
+
+void ppu_frame_done()
+{
+    if (g_frame_callback)
+        g_frame_callback(&g_ppu.framebuffer[0][0]);
+}
+
+void ppu_sync()
+{
+    if (g_engine->sync)
+        g_engine->sync();
+}
+
+static void switch_engine()
+{
+    // Lines drawn asynchronously by the previous engine must not overlap
+    // with the ones of the new engine
+    ppu_sync();
+
+    g_ppu.engine = g_ppu.next_engine;
+    g_engine = g_engines[g_ppu.engine];
+}
+
+void reset_ppu()
+{
+    ppu_sync();
+    memset(g_ppu.framebuffer, 0, sizeof(g_ppu.framebuffer));
+
+    g_ppu.lcdc = 0x91;
+    g_ppu.stat = 0x00;
+    g_ppu.scy = 0x00;
+    g_ppu.scx = 0x00;
+    g_ppu.ly = 0x00;
+    g_ppu.lyc = 0x00;
+    g_ppu.bgp = 0xFC;
+    g_ppu.obp0 = 0xFF;
+    g_ppu.obp1 = 0xFF;
+    g_ppu.wy = 0x00;
+    g_ppu.wx = 0x00;
+
+    g_ppu.dot = 0;
+    g_ppu.frame = 0;
+    g_ppu.window_line = 0;
+    g_ppu.window_triggered = false;
+    g_ppu.stat_line = false;
+    g_ppu.sprite_count = 0;
+    g_ppu.stats = (struct ppu_stats){0};
+    g_ppu.vram_dirty = 0xFF; // Force a first copy of the VRAM
+    oam_invalidate();
+
+    switch_engine();
+    g_ppu.render = true;
+
+    set_mode(PPU_OAM_SCAN);
+}
+
+static void start_frame()
+{
+    g_ppu.window_line = 0;
+    g_ppu.window_triggered = false;
+
+    // The engine can only be changed on frame boundaries
+    if (g_ppu.engine != g_ppu.next_engine)
+        switch_engine();
+
+    g_ppu.render = g_ppu.frame_requested || g_ppu.frameskip <= 1 ||
+                   g_ppu.frame % g_ppu.frameskip == 0;
+    g_ppu.frame_requested = false;
+}
+
+static void next_line()
+{
+    g_ppu.dot = 0;
+    g_ppu.ly += 1;
+
+    if (g_ppu.ly == LCD_HEIGHT) {
+        if (g_ppu.render) {
+            g_ppu.stats.rendered_frames += 1;
+            if (!g_engine->async)
+                ppu_frame_done();
+        } else {
+            g_ppu.stats.skipped_frames += 1;
+        }
+
+        timing_frame(g_ppu.frame);
+        g_ppu.frame += 1;
+        interrupt_request(IV_VBLANK);
+        set_mode(PPU_VBLANK);
+        return;
+    }
+
+    if (g_ppu.ly == LINES_PER_FRAME) {
+        g_ppu.ly = 0;
+        start_frame();
+    }
+
+    if (g_ppu.mode == PPU_VBLANK && g_ppu.ly != 0) {
+        update_stat(); // LY changed
+        return;
+    }
+
+    set_mode(PPU_OAM_SCAN);
+}
+
+/*
+ * Advance the PPU until the end of the current mode, or until all the dots
+ * have been consumed.
+ *
+ * Return the number of dots consumed.
+ */
+static u16 ppu_step(u16 dots)
+{
+    u16 consumed;
+    bool done = false;
+
+    switch (g_ppu.mode) {
+    case PPU_OAM_SCAN:
+        consumed = MIN(dots, OAM_SCAN_DOTS - g_ppu.dot);
+        g_ppu.dot += consumed;
+        if (g_ppu.dot == OAM_SCAN_DOTS) {
+            if (g_ppu.ly == g_ppu.wy)
+                g_ppu.window_triggered = true;
+            oam_scan();
+            set_mode(PPU_TRANSFER);
+            if (g_ppu.render) {
+                g_engine->start_transfer();
+            } else {
+                g_skipped_transfer_dots = g_engine->transfer_dots();
+                g_ppu.stats.skipped_lines += 1;
+            }
+        }
+        return consumed;
+
+    case PPU_TRANSFER:
+        if (g_ppu.render) {
+            consumed = g_engine->transfer(dots, &done);
+        } else {
+            const u16 left =
+                OAM_SCAN_DOTS + g_skipped_transfer_dots - g_ppu.dot;
+            consumed = MIN(dots, left);
+            done = consumed == left;
+        }
+        g_ppu.dot += consumed;
+        if (done)
+            set_mode(PPU_HBLANK);
+        return consumed;
+
+    case PPU_HBLANK:
+    case PPU_VBLANK:
+    default:
+        consumed = MIN(dots, DOTS_PER_LINE - g_ppu.dot);
+        g_ppu.dot += consumed;
+        if (g_ppu.dot == DOTS_PER_LINE)
+            next_line();
+        return consumed;
+    }
+}
+
+void ppu_ticks(u8 ticks)
+{
+    TIMING_SCOPE(TIMING_PPU);
+
+    if (!BIT(g_ppu.lcdc, LCDC_ENABLE))
+        return;
+
+    u16 dots = ticks * DOTS_PER_CYCLE;
+    while (dots)
+        dots -= ppu_step(dots);
+}
+
+/*
+ * OAM DMA transfer: copy 160 bytes from 0xXX00 into the OAM.
+ * The transfer is done instantly instead of taking 160 machine cycles.
+ */
+static void dma_transfer(u8 source)
+{
+    const u16 address = source << 8;
+
+    for (u16 i = 0; i <= OAM_END - OAM_START; ++i)
+        g_cpu.memory[OAM_START + i] = read_memory(address + i);
+
+    ppu_oam_written();
+}
+
+static void write_lcdc(u8 data)
+{
+    const bool was_enabled = BIT(g_ppu.lcdc, LCDC_ENABLE);
+
+    g_ppu.lcdc = data;
+
+    if (was_enabled == BIT(data, LCDC_ENABLE))
+        return;
+
+    // Turning the LCD off or on resets the current frame
+    g_ppu.ly = 0;
+    g_ppu.dot = 0;
+    g_ppu.stat_line = false;
+    start_frame();
+
+    if (BIT(data, LCDC_ENABLE))
+        set_mode(PPU_OAM_SCAN);
+    else
+        g_ppu.mode = PPU_HBLANK;
+}
+
+void write_ppu(u16 address, u8 data)
+{
+    switch ((ppu_registers)address) {
+    case PPU_LCDC:
+        write_lcdc(data);
+        break;
+    case PPU_STAT:
+        // Only the interrupt selection bits are writable
+        g_ppu.stat = data & 0x78;
+        update_stat();
+        break;
+    case PPU_SCY:
+        g_ppu.scy = data;
+        break;
+    case PPU_SCX:
+        g_ppu.scx = data;
+        break;
+    case PPU_LY: // Read only
+        break;
+    case PPU_LYC:
+        g_ppu.lyc = data;
+        update_stat();
+        break;
+    case PPU_DMA:
+        g_ppu.dma = data;
+        dma_transfer(data);
+        break;
+    case PPU_BGP:
+        g_ppu.bgp = data;
+        break;
+    case PPU_OBP0:
+        g_ppu.obp0 = data;
+        break;
+    case PPU_OBP1:
+        g_ppu.obp1 = data;
+        break;
+    case PPU_WY:
+        g_ppu.wy = data;
+        break;
+    case PPU_WX:
+        g_ppu.wx = data;
+        break;
+
+    default:
+    case PPU_UNKNOWN:
+        log_warn("Invalid LCD write: (" HEX16 "). Skipping", address);
+        break;
+    }
+}
+
+u8 read_ppu(u16 address)
+{
+    switch ((ppu_registers)address) {
+    case PPU_LCDC:
+        return g_ppu.lcdc;
+    case PPU_STAT:
+        // Bit 7 is unused and always set
+        return 0x80 | g_ppu.stat | ((g_ppu.ly == g_ppu.lyc) << STAT_LYC_EQUAL) |
+             (BIT(g_ppu.lcdc, LCDC_ENABLE) ? g_ppu.mode : PPU_HBLANK);
+    case PPU_SCY:
+        return g_ppu.scy;
+    case PPU_SCX:
+        return g_ppu.scx;
+    case PPU_LY:
+        return g_ppu.ly;
+    case PPU_LYC:
+        return g_ppu.lyc;
+    case PPU_DMA:
+        return g_ppu.dma;
+    case PPU_BGP:
+        return g_ppu.bgp;
+    case PPU_OBP0:
+        return g_ppu.obp0;
+    case PPU_OBP1:
+        return g_ppu.obp1;
+    case PPU_WY:
+        return g_ppu.wy;
+    case PPU_WX:
+        return g_ppu.wx;
+
+    default:
+    case PPU_UNKNOWN:
+        log_warn("Invalid LCD read: (" HEX16 "). Skipping", address);
+        return 0;
+    }
+}
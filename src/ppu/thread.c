@@ -0,0 +1,267 @@
+/**
+ * \file thread.c
+ * \brief Pipelined scanline renderer
+ *
+ * Same rendering as the scanline engine, except that the lines are drawn by
+ * a separate render thread so that the CPU never waits for the pixels to be
+ * composed.
+ *
+ * When entering mode 3, the CPU thread pushes a snapshot of the line's state
+ * (registers and selected sprites) into a single-producer single-consumer
+ * ring, which the render thread consumes.
+ *
+ * The VRAM is shared through copy-on-write pages: the CPU thread only copies
+ * the pages that were modified since the previous line into free pages of a
+ * pool, and each snapshot references the pages that were current at that
+ * time. The render thread releases them once the line is drawn.
+ *
+ * If the render thread lags too far behind (the ring or the pool of pages is
+ * full), lines are dropped instead of stalling the emulation.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "ppu/engine.h"
+#include "ppu/ppu.h"
+#include "utils/error.h"
+#include "utils/macro.h"
+
+/// Number of snapshots in the ring (power of 2), around 7 frames. The render
+/// thread can be kept from running for a few milliseconds by the scheduler.
+#define RING_SIZE 1024
+/// Pages copied by the CPU thread. Games usually only modify the VRAM during
+/// VBlank, but this is enough for a whole frame that modifies every page on
+/// each line.
+#define PAGE_POOL_SIZE 2048
+#define PAGE_NONE PAGE_POOL_SIZE
+
+/// Wake the render thread up once this many lines are waiting, even if the
+/// frame is not over yet.
+#define WAKE_THRESHOLD (RING_SIZE / 2)
+
+#define CACHE_LINE 64
+
+struct line_snapshot {
+    struct ppu_line line;
+    u16 pages[VRAM_PAGES]; ///< Index of the VRAM pages inside the pool
+};
+
+static struct vram_page {
+    u8 data[VRAM_PAGE_SIZE];
+    u32 refcount; ///< Number of snapshots (and current view) using the page
+} g_pages[PAGE_POOL_SIZE];
+
+static struct render_thread {
+    struct line_snapshot ring[RING_SIZE];
+
+    // Monotonic counters, the ring is empty when they are equal
+    u32 head __attribute__((aligned(CACHE_LINE))); ///< Written by the CPU
+    u32 tail __attribute__((aligned(CACHE_LINE))); ///< Written by the renderer
+
+    // Only accessed by the CPU thread
+    u16 current[VRAM_PAGES] __attribute__((aligned(CACHE_LINE)));
+    u16 next_page; ///< Where to start looking for a free page
+    bool started;
+
+    // Sleep/wake-up of the render thread, never used on the fast path
+    bool sleeping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t drained;
+} g_render = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+};
+
+static void release_page(u16 page)
+{
+    __atomic_sub_fetch(&g_pages[page].refcount, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Find a page that is not referenced anymore.
+ * Pages are released roughly in the order they were allocated, so the search
+ * usually stops right away.
+ *
+ * Return PAGE_NONE if all the pages are still in use.
+ */
+static u16 allocate_page()
+{
+    for (u16 i = 0; i < PAGE_POOL_SIZE; ++i) {
+        const u16 page = (g_render.next_page + i) % PAGE_POOL_SIZE;
+        if (!__atomic_load_n(&g_pages[page].refcount, __ATOMIC_ACQUIRE)) {
+            g_render.next_page = (page + 1) % PAGE_POOL_SIZE;
+            __atomic_store_n(&g_pages[page].refcount, 1, __ATOMIC_RELAXED);
+            return page;
+        }
+    }
+
+    return PAGE_NONE;
+}
+
+/*
+ * Copy the pages that were modified by the CPU since the previous line.
+ * Return false if the pool was too small to copy all of them.
+ */
+static bool update_pages()
+{
+    for (u8 i = 0; i < VRAM_PAGES; ++i) {
+        if (!BIT(g_ppu.vram_dirty, i))
+            continue;
+
+        const u16 page = allocate_page();
+        if (page == PAGE_NONE)
+            return false;
+
+        memcpy(g_pages[page].data,
+               &g_cpu.memory[VRAM_START + i * VRAM_PAGE_SIZE], VRAM_PAGE_SIZE);
+        release_page(g_render.current[i]);
+        g_render.current[i] = page;
+        g_ppu.vram_dirty &= ~(1 << i);
+    }
+
+    return true;
+}
+
+static void render_snapshot(const struct line_snapshot *snapshot_ptr)
+{
+    const u8 *vram[VRAM_PAGES];
+
+    for (u8 i = 0; i < VRAM_PAGES; ++i)
+        vram[i] = g_pages[snapshot_ptr->pages[i]].data;
+
+    render_line(&snapshot_ptr->line, vram,
+                g_ppu.framebuffer[snapshot_ptr->line.ly]);
+
+    for (u8 i = 0; i < VRAM_PAGES; ++i)
+        release_page(snapshot_ptr->pages[i]);
+
+    if (snapshot_ptr->line.ly == LCD_HEIGHT - 1)
+        ppu_frame_done();
+}
+
+static void *render_loop(void *arg)
+{
+    (void)arg;
+
+    while (true) {
+        u32 tail = g_render.tail;
+
+        while (tail != __atomic_load_n(&g_render.head, __ATOMIC_ACQUIRE)) {
+            render_snapshot(&g_render.ring[tail % RING_SIZE]);
+            __atomic_store_n(&g_render.tail, ++tail, __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_lock(&g_render.lock);
+        pthread_cond_broadcast(&g_render.drained);
+        __atomic_store_n(&g_render.sleeping, true, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&g_render.head, __ATOMIC_SEQ_CST) == tail)
+            pthread_cond_wait(&g_render.wake, &g_render.lock);
+        __atomic_store_n(&g_render.sleeping, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&g_render.lock);
+    }
+
+    return NULL;
+}
+
+static void start_thread()
+{
+    // The current view holds a reference to its pages
+    for (u8 i = 0; i < VRAM_PAGES; ++i)
+        g_render.current[i] = allocate_page();
+    g_ppu.vram_dirty = 0xFF;
+
+    ASSERT_MSG(g_render.current[VRAM_PAGES - 1] != PAGE_NONE,
+               "The VRAM page pool is too small");
+
+    if (pthread_create(&g_render.thread, NULL, render_loop, NULL))
+        FATAL_ERROR("Failed to start the render thread");
+
+    g_render.started = true;
+}
+
+static void wake_up()
+{
+    if (!__atomic_load_n(&g_render.sleeping, __ATOMIC_SEQ_CST))
+        return;
+
+    pthread_mutex_lock(&g_render.lock);
+    pthread_cond_signal(&g_render.wake);
+    pthread_mutex_unlock(&g_render.lock);
+}
+
+static void start_transfer()
+{
+    const u32 head = g_render.head;
+    const u32 tail = __atomic_load_n(&g_render.tail, __ATOMIC_ACQUIRE);
+    const u32 pending = head - tail;
+
+    if (!g_render.started)
+        start_thread();
+
+    struct line_snapshot *snapshot_ptr = &g_render.ring[head % RING_SIZE];
+
+    // Never wait for the render thread
+    if (pending == RING_SIZE || (g_ppu.vram_dirty && !update_pages())) {
+        struct ppu_line line;
+        ppu_line_snapshot(&line); // Keep the window's line counter in sync
+        g_ppu.stats.dropped_lines += 1;
+        wake_up();
+        return;
+    }
+
+    ppu_line_snapshot(&snapshot_ptr->line);
+
+    for (u8 i = 0; i < VRAM_PAGES; ++i) {
+        snapshot_ptr->pages[i] = g_render.current[i];
+        __atomic_add_fetch(&g_pages[g_render.current[i]].refcount, 1,
+                           __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&g_render.head, head + 1, __ATOMIC_SEQ_CST);
+
+    // Lines are drawn in batches, to avoid waking the thread up too often
+    if (g_ppu.ly == LCD_HEIGHT - 1 || pending + 1 >= WAKE_THRESHOLD)
+        wake_up();
+}
+
+static u16 transfer(u16 dots, bool *done_ptr)
+{
+    const u16 left = OAM_SCAN_DOTS + TRANSFER_DOTS - g_ppu.dot;
+
+    if (dots < left)
+        return dots;
+
+    *done_ptr = true;
+    return left;
+}
+
+static u16 transfer_dots()
+{
+    return TRANSFER_DOTS;
+}
+
+static void sync_lines()
+{
+    if (!g_render.started)
+        return;
+
+    pthread_mutex_lock(&g_render.lock);
+    while (__atomic_load_n(&g_render.tail, __ATOMIC_ACQUIRE) !=
+           g_render.head) {
+        pthread_cond_signal(&g_render.wake);
+        pthread_cond_wait(&g_render.drained, &g_render.lock);
+    }
+    pthread_mutex_unlock(&g_render.lock);
+}
+
+const struct ppu_engine g_thread_engine = {
+    .start_transfer = start_transfer,
+    .transfer = transfer,
+    .transfer_dots = transfer_dots,
+    .sync = sync_lines,
+    .async = true,
+};
@@ -1,30 +1,110 @@
 #include "test_rom.h"
 
-#include "cpu/memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu/cpu.h"
+#include "cpu/serial.h"
+#include "utils/error.h"
 #include "utils/log.h"
 
-static char g_output[1024] = {0};
-static u16 g_output_size = 0;
+#define INITIAL_CAPACITY 256
 
-#define TEST_CHECK 0xFF02
-#define TEST_VALUE 0xFF01
+#define PASSED "Passed"
+#define FAILED "Failed"
 
-#define CHECK_TRUE 0x81
+static struct test_rom {
+    char *output;
+    size_t size;
+    size_t capacity;
+    size_t flushed; ///< Start of the line being printed
+    bool stop_on_result;
+    test_rom_result result;
+} g_test_rom;
 
-void test_rom_update()
+static void flush_line(size_t end)
 {
-    if (read_memory(TEST_CHECK) == CHECK_TRUE) {
-        g_output[g_output_size++] = (char)read_memory(TEST_VALUE);
-        write_memory(TEST_CHECK, 0);
-    }
+    const size_t length = end - g_test_rom.flushed;
+
+    if (length)
+        log_info("test result: %.*s", (int)length,
+                 &g_test_rom.output[g_test_rom.flushed]);
+}
+
+static bool ends_with(const char *suffix)
+{
+    const size_t length = strlen(suffix);
+
+    return g_test_rom.size >= length &&
+           !memcmp(&g_test_rom.output[g_test_rom.size - length], suffix,
+                   length);
 }
 
-void test_rom_print()
+static void capture(u8 data)
 {
-    static u16 last_output_size = 0;
+    if (g_test_rom.size == g_test_rom.capacity) {
+        g_test_rom.capacity *= 2;
+        g_test_rom.output = realloc(g_test_rom.output, g_test_rom.capacity);
+        if (!g_test_rom.output)
+            FATAL_ERROR("Failed to allocate the test output");
+    }
+
+    g_test_rom.output[g_test_rom.size++] = data;
 
-    if (g_output[0] && g_output_size > last_output_size) {
-        log_info("test result: %s", g_output);
-        last_output_size = g_output_size;
+    if (data == '\n') {
+        flush_line(g_test_rom.size - 1);
+        g_test_rom.flushed = g_test_rom.size;
+        return;
     }
+
+    if (g_test_rom.result != TEST_ROM_RUNNING)
+        return;
+
+    if (ends_with(PASSED))
+        g_test_rom.result = TEST_ROM_PASSED;
+    else if (ends_with(FAILED))
+        g_test_rom.result = TEST_ROM_FAILED;
+    else
+        return;
+
+    if (g_test_rom.stop_on_result)
+        g_cpu.is_running = false;
+}
+
+void test_rom_start(bool stop_on_result)
+{
+    g_test_rom.output = malloc(INITIAL_CAPACITY);
+    if (!g_test_rom.output)
+        FATAL_ERROR("Failed to allocate the test output");
+
+    g_test_rom.capacity = INITIAL_CAPACITY;
+    g_test_rom.size = 0;
+    g_test_rom.flushed = 0;
+    g_test_rom.stop_on_result = stop_on_result;
+    g_test_rom.result = TEST_ROM_RUNNING;
+
+    serial_set_transfer_callback(capture);
+}
+
+void test_rom_stop()
+{
+    if (!g_test_rom.output)
+        return;
+
+    serial_set_transfer_callback(NULL);
+    flush_line(g_test_rom.size);
+
+    free(g_test_rom.output);
+    g_test_rom.output = NULL;
+}
+
+test_rom_result test_rom_get_result()
+{
+    return g_test_rom.result;
+}
+
+const char *test_rom_output(size_t *size_ptr)
+{
+    *size_ptr = g_test_rom.size;
+    return g_test_rom.output;
 }
@@ -0,0 +1,181 @@
+#include "utils/timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils/log.h"
+
+__thread struct timing g_timing;
+
+static const char *g_zone_names[TIMING_ZONE_COUNT] = {
+    [TIMING_MAIN] = "main",
+    [TIMING_DECODE] = "decode",
+    [TIMING_EXECUTE] = "execute",
+    [TIMING_BUS] = "bus",
+    [TIMING_CARTRIDGE] = "cartridge",
+    [TIMING_TIMER] = "timer",
+    [TIMING_INTERRUPTS] = "interrupts",
+    [TIMING_PPU] = "ppu",
+    [TIMING_APU] = "apu",
+    [TIMING_LOG] = "log",
+};
+
+static struct {
+    FILE *csv_ptr;
+    u64 frame_ticks[TIMING_ZONE_COUNT]; ///< Totals at the end of last frame
+    u32 frames;
+    u64 clock_cost; ///< Minimum duration of a clock read
+    struct timespec start_time;
+} g_run;
+
+const char *timing_zone_name(timing_zone zone)
+{
+    return g_zone_names[zone];
+}
+
+static u64 elapsed_ns(const struct timespec *start_ptr)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start_ptr->tv_sec) * 1000000000LL +
+           (now.tv_nsec - start_ptr->tv_nsec);
+}
+
+static u64 measure_clock_cost(void)
+{
+    u64 cost = UINT64_MAX;
+
+    for (int i = 0; i < 1000; ++i) {
+        const u64 start = timing_now();
+        const u64 end = timing_now();
+        cost = MIN(cost, end - start);
+    }
+
+    return cost;
+}
+
+bool timing_start(const char *path)
+{
+    memset(&g_run, 0, sizeof(g_run));
+    memset(&g_timing, 0, sizeof(g_timing));
+
+    if (path) {
+        g_run.csv_ptr = fopen(path, "w");
+        if (!g_run.csv_ptr) {
+            log_err("Failed to open the host timers output '%s'", path);
+            return false;
+        }
+
+        fprintf(g_run.csv_ptr, "frame,total");
+        for (int zone = 0; zone < TIMING_ZONE_COUNT; ++zone)
+            fprintf(g_run.csv_ptr, ",%s", g_zone_names[zone]);
+        fputc('\n', g_run.csv_ptr);
+    }
+
+    g_run.clock_cost = measure_clock_cost();
+    clock_gettime(CLOCK_MONOTONIC, &g_run.start_time);
+
+    g_timing.depth = 1;
+    g_timing.stack[0] = TIMING_MAIN;
+    g_timing.calls[TIMING_MAIN] = 1;
+    g_timing.last = timing_now();
+    g_timing.enabled = true;
+
+    return true;
+}
+
+// Attribute the time elapsed since the last transition to the current zone
+static void flush_ticks(void)
+{
+    const u64 now = timing_now();
+
+    g_timing.ticks[g_timing.stack[g_timing.depth - 1]] += now - g_timing.last;
+    g_timing.last = now;
+}
+
+void timing_write_frame(u32 frame)
+{
+    u64 ticks[TIMING_ZONE_COUNT];
+    u64 total = 0;
+
+    g_run.frames += 1;
+    if (!g_run.csv_ptr)
+        return;
+
+    flush_ticks();
+
+    for (int zone = 0; zone < TIMING_ZONE_COUNT; ++zone) {
+        ticks[zone] = g_timing.ticks[zone] - g_run.frame_ticks[zone];
+        g_run.frame_ticks[zone] = g_timing.ticks[zone];
+        total += ticks[zone];
+    }
+
+    fprintf(g_run.csv_ptr, "%u,%llu", frame, (unsigned long long)total);
+    for (int zone = 0; zone < TIMING_ZONE_COUNT; ++zone)
+        fprintf(g_run.csv_ptr, ",%llu", (unsigned long long)ticks[zone]);
+    fputc('\n', g_run.csv_ptr);
+
+    // Do not attribute the time spent writing the line
+    g_timing.last = timing_now();
+}
+
+static int compare_zones(const void *lhs, const void *rhs)
+{
+    const u64 lhs_ticks = g_timing.ticks[*(const u8 *)lhs];
+    const u64 rhs_ticks = g_timing.ticks[*(const u8 *)rhs];
+
+    return (lhs_ticks < rhs_ticks) - (lhs_ticks > rhs_ticks);
+}
+
+void timing_stop(void)
+{
+    u8 zones[TIMING_ZONE_COUNT];
+    u64 total = 0;
+    u64 transitions = 0;
+
+    if (!g_timing.enabled)
+        return;
+
+    flush_ticks();
+    g_timing.enabled = false;
+
+    const u64 duration = elapsed_ns(&g_run.start_time);
+
+    if (g_run.csv_ptr) {
+        fclose(g_run.csv_ptr);
+        g_run.csv_ptr = NULL;
+    }
+
+    for (int zone = 0; zone < TIMING_ZONE_COUNT; ++zone) {
+        zones[zone] = zone;
+        total += g_timing.ticks[zone];
+        transitions += g_timing.calls[zone];
+    }
+
+    qsort(zones, TIMING_ZONE_COUNT, sizeof(*zones), compare_zones);
+
+    log_info("Host timers: %llu cycles in %.1f ms (%.2f cycles/ns), %u frames",
+             (unsigned long long)total, duration / 1e6,
+             duration ? (double)total / duration : 0.0, g_run.frames);
+    log_info("%-12s %16s %7s %12s %12s", "Zone", "Cycles", "Share", "Calls",
+             "Cycles/call");
+
+    for (int i = 0; i < TIMING_ZONE_COUNT; ++i) {
+        const u8 zone = zones[i];
+        const u64 ticks = g_timing.ticks[zone];
+        const u64 calls = g_timing.calls[zone];
+
+        log_info("%-12s %16lu %6.2f%% %12lu %12.1f", g_zone_names[zone], ticks,
+                 total ? 100.0 * ticks / total : 0.0, calls,
+                 calls ? (double)ticks / calls : 0.0);
+    }
+
+    // Each scope reads the clock twice
+    const u64 overhead = 2 * transitions * g_run.clock_cost;
+    log_info("Measurement overhead: ~%.1f%% (%llu cycles per clock read)",
+             total ? 100.0 * overhead / total : 0.0,
+             (unsigned long long)g_run.clock_cost);
+}
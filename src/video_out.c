@@ -0,0 +1,170 @@
+#include "video_out.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ppu/ppu.h"
+#include "utils/error.h"
+#include "utils/file.h"
+#include "utils/log.h"
+
+/// Triple buffering: one frame being written, one ready, one being filled
+#define FRAME_COUNT 3
+#define FRAME_SIZE (LCD_WIDTH * LCD_HEIGHT)
+
+static struct video_out {
+    int fd;
+    bool failed; ///< An error occurred, stop writing
+
+    // Conversion from the PPU's shades to the output format
+    u8 palette[4];
+
+    // Frame ring, the frames between tail and head are waiting to be written
+    u8 frames[FRAME_COUNT][FRAME_SIZE];
+    u32 head; ///< Written by the producer (PPU)
+    u32 tail; ///< Written by the writer thread
+
+    struct video_out_stats stats;
+
+    bool sleeping;
+    bool closing;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} g_video = {
+    .fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+// Write all the ready frames at once
+static void write_frames(u32 tail, u32 head)
+{
+    struct iovec iov[FRAME_COUNT];
+    int count = 0;
+
+    for (u32 frame = tail; frame != head; ++frame) {
+        iov[count].iov_base = g_video.frames[frame % FRAME_COUNT];
+        iov[count].iov_len = FRAME_SIZE;
+        count += 1;
+    }
+
+    if (!g_video.failed && !write_all(g_video.fd, iov, count)) {
+        log_err("Failed to write video output: %s", strerror(errno));
+        g_video.failed = true;
+    }
+}
+
+static void *writer_loop(void *arg)
+{
+    (void)arg;
+
+    while (true) {
+        const u32 tail = g_video.tail;
+        const u32 head = __atomic_load_n(&g_video.head, __ATOMIC_ACQUIRE);
+
+        if (tail != head) {
+            write_frames(tail, head);
+            if (!g_video.failed)
+                __atomic_add_fetch(&g_video.stats.written_frames, head - tail,
+                                   __ATOMIC_RELAXED);
+            __atomic_store_n(&g_video.tail, head, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        pthread_mutex_lock(&g_video.lock);
+        __atomic_store_n(&g_video.sleeping, true, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&g_video.head, __ATOMIC_SEQ_CST) == tail &&
+            !g_video.closing)
+            pthread_cond_wait(&g_video.wake, &g_video.lock);
+        __atomic_store_n(&g_video.sleeping, false, __ATOMIC_RELAXED);
+        const bool closing = g_video.closing;
+        pthread_mutex_unlock(&g_video.lock);
+
+        if (closing && __atomic_load_n(&g_video.head, __ATOMIC_ACQUIRE) == tail)
+            break;
+    }
+
+    return NULL;
+}
+
+// Called by the PPU on each frame, must never block
+static void push_frame(const u8 *framebuffer_ptr)
+{
+    const u32 head = g_video.head;
+
+    if (head - __atomic_load_n(&g_video.tail, __ATOMIC_ACQUIRE) ==
+        FRAME_COUNT) {
+        g_video.stats.dropped_frames += 1;
+        return;
+    }
+
+    u8 *frame_ptr = g_video.frames[head % FRAME_COUNT];
+    for (u16 i = 0; i < FRAME_SIZE; ++i)
+        frame_ptr[i] = g_video.palette[framebuffer_ptr[i]];
+
+    __atomic_store_n(&g_video.head, head + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&g_video.sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&g_video.lock);
+        pthread_cond_signal(&g_video.wake);
+        pthread_mutex_unlock(&g_video.lock);
+    }
+}
+
+void video_out_open(const char *path, video_format format)
+{
+    static const u8 palettes[][4] = {
+        [VIDEO_GRAY] = {0xFF, 0xAA, 0x55, 0x00},
+        [VIDEO_SHADES] = {0, 1, 2, 3},
+    };
+
+    g_video.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (g_video.fd < 0)
+        FATAL_ERROR("Failed to open video output '%s': %s", path,
+                    strerror(errno));
+
+    memcpy(g_video.palette, palettes[format], sizeof(g_video.palette));
+
+    // Report errors through writev when the consumer closes the FIFO
+    signal(SIGPIPE, SIG_IGN);
+
+    if (pthread_create(&g_video.thread, NULL, writer_loop, NULL))
+        FATAL_ERROR("Failed to start the video output thread");
+
+    ppu_set_frame_callback(push_frame);
+}
+
+void video_out_close()
+{
+    if (g_video.fd < 0)
+        return;
+
+    // The render thread might still be reporting frames
+    ppu_sync();
+    ppu_set_frame_callback(NULL);
+
+    pthread_mutex_lock(&g_video.lock);
+    g_video.closing = true;
+    pthread_cond_signal(&g_video.wake);
+    pthread_mutex_unlock(&g_video.lock);
+
+    pthread_join(g_video.thread, NULL);
+    close(g_video.fd);
+    g_video.fd = -1;
+}
+
+struct video_out_stats video_out_get_stats()
+{
+    struct video_out_stats stats;
+
+    stats.written_frames =
+        __atomic_load_n(&g_video.stats.written_frames, __ATOMIC_RELAXED);
+    stats.dropped_frames = g_video.stats.dropped_frames;
+
+    return stats;
+}
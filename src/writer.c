@@ -0,0 +1,68 @@
+#include "utils/writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils/error.h"
+#include "utils/file.h"
+#include "utils/log.h"
+
+// Keep the standard output for the writer, everything else that was written
+// there (logs, banners, ...) now goes to the standard error
+static int take_stdout(void)
+{
+    const int fd = dup(STDOUT_FILENO);
+
+    if (fd >= 0) {
+        fflush(stdout);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    return fd;
+}
+
+bool writer_open(struct writer *writer_ptr, const char *path)
+{
+    writer_ptr->fd = path ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+                          : take_stdout();
+    if (writer_ptr->fd < 0)
+        return false;
+
+    writer_ptr->buffer = malloc(WRITER_BUFFER_SIZE);
+    if (!writer_ptr->buffer)
+        FATAL_ERROR("Failed to allocate the output buffer");
+
+    writer_ptr->failed = false;
+    writer_ptr->used = 0;
+
+    return true;
+}
+
+void writer_flush(struct writer *writer_ptr)
+{
+    struct iovec iov = {writer_ptr->buffer, writer_ptr->used};
+
+    if (!writer_ptr->failed && !write_all(writer_ptr->fd, &iov, 1)) {
+        log_err("Failed to write output: %s", strerror(errno));
+        writer_ptr->failed = true;
+    }
+
+    writer_ptr->used = 0;
+}
+
+void writer_close(struct writer *writer_ptr)
+{
+    if (!writer_ptr->buffer)
+        return;
+
+    writer_flush(writer_ptr);
+
+    close(writer_ptr->fd);
+
+    free(writer_ptr->buffer);
+    writer_ptr->buffer = NULL;
+}
@@ -0,0 +1,190 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+extern "C" {
+#include <apu/apu.h>
+#include <apu/blip.h>
+#include <utils/macro.h>
+}
+
+namespace apu_tests
+{
+
+// Machine cycles in a video frame
+#define FRAME_CYCLES (70224 / 4)
+
+static std::vector<i16> g_samples;
+
+static void StoreSamples(const i16 *samples_ptr, size_t count)
+{
+    g_samples.insert(g_samples.end(), samples_ptr, samples_ptr + 2 * count);
+}
+
+class APUTest : public ::testing::Test
+{
+  public:
+    void SetUp() override
+    {
+        apu_set_sample_callback(nullptr, 0);
+        reset_apu();
+        g_samples.clear();
+    }
+
+    void TearDown() override
+    {
+        apu_set_sample_callback(nullptr, 0);
+    }
+
+    static void RunCycles(unsigned cycles)
+    {
+        while (cycles--)
+            apu_ticks(1);
+    }
+};
+
+TEST_F(APUTest, ReadMasks)
+{
+    write_apu(APU_NR10, 0x00);
+    write_apu(APU_NR11, 0x00);
+    write_apu(APU_NR30, 0x00);
+    write_apu(APU_NR50, 0x00);
+
+    ASSERT_EQ(read_apu(APU_NR10), 0x80);
+    ASSERT_EQ(read_apu(APU_NR11), 0x3F);
+    ASSERT_EQ(read_apu(APU_NR13), 0xFF); // Write-only
+    ASSERT_EQ(read_apu(APU_NR30), 0x7F);
+    ASSERT_EQ(read_apu(APU_NR50), 0x00);
+    ASSERT_EQ(read_apu(0xFF15), 0xFF); // Unused
+    ASSERT_EQ(read_apu(0xFF27), 0xFF);
+}
+
+TEST_F(APUTest, WaveRAM)
+{
+    for (u16 address = APU_WAVE_START; address <= APU_WAVE_END; ++address)
+        write_apu(address, address & 0xFF);
+
+    for (u16 address = APU_WAVE_START; address <= APU_WAVE_END; ++address)
+        ASSERT_EQ(read_apu(address), address & 0xFF);
+}
+
+TEST_F(APUTest, PowerOff)
+{
+    write_apu(APU_WAVE_START, 0x42);
+    write_apu(APU_NR52, 0x00);
+
+    ASSERT_EQ(read_apu(APU_NR52), 0x70);
+    ASSERT_EQ(read_apu(APU_NR50), 0x00);
+    ASSERT_EQ(read_apu(APU_NR12), 0x00);
+    ASSERT_EQ(read_apu(APU_WAVE_START), 0x42); // Not cleared
+
+    // Registers are read-only while off
+    write_apu(APU_NR50, 0x77);
+    ASSERT_EQ(read_apu(APU_NR50), 0x00);
+
+    write_apu(APU_NR52, 0x80);
+    write_apu(APU_NR50, 0x77);
+    ASSERT_EQ(read_apu(APU_NR50), 0x77);
+    ASSERT_EQ(read_apu(APU_NR52), 0xF0);
+}
+
+TEST_F(APUTest, Trigger)
+{
+    // No DAC: the channel cannot be enabled
+    write_apu(APU_NR22, 0x00);
+    write_apu(APU_NR24, 0x80);
+    ASSERT_FALSE(BIT(read_apu(APU_NR52), 1));
+
+    write_apu(APU_NR22, 0xF0);
+    write_apu(APU_NR24, 0x80);
+    ASSERT_TRUE(BIT(read_apu(APU_NR52), 1));
+
+    // Disabling the DAC disables the channel
+    write_apu(APU_NR22, 0x00);
+    ASSERT_FALSE(BIT(read_apu(APU_NR52), 1));
+}
+
+TEST_F(APUTest, Length)
+{
+    write_apu(APU_NR22, 0xF0);
+    write_apu(APU_NR21, 0x3E); // 2 length clocks
+    write_apu(APU_NR24, 0xC0);
+
+    // Length counters are clocked at 256Hz
+    RunCycles(2048);
+    ASSERT_TRUE(BIT(read_apu(APU_NR52), 1));
+    RunCycles(2 * 2048);
+    ASSERT_FALSE(BIT(read_apu(APU_NR52), 1));
+}
+
+TEST_F(APUTest, Samples)
+{
+    // 1kHz square wave, left only
+    write_apu(APU_NR50, 0x77);
+    write_apu(APU_NR51, 0x20);
+    apu_set_sample_callback(StoreSamples, 48000);
+
+    write_apu(APU_NR21, 0x80);
+    write_apu(APU_NR22, 0xF0);
+    write_apu(APU_NR23, LSB(1917));
+    write_apu(APU_NR24, 0x80 | MSB(1917));
+
+    RunCycles(10 * FRAME_CYCLES);
+
+    const size_t count = g_samples.size() / 2;
+    ASSERT_NEAR(count, 48000ULL * 10 * 70224 / 4194304, 2);
+
+    // Skip the first frames, until the filter has settled
+    unsigned crossings = 0;
+    i16 peak = 0;
+    for (size_t i = count / 5; i < count; ++i) {
+        const i16 left = g_samples[2 * i];
+        ASSERT_EQ(g_samples[2 * i + 1], 0);
+        peak = std::max<i16>(peak, std::abs(left));
+        crossings += (left < 0) != (g_samples[2 * (i - 1)] < 0);
+    }
+
+    const double duration = (count - count / 5) / 48000.0;
+    ASSERT_NEAR(crossings / duration, 2 * 1000, 100);
+    ASSERT_GT(peak, 15 * 64 * 8 / 2);
+}
+
+TEST_F(APUTest, MutedChannel)
+{
+    write_apu(APU_NR51, 0x00);
+    apu_set_sample_callback(StoreSamples, 48000);
+
+    write_apu(APU_NR22, 0xF0);
+    write_apu(APU_NR24, 0x80);
+
+    RunCycles(5 * FRAME_CYCLES);
+
+    for (const i16 sample : g_samples)
+        ASSERT_EQ(sample, 0);
+}
+
+TEST(Blip, Step)
+{
+    static struct blip blip;
+    i16 samples[64];
+
+    blip_init(&blip, 1000, 1000);
+    blip_add_delta(&blip, 10, 10000);
+    blip_end_frame(&blip, 64);
+
+    ASSERT_EQ(blip_samples_avail(&blip), 64);
+    ASSERT_EQ(blip_read_samples(&blip, samples, 64, false), 64);
+    ASSERT_EQ(blip_samples_avail(&blip), 0);
+
+    // The step is spread around its position, and slowly filtered out
+    ASSERT_EQ(samples[0], 0);
+    ASSERT_NEAR(samples[30], 10000, 500);
+    ASSERT_LT(samples[63], samples[30]);
+}
+
+} // namespace apu_tests
@@ -0,0 +1,106 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include <apu/apu.h>
+#include <audio_out.h>
+}
+
+// The output registers itself as the APU's sample callback, keep it to push
+// known samples directly.
+static apu_sample_callback g_callback = nullptr;
+
+extern "C" void apu_set_sample_callback(apu_sample_callback callback,
+                                        u32 sample_rate)
+{
+    (void)sample_rate;
+    g_callback = callback;
+}
+
+namespace apu_tests
+{
+
+// Left, right
+static const i16 g_samples[] = {
+    0, 1, -1, 0x1234, -32768, 32767, 0x00FF, -256,
+};
+
+// The same samples, serialized as 16-bit little-endian
+static const std::vector<u8> g_bytes = {
+    0x00, 0x00, 0x01, 0x00, 0xFF, 0xFF, 0x34, 0x12,
+    0x00, 0x80, 0xFF, 0x7F, 0xFF, 0x00, 0x00, 0xFF,
+};
+
+class AudioOutTest : public ::testing::Test
+{
+  public:
+    void SetUp() override
+    {
+        char path[] = "/tmp/emu-gb-audio-XXXXXX";
+        const int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        output = path;
+    }
+
+    void TearDown() override
+    {
+        std::remove(output.c_str());
+    }
+
+    void Write(audio_format format)
+    {
+        audio_out_open(output.c_str(), format, APU_SAMPLE_RATE,
+                       RESAMPLER_MEDIUM);
+        ASSERT_NE(g_callback, nullptr);
+        g_callback(g_samples, std::size(g_samples) / 2);
+        audio_out_close();
+    }
+
+    std::vector<u8> Read() const
+    {
+        std::ifstream file(output, std::ios::binary);
+        return std::vector<u8>(std::istreambuf_iterator<char>(file), {});
+    }
+
+    std::string output;
+};
+
+TEST_F(AudioOutTest, Raw)
+{
+    Write(AUDIO_RAW);
+
+    ASSERT_EQ(Read(), g_bytes);
+    ASSERT_EQ(audio_out_get_stats().written_samples, 4);
+    ASSERT_EQ(audio_out_get_stats().dropped_samples, 0);
+}
+
+TEST_F(AudioOutTest, Wav)
+{
+    Write(AUDIO_WAV);
+
+    const auto bytes = Read();
+    ASSERT_EQ(bytes.size(), 44 + g_bytes.size());
+    ASSERT_EQ(std::string(bytes.begin(), bytes.begin() + 4), "RIFF");
+    ASSERT_EQ(std::string(bytes.begin() + 8, bytes.begin() + 16), "WAVEfmt ");
+    ASSERT_EQ(std::string(bytes.begin() + 36, bytes.begin() + 40), "data");
+
+    // Sizes, rewritten on close
+    const std::vector<u8> riff_size(bytes.begin() + 4, bytes.begin() + 8);
+    const std::vector<u8> data_size(bytes.begin() + 40, bytes.begin() + 44);
+    ASSERT_EQ(riff_size, std::vector<u8>({36 + 16, 0, 0, 0}));
+    ASSERT_EQ(data_size, std::vector<u8>({16, 0, 0, 0}));
+
+    ASSERT_EQ(std::vector<u8>(bytes.begin() + 44, bytes.end()), g_bytes);
+}
+
+} // namespace apu_tests
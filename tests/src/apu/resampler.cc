@@ -0,0 +1,121 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest-param-test.h>
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include <apu/resampler.h>
+}
+
+namespace apu_tests
+{
+
+// Aligned for the vectorized kernels
+static struct resampler g_resampler;
+
+// Stereo sine wave, the right channel is inverted
+static std::vector<i16> Sine(double frequency, u32 rate, size_t count)
+{
+    std::vector<i16> samples(2 * count);
+
+    for (size_t i = 0; i < count; ++i) {
+        const i16 value = 16000 * std::sin(2 * M_PI * frequency * i / rate);
+        samples[2 * i] = value;
+        samples[2 * i + 1] = -value;
+    }
+
+    return samples;
+}
+
+static std::vector<i16> Resample(const std::vector<i16> &input)
+{
+    const size_t count = input.size() / 2;
+    std::vector<i16> output;
+
+    // Feed the samples in small uneven blocks, like the APU does
+    for (size_t i = 0; i < count; i += 733) {
+        const size_t block = std::min<size_t>(733, count - i);
+        std::vector<i16> samples(
+            2 * resampler_max_output(&g_resampler, block));
+        const size_t generated = resampler_process(
+            &g_resampler, &input[2 * i], block, samples.data());
+        output.insert(output.end(), samples.begin(),
+                      samples.begin() + 2 * generated);
+    }
+
+    return output;
+}
+
+class ResamplerTest : public ::testing::TestWithParam<resampler_kernel>
+{
+  public:
+    void SetUp() override
+    {
+        if (!resampler_set_kernel(GetParam()))
+            GTEST_SKIP() << resampler_kernel_name(GetParam())
+                         << " is not supported";
+    }
+};
+
+TEST_P(ResamplerTest, Ratio)
+{
+    resampler_init(&g_resampler, 48000, 44100, RESAMPLER_MEDIUM);
+    const auto output = Resample(Sine(1000, 48000, 48000));
+
+    ASSERT_NEAR(output.size() / 2, 44100, 16);
+}
+
+TEST_P(ResamplerTest, Adjustment)
+{
+    resampler_init(&g_resampler, 48000, 48000, RESAMPLER_LOW);
+    resampler_set_adjustment(&g_resampler, 0.004);
+    ASSERT_NEAR(Resample(Sine(1000, 48000, 48000)).size() / 2, 47808, 16);
+
+    // Clamped to 0.5%
+    resampler_init(&g_resampler, 48000, 48000, RESAMPLER_LOW);
+    resampler_set_adjustment(&g_resampler, -0.1);
+    ASSERT_NEAR(Resample(Sine(1000, 48000, 48000)).size() / 2, 48241, 16);
+}
+
+TEST_P(ResamplerTest, Sine)
+{
+    resampler_init(&g_resampler, 48000, 44100, RESAMPLER_HIGH);
+    const auto output = Resample(Sine(1000, 48000, 48000));
+    const size_t count = output.size() / 2;
+
+    // Compare against the expected sine, once the filter's delay is removed
+    const double delay = (32 / 2 - 1) / 48000.0;
+    double error = 0;
+    for (size_t i = 100; i < count; ++i) {
+        const double t = i / 44100.0 + delay;
+        const double expected = 16000 * std::sin(2 * M_PI * 1000 * t);
+        error = std::max(error, std::abs(output[2 * i] - expected));
+        ASSERT_EQ(output[2 * i], -output[2 * i + 1]);
+    }
+
+    ASSERT_LT(error, 16000 * 0.01);
+}
+
+TEST_P(ResamplerTest, LowPass)
+{
+    // Above the output's Nyquist frequency
+    resampler_init(&g_resampler, 48000, 22050, RESAMPLER_HIGH);
+    const auto output = Resample(Sine(20000, 48000, 48000));
+
+    for (size_t i = 100; i < output.size(); ++i)
+        ASSERT_LT(std::abs(output[i]), 16000 * 0.05);
+}
+
+INSTANTIATE_TEST_SUITE_P(Kernels, ResamplerTest,
+                         ::testing::Values(RESAMPLER_SCALAR, RESAMPLER_SSE2,
+                                           RESAMPLER_AVX2, RESAMPLER_NEON),
+                         [](const auto &info) {
+                             return std::string(
+                                 resampler_kernel_name(info.param));
+                         });
+
+} // namespace apu_tests
@@ -0,0 +1,57 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <string>
+
+extern "C" {
+#include <cpu/instruction.h>
+}
+
+namespace cpu_tests
+{
+
+struct disassembly_param {
+    u8 bytes[3];
+    u8 length;
+    std::string text;
+};
+
+class DisassembleTest : public ::testing::TestWithParam<disassembly_param>
+{
+};
+
+TEST_P(DisassembleTest, Disassemble)
+{
+    const auto param = GetParam();
+    char buffer[32];
+
+    ASSERT_EQ(disassemble_instruction(param.bytes, buffer, sizeof(buffer)),
+              param.length);
+    ASSERT_EQ(std::string(buffer), param.text);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Instructions, DisassembleTest,
+    ::testing::Values(
+        disassembly_param{{0x00, 0x00, 0x00}, 1, "NOP"},
+        disassembly_param{{0x3E, 0x42, 0x00}, 2, "LD   A, 0x42"},
+        disassembly_param{{0x21, 0x00, 0xC0}, 3, "LD   HL, 0xC000"},
+        disassembly_param{{0x46, 0x00, 0x00}, 1, "LD   B, (HL)"},
+        disassembly_param{{0x2A, 0x00, 0x00}, 1, "LD   A, (HL+)"},
+        disassembly_param{{0xEA, 0x34, 0x12}, 3, "LD   (0x1234), A"},
+        disassembly_param{{0xE0, 0x44, 0x00}, 2, "LDH  (0x44), A"},
+        disassembly_param{{0x20, 0xFB, 0x00}, 2, "JR   NZ, -5"},
+        disassembly_param{{0xCA, 0x00, 0x02}, 3, "JP   Z, 0x0200"},
+        disassembly_param{{0xF5, 0x00, 0x00}, 1, "PUSH AF"},
+        disassembly_param{{0xC5, 0x00, 0x00}, 1, "PUSH BC"},
+        disassembly_param{{0x33, 0x00, 0x00}, 1, "INC  SP"},
+        disassembly_param{{0xFF, 0x00, 0x00}, 1, "RST  0x38"},
+        disassembly_param{{0xF8, 0xFE, 0x00}, 2, "LD   HL, SP-2"},
+        disassembly_param{{0xCB, 0x37, 0x00}, 2, "SWAP A"},
+        disassembly_param{{0xCB, 0x7E, 0x00}, 2, "BIT  7, (HL)"},
+        disassembly_param{{0xCB, 0xC1, 0x00}, 2, "SET  0, C"},
+        disassembly_param{{0xD3, 0x00, 0x00}, 1, "DB   0xD3"}));
+
+} // namespace cpu_tests
@@ -134,7 +134,7 @@ TEST_P(Add16BitRegisterToHL, Add)
 
 TEST_P(AddSigned8bitToSP, IntoSP)
 {
-    get_options()->trace = true;
+    log_set_level(LOG_INFO, true);
 
     const auto &param = GetParam();
     cpu.registers.sp = param.x;
@@ -16,22 +16,6 @@ extern "C" {
 
 #define cpu g_cpu // NOLINT
 
-struct timer {
-    u16 div;
-    u8 tima;
-    u8 tma;
-    u8 tac;
-};
-
-struct in_type {
-    in_name name;
-    operand_type type;
-    u8 cycle_count;
-    u8 cycle_count_false; // For conditional jumps
-};
-
-extern struct timer g_timer;
-
 class InstructionTest : public ::testing::Test
 {
   public:
@@ -44,7 +28,7 @@ class InstructionTest : public ::testing::Test
     {
         cpu.registers.pc = start_pc_;
         set_all_flags(false, false, false, false);
-        get_options()->trace = false; // Manually set the value when needed
+        log_set_level(LOG_INFO, false); // Manually enable traces when needed
 
         reset_timer();
     }
@@ -19,15 +19,6 @@ extern "C" {
 #include <utils/macro.h>
 }
 
-struct timer {
-    u16 div;
-    u8 tima;
-    u8 tma;
-    u8 tac;
-};
-
-extern struct timer g_timer;
-
 namespace cpu_tests
 {
 
@@ -55,7 +46,7 @@ using IME = InterrupTest;
 
 TEST_F(IME, Modify)
 {
-    get_options()->trace = true;
+    log_set_level(LOG_INFO, true);
 
     // DI: Disable ime
     call(0xF3);
@@ -81,7 +72,7 @@ TEST_F(IME, Modify)
 
 TEST_F(IME, HaltBug)
 {
-    get_options()->trace = true;
+    log_set_level(LOG_INFO, true);
 
     interrupt_set_ime(false);
 
@@ -0,0 +1,187 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" {
+#include <cpu/serial.h>
+#include <cpu/timer.h>
+#include <link.h>
+#include <utils/macro.h>
+}
+
+namespace cpu_tests
+{
+
+// Result of a transfer, sent back by the other process
+struct transfer {
+    u8 received;
+    u64 end;
+};
+
+class LinkTest : public ::testing::Test
+{
+  public:
+    void SetUp() override
+    {
+        char path[] = "/tmp/emu-gb-link-XXXXXX";
+        const int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        cable = path;
+
+        reset_timer();
+        reset_serial();
+    }
+
+    void TearDown() override
+    {
+        link_close();
+        std::remove(cable.c_str());
+    }
+
+    // Run until the transfer is over
+    static transfer Transfer(u8 data, u8 clock)
+    {
+        write_serial(SERIAL_SB, data);
+        write_serial(SERIAL_SC, 1 << SC_TRANSFER | clock << SC_CLOCK);
+
+        for (unsigned cycles = 0; cycles < 64 * SERIAL_TRANSFER_CYCLES;
+             cycles += 4) {
+            if (!BIT(read_serial(SERIAL_SC), SC_TRANSFER))
+                break;
+            timer_ticks(4);
+        }
+
+        return {read_serial(SERIAL_SB), timer_get_cycles()};
+    }
+
+    static void Ticks(unsigned cycles)
+    {
+        for (; cycles; cycles -= 4)
+            timer_ticks(4);
+    }
+
+    // Plug the other side into the cable from a child process, which sends
+    // back the result of its transfer through a pipe
+    pid_t Fork(u8 data, bool run = true)
+    {
+        int fds[2];
+        EXPECT_EQ(pipe(fds), 0);
+
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            link_open(cable.c_str());
+            if (!run)
+                pause();
+
+            const transfer result = Transfer(data, 0);
+            const bool written =
+                write(fds[1], &result, sizeof(result)) == sizeof(result);
+            link_close();
+            _exit(written ? 0 : 1);
+        }
+
+        close(fds[1]);
+        pipe_fd = fds[0];
+
+        while (!link_connected())
+            sched_yield();
+        return pid;
+    }
+
+    transfer Wait(pid_t pid)
+    {
+        transfer result = {};
+        int status;
+
+        EXPECT_EQ(read(pipe_fd, &result, sizeof(result)), sizeof(result));
+        close(pipe_fd);
+        EXPECT_EQ(waitpid(pid, &status, 0), pid);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        return result;
+    }
+
+    std::string cable;
+    int pipe_fd = -1;
+};
+
+TEST_F(LinkTest, Exchange)
+{
+    link_open(cable.c_str());
+    const pid_t pid = Fork(0x42);
+
+    Ticks(300);
+    const transfer master = Transfer(0x99, 1);
+    const transfer slave = Wait(pid);
+
+    ASSERT_EQ(master.received, 0x42);
+    ASSERT_EQ(slave.received, 0x99);
+
+    // Both sides exchanged their bytes at the same cycle
+    ASSERT_EQ(master.end, 300 + SERIAL_TRANSFER_CYCLES);
+    ASSERT_EQ(slave.end, master.end);
+
+    ASSERT_EQ(link_get_stats().sent_bytes, 1);
+}
+
+TEST_F(LinkTest, Unplugged)
+{
+    link_open(cable.c_str());
+    ASSERT_FALSE(link_connected());
+
+    const transfer master = Transfer(0x99, 1);
+    ASSERT_EQ(master.received, 0xFF);
+    ASSERT_EQ(master.end, SERIAL_TRANSFER_CYCLES);
+}
+
+TEST_F(LinkTest, Timeout)
+{
+    link_open(cable.c_str());
+
+    // The other side is plugged but its clock does not move
+    const pid_t pid = Fork(0x42, false);
+    const auto start = std::chrono::steady_clock::now();
+    const transfer master = Transfer(0x99, 1);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ASSERT_EQ(master.received, 0xFF);
+    ASSERT_EQ(master.end, SERIAL_TRANSFER_CYCLES);
+    ASSERT_GE(elapsed, std::chrono::seconds(1));
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(pipe_fd);
+}
+
+TEST_F(LinkTest, PeerDied)
+{
+    link_open(cable.c_str());
+
+    // Killed without unplugging itself
+    const pid_t dead = Fork(0x42, false);
+    kill(dead, SIGKILL);
+    waitpid(dead, NULL, 0);
+    close(pipe_fd);
+
+    ASSERT_FALSE(link_connected());
+    ASSERT_EQ(Transfer(0x99, 1).received, 0xFF);
+
+    // Another process takes the dead end of the cable
+    const pid_t pid = Fork(0x24);
+    const transfer master = Transfer(0x99, 1);
+    const transfer slave = Wait(pid);
+
+    ASSERT_EQ(master.received, 0x24);
+    ASSERT_EQ(slave.received, 0x99);
+}
+
+} // namespace cpu_tests
@@ -0,0 +1,198 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../cartridges/cartridge.hxx"
+
+extern "C" {
+#include <cpu/cpu.h>
+#include <cpu/instruction.h>
+#include <cpu/memory.h>
+#include <cpu/profiler.h>
+#include <cpu/symbols.h>
+}
+
+namespace cpu_tests
+{
+
+static std::string write_file(const std::string &name,
+                              const std::string &content)
+{
+    const std::string path = ::testing::TempDir() + name;
+    std::ofstream(path) << content;
+    return path;
+}
+
+static std::string read_file(const std::string &path)
+{
+    std::stringstream content;
+    content << std::ifstream(path).rdbuf();
+    return content.str();
+}
+
+class SymbolsTest : public ::testing::Test
+{
+  public:
+    void SetUp() override
+    {
+        const auto path = write_file("symbols.sym",
+                                     "; File generated by rgblink\n"
+                                     "00:0150 Main\n"
+                                     "00:0160 Main.loop\n"
+                                     "01:4000 BankOne\n"
+                                     "02:4000 BankTwo\n"
+                                     "00:c000 wBuffer\n");
+        ASSERT_TRUE(symbols_load(path.c_str()));
+    }
+
+    void TearDown() override
+    {
+        symbols_clear();
+    }
+};
+
+TEST_F(SymbolsTest, Find)
+{
+    u16 offset;
+
+    ASSERT_STREQ(symbols_find(0, 0x0150, &offset), "Main");
+    ASSERT_EQ(offset, 0);
+    ASSERT_STREQ(symbols_find(0, 0x0165, &offset), "Main.loop");
+    ASSERT_EQ(offset, 5);
+    ASSERT_EQ(symbols_find(0, 0x0100, &offset), nullptr);
+}
+
+TEST_F(SymbolsTest, Banks)
+{
+    ASSERT_STREQ(symbols_find(1, 0x4010, NULL), "BankOne");
+    ASSERT_STREQ(symbols_find(2, 0x4010, NULL), "BankTwo");
+    ASSERT_EQ(symbols_find(3, 0x4010, NULL), nullptr);
+
+    // The bank is ignored outside of the switchable ROM area
+    ASSERT_STREQ(symbols_find(5, 0x0150, NULL), "Main");
+}
+
+TEST_F(SymbolsTest, Regions)
+{
+    // Labels are not used outside of their memory region
+    ASSERT_STREQ(symbols_find(0, 0xC010, NULL), "wBuffer");
+    ASSERT_EQ(symbols_find(0, 0xFF80, NULL), nullptr);
+    ASSERT_EQ(symbols_find(0, 0x8000, NULL), nullptr);
+}
+
+TEST_F(SymbolsTest, Format)
+{
+    char name[32];
+
+    symbols_format(0, 0x0150, name, sizeof(name));
+    ASSERT_STREQ(name, "Main");
+    symbols_format(0, 0x016A, name, sizeof(name));
+    ASSERT_STREQ(name, "Main.loop+0xA");
+    symbols_format(0, 0x0100, name, sizeof(name));
+    ASSERT_STREQ(name, "00:0100");
+    symbols_format(3, 0x4567, name, sizeof(name));
+    ASSERT_STREQ(name, "03:4567");
+}
+
+class ProfilerTest : public ::testing::Test
+{
+  public:
+    ProfilerTest()
+    {
+        const auto cart = CartridgeGenerator<1 << 18>(ROM_ONLY);
+        cartridge = cart.GetCart();
+    }
+
+    void SetUp() override
+    {
+        if (!EMUGB_INSTRUMENT)
+            GTEST_SKIP() << "The profiler is not built (EMUGB_INSTRUMENT)";
+
+        reset_cpu();
+        reset_timer();
+        g_cpu.registers.pc = 0xC000;
+        g_cpu.registers.sp = 0xDFFE;
+
+        const auto path = write_file("profiler.sym", "00:c000 Start\n"
+                                                     "00:c100 First\n"
+                                                     "00:c200 Second\n");
+        ASSERT_TRUE(symbols_load(path.c_str()));
+
+        // Sample every cycle
+        profiler_start(NULL, 1, 0);
+    }
+
+    void TearDown() override
+    {
+        g_profiler_enabled = false;
+        symbols_clear();
+    }
+
+    void Load(u16 address, std::initializer_list<u8> bytes)
+    {
+        for (const u8 byte : bytes)
+            write_memory(address++, byte);
+    }
+
+    void Run(unsigned count)
+    {
+        while (count--) {
+            const u16 pc = g_cpu.registers.pc;
+            execute_instruction();
+            profiler_step(pc);
+        }
+    }
+
+    std::string Stacks()
+    {
+        const std::string path = ::testing::TempDir() + "profiler.folded";
+        EXPECT_TRUE(profiler_write_stacks(path.c_str()));
+        return read_file(path);
+    }
+};
+
+TEST_F(ProfilerTest, Calls)
+{
+    Load(0xC000, {0xCD, 0x00, 0xC1, 0x00}); // CALL First; NOP
+    Load(0xC100, {0xCD, 0x00, 0xC2, 0xC9}); // CALL Second; RET
+    Load(0xC200, {0x00, 0x00, 0xC9});       // NOP; NOP; RET
+
+    Run(7);
+
+    const auto stacks = Stacks();
+    ASSERT_NE(stacks.find("root "), std::string::npos) << stacks;
+    ASSERT_NE(stacks.find("root;First "), std::string::npos) << stacks;
+    ASSERT_NE(stacks.find("root;First;Second "), std::string::npos) << stacks;
+}
+
+TEST_F(ProfilerTest, Restart)
+{
+    Load(0xC000, {0xC7}); // RST 0x00
+    Load(0x0000, {0x00}); // NOP (ROM)
+
+    Run(2);
+
+    const auto stacks = Stacks();
+    ASSERT_NE(stacks.find("root;00:0000 "), std::string::npos) << stacks;
+}
+
+TEST_F(ProfilerTest, DiscardedReturnAddress)
+{
+    Load(0xC000, {0xCD, 0x00, 0xC1});       // CALL First
+    Load(0xC100, {0xE1, 0xCD, 0x00, 0xC2}); // POP HL; CALL Second
+    Load(0xC200, {0x00, 0x00});             // NOP; NOP
+
+    Run(5);
+
+    // First never returned, but its return address was popped
+    const auto stacks = Stacks();
+    ASSERT_NE(stacks.find("root;Second "), std::string::npos) << stacks;
+    ASSERT_EQ(stacks.find("root;First;Second "), std::string::npos) << stacks;
+}
+
+} // namespace cpu_tests
@@ -0,0 +1,134 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+
+#include "../cartridges/cartridge.hxx"
+
+extern "C" {
+#include <cpu/cpu.h>
+#include <cpu/instruction.h>
+#include <cpu/memory.h>
+#include <cpu/recorder.h>
+}
+
+namespace cpu_tests
+{
+
+class RecorderTest : public ::testing::Test
+{
+  public:
+    RecorderTest()
+    {
+        const auto cart = CartridgeGenerator<1 << 18>(ROM_ONLY);
+        cartridge = cart.GetCart();
+    }
+
+    void SetUp() override
+    {
+        if (!EMUGB_INSTRUMENT)
+            GTEST_SKIP() << "The recorder is not built (EMUGB_INSTRUMENT)";
+
+        reset_cpu();
+        reset_timer();
+        memset(&g_recorder, 0, sizeof(g_recorder));
+    }
+};
+
+TEST_F(RecorderTest, Writes)
+{
+    write_memory(0xC000, 0x42);
+    write_memory(0xC001, 0x43);
+
+    ASSERT_EQ(g_recorder.write_count, 2);
+    ASSERT_EQ(g_recorder.writes[0].address, 0xC000);
+    ASSERT_EQ(g_recorder.writes[0].value, 0x42);
+    ASSERT_EQ(g_recorder.writes[1].address, 0xC001);
+    ASSERT_EQ(g_recorder.writes[1].value, 0x43);
+}
+
+TEST_F(RecorderTest, Instructions)
+{
+    g_cpu.registers.pc = 0x0151; // The opcode at 0x0150 was fetched
+    g_cpu.registers.a = 0x12;
+    recorder_instruction(0x3E);
+
+    ASSERT_EQ(g_recorder.instruction_count, 1);
+    ASSERT_EQ(g_recorder.instructions[0].bytes[0], 0x3E);
+    ASSERT_EQ(g_recorder.instructions[0].length, 1);
+    ASSERT_EQ(g_recorder.instructions[0].registers.pc, 0x0150);
+    ASSERT_EQ(g_recorder.instructions[0].registers.a, 0x12);
+}
+
+TEST_F(RecorderTest, Operands)
+{
+    // LD A, d8 ; JP a16 ; BIT 7, H
+    const u8 program[] = {0x3E, 0x42, 0xC3, 0x34, 0x12, 0xCB, 0x7C};
+    for (unsigned i = 0; i < sizeof(program); ++i)
+        write_memory(0xC000 + i, program[i]);
+
+    g_cpu.registers.pc = 0xC000;
+    execute_instruction();
+    execute_instruction();
+    g_cpu.registers.pc = 0xC005;
+    execute_instruction();
+
+    // The bytes as they were fetched, even if the memory changes afterwards
+    write_memory(0xC001, 0x00);
+
+    ASSERT_EQ(g_recorder.instruction_count, 3);
+    ASSERT_EQ(g_recorder.instructions[0].length, 2);
+    ASSERT_EQ(g_recorder.instructions[0].bytes[1], 0x42);
+    ASSERT_EQ(g_recorder.instructions[1].length, 3);
+    ASSERT_EQ(g_recorder.instructions[1].bytes[1], 0x34);
+    ASSERT_EQ(g_recorder.instructions[1].bytes[2], 0x12);
+    ASSERT_EQ(g_recorder.instructions[2].length, 2);
+    ASSERT_EQ(g_recorder.instructions[2].bytes[1], 0x7C);
+}
+
+TEST_F(RecorderTest, Dump)
+{
+    char path[] = "/tmp/emu-gb-crash-XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(path);
+
+    recorder_start(path);
+
+    // Nothing was recorded yet
+    recorder_dump("Failed to load the cartridge");
+    ASSERT_NE(access(path, F_OK), 0);
+
+    recorder_instruction(0x00);
+
+    const std::string reason(200, 'x');
+    recorder_dump(reason.c_str());
+
+    std::ifstream file(path);
+    const std::string report((std::istreambuf_iterator<char>(file)), {});
+    unlink(path);
+
+    ASSERT_NE(report.find("Reason: " + reason + "\nCycle: "),
+              std::string::npos);
+    ASSERT_NE(report.find("HALT=0\n"), std::string::npos);
+    ASSERT_NE(report.find("Last 1 instructions"), std::string::npos);
+}
+
+TEST_F(RecorderTest, Wrap)
+{
+    for (unsigned i = 0; i < RECORDER_WRITES + 3; ++i)
+        write_memory(0xC000 + i, i);
+
+    // The oldest writes were overwritten
+    ASSERT_EQ(g_recorder.write_count, RECORDER_WRITES + 3);
+    ASSERT_EQ(g_recorder.writes[0].address, 0xC000 + RECORDER_WRITES);
+    ASSERT_EQ(g_recorder.writes[3].address, 0xC003);
+}
+
+} // namespace cpu_tests
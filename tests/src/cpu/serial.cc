@@ -0,0 +1,165 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include "../cartridges/cartridge.hxx"
+
+extern "C" {
+#include <cpu/cpu.h>
+#include <cpu/interrupt.h>
+#include <cpu/memory.h>
+#include <cpu/serial.h>
+#include <utils/macro.h>
+}
+
+namespace cpu_tests
+{
+
+// Other side of the link cable
+static u8 g_peer_data;
+static u8 g_sent_data;
+static unsigned g_polls;
+static unsigned g_starts;
+
+static void start(u8 data)
+{
+    g_sent_data = data;
+    g_starts += 1;
+}
+
+static u8 exchange(u8 data)
+{
+    g_sent_data = data;
+    return g_peer_data;
+}
+
+static u16 poll()
+{
+    g_polls += 1;
+    return SERIAL_BIT_CYCLES;
+}
+
+static const struct serial_link g_link = {start, exchange, poll};
+
+class SerialTest : public ::testing::Test
+{
+  public:
+    SerialTest()
+    {
+        const auto cart = CartridgeGenerator<1 << 18>(ROM_ONLY);
+        cartridge = cart.GetCart();
+    }
+
+    void SetUp() override
+    {
+        reset_cpu();
+        reset_serial();
+        serial_set_link(NULL);
+        write_memory(IF_ADDRESS, 0);
+        g_peer_data = 0;
+        g_sent_data = 0;
+        g_polls = 0;
+        g_starts = 0;
+    }
+
+    void TearDown() override
+    {
+        serial_set_link(NULL);
+    }
+
+    static void Ticks(unsigned cycles)
+    {
+        while (cycles) {
+            const u8 ticks = MIN(cycles, 4);
+            serial_ticks(ticks);
+            cycles -= ticks;
+        }
+    }
+};
+
+TEST_F(SerialTest, DefaultValues)
+{
+    ASSERT_EQ(read_memory(SERIAL_SB), 0x00);
+    ASSERT_EQ(read_memory(SERIAL_SC), 0x7E);
+}
+
+TEST_F(SerialTest, Unplugged)
+{
+    write_memory(SERIAL_SB, 0x42);
+    write_memory(SERIAL_SC, 0x81);
+
+    Ticks(SERIAL_TRANSFER_CYCLES - 4);
+    ASSERT_EQ(read_memory(SERIAL_SC), 0xFF);
+    ASSERT_EQ(read_memory(SERIAL_SB), 0x42);
+    ASSERT_FALSE(interrupt_is_set(IV_SERIAL));
+
+    Ticks(4);
+    ASSERT_EQ(read_memory(SERIAL_SC), 0x7F);
+    ASSERT_EQ(read_memory(SERIAL_SB), 0xFF);
+    ASSERT_TRUE(interrupt_is_set(IV_SERIAL));
+}
+
+TEST_F(SerialTest, InternalClock)
+{
+    serial_set_link(&g_link);
+    g_peer_data = 0x5A;
+
+    write_memory(SERIAL_SB, 0x42);
+    write_memory(SERIAL_SC, 0x81);
+    ASSERT_EQ(g_starts, 1);
+    ASSERT_EQ(g_sent_data, 0x42);
+
+    write_memory(SERIAL_SB, 0x24);
+    Ticks(SERIAL_TRANSFER_CYCLES);
+
+    ASSERT_EQ(g_sent_data, 0x24);
+    ASSERT_EQ(read_memory(SERIAL_SB), 0x5A);
+    ASSERT_TRUE(interrupt_is_set(IV_SERIAL));
+    ASSERT_EQ(g_polls, SERIAL_TRANSFER_CYCLES / SERIAL_BIT_CYCLES);
+}
+
+TEST_F(SerialTest, ExternalClock)
+{
+    serial_set_link(&g_link);
+
+    write_memory(SERIAL_SB, 0x42);
+    write_memory(SERIAL_SC, 0x80);
+
+    // Only the other side can drive the transfer
+    Ticks(4 * SERIAL_TRANSFER_CYCLES);
+    ASSERT_EQ(read_memory(SERIAL_SC), 0xFE);
+    ASSERT_FALSE(interrupt_is_set(IV_SERIAL));
+
+    ASSERT_EQ(serial_receive(0x5A), 0x42);
+    ASSERT_EQ(read_memory(SERIAL_SB), 0x5A);
+    ASSERT_EQ(read_memory(SERIAL_SC), 0x7E);
+    ASSERT_TRUE(interrupt_is_set(IV_SERIAL));
+}
+
+TEST_F(SerialTest, ExternalClockNotRequested)
+{
+    write_memory(SERIAL_SB, 0x42);
+
+    ASSERT_EQ(serial_receive(0x5A), 0xFF);
+    ASSERT_EQ(read_memory(SERIAL_SB), 0x42);
+    ASSERT_FALSE(interrupt_is_set(IV_SERIAL));
+
+    // The transfer was requested using the internal clock
+    write_memory(SERIAL_SC, 0x81);
+    ASSERT_EQ(serial_receive(0x5A), 0xFF);
+    ASSERT_EQ(read_memory(SERIAL_SB), 0x42);
+}
+
+TEST_F(SerialTest, Cancel)
+{
+    write_memory(SERIAL_SC, 0x81);
+    Ticks(SERIAL_TRANSFER_CYCLES / 2);
+    write_memory(SERIAL_SC, 0x00);
+    Ticks(SERIAL_TRANSFER_CYCLES);
+
+    ASSERT_EQ(read_memory(SERIAL_SB), 0x00);
+    ASSERT_FALSE(interrupt_is_set(IV_SERIAL));
+}
+
+} // namespace cpu_tests
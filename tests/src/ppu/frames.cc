@@ -0,0 +1,208 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest-param-test.h>
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+extern "C" {
+#include <cartridge/cartridge.h>
+#include <cpu/cpu.h>
+#include <cpu/instruction.h>
+#include <cpu/interrupt.h>
+#include <cpu/timer.h>
+#include <options.h>
+#include <ppu/ppu.h>
+#include <utils/hash.h>
+}
+
+/*
+ * Golden frame tests: run a ROM for a given amount of frames, and compare the
+ * hash of each frame against the ones stored inside a golden file
+ * (tests/golden/<name>.txt), one "<frame> <hash>" line per frame.
+ *
+ * The frames that differ are dumped as PGM images into the current directory.
+ *
+ * To regenerate the golden files, after checking the output, run the test
+ * with EMUGB_UPDATE_GOLDEN=1.
+ */
+
+namespace ppu_tests
+{
+
+struct GoldenRom {
+    const char *name;
+    const char *rom;
+    unsigned frames;
+};
+
+static const GoldenRom g_golden_roms[] = {
+    {"dmg-acid2", "roms/dmg-acid2.gb", 60},
+    {"01-special", "roms/01-special.gb", 150},
+};
+
+static const char *g_engine_names[] = {"fast", "accurate", "threaded"};
+
+// Frames reported by the PPU, only read once the PPU is synchronized
+static std::vector<u64> g_hashes;
+static std::vector<std::vector<u8>> g_frames;
+
+static void StoreFrame(const u8 *framebuffer_ptr)
+{
+    const size_t size = LCD_HEIGHT * LCD_WIDTH;
+
+    g_hashes.push_back(hash64(framebuffer_ptr, size));
+    g_frames.emplace_back(framebuffer_ptr, framebuffer_ptr + size);
+}
+
+static std::vector<u64> ReadGolden(const std::string &path)
+{
+    std::vector<u64> hashes;
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line)) {
+        unsigned frame;
+        u64 hash;
+        if (std::sscanf(line.c_str(), "%u %" SCNx64, &frame, &hash) == 2)
+            hashes.push_back(hash);
+    }
+
+    return hashes;
+}
+
+static void WriteGolden(const std::string &path)
+{
+    std::ofstream file(path);
+
+    for (size_t frame = 0; frame < g_hashes.size(); ++frame) {
+        char line[32];
+        std::snprintf(line, sizeof(line), "%zu %016" PRIx64 "\n", frame,
+                      g_hashes[frame]);
+        file << line;
+    }
+}
+
+static void DumpFrame(const std::string &path, const std::vector<u8> &frame)
+{
+    std::ofstream file(path, std::ios::binary);
+
+    file << "P5 " << LCD_WIDTH << " " << LCD_HEIGHT << " 3\n";
+    for (const u8 shade : frame)
+        file.put(3 - shade);
+}
+
+class FrameHashes
+    : public ::testing::TestWithParam<std::tuple<GoldenRom, ppu_engine_type>>
+{
+  public:
+    void SetUp() override
+    {
+        log_set_level(LOG_ERROR, false);
+        g_hashes.clear();
+        g_frames.clear();
+    }
+
+    void TearDown() override
+    {
+        ppu_set_frame_callback(nullptr);
+    }
+
+    static void Run(const GoldenRom &golden, ppu_engine_type engine)
+    {
+        std::string rom = std::string(TESTS_DIR "/") + golden.rom;
+
+        // Don't inherit the VRAM/OAM of the previous ROM
+        memset(g_cpu.memory, 0, sizeof(g_cpu.memory));
+
+        load_cartridge(rom.data());
+        reset_cpu();
+        reset_timer();
+        ppu_set_engine(engine);
+        ppu_set_frameskip(0);
+        reset_ppu();
+        write_memory(IF_ADDRESS, 0);
+
+        ppu_set_frame_callback(StoreFrame);
+
+        u32 frame = 0;
+        while (g_ppu.stats.rendered_frames < golden.frames) {
+            if (g_cpu.halt)
+                timer_tick();
+            else
+                execute_instruction();
+            handle_interrupts();
+
+            // Never let the threaded engine drop lines
+            if (g_ppu.stats.rendered_frames != frame) {
+                frame = g_ppu.stats.rendered_frames;
+                ppu_sync();
+            }
+        }
+
+        ppu_sync();
+        ppu_set_frame_callback(nullptr);
+    }
+};
+
+TEST_P(FrameHashes, Golden)
+{
+    const auto golden = std::get<0>(GetParam());
+    const auto engine = std::get<1>(GetParam());
+    const auto path = std::string(TESTS_DIR "/golden/") + golden.name + ".txt";
+
+    Run(golden, engine);
+    ASSERT_EQ(g_ppu.stats.dropped_lines, 0);
+    ASSERT_GE(g_hashes.size(), golden.frames);
+    g_hashes.resize(golden.frames);
+
+    if (std::getenv("EMUGB_UPDATE_GOLDEN")) {
+        WriteGolden(path);
+        return;
+    }
+
+    const auto expected = ReadGolden(path);
+    ASSERT_EQ(expected.size(), golden.frames) << "Invalid golden file " << path;
+
+    unsigned mismatches = 0;
+    for (unsigned frame = 0; frame < golden.frames; ++frame) {
+        if (g_hashes[frame] == expected[frame])
+            continue;
+
+        std::ostringstream dump;
+        dump << golden.name << "-" << g_engine_names[engine] << "-" << frame
+             << ".pgm";
+        DumpFrame(dump.str(), g_frames[frame]);
+
+        ADD_FAILURE() << "Frame " << frame << " differs (dumped into "
+                      << dump.str() << ")";
+        mismatches += 1;
+    }
+
+    ASSERT_EQ(mismatches, 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ROM, FrameHashes,
+    ::testing::Combine(::testing::ValuesIn(g_golden_roms),
+                       ::testing::Values(PPU_ENGINE_FAST, PPU_ENGINE_ACCURATE,
+                                         PPU_ENGINE_THREADED)),
+    [](const auto &info) {
+        std::string name = std::get<0>(info.param).name;
+        for (auto &c : name)
+            if (!std::isalnum(c))
+                c = '_';
+        return name + "_" + g_engine_names[std::get<1>(info.param)];
+    });
+
+} // namespace ppu_tests
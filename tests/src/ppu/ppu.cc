@@ -0,0 +1,486 @@
+// REG_ERR is also defined inside gtest ...
+#define REG_ERR REG_ERR_
+#include <gtest/gtest-param-test.h>
+#include <gtest/gtest.h>
+#undef REG_ERR
+
+#include <cstring>
+#include <vector>
+
+#include "../cartridges/cartridge.hxx"
+
+extern "C" {
+#include <cpu/cpu.h>
+#include <cpu/interrupt.h>
+#include <cpu/memory.h>
+#include <ppu/ppu.h>
+#include <utils/macro.h>
+}
+
+namespace ppu_tests
+{
+
+class PPUTest : public ::testing::Test
+{
+  public:
+    PPUTest()
+    {
+        const auto cart = CartridgeGenerator<1 << 15>(ROM_ONLY);
+        cartridge = cart.GetCart();
+    }
+
+    void SetUp() override
+    {
+        reset_cpu();
+        std::memset(&g_cpu.memory[OAM_START], 0, OAM_END - OAM_START + 1);
+        ppu_set_engine(PPU_ENGINE_FAST);
+        ppu_set_frameskip(0);
+        reset_ppu();
+        write_memory(IF_ADDRESS, 0);
+    }
+
+    // Run the PPU until it reaches the given mode, return the elapsed cycles
+    static unsigned RunUntil(ppu_mode mode)
+    {
+        unsigned cycles = 0;
+        while (g_ppu.mode != mode) {
+            ppu_ticks(1);
+            cycles += 1;
+        }
+        return cycles;
+    }
+
+    static void RunCycles(unsigned cycles)
+    {
+        while (cycles--)
+            ppu_ticks(1);
+    }
+
+    // Fill the VRAM with a pattern and a few sprites
+    static void DrawPattern()
+    {
+        write_memory(PPU_LCDC, 0x00);
+        for (u16 address = VRAM_START; address <= VRAM_END; ++address)
+            write_memory(address, address * 7 + (address >> 8));
+        for (u16 i = 0; i < OAM_SPRITE_COUNT; ++i) {
+            write_memory(OAM_START + 4 * i, 16 + i * 3);
+            write_memory(OAM_START + 4 * i + 1, i * 4);
+            write_memory(OAM_START + 4 * i + 2, i);
+            write_memory(OAM_START + 4 * i + 3, i << 4);
+        }
+        write_memory(PPU_WX, 87);
+        write_memory(PPU_WY, 40);
+        write_memory(PPU_SCX, 13);
+        write_memory(PPU_SCY, 3);
+        write_memory(PPU_OBP0, 0xE4);
+        write_memory(PPU_OBP1, 0x1B);
+        write_memory(PPU_LCDC, 0xF3);
+    }
+};
+
+using PPUTiming = PPUTest;
+using PPUInterrupt = PPUTest;
+using PPUMemory = PPUTest;
+using PPUEngine = PPUTest;
+
+TEST_F(PPUTiming, Line)
+{
+    for (u8 line = 0; line < LINES_PER_FRAME; ++line) {
+        ASSERT_EQ(read_memory(PPU_LY), line);
+        ppu_ticks(DOTS_PER_LINE / DOTS_PER_CYCLE);
+    }
+
+    ASSERT_EQ(read_memory(PPU_LY), 0);
+    ASSERT_EQ(g_ppu.frame, 1);
+}
+
+TEST_F(PPUTiming, Modes)
+{
+    ASSERT_EQ(read_memory(PPU_STAT) & 0x3, PPU_OAM_SCAN);
+    ASSERT_EQ(RunUntil(PPU_TRANSFER), 80 / DOTS_PER_CYCLE);
+    ASSERT_EQ(RunUntil(PPU_HBLANK), 172 / DOTS_PER_CYCLE);
+    ASSERT_EQ(RunUntil(PPU_OAM_SCAN), (456 - 80 - 172) / DOTS_PER_CYCLE);
+    ASSERT_EQ(read_memory(PPU_LY), 1);
+}
+
+TEST_F(PPUTiming, LCDOff)
+{
+    write_memory(PPU_LCDC, 0x11);
+    RunCycles(200);
+
+    ASSERT_EQ(read_memory(PPU_LY), 0);
+    ASSERT_EQ(read_memory(PPU_STAT) & 0x3, PPU_HBLANK);
+
+    write_memory(PPU_LCDC, 0x91);
+    ASSERT_EQ(read_memory(PPU_STAT) & 0x3, PPU_OAM_SCAN);
+}
+
+class FIFOTiming : public PPUTest, public ::testing::WithParamInterface<u8>
+{
+};
+
+// Mode 3 lasts 172 dots + the pixels discarded because of fine scrolling
+TEST_P(FIFOTiming, Scroll)
+{
+    const u8 scx = GetParam();
+
+    ppu_set_engine(PPU_ENGINE_ACCURATE);
+    reset_ppu();
+    write_memory(PPU_SCX, scx);
+
+    RunUntil(PPU_TRANSFER);
+    const auto cycles = RunUntil(PPU_HBLANK);
+
+    ASSERT_EQ(cycles, (172 + (scx % 8) + 3) / DOTS_PER_CYCLE);
+}
+
+INSTANTIATE_TEST_SUITE_P(SCX, FIFOTiming, ::testing::Range<u8>(0, 16, 1));
+
+TEST_F(PPUTiming, FIFOSprites)
+{
+    ppu_set_engine(PPU_ENGINE_ACCURATE);
+    reset_ppu();
+
+    // Put 4 sprites on the first line
+    write_memory(PPU_LCDC, 0x00);
+    for (u8 i = 0; i < 4; ++i) {
+        write_memory(OAM_START + 4 * i, 16);
+        write_memory(OAM_START + 4 * i + 1, 8 + 32 * i);
+    }
+    write_memory(PPU_LCDC, 0x93);
+
+    RunUntil(PPU_TRANSFER);
+    ASSERT_EQ(RunUntil(PPU_HBLANK), (172 + 4 * 6) / DOTS_PER_CYCLE);
+}
+
+TEST_F(PPUInterrupt, VBlank)
+{
+    RunCycles(LCD_HEIGHT * DOTS_PER_LINE / DOTS_PER_CYCLE - 1);
+    ASSERT_FALSE(interrupt_is_set(IV_VBLANK));
+
+    ppu_ticks(1);
+    ASSERT_TRUE(interrupt_is_set(IV_VBLANK));
+    ASSERT_EQ(read_memory(PPU_STAT) & 0x3, PPU_VBLANK);
+}
+
+TEST_F(PPUInterrupt, LYC)
+{
+    write_memory(PPU_LYC, 42);
+    write_memory(PPU_STAT, 1 << STAT_LYC_INT);
+
+    RunCycles(42 * DOTS_PER_LINE / DOTS_PER_CYCLE - 1);
+    ASSERT_FALSE(interrupt_is_set(IV_LCD));
+    ASSERT_FALSE(BIT(read_memory(PPU_STAT), STAT_LYC_EQUAL));
+
+    ppu_ticks(1);
+    ASSERT_TRUE(interrupt_is_set(IV_LCD));
+    ASSERT_TRUE(BIT(read_memory(PPU_STAT), STAT_LYC_EQUAL));
+}
+
+TEST_F(PPUInterrupt, StatBlocking)
+{
+    // Mode 0 then mode 2: the line never goes low, a single interrupt
+    write_memory(PPU_STAT, (1 << STAT_HBLANK_INT) | (1 << STAT_OAM_INT));
+    write_memory(IF_ADDRESS, 0);
+
+    RunUntil(PPU_HBLANK);
+    ASSERT_TRUE(interrupt_is_set(IV_LCD));
+
+    write_memory(IF_ADDRESS, 0);
+    RunUntil(PPU_OAM_SCAN);
+    ASSERT_FALSE(interrupt_is_set(IV_LCD));
+}
+
+TEST_F(PPUMemory, VRAMLocked)
+{
+    RunUntil(PPU_TRANSFER);
+    write_memory(VRAM_START, 0x42);
+    ASSERT_EQ(read_memory(VRAM_START), 0xFF);
+    ASSERT_EQ(read_memory(OAM_START), 0xFF);
+
+    RunUntil(PPU_HBLANK);
+    write_memory(VRAM_START, 0x42);
+    ASSERT_EQ(read_memory(VRAM_START), 0x42);
+}
+
+TEST_F(PPUMemory, DMA)
+{
+    write_memory(PPU_LCDC, 0x00);
+    for (u8 i = 0; i <= OAM_END - OAM_START; ++i)
+        write_memory(0xC100 + i, i ^ 0x5A);
+
+    write_memory(PPU_DMA, 0xC1);
+
+    for (u8 i = 0; i <= OAM_END - OAM_START; ++i)
+        ASSERT_EQ(read_memory(OAM_START + i), i ^ 0x5A);
+}
+
+TEST_F(PPUEngine, SwitchOnFrameBoundary)
+{
+    ppu_set_engine(PPU_ENGINE_ACCURATE);
+    ppu_ticks(DOTS_PER_LINE / DOTS_PER_CYCLE);
+    ASSERT_EQ(g_ppu.engine, PPU_ENGINE_FAST);
+
+    while (g_ppu.frame == 0 || g_ppu.ly != 0)
+        ppu_ticks(1);
+
+    ASSERT_EQ(g_ppu.engine, PPU_ENGINE_ACCURATE);
+}
+
+// Both engines must produce the same picture when registers are not modified
+// during the frame
+TEST_F(PPUEngine, SameFrame)
+{
+    static u8 frames[3][LCD_HEIGHT][LCD_WIDTH];
+
+    for (const auto engine :
+         {PPU_ENGINE_FAST, PPU_ENGINE_ACCURATE, PPU_ENGINE_THREADED}) {
+        ppu_set_engine(engine);
+        reset_ppu();
+        DrawPattern();
+
+        const auto frame = g_ppu.frame;
+        while (g_ppu.frame == frame)
+            ppu_ticks(1);
+
+        ppu_sync();
+        std::memcpy(frames[engine], g_ppu.framebuffer, sizeof(frames[0]));
+    }
+
+    ASSERT_EQ(std::memcmp(frames[0], frames[1], sizeof(frames[0])), 0);
+    ASSERT_EQ(std::memcmp(frames[0], frames[2], sizeof(frames[0])), 0);
+}
+
+// The render thread must draw each line with the VRAM and registers as they
+// were when the line started, even if they were modified since then
+TEST_F(PPUEngine, ThreadedSnapshots)
+{
+    static u8 frames[2][LCD_HEIGHT][LCD_WIDTH];
+
+    for (const auto engine : {PPU_ENGINE_FAST, PPU_ENGINE_THREADED}) {
+        ppu_set_engine(engine);
+        reset_ppu();
+        DrawPattern();
+
+        for (u8 line = 0; line < LCD_HEIGHT; ++line) {
+            RunUntil(PPU_HBLANK);
+            write_memory(PPU_SCX, line * 3);
+            write_memory(PPU_BGP, line);
+            for (u16 address = VRAM_START; address <= VRAM_END; address += 97)
+                write_memory(address, line ^ address);
+            RunUntil(PPU_OAM_SCAN);
+        }
+
+        ppu_sync();
+        std::memcpy(frames[engine == PPU_ENGINE_THREADED],
+                    g_ppu.framebuffer, sizeof(frames[0]));
+    }
+
+    ASSERT_EQ(g_ppu.stats.dropped_lines, 0);
+    ASSERT_EQ(std::memcmp(frames[0], frames[1], sizeof(frames[0])), 0);
+}
+
+TEST_F(PPUEngine, ThreadedLongRun)
+{
+    static u8 frame[LCD_HEIGHT][LCD_WIDTH];
+
+    ppu_set_engine(PPU_ENGINE_FAST);
+    reset_ppu();
+    DrawPattern();
+    RunCycles(LCD_HEIGHT * DOTS_PER_LINE / DOTS_PER_CYCLE);
+    std::memcpy(frame, g_ppu.framebuffer, sizeof(frame));
+
+    ppu_set_engine(PPU_ENGINE_THREADED);
+    reset_ppu();
+    DrawPattern();
+    RunCycles(20 * LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+    ppu_sync();
+
+    ASSERT_EQ(g_ppu.stats.rendered_frames, 20);
+    ASSERT_EQ(std::memcmp(frame, g_ppu.framebuffer, sizeof(frame)), 0);
+}
+
+using PPUSprites = PPUTest;
+
+// Only the first 10 sprites in OAM order are selected, then sorted by X
+TEST_F(PPUSprites, Selection)
+{
+    write_memory(PPU_LCDC, 0x00);
+    for (u8 i = 0; i < 12; ++i) {
+        write_memory(OAM_START + 4 * i, 16);
+        write_memory(OAM_START + 4 * i + 1, 100 - i * (i % 2 ? 1 : 0));
+        write_memory(OAM_START + 4 * i + 2, i);
+    }
+    write_memory(PPU_LCDC, 0x93);
+
+    RunUntil(PPU_TRANSFER);
+    ASSERT_EQ(g_ppu.sprite_count, LINE_SPRITE_COUNT);
+    for (u8 i = 0; i < LINE_SPRITE_COUNT; ++i) {
+        // Odd sprites come first (smaller X), by decreasing index
+        const u8 tile = i < 5 ? 9 - 2 * i : 2 * (i - 5);
+        ASSERT_EQ(g_ppu.sprites[i].tile, tile);
+    }
+}
+
+TEST_F(PPUSprites, OAMWrite)
+{
+    RunUntil(PPU_TRANSFER);
+    ASSERT_EQ(g_ppu.sprite_count, 0);
+
+    RunUntil(PPU_HBLANK);
+    write_memory(OAM_START, 17); // Move sprite 0 onto line 1
+    RunUntil(PPU_TRANSFER);
+    ASSERT_EQ(g_ppu.sprite_count, 1);
+}
+
+TEST_F(PPUSprites, DMA)
+{
+    write_memory(PPU_LCDC, 0x00);
+    for (u8 i = 0; i <= OAM_END - OAM_START; ++i)
+        write_memory(0xC100 + i, 0);
+    write_memory(0xC100, 16);
+    write_memory(0xC104, 16);
+    write_memory(PPU_LCDC, 0x93);
+
+    RunUntil(PPU_TRANSFER);
+    ASSERT_EQ(g_ppu.sprite_count, 0);
+
+    write_memory(PPU_DMA, 0xC1);
+    RunCycles(LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+    ASSERT_EQ(g_ppu.sprite_count, 2);
+}
+
+TEST_F(PPUSprites, Size)
+{
+    write_memory(PPU_LCDC, 0x00);
+    write_memory(OAM_START, 8); // Covers lines 0-7 in 8x16 mode only
+    write_memory(PPU_LCDC, 0x93);
+
+    RunUntil(PPU_TRANSFER);
+    ASSERT_EQ(g_ppu.sprite_count, 0);
+
+    RunUntil(PPU_HBLANK);
+    write_memory(PPU_LCDC, 0x93 | (1 << LCDC_OBJ_SIZE));
+    RunUntil(PPU_TRANSFER);
+    ASSERT_EQ(g_ppu.sprite_count, 1);
+}
+
+using PPUFrameskip = PPUTest;
+
+TEST_F(PPUFrameskip, Counters)
+{
+    ppu_set_frameskip(3);
+    RunCycles(6 * LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+
+    ASSERT_EQ(g_ppu.frame, 6);
+    ASSERT_EQ(g_ppu.stats.rendered_frames, 2);
+    ASSERT_EQ(g_ppu.stats.skipped_frames, 4);
+    ASSERT_EQ(g_ppu.stats.skipped_lines, 4 * LCD_HEIGHT);
+}
+
+TEST_F(PPUFrameskip, RequestFrame)
+{
+    ppu_set_frameskip(UINT16_MAX);
+    RunCycles(LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+    ASSERT_EQ(g_ppu.stats.skipped_frames, 0); // First frame is always drawn
+
+    RunCycles(LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+    ASSERT_EQ(g_ppu.stats.skipped_frames, 1);
+
+    ppu_request_frame();
+    RunCycles(2 * LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+    ASSERT_EQ(g_ppu.stats.rendered_frames, 2);
+    ASSERT_EQ(g_ppu.stats.skipped_frames, 2);
+}
+
+TEST_F(PPUFrameskip, KeepFramebuffer)
+{
+    ppu_set_frameskip(2);
+    DrawPattern();
+    RunCycles(LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+
+    static u8 frame[LCD_HEIGHT][LCD_WIDTH];
+    std::memcpy(frame, g_ppu.framebuffer, sizeof(frame));
+
+    write_memory(PPU_BGP, ~g_ppu.bgp);
+    write_memory(PPU_SCX, 42);
+    RunCycles(LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+
+    ASSERT_EQ(g_ppu.stats.skipped_frames, 1);
+    ASSERT_EQ(std::memcmp(frame, g_ppu.framebuffer, sizeof(frame)), 0);
+}
+
+static unsigned g_callback_frames = 0;
+
+static void CountFrame(const u8 *framebuffer_ptr)
+{
+    ASSERT_EQ(framebuffer_ptr, &g_ppu.framebuffer[0][0]);
+    g_callback_frames += 1;
+}
+
+class FrameCallback : public PPUTest,
+                      public ::testing::WithParamInterface<ppu_engine_type>
+{
+};
+
+// Only the frames that were actually drawn are reported
+TEST_P(FrameCallback, SkippedFrames)
+{
+    ppu_set_engine(GetParam());
+    ppu_set_frameskip(2);
+    reset_ppu();
+
+    g_callback_frames = 0;
+    ppu_set_frame_callback(CountFrame);
+    RunCycles(10 * LINES_PER_FRAME * DOTS_PER_LINE / DOTS_PER_CYCLE);
+    ppu_sync();
+    ppu_set_frame_callback(nullptr);
+
+    ASSERT_EQ(g_callback_frames, 5);
+}
+
+INSTANTIATE_TEST_SUITE_P(Engine, FrameCallback,
+                         ::testing::Values(PPU_ENGINE_FAST, PPU_ENGINE_ACCURATE,
+                                           PPU_ENGINE_THREADED));
+
+class FrameskipTiming : public PPUTest,
+                        public ::testing::WithParamInterface<ppu_engine_type>
+{
+  protected:
+    // Record the mode of the PPU at each cycle of a whole frame
+    static std::vector<u8> RecordFrame()
+    {
+        std::vector<u8> modes;
+        const auto frame = g_ppu.frame;
+
+        while (g_ppu.frame == frame) {
+            modes.push_back(g_ppu.mode);
+            ppu_ticks(1);
+        }
+
+        return modes;
+    }
+};
+
+// Skipping the composition must not alter the timing seen by the CPU
+TEST_P(FrameskipTiming, SameTiming)
+{
+    ppu_set_engine(GetParam());
+    reset_ppu();
+    DrawPattern();
+
+    const auto rendered = RecordFrame();
+
+    ppu_set_frameskip(2);
+    RunCycles(10 * DOTS_PER_LINE / DOTS_PER_CYCLE); // VBlank
+    const auto skipped = RecordFrame();
+
+    ASSERT_EQ(g_ppu.stats.skipped_frames, 1);
+    ASSERT_EQ(rendered, skipped);
+}
+
+INSTANTIATE_TEST_SUITE_P(Engine, FrameskipTiming,
+                         ::testing::Values(PPU_ENGINE_FAST,
+                                           PPU_ENGINE_ACCURATE));
+
+} // namespace ppu_tests
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+extern "C" {
+#include <utils/log.h>
+
+// Defined inside log.c for the unit tests
+__attribute__((format(printf, 3, 4))) size_t
+log_format(char *data, size_t size, const char *fmt, ...);
+}
+
+namespace utils_tests
+{
+
+// Messages are formatted by the logging thread, they must be identical to
+// what printf would have written
+#define ASSERT_FORMAT(...)                                                \
+    do {                                                                  \
+        char expected_[1024];                                             \
+        char actual_[1024];                                               \
+        snprintf(expected_, sizeof(expected_), __VA_ARGS__);              \
+        const size_t length_ = log_format(actual_, sizeof(actual_),       \
+                                          __VA_ARGS__);                   \
+        ASSERT_GE(length_, 1);                                            \
+        ASSERT_EQ(actual_[length_ - 1], '\n');                            \
+        ASSERT_EQ(std::string(actual_, length_ - 1), expected_);          \
+    } while (0)
+
+// Some of the conversions below are unusual on purpose
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wformat-extra-args"
+
+TEST(LogFormatTest, Text)
+{
+    ASSERT_FORMAT("No conversion");
+    ASSERT_FORMAT("%%");
+    ASSERT_FORMAT("100%% done, %d%%", 42);
+    ASSERT_FORMAT("");
+}
+
+TEST(LogFormatTest, Flags)
+{
+    ASSERT_FORMAT("[%-5d] [%05d] [%-05d]", 42, 42, 42);
+    ASSERT_FORMAT("[%+d] [%+d] [% d] [% d]", 42, -42, 42, -42);
+    ASSERT_FORMAT("[%#x] [%#X] [%#o] [%#x]", 0xBEEF, 0xBEEF, 8, 0);
+    ASSERT_FORMAT("[%05d] [%05x] [%-5x]", -42, 0xAB, 0xAB);
+}
+
+TEST(LogFormatTest, WidthAndPrecision)
+{
+    ASSERT_FORMAT("[%8d] [%2d] [%.3d] [%8.3d] [%-8.3d]", 42, 1234, 7, 7, 7);
+    ASSERT_FORMAT("[%08.3d] [%.5x] [%8.4X]", 7, 0xAB, 0xAB);
+    ASSERT_FORMAT("[%.3d] [%8.3d] [%08.3d]", -7, -7, -7);
+}
+
+TEST(LogFormatTest, Star)
+{
+    ASSERT_FORMAT("[%*d] [%-*d]", 6, 42, 6, 42);
+    ASSERT_FORMAT("[%*d]", -6, 42); // Negative width: left-justified
+    ASSERT_FORMAT("[%.*d] [%*.*d]", 4, 42, 8, 4, 42);
+    ASSERT_FORMAT("[%.*d] [%0*.*d]", -1, 42, 6, -1, 42); // No precision
+    ASSERT_FORMAT("[%*x] [%*s]", 6, 0xAB, 6, "ab");
+    ASSERT_FORMAT("[%.*s] [%*.*s]", 2, "abcdef", 5, 2, "abcdef");
+}
+
+TEST(LogFormatTest, LengthModifiers)
+{
+    ASSERT_FORMAT("%hd %hd %hu %hx", 70000, -70000, -1, 0x12345);
+    ASSERT_FORMAT("%hhd %hhd %hhu %hhX", 300, -129, -1, 0x1FF);
+    ASSERT_FORMAT("%ld %ld %lu %lx", LONG_MAX, LONG_MIN, ULONG_MAX, -1L);
+    ASSERT_FORMAT("%lld %lld %llu %llX", LLONG_MAX, LLONG_MIN, ULLONG_MAX,
+                  0xDEADBEEFCAFEULL);
+    ASSERT_FORMAT("%zu %zx %zd", SIZE_MAX, (size_t)0xABC, (size_t)-5);
+    ASSERT_FORMAT("%08lx %-12lld|", 0xABCL, -12345LL);
+}
+
+TEST(LogFormatTest, NegativeAndZero)
+{
+    ASSERT_FORMAT("%d %d %d %i", 0, -1, INT_MIN, INT_MAX);
+    ASSERT_FORMAT("%u %x %X", -1, -1, INT_MIN);
+    ASSERT_FORMAT("[%.0d] [%5.0d] [%-5.0d] [%.0x] [%.0u]", 0, 0, 0, 0, 0);
+    ASSERT_FORMAT("[%.0d] [%.0d]", 1, -1);
+    ASSERT_FORMAT("[%+.0d] [% .0d]", 0, 0);
+    ASSERT_FORMAT("[%x] [%5x] [%05x]", 0, 0, 0);
+}
+
+TEST(LogFormatTest, Characters)
+{
+    ASSERT_FORMAT("%c%c%c", 'a', 'b', 'c');
+    ASSERT_FORMAT("[%3c] [%-3c]", 'x', 'y');
+}
+
+TEST(LogFormatTest, Strings)
+{
+    ASSERT_FORMAT("[%s] [%s]", "", "abc");
+    ASSERT_FORMAT("[%.3s] [%.0s] [%.10s]", "abcdef", "abcdef", "abc");
+    ASSERT_FORMAT("[%10s] [%-10s] [%10.2s] [%-10.2s]", "abc", "abc", "abc",
+                  "abc");
+    ASSERT_FORMAT("%s", (const char *)nullptr);
+}
+
+TEST(LogFormatTest, Others)
+{
+    ASSERT_FORMAT("%.2f %e %g %10.3f", 3.14159, 12345.678, 0.0001, -2.5);
+    ASSERT_FORMAT("%Lf", (long double)1.5);
+    ASSERT_FORMAT("%o %5o", 8, 64);
+    ASSERT_FORMAT("%p", (void *)0x1234);
+}
+
+TEST(LogFormatTest, Truncation)
+{
+    char actual[1024];
+
+    // The arguments are limited to ARGS_SIZE (512) bytes, long strings are
+    // truncated and the following arguments dropped
+    const std::string big(600, 'x');
+    size_t length = log_format(actual, sizeof(actual), "%s|%d", big.c_str(), 1);
+    ASSERT_EQ(std::string(actual, length), std::string(511, 'x') + "|\n");
+
+    // 64 integers fill the arguments, the next ones are dropped
+    std::string fmt;
+    std::string expected;
+    for (int i = 0; i < 70; ++i)
+        fmt += "%lld ";
+    for (int i = 0; i < 64; ++i)
+        expected += std::to_string(i) + " ";
+
+#define ARGS_10(n_)                                                          \
+    n_##0LL, n_##1LL, n_##2LL, n_##3LL, n_##4LL, n_##5LL, n_##6LL, n_##7LL, \
+        n_##8LL, n_##9LL
+    length = log_format(actual, sizeof(actual), fmt.c_str(), ARGS_10(),
+                        ARGS_10(1), ARGS_10(2), ARGS_10(3), ARGS_10(4),
+                        ARGS_10(5), ARGS_10(6));
+#undef ARGS_10
+
+    ASSERT_EQ(std::string(actual, length), expected + "\n");
+}
+
+TEST(LogFormatTest, LineSize)
+{
+    char actual[16];
+
+    // The message is cut to leave room for the new line
+    const size_t length =
+        log_format(actual, sizeof(actual), "%s %d", "0123456789abcdef", 42);
+    ASSERT_EQ(std::string(actual, length), "0123456789abcde\n");
+}
+
+} // namespace utils_tests
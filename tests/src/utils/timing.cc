@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// The scopes are inline, they can be tested regardless of the build option
+#undef EMUGB_HOST_TIMERS
+#define EMUGB_HOST_TIMERS 1
+
+extern "C" {
+#include <utils/log.h>
+#include <utils/timing.h>
+}
+
+namespace utils_tests
+{
+
+class TimingTest : public ::testing::Test
+{
+  public:
+    void SetUp() override
+    {
+        log_set_level(LOG_ERROR, false);
+        ASSERT_TRUE(timing_start(NULL));
+    }
+
+    void TearDown() override
+    {
+        timing_stop();
+    }
+};
+
+static void access_cartridge()
+{
+    TIMING_SCOPE(TIMING_CARTRIDGE);
+}
+
+static int access_memory(bool cartridge)
+{
+    TIMING_SCOPE(TIMING_BUS);
+
+    if (!cartridge)
+        return 0;
+
+    access_cartridge();
+    return 1;
+}
+
+TEST_F(TimingTest, Scopes)
+{
+    access_memory(false);
+    access_memory(true);
+
+    ASSERT_EQ(g_timing.depth, 1);
+    ASSERT_EQ(g_timing.calls[TIMING_BUS], 2);
+    ASSERT_EQ(g_timing.calls[TIMING_CARTRIDGE], 1);
+    ASSERT_EQ(g_timing.calls[TIMING_PPU], 0);
+}
+
+TEST_F(TimingTest, Disabled)
+{
+    timing_stop();
+    access_memory(true);
+
+    ASSERT_EQ(g_timing.calls[TIMING_BUS], 0);
+    ASSERT_EQ(g_timing.calls[TIMING_CARTRIDGE], 0);
+}
+
+TEST_F(TimingTest, Frames)
+{
+    const std::string path = ::testing::TempDir() + "timing.csv";
+
+    timing_stop();
+    ASSERT_TRUE(timing_start(path.c_str()));
+
+    access_memory(true);
+    timing_frame(0);
+    timing_frame(1);
+    timing_stop();
+
+    std::ifstream file(path);
+    std::string line;
+    unsigned lines = 0;
+
+    std::getline(file, line);
+    ASSERT_EQ(line, "frame,total,main,decode,execute,bus,cartridge,timer,"
+                    "interrupts,ppu,apu,log");
+
+    while (std::getline(file, line)) {
+        std::stringstream row(line);
+        std::string column;
+        unsigned columns = 0;
+
+        while (std::getline(row, column, ','))
+            columns += 1;
+
+        ASSERT_EQ(line.rfind(std::to_string(lines) + ",", 0), 0) << line;
+        ASSERT_EQ(columns, TIMING_ZONE_COUNT + 2) << line;
+        lines += 1;
+    }
+
+    ASSERT_EQ(lines, 2);
+}
+
+} // namespace utils_tests
@@ -0,0 +1,712 @@
+/**
+ * \file baseline.c
+ * \brief Store benchmark results and detect performance regressions
+ *
+ * Each cartridge is run several times with `emu-gb --bench-json`, the runs of
+ * the different cartridges being interleaved so that a change of the host's
+ * load affects all of them. The throughputs (emulated machine cycles per
+ * second) are compared with the baseline: the runs recorded in the database
+ * for the last commits, on the same CPU model.
+ *
+ * A cartridge regresses when its median throughput is lower than the
+ * baseline's by more than a threshold, and when a one-sided Mann-Whitney U
+ * test finds the difference significant. Single noisy runs are thus not
+ * reported. The program exits with a non-zero status if any cartridge
+ * regressed.
+ *
+ * The database is a JSON Lines file, one run per line, keyed by commit and
+ * CPU model. --record appends the new runs to it.
+ *
+ *     emu-gb-romgen -o workloads
+ *     emu-gb-baseline --record workloads      # on the reference commit
+ *     emu-gb-baseline workloads               # on the modified tree
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700 // needed for nftw
+
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "utils/error.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+#define DEFAULT_DATABASE "benchmarks.jsonl"
+#define DEFAULT_RUNS 5
+#define DEFAULT_WINDOW 5
+#define DEFAULT_THRESHOLD 3.0 ///< Percents
+#define DEFAULT_ALPHA 0.05
+
+#define KEY_SIZE 256
+#define LINE_SIZE 4096
+
+#define RED "\033[0;31m"
+#define GREEN "\033[0;32m"
+#define NC "\033[0m"
+
+/// A run of a cartridge, read from emu-gb's JSON output or from the database
+struct run {
+    char commit[KEY_SIZE];
+    char cpu[KEY_SIZE];
+    char rom[KEY_SIZE]; ///< File name, the directory is ignored
+    char date[KEY_SIZE];
+    double cycles_per_second;
+    double ns_per_instruction;
+    double peak_rss_kib;
+};
+
+struct runs {
+    struct run *runs;
+    size_t count;
+    size_t capacity;
+};
+
+typedef enum verdict {
+    VERDICT_NO_BASELINE = 0,
+    VERDICT_UNCHANGED,
+    VERDICT_IMPROVED,
+    VERDICT_REGRESSED,
+} verdict;
+
+static struct baseline {
+    const char *database;
+    char emulator[4096];
+    char commit[KEY_SIZE];
+    char cpu[KEY_SIZE];
+    unsigned runs;
+    unsigned window; ///< Number of commits in the baseline
+    double threshold;
+    double alpha;
+    u64 cycles; ///< 0 to run the cartridges until they print their result
+    bool record;
+
+    char **roms;
+    size_t count;
+    size_t capacity;
+} g_baseline = {
+    .database = DEFAULT_DATABASE,
+    .runs = DEFAULT_RUNS,
+    .window = DEFAULT_WINDOW,
+    .threshold = DEFAULT_THRESHOLD,
+    .alpha = DEFAULT_ALPHA,
+};
+
+static void add_run(struct runs *runs_ptr, const struct run *run_ptr)
+{
+    if (runs_ptr->count == runs_ptr->capacity) {
+        runs_ptr->capacity = MAX(2 * runs_ptr->capacity, 64);
+        runs_ptr->runs =
+            realloc(runs_ptr->runs, runs_ptr->capacity * sizeof(struct run));
+        if (!runs_ptr->runs)
+            FATAL_ERROR("Failed to allocate the runs");
+    }
+
+    runs_ptr->runs[runs_ptr->count++] = *run_ptr;
+}
+
+/*
+ * JSON
+ *
+ * Only the flat objects written by emu-gb and by this tool are read, values
+ * are looked up by key.
+ */
+
+static const char *json_value(const char *text, const char *key)
+{
+    char pattern[KEY_SIZE];
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *value = strstr(text, pattern);
+    if (!value)
+        return NULL;
+
+    value += strlen(pattern);
+    while (*value == ' ')
+        value += 1;
+
+    return value;
+}
+
+static bool json_number(const char *text, const char *key, double *value_ptr)
+{
+    const char *value = json_value(text, key);
+    char *end_ptr;
+
+    if (!value)
+        return false;
+
+    *value_ptr = strtod(value, &end_ptr);
+    return end_ptr != value;
+}
+
+static bool json_string(const char *text, const char *key, char *string,
+                        size_t size)
+{
+    const char *value = json_value(text, key);
+    size_t length = 0;
+
+    if (!value || *value++ != '"')
+        return false;
+
+    for (; *value && *value != '"' && length + 1 < size; ++value) {
+        if (*value == '\\' && value[1])
+            value += 1;
+        string[length++] = *value;
+    }
+
+    string[length] = '\0';
+    return true;
+}
+
+static void write_json_string(FILE *file_ptr, const char *key,
+                              const char *string)
+{
+    fprintf(file_ptr, "\"%s\": \"", key);
+
+    for (; *string; ++string) {
+        if (*string == '"' || *string == '\\')
+            fputc('\\', file_ptr);
+        if ((unsigned char)*string >= 0x20)
+            fputc(*string, file_ptr);
+    }
+
+    fputs("\", ", file_ptr);
+}
+
+/*
+ * Database
+ */
+
+static void load_database(struct runs *runs_ptr)
+{
+    FILE *file_ptr = fopen(g_baseline.database, "r");
+    char line[LINE_SIZE];
+
+    if (!file_ptr) {
+        if (errno != ENOENT)
+            FATAL_ERROR("Failed to open '%s': %s", g_baseline.database,
+                        strerror(errno));
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file_ptr)) {
+        struct run run = {0};
+
+        if (!json_string(line, "commit", run.commit, KEY_SIZE) ||
+            !json_string(line, "cpu", run.cpu, KEY_SIZE) ||
+            !json_string(line, "rom", run.rom, KEY_SIZE) ||
+            !json_number(line, "cycles_per_second", &run.cycles_per_second))
+            continue;
+
+        json_string(line, "date", run.date, KEY_SIZE);
+        json_number(line, "ns_per_instruction", &run.ns_per_instruction);
+        json_number(line, "peak_rss_kib", &run.peak_rss_kib);
+        add_run(runs_ptr, &run);
+    }
+
+    fclose(file_ptr);
+}
+
+static void record_runs(const struct runs *runs_ptr)
+{
+    FILE *file_ptr = fopen(g_baseline.database, "a");
+
+    if (!file_ptr)
+        FATAL_ERROR("Failed to open '%s': %s", g_baseline.database,
+                    strerror(errno));
+
+    for (size_t i = 0; i < runs_ptr->count; ++i) {
+        const struct run *run_ptr = &runs_ptr->runs[i];
+
+        fputc('{', file_ptr);
+        write_json_string(file_ptr, "commit", run_ptr->commit);
+        write_json_string(file_ptr, "cpu", run_ptr->cpu);
+        write_json_string(file_ptr, "rom", run_ptr->rom);
+        write_json_string(file_ptr, "date", run_ptr->date);
+        fprintf(file_ptr,
+                "\"cycles_per_second\": %.1f, \"ns_per_instruction\": %.4f, "
+                "\"peak_rss_kib\": %.0f}\n",
+                run_ptr->cycles_per_second, run_ptr->ns_per_instruction,
+                run_ptr->peak_rss_kib);
+    }
+
+    fclose(file_ptr);
+}
+
+// The last commits recorded on this CPU, other than the current one
+static size_t baseline_commits(const struct runs *database_ptr,
+                               const char **commits)
+{
+    size_t count = 0;
+
+    for (size_t i = database_ptr->count;
+         i-- > 0 && count < g_baseline.window;) {
+        const struct run *run_ptr = &database_ptr->runs[i];
+        bool known = !strcmp(run_ptr->commit, g_baseline.commit) ||
+                     strcmp(run_ptr->cpu, g_baseline.cpu);
+
+        for (size_t j = 0; j < count && !known; ++j)
+            known = !strcmp(commits[j], run_ptr->commit);
+
+        if (!known)
+            commits[count++] = run_ptr->commit;
+    }
+
+    return count;
+}
+
+/*
+ * Host
+ */
+
+static void read_command(const char *command, char *output, size_t size)
+{
+    FILE *pipe_ptr = popen(command, "r");
+
+    output[0] = '\0';
+    if (!pipe_ptr)
+        return;
+
+    if (fgets(output, size, pipe_ptr))
+        output[strcspn(output, "\n")] = '\0';
+
+    pclose(pipe_ptr);
+}
+
+static void read_cpu_model(char *model, size_t size)
+{
+    FILE *file_ptr = fopen("/proc/cpuinfo", "r");
+    char line[LINE_SIZE];
+
+    snprintf(model, size, "unknown");
+    if (!file_ptr)
+        return;
+
+    while (fgets(line, sizeof(line), file_ptr)) {
+        const char *value = strchr(line, ':');
+        if (strncmp(line, "model name", 10) || !value)
+            continue;
+
+        value += strspn(value, ": \t");
+        snprintf(model, size, "%.*s", (int)strcspn(value, "\n"), value);
+        break;
+    }
+
+    fclose(file_ptr);
+}
+
+/*
+ * Runs
+ */
+
+static struct run run_rom(const char *rom, const char *json_path)
+{
+    char json[LINE_SIZE] = {0};
+    char json_option[4096 + 16];
+    char cycles_option[32];
+    struct run run = {0};
+    int status;
+
+    snprintf(json_option, sizeof(json_option), "--bench-json=%s", json_path);
+    snprintf(cycles_option, sizeof(cycles_option), "--cycles=%llu",
+             (unsigned long long)g_baseline.cycles);
+
+    const pid_t pid = fork();
+    if (pid < 0)
+        FATAL_ERROR("Failed to start the emulator");
+
+    if (pid == 0) {
+        const int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        if (g_baseline.cycles)
+            execl(g_baseline.emulator, g_baseline.emulator, json_option,
+                  cycles_option, rom, (char *)NULL);
+        else
+            execl(g_baseline.emulator, g_baseline.emulator, json_option,
+                  "--stop-on-result", rom, (char *)NULL);
+        _exit(127);
+    }
+
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status))
+        FATAL_ERROR("'%s %s' failed (status %d)", g_baseline.emulator, rom,
+                    WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+
+    FILE *file_ptr = fopen(json_path, "r");
+    if (!file_ptr || !fread(json, 1, sizeof(json) - 1, file_ptr) ||
+        !json_number(json, "cycles_per_second", &run.cycles_per_second))
+        FATAL_ERROR("Failed to read the results of '%s'", rom);
+    fclose(file_ptr);
+
+    json_number(json, "ns_per_instruction", &run.ns_per_instruction);
+    json_number(json, "peak_rss_kib", &run.peak_rss_kib);
+    json_string(json, "date", run.date, KEY_SIZE);
+
+    snprintf(run.commit, KEY_SIZE, "%s", g_baseline.commit);
+    snprintf(run.cpu, KEY_SIZE, "%s", g_baseline.cpu);
+    snprintf(run.rom, KEY_SIZE, "%s",
+             strrchr(rom, '/') ? strrchr(rom, '/') + 1 : rom);
+
+    return run;
+}
+
+// Interleave the cartridges, so that a change of load affects all of them
+static void run_all(struct runs *runs_ptr)
+{
+    char json_path[] = "/tmp/emu-gb-baseline-XXXXXX";
+    const int fd = mkstemp(json_path);
+    const bool progress = isatty(STDERR_FILENO);
+
+    if (fd < 0)
+        FATAL_ERROR("Failed to create a temporary file: %s", strerror(errno));
+    close(fd);
+
+    for (unsigned i = 0; i < g_baseline.runs; ++i) {
+        for (size_t j = 0; j < g_baseline.count; ++j) {
+            if (progress)
+                fprintf(stderr, "\rRun %u/%u: %-48s", i + 1, g_baseline.runs,
+                        g_baseline.roms[j]);
+            const struct run run = run_rom(g_baseline.roms[j], json_path);
+            add_run(runs_ptr, &run);
+        }
+    }
+
+    if (progress)
+        fprintf(stderr, "\r%-80s\r", "");
+    unlink(json_path);
+}
+
+/*
+ * Statistics
+ */
+
+static int compare_doubles(const void *lhs, const void *rhs)
+{
+    const double a = *(const double *)lhs;
+    const double b = *(const double *)rhs;
+
+    return (a > b) - (a < b);
+}
+
+static double median(double *values, size_t count)
+{
+    qsort(values, count, sizeof(double), compare_doubles);
+
+    return count % 2 ? values[count / 2]
+                     : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/*
+ * One-sided Mann-Whitney U test, using the normal approximation with a
+ * correction for ties and for continuity.
+ *
+ * \return The probability of observing samples at least this much lower
+ *         (higher if \c greater) than the reference if both came from the
+ *         same distribution.
+ */
+static double mann_whitney(const double *samples, size_t count,
+                           const double *reference, size_t reference_count,
+                           bool greater)
+{
+    const size_t total = count + reference_count;
+    double *values = malloc(total * sizeof(double));
+    double rank_sum = 0;
+    double ties = 0;
+
+    if (!values)
+        FATAL_ERROR("Failed to allocate the samples");
+
+    memcpy(values, samples, count * sizeof(double));
+    memcpy(values + count, reference, reference_count * sizeof(double));
+    qsort(values, total, sizeof(double), compare_doubles);
+
+    // Equal values share the average of their ranks
+    for (size_t i = 0; i < total;) {
+        size_t j = i;
+        while (j < total && values[j] == values[i])
+            j += 1;
+
+        const double tied = j - i;
+        const double rank = (i + 1 + j) / 2.0;
+        ties += tied * tied * tied - tied;
+
+        for (size_t k = 0; k < count; ++k) {
+            if (samples[k] == values[i])
+                rank_sum += rank;
+        }
+
+        i = j;
+    }
+
+    free(values);
+
+    const double u = rank_sum - count * (count + 1) / 2.0;
+    const double mean = count * reference_count / 2.0;
+    const double variance = count * reference_count / 12.0 *
+                            (total + 1 - ties / (total * (total - 1.0)));
+    if (variance <= 0)
+        return 1.0;
+
+    const double z = greater ? (u - 0.5 - mean) / sqrt(variance)
+                             : (u + 0.5 - mean) / sqrt(variance);
+    return greater ? 0.5 * erfc(z / M_SQRT2) : 0.5 * erfc(-z / M_SQRT2);
+}
+
+static size_t collect(const struct runs *runs_ptr, const char *rom,
+                      const char **commits, size_t commit_count,
+                      double *values)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < runs_ptr->count; ++i) {
+        const struct run *run_ptr = &runs_ptr->runs[i];
+        bool selected = !commits;
+
+        if (strcmp(run_ptr->rom, rom) || strcmp(run_ptr->cpu, g_baseline.cpu))
+            continue;
+        for (size_t j = 0; j < commit_count && !selected; ++j)
+            selected = !strcmp(run_ptr->commit, commits[j]);
+
+        if (selected)
+            values[count++] = run_ptr->cycles_per_second;
+    }
+
+    return count;
+}
+
+static int compare(const struct runs *current_ptr,
+                   const struct runs *database_ptr)
+{
+    static const char *names[] = {
+        [VERDICT_NO_BASELINE] = "No baseline",
+        [VERDICT_UNCHANGED] = "Unchanged",
+        [VERDICT_IMPROVED] = "Improved",
+        [VERDICT_REGRESSED] = "Regressed",
+    };
+    const char **commits = malloc(g_baseline.window * sizeof(char *));
+    double *values = malloc(current_ptr->count * sizeof(double));
+    double *reference = malloc(database_ptr->count * sizeof(double) + 1);
+    const bool colors = isatty(STDOUT_FILENO);
+    size_t regressions = 0;
+
+    if (!commits || !values || !reference)
+        FATAL_ERROR("Failed to allocate the samples");
+
+    const size_t commit_count = baseline_commits(database_ptr, commits);
+
+    printf("Commit %s on %s, baseline of %zu commit(s)\n\n",
+           g_baseline.commit, g_baseline.cpu, commit_count);
+    printf("%-24s %14s %14s %8s %8s  %s\n", "ROM", "Baseline (MHz)",
+           "Current (MHz)", "Change", "p-value", "Result");
+
+    // Runs are stored in the order of the cartridges
+    for (size_t i = 0; i < g_baseline.count; ++i) {
+        const char *rom = current_ptr->runs[i].rom;
+        const size_t count = collect(current_ptr, rom, NULL, 0, values);
+        const size_t reference_count =
+            collect(database_ptr, rom, commits, commit_count, reference);
+        const double current = median(values, count);
+        verdict result = VERDICT_NO_BASELINE;
+        double change = 0;
+        double p_value = 1;
+
+        if (reference_count) {
+            const double base = median(reference, reference_count);
+            change = 100.0 * (current - base) / base;
+            p_value = mann_whitney(values, count, reference, reference_count,
+                                   change > 0);
+            result = VERDICT_UNCHANGED;
+            if (fabs(change) > g_baseline.threshold &&
+                p_value < g_baseline.alpha)
+                result = change > 0 ? VERDICT_IMPROVED : VERDICT_REGRESSED;
+
+            printf("%-24s %14.2f %14.2f %+7.1f%% %8.3f  ", rom,
+                   4 * base / 1e6, 4 * current / 1e6, change, p_value);
+        } else {
+            printf("%-24s %14s %14.2f %8s %8s  ", rom, "-",
+                   4 * current / 1e6, "-", "-");
+        }
+
+        if (colors && result >= VERDICT_IMPROVED)
+            printf("%s%s%s\n", result == VERDICT_IMPROVED ? GREEN : RED,
+                   names[result], NC);
+        else
+            printf("%s\n", names[result]);
+
+        if (result == VERDICT_REGRESSED)
+            regressions += 1;
+    }
+
+    printf("\n%zu regression(s) beyond %.1f%% (p < %.3f)\n", regressions,
+           g_baseline.threshold, g_baseline.alpha);
+
+    free(commits);
+    free(values);
+    free(reference);
+    return regressions != 0;
+}
+
+/*
+ * Options
+ */
+
+static int add_rom(const char *path, const struct stat *stat_ptr, int type,
+                   struct FTW *ftw_ptr)
+{
+    (void)stat_ptr;
+    (void)ftw_ptr;
+
+    const size_t length = strlen(path);
+    if (type != FTW_F || length < 3 || strcmp(path + length - 3, ".gb"))
+        return 0;
+
+    if (g_baseline.count == g_baseline.capacity) {
+        g_baseline.capacity = MAX(2 * g_baseline.capacity, 16);
+        g_baseline.roms =
+            realloc(g_baseline.roms, g_baseline.capacity * sizeof(char *));
+        if (!g_baseline.roms)
+            FATAL_ERROR("Failed to allocate the list of roms");
+    }
+
+    g_baseline.roms[g_baseline.count++] = strdup(path);
+    return 0;
+}
+
+static int compare_roms(const void *lhs, const void *rhs)
+{
+    return strcmp(*(char *const *)lhs, *(char *const *)rhs);
+}
+
+static error_t parse_opt(int key, char *value, struct argp_state *state)
+{
+    char *end_ptr;
+
+    switch (key) {
+    case 'd':
+        g_baseline.database = value;
+        break;
+    case 'e':
+        snprintf(g_baseline.emulator, sizeof(g_baseline.emulator), "%s",
+                 value);
+        break;
+    case 'C':
+        snprintf(g_baseline.commit, sizeof(g_baseline.commit), "%s", value);
+        break;
+    case 'n':
+        g_baseline.runs = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || g_baseline.runs < 2)
+            argp_error(state, "Invalid argument for option --runs: %s", value);
+        break;
+    case 'w':
+        g_baseline.window = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || !g_baseline.window)
+            argp_error(state, "Invalid argument for option --window: %s",
+                       value);
+        break;
+    case 't':
+        g_baseline.threshold = strtod(value, &end_ptr);
+        if (*value == '\0' || *end_ptr != '\0' || g_baseline.threshold < 0)
+            argp_error(state, "Invalid argument for option --threshold: %s",
+                       value);
+        break;
+    case 'a':
+        g_baseline.alpha = strtod(value, &end_ptr);
+        if (*value == '\0' || *end_ptr != '\0' ||
+            !(g_baseline.alpha > 0 && g_baseline.alpha < 1))
+            argp_error(state, "Invalid argument for option --alpha: %s",
+                       value);
+        break;
+    case 'c':
+        g_baseline.cycles = strtoull(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || !g_baseline.cycles)
+            argp_error(state, "Invalid argument for option --cycles: %s",
+                       value);
+        break;
+    case 'r':
+        g_baseline.record = true;
+        break;
+
+    case ARGP_KEY_ARG:
+        if (nftw(value, add_rom, 16, 0))
+            argp_error(state, "Cannot read %s", value);
+        break;
+    case ARGP_KEY_END:
+        if (state->arg_num == 0)
+            argp_usage(state);
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp_option g_options[] = {
+    {"database", 'd', "FILE", 0,
+     "Results of the previous runs (default: benchmarks.jsonl)", 0},
+    {"record", 'r', 0, 0, "Append the new runs to the database", 0},
+    {"emulator", 'e', "PATH", 0,
+     "Emulator to benchmark (default: emu-gb, next to this program)", 0},
+    {"commit", 'C', "ID", 0,
+     "Commit of the emulator (default: git describe --always --dirty)", 0},
+    {"runs", 'n', "N", 0, "Number of runs of each rom (default: 5)", 0},
+    {"cycles", 'c', "N", 0,
+     "Stop each run after N machine cycles (default: once the rom prints its "
+     "result)",
+     0},
+    {"window", 'w', "N", 0,
+     "Number of previous commits in the baseline (default: 5)", 0},
+    {"threshold", 't', "PERCENT", 0,
+     "Smallest change of the median throughput reported (default: 3)", 0},
+    {"alpha", 'a', "P", 0,
+     "Significance level of the Mann-Whitney U test (default: 0.05)", 0},
+    {0},
+};
+
+int main(int argc, char **argv)
+{
+    static struct argp argp = {
+        g_options, parse_opt, "ROM|DIRECTORY...",
+        "Benchmark the emulator and compare the results with the previous "
+        "commits"};
+    struct runs database = {0};
+    struct runs current = {0};
+
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+
+    if (!g_baseline.count)
+        FATAL_ERROR("No rom found");
+
+    qsort(g_baseline.roms, g_baseline.count, sizeof(char *), compare_roms);
+
+    if (!g_baseline.emulator[0])
+        snprintf(g_baseline.emulator, sizeof(g_baseline.emulator),
+                 "%s/emu-gb", dirname(strdup(argv[0])));
+    if (!g_baseline.commit[0])
+        read_command("git describe --always --dirty 2>/dev/null",
+                     g_baseline.commit, sizeof(g_baseline.commit));
+    if (!g_baseline.commit[0])
+        snprintf(g_baseline.commit, sizeof(g_baseline.commit), "unknown");
+    read_cpu_model(g_baseline.cpu, sizeof(g_baseline.cpu));
+
+    load_database(&database);
+    run_all(&current);
+
+    const int status = compare(&current, &database);
+
+    if (g_baseline.record)
+        record_runs(&current);
+
+    return status;
+}
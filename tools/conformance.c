@@ -0,0 +1,400 @@
+/**
+ * \file conformance.c
+ * \brief Run test roms in parallel, each one with a fixed cycle budget
+ *
+ * Each rom is run inside its own process, as the emulator's state is global.
+ * The result is read from the serial output ("Passed" or "Failed"), or from
+ * the memory signature written into the cartridge RAM by the most recent
+ * blargg test roms. The roms that never report a result (dmg-acid2) are
+ * checked against the hash of their screen instead.
+ *
+ * The budget is counted in emulated cycles, so the result does not depend on
+ * the load of the host.
+ *
+ * Known failures are reported along with their reason, but do not change the
+ * exit status.
+ *
+ *     emu-gb-conformance tests/roms
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700 // needed for nftw
+
+#include <argp.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apu/apu.h"
+#include "cartridge/cartridge.h"
+#include "cpu/cpu.h"
+#include "cpu/instruction.h"
+#include "cpu/interrupt.h"
+#include "cpu/serial.h"
+#include "cpu/timer.h"
+#include "options.h"
+#include "ppu/ppu.h"
+#include "test_rom.h"
+#include "utils/error.h"
+#include "utils/hash.h"
+#include "utils/log.h"
+#include "utils/macro.h"
+
+/// Default budget, 2 minutes of emulated time
+#define DEFAULT_BUDGET (120ULL * CPU_CYCLES_PER_SECOND)
+
+/// Check the memory signature once every frame
+#define SIGNATURE_PERIOD 17556
+
+/// Status and signature written inside the cartridge RAM
+#define SIGNATURE_RUNNING 0x80
+static const u8 g_signature[] = {0xDE, 0xB0, 0x61};
+
+#define OUTPUT_SIZE 1024
+
+#define RED "\033[0;31m"
+#define GREEN "\033[0;32m"
+#define YELLOW "\033[0;33m"
+#define NC "\033[0m"
+
+/// Roms that cannot be run as is, identified by their file name
+struct expectation {
+    const char *name;
+    u32 frames; ///< Compare the screen after this many frames, 0 if unused
+    u64 screen; ///< hash64 of the framebuffer
+    const char *failure; ///< Why the emulator fails the rom, NULL if it passes
+};
+
+static const struct expectation g_expectations[] = {
+    // Same frame as tests/golden/dmg-acid2.txt, checked against the reference
+    {"dmg-acid2.gb", 60, 0x4f0f09f588bbf544ULL, NULL},
+    {"mem_timing.gb", 0, 0,
+     "memory accesses are not timed within the instructions"},
+};
+
+typedef enum run_status {
+    RUN_CRASHED = 0, ///< The process exited before reporting its result
+    RUN_PASSED,
+    RUN_FAILED,
+    RUN_TIMEOUT, ///< The budget was exhausted before any result
+} run_status;
+
+// Shared between the runner and the process running the rom
+struct run {
+    run_status status;
+    u64 cycles;
+    u64 host_ns;
+    char output[OUTPUT_SIZE]; ///< End of the text printed by the rom
+};
+
+static struct conformance {
+    u64 budget;
+    unsigned jobs;
+    bool verbose;
+
+    char **roms;
+    size_t count;
+    size_t capacity;
+} g_conformance = {
+    .budget = DEFAULT_BUDGET,
+};
+
+static u64 now_ns()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+static void save_output(struct run *run_ptr, const char *text, size_t size)
+{
+    const size_t kept = MIN(size, OUTPUT_SIZE - 1);
+
+    memcpy(run_ptr->output, text + size - kept, kept);
+    run_ptr->output[kept] = '\0';
+}
+
+// Result written inside the cartridge RAM, RUN_TIMEOUT if none
+static run_status read_signature(struct run *run_ptr)
+{
+    const u8 *ram_ptr = g_cartridge.ram;
+
+    if (!ram_ptr || g_cartridge.ram_size < 4 ||
+        memcmp(ram_ptr + 1, g_signature, sizeof(g_signature)) ||
+        ram_ptr[0] == SIGNATURE_RUNNING)
+        return RUN_TIMEOUT;
+
+    const char *text = (const char *)ram_ptr + 4;
+    save_output(run_ptr, text, strnlen(text, g_cartridge.ram_size - 4));
+
+    return ram_ptr[0] ? RUN_FAILED : RUN_PASSED;
+}
+
+static const struct expectation *find_expectation(const char *path)
+{
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    for (size_t i = 0; i < sizeof(g_expectations) / sizeof(*g_expectations);
+         ++i)
+        if (!strcmp(name, g_expectations[i].name))
+            return &g_expectations[i];
+
+    return NULL;
+}
+
+// Compare the screen once the expected number of frames has been drawn
+static run_status check_screen(const struct expectation *expectation_ptr,
+                               struct run *run_ptr)
+{
+    const u64 hash = hash64(g_ppu.framebuffer, sizeof(g_ppu.framebuffer));
+
+    snprintf(run_ptr->output, OUTPUT_SIZE,
+             "screen hash %016llx after %u frames, expected %016llx",
+             (unsigned long long)hash, expectation_ptr->frames,
+             (unsigned long long)expectation_ptr->screen);
+
+    return hash == expectation_ptr->screen ? RUN_PASSED : RUN_FAILED;
+}
+
+static void run_rom(char *path, struct run *run_ptr)
+{
+    const struct expectation *expectation_ptr = find_expectation(path);
+    const u32 frames = expectation_ptr ? expectation_ptr->frames : 0;
+    const u64 start = now_ns();
+    u64 next_check = SIGNATURE_PERIOD;
+    run_status status = RUN_TIMEOUT;
+
+    if (!load_cartridge(path))
+        return;
+
+    reset_cpu();
+    reset_timer();
+    reset_serial();
+    reset_apu();
+    ppu_set_engine(PPU_ENGINE_FAST);
+    // Nobody looks at the frames, unless the screen is the result
+    ppu_set_frameskip(frames ? 0 : UINT16_MAX);
+    reset_ppu();
+
+    test_rom_start(true);
+
+    while (g_cpu.is_running && timer_get_cycles() < g_conformance.budget) {
+        if (g_cpu.halt)
+            timer_tick();
+        else
+            execute_instruction();
+
+        handle_interrupts();
+
+        if (frames && g_ppu.stats.rendered_frames >= frames) {
+            status = check_screen(expectation_ptr, run_ptr);
+            break;
+        }
+
+        if (timer_get_cycles() >= next_check) {
+            next_check += SIGNATURE_PERIOD;
+            status = read_signature(run_ptr);
+            if (status != RUN_TIMEOUT)
+                break;
+        }
+    }
+
+    if (status == RUN_TIMEOUT) {
+        size_t size;
+        const char *output = test_rom_output(&size);
+        save_output(run_ptr, output, size);
+
+        if (test_rom_get_result() == TEST_ROM_PASSED)
+            status = RUN_PASSED;
+        else if (test_rom_get_result() == TEST_ROM_FAILED)
+            status = RUN_FAILED;
+    }
+
+    run_ptr->cycles = timer_get_cycles();
+    run_ptr->host_ns = now_ns() - start;
+    run_ptr->status = status;
+}
+
+static void run_all(struct run *runs)
+{
+    unsigned running = 0;
+
+    for (size_t i = 0; i < g_conformance.count; ++i) {
+        if (running == g_conformance.jobs) {
+            wait(NULL);
+            running -= 1;
+        }
+
+        const pid_t pid = fork();
+        if (pid < 0)
+            FATAL_ERROR("Failed to start a test process");
+
+        if (pid == 0) {
+            run_rom(g_conformance.roms[i], &runs[i]);
+            _exit(0);
+        }
+
+        running += 1;
+    }
+
+    while (running--)
+        wait(NULL);
+}
+
+static int print_results(const struct run *runs, u64 host_ns)
+{
+    static const char *names[] = {
+        [RUN_CRASHED] = "Crashed",
+        [RUN_PASSED] = "Passed",
+        [RUN_FAILED] = "Failed",
+        [RUN_TIMEOUT] = "Timeout",
+    };
+    const bool colors = isatty(STDOUT_FILENO);
+    size_t passed = 0;
+    size_t known_failures = 0;
+
+    printf("%-48s %-7s %12s %10s\n", "ROM", "Result", "Cycles", "Time (ms)");
+
+    for (size_t i = 0; i < g_conformance.count; ++i) {
+        const struct run *run_ptr = &runs[i];
+        const struct expectation *expectation_ptr =
+            find_expectation(g_conformance.roms[i]);
+        const bool success = run_ptr->status == RUN_PASSED;
+        const bool known = !success && expectation_ptr &&
+                           expectation_ptr->failure;
+        const char *color = success ? GREEN : known ? YELLOW : RED;
+
+        printf("%-48s %s%-7s%s %12llu %10.1f\n", g_conformance.roms[i],
+               colors ? color : "", names[run_ptr->status], colors ? NC : "",
+               (unsigned long long)run_ptr->cycles, run_ptr->host_ns / 1e6);
+
+        if (known)
+            printf("    known failure: %s\n", expectation_ptr->failure);
+
+        if (success)
+            passed += 1;
+        else if (known)
+            known_failures += 1;
+
+        if (!success && g_conformance.verbose && run_ptr->output[0])
+            printf("%s\n", run_ptr->output);
+    }
+
+    printf("\n%zu/%zu passed", passed, g_conformance.count);
+    if (known_failures)
+        printf(", %zu known failure%s", known_failures,
+               known_failures > 1 ? "s" : "");
+    printf(" in %.2fs\n", host_ns / 1e9);
+
+    return passed + known_failures != g_conformance.count;
+}
+
+static int add_rom(const char *path, const struct stat *stat_ptr, int type,
+                   struct FTW *ftw_ptr)
+{
+    (void)stat_ptr;
+    (void)ftw_ptr;
+
+    const size_t length = strlen(path);
+    if (type != FTW_F || length < 3 || strcmp(path + length - 3, ".gb"))
+        return 0;
+
+    if (g_conformance.count == g_conformance.capacity) {
+        g_conformance.capacity = MAX(2 * g_conformance.capacity, 16);
+        g_conformance.roms = realloc(
+            g_conformance.roms, g_conformance.capacity * sizeof(char *));
+        if (!g_conformance.roms)
+            FATAL_ERROR("Failed to allocate the list of roms");
+    }
+
+    g_conformance.roms[g_conformance.count++] = strdup(path);
+    return 0;
+}
+
+static int compare_roms(const void *lhs, const void *rhs)
+{
+    return strcmp(*(char *const *)lhs, *(char *const *)rhs);
+}
+
+static error_t parse_opt(int key, char *value, struct argp_state *state)
+{
+    char *end_ptr;
+
+    switch (key) {
+    case 'c':
+        g_conformance.budget = strtoull(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || !g_conformance.budget)
+            argp_error(state, "Invalid argument for option --cycles: %s",
+                       value);
+        break;
+    case 'j':
+        g_conformance.jobs = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' || !g_conformance.jobs)
+            argp_error(state, "Invalid argument for option --jobs: %s",
+                       value);
+        break;
+    case 'v':
+        g_conformance.verbose = true;
+        break;
+
+    case ARGP_KEY_ARG:
+        if (nftw(value, add_rom, 16, 0))
+            argp_error(state, "Cannot read %s", value);
+        break;
+    case ARGP_KEY_END:
+        if (state->arg_num == 0)
+            argp_usage(state);
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp_option g_options[] = {
+    {"cycles", 'c', "N", 0,
+     "Stop each rom after N machine cycles (default: 2 emulated minutes)", 0},
+    {"jobs", 'j', "N", 0,
+     "Number of roms run in parallel (default: number of CPUs)", 0},
+    {"verbose", 'v', 0, 0, "Print the output of the roms that did not pass",
+     0},
+    {0},
+};
+
+int main(int argc, char **argv)
+{
+    static struct argp argp = {
+        g_options, parse_opt, "ROM|DIRECTORY...",
+        "Run test roms in parallel and report their results"};
+
+    g_conformance.jobs = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+
+    if (!g_conformance.count)
+        FATAL_ERROR("No rom found");
+
+    qsort(g_conformance.roms, g_conformance.count, sizeof(char *),
+          compare_roms);
+
+    // Written by the test processes
+    struct run *runs = mmap(NULL, g_conformance.count * sizeof(struct run),
+                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                            -1, 0);
+    if (runs == MAP_FAILED)
+        FATAL_ERROR("Failed to allocate the results");
+
+    log_set_level(LOG_NONE, false);
+
+    const u64 start = now_ns();
+    run_all(runs);
+
+    return print_results(runs, now_ns() - start);
+}
@@ -0,0 +1,267 @@
+/**
+ * \file doctor.c
+ * \brief Find the first divergence between two gameboy-doctor logs
+ *
+ * Both logs are mapped into memory and compared line by line, so that logs of
+ * several gigabytes can be compared without reading them entirely. The lines
+ * preceding the first divergence are displayed, along with the name of the
+ * registers that differ.
+ *
+ *     emu-gb --trace-format=doctor --trace-out=trace.log ROM
+ *     emu-gb-doctor reference.log trace.log
+ */
+
+#define _DEFAULT_SOURCE // needed for madvise
+
+#include <argp.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/error.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+#define DEFAULT_CONTEXT 5
+#define MAX_CONTEXT 64
+
+struct log_file {
+    const char *path;
+    const char *data;
+    size_t size;
+    size_t offset; ///< Start of the next line
+};
+
+struct line {
+    const char *data;
+    size_t length;
+};
+
+static struct doctor {
+    unsigned context;
+    struct log_file files[2]; ///< Reference, then compared log
+} g_doctor = {
+    .context = DEFAULT_CONTEXT,
+};
+
+static void map_file(struct log_file *file_ptr)
+{
+    struct stat stat;
+    const int fd = open(file_ptr->path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &stat) < 0)
+        FATAL_ERROR("Failed to open '%s': %s", file_ptr->path,
+                    strerror(errno));
+
+    file_ptr->size = stat.st_size;
+    file_ptr->offset = 0;
+    file_ptr->data = "";
+
+    if (file_ptr->size) {
+        file_ptr->data =
+            mmap(NULL, file_ptr->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file_ptr->data == MAP_FAILED)
+            FATAL_ERROR("Failed to map '%s': %s", file_ptr->path,
+                        strerror(errno));
+        madvise((void *)file_ptr->data, file_ptr->size, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+}
+
+static bool next_line(struct log_file *file_ptr, struct line *line_ptr)
+{
+    if (file_ptr->offset >= file_ptr->size)
+        return false;
+
+    const char *start = file_ptr->data + file_ptr->offset;
+    const size_t left = file_ptr->size - file_ptr->offset;
+    const char *end = memchr(start, '\n', left);
+    size_t length = end ? (size_t)(end - start) : left;
+
+    file_ptr->offset += length + 1;
+
+    if (length && start[length - 1] == '\r')
+        length -= 1;
+
+    line_ptr->data = start;
+    line_ptr->length = length;
+    return true;
+}
+
+// Hexadecimal values may be written in lowercase by other emulators
+static bool same_line(const struct line *lhs_ptr, const struct line *rhs_ptr)
+{
+    if (lhs_ptr->length != rhs_ptr->length)
+        return false;
+
+    if (!memcmp(lhs_ptr->data, rhs_ptr->data, lhs_ptr->length))
+        return true;
+
+    for (size_t i = 0; i < lhs_ptr->length; ++i)
+        if (toupper(lhs_ptr->data[i]) != toupper(rhs_ptr->data[i]))
+            return false;
+
+    return true;
+}
+
+static void print_line(char prefix, u64 number, const struct line *line_ptr)
+{
+    printf("%c %10llu  %.*s\n", prefix, (unsigned long long)number,
+           (int)line_ptr->length, line_ptr->data);
+}
+
+// Length of the next "NAME:VALUE" field, 0 at the end of the line
+static size_t next_field(const struct line *line_ptr, size_t *offset_ptr)
+{
+    while (*offset_ptr < line_ptr->length &&
+           line_ptr->data[*offset_ptr] == ' ')
+        *offset_ptr += 1;
+
+    const size_t start = *offset_ptr;
+    while (*offset_ptr < line_ptr->length &&
+           line_ptr->data[*offset_ptr] != ' ')
+        *offset_ptr += 1;
+
+    return *offset_ptr - start;
+}
+
+static void print_fields(const struct line *expected_ptr,
+                         const struct line *actual_ptr)
+{
+    size_t expected_offset = 0;
+    size_t actual_offset = 0;
+
+    printf("Differences:");
+
+    while (true) {
+        const size_t expected_length =
+            next_field(expected_ptr, &expected_offset);
+        const size_t actual_length = next_field(actual_ptr, &actual_offset);
+        if (!expected_length || !actual_length)
+            break;
+
+        const struct line expected = {
+            expected_ptr->data + expected_offset - expected_length,
+            expected_length};
+        const struct line actual = {
+            actual_ptr->data + actual_offset - actual_length, actual_length};
+        if (same_line(&expected, &actual))
+            continue;
+
+        const char *separator = memchr(expected.data, ':', expected.length);
+        const int name_length =
+            separator ? separator - expected.data : (int)expected.length;
+        printf(" %.*s", name_length, expected.data);
+    }
+
+    printf("\n");
+}
+
+static int compare()
+{
+    struct line history[MAX_CONTEXT];
+    struct line expected = {0};
+    struct line actual = {0};
+    bool has_expected;
+    bool has_actual;
+    u64 number = 0;
+
+    while (true) {
+        has_expected = next_line(&g_doctor.files[0], &expected);
+        has_actual = next_line(&g_doctor.files[1], &actual);
+        number += 1;
+
+        if (!has_expected || !has_actual || !same_line(&expected, &actual))
+            break;
+
+        if (g_doctor.context)
+            history[number % g_doctor.context] = actual;
+    }
+
+    if (!has_expected && !has_actual) {
+        printf("No divergence (%llu lines)\n",
+               (unsigned long long)number - 1);
+        return 0;
+    }
+
+    printf("First divergence at line %llu\n\n", (unsigned long long)number);
+
+    const u64 context = MIN(number - 1, g_doctor.context);
+    for (u64 i = number - context; i < number; ++i)
+        print_line(' ', i, &history[i % g_doctor.context]);
+
+    if (has_expected)
+        print_line('-', number, &expected);
+    else
+        printf("-             <end of %s>\n", g_doctor.files[0].path);
+
+    if (has_actual)
+        print_line('+', number, &actual);
+    else
+        printf("+             <end of %s>\n", g_doctor.files[1].path);
+
+    if (has_expected && has_actual) {
+        printf("\n");
+        print_fields(&expected, &actual);
+    }
+
+    return 1;
+}
+
+static error_t parse_opt(int key, char *value, struct argp_state *state)
+{
+    char *end_ptr;
+
+    switch (key) {
+    case 'c':
+        g_doctor.context = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' ||
+            g_doctor.context > MAX_CONTEXT)
+            argp_error(state, "Invalid argument for option --context: %s",
+                       value);
+        break;
+
+    case ARGP_KEY_ARG:
+        if (state->arg_num >= 2)
+            argp_usage(state);
+        g_doctor.files[state->arg_num].path = value;
+        break;
+    case ARGP_KEY_END:
+        if (state->arg_num < 2)
+            argp_usage(state);
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp_option g_options[] = {
+    {"context", 'c', "N", 0,
+     "Number of identical lines displayed before the divergence (default: 5)",
+     0},
+    {0},
+};
+
+int main(int argc, char **argv)
+{
+    static struct argp argp = {
+        g_options, parse_opt, "REFERENCE LOG",
+        "Find the first divergence between two gameboy-doctor logs"};
+
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+
+    map_file(&g_doctor.files[0]);
+    map_file(&g_doctor.files[1]);
+
+    return compare();
+}
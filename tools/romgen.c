@@ -0,0 +1,501 @@
+/**
+ * \file romgen.c
+ * \brief Generate the synthetic cartridges used to benchmark the emulator
+ *
+ * Each cartridge repeats a loop stressing a single part of the emulator (ALU,
+ * CB instructions, memory copies, MBC bank switching, HALT and interrupts,
+ * deep call stacks, self-modifying code) for a fixed number of iterations,
+ * then prints "<workload>: Passed" on the serial port. They do not depend on
+ * any commercial ROM, and can be run like blargg's test roms.
+ *
+ *     emu-gb-romgen -o workloads
+ *     emu-gb-conformance workloads
+ *     emu-gb --stop-on-result workloads/alu.gb
+ */
+
+#include <argp.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cartridge/cartridge.h"
+#include "utils/error.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+#define ROM_BANK_SIZE 0x4000
+
+#define PROGRAM_START 0x0150 ///< Right after the header
+#define STACK_TOP 0xE000 ///< End of the WRAM, HRAM is kept for the counter
+#define COUNTER 0xFF80   ///< Remaining iterations (16-bit, little endian)
+#define SMC_ROUTINE 0xD000
+
+#define MESSAGE_SIZE 64
+
+/// Cartridge being assembled
+struct rom {
+    u8 *data;
+    u32 size;
+    u16 pc;   ///< Address of the next instruction, inside bank 0
+    u16 fail; ///< Prints the failure message and stops
+};
+
+struct workload {
+    const char *name;
+    const char *description;
+    cartridge_type type;
+    u16 banks;      ///< Number of 16 KiB ROM banks, a power of 2
+    u16 iterations; ///< Default number of iterations, about 2^22 cycles
+    void (*setup)(struct rom *rom_ptr); ///< Executed once, may be NULL
+    void (*body)(struct rom *rom_ptr);  ///< Executed once per iteration
+};
+
+static struct romgen {
+    const char *output_dir;
+    u16 iterations; ///< Overrides the default of each workload if not null
+    bool list;
+    char **names;
+    size_t count;
+} g_romgen = {
+    .output_dir = ".",
+};
+
+static void emit(struct rom *rom_ptr, const u8 *bytes, size_t count)
+{
+    if (rom_ptr->pc + count > ROM_BANK_SIZE)
+        FATAL_ERROR("The program does not fit inside the first bank");
+
+    memcpy(rom_ptr->data + rom_ptr->pc, bytes, count);
+    rom_ptr->pc += count;
+}
+
+#define EMIT(_rom_ptr, ...)                         \
+    emit(_rom_ptr, (const u8[]){__VA_ARGS__},       \
+         sizeof((const u8[]){__VA_ARGS__}))
+
+// Relative jump to an instruction that has already been assembled
+static void emit_jr(struct rom *rom_ptr, u8 opcode, u16 target)
+{
+    const int offset = target - (rom_ptr->pc + 2);
+
+    if (offset < -128)
+        FATAL_ERROR("Relative jump out of range (%d)", offset);
+
+    EMIT(rom_ptr, opcode, (u8)offset);
+}
+
+// Forward relative jump, its offset is set by resolve_jr
+static u16 emit_forward_jr(struct rom *rom_ptr, u8 opcode)
+{
+    const u16 address = rom_ptr->pc;
+
+    EMIT(rom_ptr, opcode, 0x00);
+    return address;
+}
+
+static void resolve_jr(struct rom *rom_ptr, u16 jump)
+{
+    const int offset = rom_ptr->pc - (jump + 2);
+
+    if (offset > 127)
+        FATAL_ERROR("Relative jump out of range (%d)", offset);
+
+    rom_ptr->data[jump + 1] = offset;
+}
+
+/*
+ * Workloads
+ */
+
+static void alu_body(struct rom *rom_ptr)
+{
+    for (int i = 0; i < 16; ++i) {
+        EMIT(rom_ptr, 0x80, 0x89, 0x92, 0x9B); // ADD B, ADC C, SUB D, SBC E
+        EMIT(rom_ptr, 0xA4, 0xAD, 0xB0, 0xB9); // AND H, XOR L, OR B, CP C
+        EMIT(rom_ptr, 0x3C, 0x05, 0x0C, 0x15); // INC A, DEC B, INC C, DEC D
+        EMIT(rom_ptr, 0x19, 0x1C, 0x07, 0x27); // ADD HL,DE, INC E, RLCA, DAA
+        EMIT(rom_ptr, 0xC6, 0x3B);             // ADD A,0x3B
+        EMIT(rom_ptr, 0xEE, 0xA5);             // XOR 0xA5
+    }
+}
+
+// Every CB instruction, except the ones modifying H and L
+static void cb_body(struct rom *rom_ptr)
+{
+    EMIT(rom_ptr, 0x21, 0x00, 0xC0); // LD HL,0xC000
+
+    for (int opcode = 0x00; opcode <= 0xFF; ++opcode) {
+        if ((opcode & 0x7) != 4 && (opcode & 0x7) != 5)
+            EMIT(rom_ptr, 0xCB, opcode);
+    }
+}
+
+// Copy 1 KiB from the ROM into the WRAM
+static void memcpy_body(struct rom *rom_ptr)
+{
+    EMIT(rom_ptr, 0x11, 0x00, 0x00); // LD DE,0x0000
+    EMIT(rom_ptr, 0x21, 0x00, 0xC0); // LD HL,0xC000
+    EMIT(rom_ptr, 0x06, 0x04);       // LD B,4
+
+    const u16 outer = rom_ptr->pc;
+    EMIT(rom_ptr, 0x0E, 0x00); // LD C,0 (256 bytes)
+
+    const u16 inner = rom_ptr->pc;
+    EMIT(rom_ptr, 0x1A, 0x13); // LD A,(DE); INC DE
+    EMIT(rom_ptr, 0x22, 0x0D); // LD (HL+),A; DEC C
+    emit_jr(rom_ptr, 0x20, inner);
+
+    EMIT(rom_ptr, 0x05); // DEC B
+    emit_jr(rom_ptr, 0x20, outer);
+}
+
+// Map each switchable bank in turn, and check its number (see generate)
+static void mbc_body(struct rom *rom_ptr)
+{
+    const u16 banks = rom_ptr->size / ROM_BANK_SIZE;
+
+    EMIT(rom_ptr, 0x21, 0x00, 0x20); // LD HL,0x2000 (ROM bank register)
+    EMIT(rom_ptr, 0x06, 0x01);       // LD B,1
+
+    const u16 loop = rom_ptr->pc;
+    EMIT(rom_ptr, 0x70);             // LD (HL),B
+    EMIT(rom_ptr, 0xFA, 0x00, 0x40); // LD A,(0x4000)
+    EMIT(rom_ptr, 0xB8);             // CP B
+    EMIT(rom_ptr, 0xC2, LSB(rom_ptr->fail), MSB(rom_ptr->fail)); // JP NZ,fail
+    EMIT(rom_ptr, 0x04, 0x78);  // INC B; LD A,B
+    EMIT(rom_ptr, 0xFE, banks); // CP banks
+    emit_jr(rom_ptr, 0x20, loop);
+}
+
+// The timer overflows every 64 cycles
+static void halt_setup(struct rom *rom_ptr)
+{
+    EMIT(rom_ptr, 0xAF, 0xE0, 0x05);       // TIMA = 0
+    EMIT(rom_ptr, 0x3E, 0xF0, 0xE0, 0x06); // TMA = 0xF0
+    EMIT(rom_ptr, 0x3E, 0x05, 0xE0, 0x07); // TAC = enabled, every 4 cycles
+    EMIT(rom_ptr, 0x3E, 0x04, 0xE0, 0xFF); // IE = timer
+    EMIT(rom_ptr, 0xAF, 0xE0, 0x0F);       // IF = 0
+    EMIT(rom_ptr, 0xFB);                   // EI
+}
+
+// Each HALT is interrupted by the timer (the handler only returns)
+static void halt_body(struct rom *rom_ptr)
+{
+    for (int i = 0; i < 64; ++i)
+        EMIT(rom_ptr, 0x76); // HALT
+}
+
+// Recurse 64 calls deep, 4 times
+static void calls_body(struct rom *rom_ptr)
+{
+    const u16 skip = emit_forward_jr(rom_ptr, 0x18);
+
+    const u16 recurse = rom_ptr->pc;
+    EMIT(rom_ptr, 0xC5, 0x3D);                       // PUSH BC; DEC A
+    EMIT(rom_ptr, 0xC4, LSB(recurse), MSB(recurse)); // CALL NZ,recurse
+    EMIT(rom_ptr, 0xC1, 0xC9);                       // POP BC; RET
+    resolve_jr(rom_ptr, skip);
+
+    EMIT(rom_ptr, 0x06, 0x04); // LD B,4
+
+    const u16 loop = rom_ptr->pc;
+    EMIT(rom_ptr, 0x3E, 0x40);                       // LD A,64
+    EMIT(rom_ptr, 0xCD, LSB(recurse), MSB(recurse)); // CALL recurse
+    EMIT(rom_ptr, 0x05);                             // DEC B
+    emit_jr(rom_ptr, 0x20, loop);
+}
+
+// Copy a routine which patches its own operand into the WRAM
+static void smc_setup(struct rom *rom_ptr)
+{
+    static const u8 routine[] = {
+        0x3E, 0x00, // LD A,0
+        0x3C,       // INC A or DEC A
+        0xEA, LSB(SMC_ROUTINE + 1), MSB(SMC_ROUTINE + 1), // LD (operand),A
+        0xC9,                                             // RET
+    };
+
+    const u16 skip = emit_forward_jr(rom_ptr, 0x18);
+    const u16 source = rom_ptr->pc;
+    emit(rom_ptr, routine, sizeof(routine));
+    resolve_jr(rom_ptr, skip);
+
+    EMIT(rom_ptr, 0x21, LSB(source), MSB(source));           // LD HL,source
+    EMIT(rom_ptr, 0x11, LSB(SMC_ROUTINE), MSB(SMC_ROUTINE)); // LD DE,routine
+    EMIT(rom_ptr, 0x06, sizeof(routine));                    // LD B,size
+
+    const u16 copy = rom_ptr->pc;
+    EMIT(rom_ptr, 0x2A, 0x12); // LD A,(HL+); LD (DE),A
+    EMIT(rom_ptr, 0x13, 0x05); // INC DE; DEC B
+    emit_jr(rom_ptr, 0x20, copy);
+}
+
+// Call the routine, then swap its INC A and DEC A
+static void smc_body(struct rom *rom_ptr)
+{
+    EMIT(rom_ptr, 0x06, 0x40); // LD B,64
+
+    const u16 loop = rom_ptr->pc;
+    EMIT(rom_ptr, 0xCD, LSB(SMC_ROUTINE), MSB(SMC_ROUTINE)); // CALL routine
+    EMIT(rom_ptr, 0x21, LSB(SMC_ROUTINE + 2),
+         MSB(SMC_ROUTINE + 2));      // LD HL,instruction
+    EMIT(rom_ptr, 0x7E, 0xEE, 0x01); // LD A,(HL); XOR 1
+    EMIT(rom_ptr, 0x77, 0x05);       // LD (HL),A; DEC B
+    emit_jr(rom_ptr, 0x20, loop);
+}
+
+static const struct workload g_workloads[] = {
+    {"alu", "Arithmetic and logic instructions on registers", ROM_ONLY, 2,
+     11700, NULL, alu_body},
+    {"cb", "CB prefixed instructions (rotations, shifts, BIT, RES, SET)",
+     ROM_ONLY, 2, 15400, NULL, cb_body},
+    {"memcpy", "1 KiB copies from the ROM into the WRAM, using LD (HL+),A",
+     ROM_ONLY, 2, 450, NULL, memcpy_body},
+    {"mbc1", "MBC1 ROM bank switch before each read (512 KiB)", MBC1, 32,
+     7500, NULL, mbc_body},
+    {"mbc3", "MBC3 ROM bank switch before each read (1 MiB)", MBC3, 64,
+     3700, NULL, mbc_body},
+    {"halt", "HALT woken up by the timer interrupt every 64 cycles",
+     ROM_ONLY, 2, 1000, halt_setup, halt_body},
+    {"calls", "Recursive CALL and RET, 64 calls deep", ROM_ONLY, 2, 900,
+     NULL, calls_body},
+    {"smc", "Routine in WRAM patching its own code before each call",
+     ROM_ONLY, 2, 2200, smc_setup, smc_body},
+};
+
+#define WORKLOAD_COUNT (sizeof(g_workloads) / sizeof(*g_workloads))
+
+/*
+ * Cartridge
+ */
+
+// HL: NUL terminated string
+static void emit_print(struct rom *rom_ptr)
+{
+    const u16 print = rom_ptr->pc;
+    EMIT(rom_ptr, 0x2A, 0xB7, 0xC8);       // LD A,(HL+); OR A; RET Z
+    EMIT(rom_ptr, 0xE0, 0x01);             // SB = A
+    EMIT(rom_ptr, 0x3E, 0x81, 0xE0, 0x02); // SC = start, internal clock
+
+    const u16 wait = rom_ptr->pc;
+    EMIT(rom_ptr, 0xF0, 0x02, 0xCB, 0x7F); // BIT 7,SC
+    emit_jr(rom_ptr, 0x20, wait);
+    emit_jr(rom_ptr, 0x18, print);
+}
+
+static u16 emit_message(struct rom *rom_ptr, const char *name,
+                        const char *result)
+{
+    const u16 address = rom_ptr->pc;
+    char message[MESSAGE_SIZE];
+
+    snprintf(message, sizeof(message), "%s: %s\n", name, result);
+    emit(rom_ptr, (const u8 *)message, strlen(message) + 1);
+
+    return address;
+}
+
+// Print the message and stop, on an infinite JR loop
+static void emit_report(struct rom *rom_ptr, u16 print, u16 message)
+{
+    EMIT(rom_ptr, 0xF3);                             // DI
+    EMIT(rom_ptr, 0x21, LSB(message), MSB(message)); // LD HL,message
+    EMIT(rom_ptr, 0xCD, LSB(print), MSB(print));     // CALL print
+    EMIT(rom_ptr, 0x18, 0xFE);                       // JR -2
+}
+
+static void write_header(struct rom *rom_ptr,
+                         const struct workload *workload_ptr)
+{
+    struct cartridge_header *header_ptr =
+        (struct cartridge_header *)(rom_ptr->data + CARTRIDGE_HEADER_START);
+    char *title = header_ptr->game_info.game_title;
+    u16 checksum = 0;
+    u16 banks = workload_ptr->banks;
+
+    memcpy(header_ptr->nintendo_logo, g_nintendo_logo,
+           sizeof(g_nintendo_logo));
+    for (size_t i = 0; i < sizeof(header_ptr->game_info.game_title) &&
+                       workload_ptr->name[i];
+         ++i)
+        title[i] = toupper(workload_ptr->name[i]);
+
+    header_ptr->type = workload_ptr->type;
+    header_ptr->rom_size = 0;
+    while (banks >>= 1)
+        header_ptr->rom_size += 1;
+    header_ptr->rom_size -= 1; // 32 KiB << value
+    header_ptr->ram_size = workload_ptr->type == ROM_ONLY ? 0 : 3; // 32 KiB
+    header_ptr->dst_code = 0x01;
+
+    // Verified by the boot ROM, see verify_header_checksum
+    header_ptr->header_checksum = 0;
+    for (u16 i = 0x0134; i <= 0x014C; ++i)
+        header_ptr->header_checksum -= rom_ptr->data[i] + 1;
+
+    // Sum of all the other bytes, stored in big endian
+    for (u32 i = 0; i < rom_ptr->size; ++i)
+        checksum += rom_ptr->data[i];
+    rom_ptr->data[0x014E] = MSB(checksum);
+    rom_ptr->data[0x014F] = LSB(checksum);
+}
+
+static void generate(const struct workload *workload_ptr, u16 iterations,
+                     struct rom *rom_ptr)
+{
+    rom_ptr->size = workload_ptr->banks * ROM_BANK_SIZE;
+    rom_ptr->data = calloc(rom_ptr->size, 1);
+    if (!rom_ptr->data)
+        FATAL_ERROR("Failed to allocate the cartridge");
+
+    // Switchable banks start with their number
+    for (u16 bank = 1; bank < workload_ptr->banks; ++bank)
+        rom_ptr->data[bank * ROM_BANK_SIZE] = bank;
+
+    // Interrupt handlers (VBlank, STAT, timer, serial, joypad) only return
+    for (u16 vector = 0x40; vector <= 0x60; vector += 0x08)
+        rom_ptr->data[vector] = 0xD9; // RETI
+
+    rom_ptr->pc = PROGRAM_START;
+    const u16 passed = emit_message(rom_ptr, workload_ptr->name, "Passed");
+    const u16 failed = emit_message(rom_ptr, workload_ptr->name, "Failed");
+    const u16 print = rom_ptr->pc;
+    emit_print(rom_ptr);
+    rom_ptr->fail = rom_ptr->pc;
+    emit_report(rom_ptr, print, failed);
+
+    const u16 start = rom_ptr->pc;
+    EMIT(rom_ptr, 0xF3);                                 // DI
+    EMIT(rom_ptr, 0x31, LSB(STACK_TOP), MSB(STACK_TOP)); // LD SP,STACK_TOP
+    EMIT(rom_ptr, 0x3E, LSB(iterations), 0xE0, LSB(COUNTER));
+    EMIT(rom_ptr, 0x3E, MSB(iterations), 0xE0, LSB(COUNTER + 1));
+    if (workload_ptr->setup)
+        workload_ptr->setup(rom_ptr);
+
+    const u16 loop = rom_ptr->pc;
+    workload_ptr->body(rom_ptr);
+
+    // Decrement the counter, the body may have used every register
+    EMIT(rom_ptr, 0x21, LSB(COUNTER), MSB(COUNTER)); // LD HL,COUNTER
+    EMIT(rom_ptr, 0x7E, 0xD6, 0x01, 0x22);           // (HL+) -= 1
+    EMIT(rom_ptr, 0x7E, 0xDE, 0x00, 0x32);           // (HL-) -= carry
+    EMIT(rom_ptr, 0xB6);                             // OR (HL)
+    EMIT(rom_ptr, 0xC2, LSB(loop), MSB(loop));       // JP NZ,loop
+    emit_report(rom_ptr, print, passed);
+
+    // Entry point: NOP; JP start
+    rom_ptr->pc = CARTRIDGE_HEADER_START;
+    EMIT(rom_ptr, 0x00, 0xC3, LSB(start), MSB(start));
+
+    write_header(rom_ptr, workload_ptr);
+}
+
+static void write_rom(const struct workload *workload_ptr)
+{
+    const u16 iterations =
+        g_romgen.iterations ? g_romgen.iterations : workload_ptr->iterations;
+    char path[ROM_MAX_FILENAME_SIZE];
+    struct rom rom;
+
+    generate(workload_ptr, iterations, &rom);
+
+    snprintf(path, sizeof(path), "%s/%s.gb", g_romgen.output_dir,
+             workload_ptr->name);
+    FILE *file_ptr = fopen(path, "wb");
+    if (!file_ptr)
+        FATAL_ERROR("Failed to open '%s': %s", path, strerror(errno));
+    if (fwrite(rom.data, 1, rom.size, file_ptr) != rom.size)
+        FATAL_ERROR("Failed to write '%s': %s", path, strerror(errno));
+
+    fclose(file_ptr);
+    free(rom.data);
+    printf("%s\n", path);
+}
+
+static const struct workload *find_workload(const char *name)
+{
+    for (size_t i = 0; i < WORKLOAD_COUNT; ++i) {
+        if (!strcmp(g_workloads[i].name, name))
+            return &g_workloads[i];
+    }
+
+    return NULL;
+}
+
+static error_t parse_opt(int key, char *value, struct argp_state *state)
+{
+    char *end_ptr;
+    unsigned long iterations;
+
+    switch (key) {
+    case 'o':
+        g_romgen.output_dir = value;
+        break;
+    case 'n':
+        iterations = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0' ||
+            !BETWEEN(iterations, 1, UINT16_MAX))
+            argp_error(state, "Invalid argument for option --iterations: %s",
+                       value);
+        g_romgen.iterations = iterations;
+        break;
+    case 'l':
+        g_romgen.list = true;
+        break;
+
+    case ARGP_KEY_ARGS:
+        g_romgen.names = state->argv + state->next;
+        g_romgen.count = state->argc - state->next;
+        for (size_t i = 0; i < g_romgen.count; ++i) {
+            if (!find_workload(g_romgen.names[i]))
+                argp_error(state, "Unknown workload: %s", g_romgen.names[i]);
+        }
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp_option g_options[] = {
+    {"output", 'o', "DIRECTORY", 0,
+     "Where to write the cartridges (default: current directory)", 0},
+    {"iterations", 'n', "N", 0,
+     "Number of iterations of each workload (default: about 4 emulated "
+     "seconds)",
+     0},
+    {"list", 'l', 0, 0, "List the available workloads", 0},
+    {0},
+};
+
+int main(int argc, char **argv)
+{
+    static struct argp argp = {
+        g_options, parse_opt, "[WORKLOAD...]",
+        "Generate synthetic cartridges, each one stressing a single part of "
+        "the emulator (default: all of them)"};
+
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+
+    if (g_romgen.list) {
+        for (size_t i = 0; i < WORKLOAD_COUNT; ++i)
+            printf("%-8s %s\n", g_workloads[i].name,
+                   g_workloads[i].description);
+        return 0;
+    }
+
+    if (!g_romgen.count) {
+        for (size_t i = 0; i < WORKLOAD_COUNT; ++i)
+            write_rom(&g_workloads[i]);
+        return 0;
+    }
+
+    for (size_t i = 0; i < g_romgen.count; ++i)
+        write_rom(find_workload(g_romgen.names[i]));
+
+    return 0;
+}
@@ -0,0 +1,417 @@
+/**
+ * \file trace.c
+ * \brief Decode the binary traces recorded by the emulator
+ *
+ * The records are disassembled offline using the opcode table of the CPU, so
+ * that recording a trace only costs a copy of the registers. The records can
+ * be filtered by address, ROM bank or cycle, and summarized into the most
+ * executed instructions and addresses.
+ *
+ *     emu-gb --trace-format=binary --trace-out=run.trace ROM
+ *     emu-gb-trace --pc=0x0200-0x02FF run.trace
+ *     emu-gb-trace --summary run.trace
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpu/instruction.h"
+#include "cpu/trace.h"
+#include "utils/error.h"
+#include "utils/macro.h"
+#include "utils/types.h"
+
+#define DEFAULT_TOP 10
+#define DISASSEMBLY_SIZE 32
+
+/// Instructions are grouped by opcode, CB prefixed ones come after the others
+#define OPCODE_KEYS 512
+
+struct range {
+    u64 first;
+    u64 last;
+};
+
+/// Number of executions of an address, inside an open addressing table
+struct address_count {
+    u32 key; ///< bank << 16 | pc, 0 for empty slots (see address_key)
+    u64 count;
+    const struct trace_record *first; ///< Used to disassemble the address
+};
+
+static struct trace_tool {
+    const char *path;
+    struct range pc;
+    struct range cycles;
+    int bank; ///< -1 for any bank
+    u64 limit;
+    bool summary;
+    unsigned top;
+
+    const struct trace_record *records;
+    size_t count;
+} g_trace_tool = {
+    .pc = {0, 0xFFFF},
+    .cycles = {0, UINT64_MAX},
+    .bank = -1,
+    .limit = UINT64_MAX,
+    .top = DEFAULT_TOP,
+};
+
+static void map_trace(const char *path)
+{
+    struct stat stat;
+    const int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &stat) < 0)
+        FATAL_ERROR("Failed to open '%s': %s", path, strerror(errno));
+    if ((size_t)stat.st_size < sizeof(struct trace_header))
+        FATAL_ERROR("'%s' is not a binary trace", path);
+
+    const u8 *data =
+        mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        FATAL_ERROR("Failed to map '%s': %s", path, strerror(errno));
+    madvise((void *)data, stat.st_size, MADV_SEQUENTIAL);
+    close(fd);
+
+    const struct trace_header *header_ptr = (const struct trace_header *)data;
+    if (memcmp(header_ptr->magic, TRACE_MAGIC, sizeof(header_ptr->magic)))
+        FATAL_ERROR("'%s' is not a binary trace", path);
+    if (header_ptr->version != TRACE_VERSION ||
+        header_ptr->record_size != sizeof(struct trace_record))
+        FATAL_ERROR("'%s': unsupported trace version (%u)", path,
+                    header_ptr->version);
+
+    // The last record may be incomplete if the emulator was interrupted
+    g_trace_tool.records =
+        (const struct trace_record *)(data + sizeof(struct trace_header));
+    g_trace_tool.count = (stat.st_size - sizeof(struct trace_header)) /
+                         sizeof(struct trace_record);
+}
+
+static bool is_selected(const struct trace_record *record_ptr)
+{
+    return BETWEEN(record_ptr->pc, g_trace_tool.pc.first,
+                   g_trace_tool.pc.last) &&
+           BETWEEN(record_ptr->cycle, g_trace_tool.cycles.first,
+                   g_trace_tool.cycles.last) &&
+           (g_trace_tool.bank < 0 || record_ptr->bank == g_trace_tool.bank);
+}
+
+static void print_record(const struct trace_record *record_ptr)
+{
+    char disassembly[DISASSEMBLY_SIZE];
+    char bytes[10];
+    const u8 length =
+        disassemble_instruction(record_ptr->bytes, disassembly,
+                                sizeof(disassembly));
+
+    for (u8 i = 0; i < length; ++i)
+        snprintf(bytes + 3 * i, sizeof(bytes) - 3 * i, "%02X ",
+                 record_ptr->bytes[i]);
+    bytes[3 * length - 1] = '\0';
+
+    printf("%12llu  %03X:%04X  %-8s  %-20s  AF=%04X BC=%04X DE=%04X HL=%04X "
+           "SP=%04X%s\n",
+           (unsigned long long)record_ptr->cycle, record_ptr->bank,
+           record_ptr->pc, bytes, disassembly, record_ptr->af, record_ptr->bc,
+           record_ptr->de, record_ptr->hl, record_ptr->sp,
+           record_ptr->ime ? " IME" : "");
+}
+
+static int disassemble()
+{
+    u64 printed = 0;
+
+    for (size_t i = 0; i < g_trace_tool.count; ++i) {
+        if (printed >= g_trace_tool.limit)
+            break;
+        if (!is_selected(&g_trace_tool.records[i]))
+            continue;
+        print_record(&g_trace_tool.records[i]);
+        printed += 1;
+    }
+
+    return 0;
+}
+
+// Keys are never null, as the bank is incremented
+static ALWAYS_INLINE u32 address_key(const struct trace_record *record_ptr)
+{
+    return ((record_ptr->bank + 1) << 16) | record_ptr->pc;
+}
+
+static u32 hash_key(u32 key)
+{
+    return key * 0x9E3779B1;
+}
+
+static struct address_count *count_addresses(size_t *size_ptr)
+{
+    size_t size = 1 << 12;
+    size_t used = 0;
+    struct address_count *table = calloc(size, sizeof(*table));
+
+    if (!table)
+        FATAL_ERROR("Failed to allocate the address table");
+
+    for (size_t i = 0; i < g_trace_tool.count; ++i) {
+        const struct trace_record *record_ptr = &g_trace_tool.records[i];
+        if (!is_selected(record_ptr))
+            continue;
+
+        // Keep the table at most half full
+        if (2 * used >= size) {
+            struct address_count *old_table = table;
+            table = calloc(2 * size, sizeof(*table));
+            if (!table)
+                FATAL_ERROR("Failed to allocate the address table");
+            for (size_t j = 0; j < size; ++j) {
+                if (!old_table[j].key)
+                    continue;
+                size_t slot = hash_key(old_table[j].key) & (2 * size - 1);
+                while (table[slot].key)
+                    slot = (slot + 1) & (2 * size - 1);
+                table[slot] = old_table[j];
+            }
+            free(old_table);
+            size *= 2;
+        }
+
+        const u32 key = address_key(record_ptr);
+        size_t slot = hash_key(key) & (size - 1);
+        while (table[slot].key && table[slot].key != key)
+            slot = (slot + 1) & (size - 1);
+
+        if (!table[slot].key) {
+            table[slot].key = key;
+            table[slot].first = record_ptr;
+            used += 1;
+        }
+        table[slot].count += 1;
+    }
+
+    *size_ptr = size;
+    return table;
+}
+
+static int compare_counts(const void *lhs, const void *rhs)
+{
+    const u64 lhs_count = ((const struct address_count *)lhs)->count;
+    const u64 rhs_count = ((const struct address_count *)rhs)->count;
+    return (lhs_count < rhs_count) - (lhs_count > rhs_count);
+}
+
+struct mnemonic {
+    char name[8];
+    u64 count;
+};
+
+static int compare_mnemonics(const void *lhs, const void *rhs)
+{
+    const u64 lhs_count = ((const struct mnemonic *)lhs)->count;
+    const u64 rhs_count = ((const struct mnemonic *)rhs)->count;
+    return (lhs_count < rhs_count) - (lhs_count > rhs_count);
+}
+
+static void print_mnemonics(const u64 *opcodes, u64 total)
+{
+    struct mnemonic mnemonics[OPCODE_KEYS];
+    size_t count = 0;
+
+    // Group the opcodes by mnemonic, the first word of the disassembly
+    for (u16 key = 0; key < OPCODE_KEYS; ++key) {
+        if (!opcodes[key])
+            continue;
+
+        const u8 bytes[3] = {key < 256 ? key : 0xCB, LSB(key), 0};
+        char disassembly[DISASSEMBLY_SIZE];
+        disassemble_instruction(bytes, disassembly, sizeof(disassembly));
+        disassembly[strcspn(disassembly, " ")] = '\0';
+
+        size_t i = 0;
+        while (i < count && strcmp(mnemonics[i].name, disassembly))
+            i += 1;
+        if (i == count) {
+            snprintf(mnemonics[i].name, sizeof(mnemonics[i].name), "%.7s",
+                     disassembly);
+            mnemonics[i].count = 0;
+            count += 1;
+        }
+        mnemonics[i].count += opcodes[key];
+    }
+
+    qsort(mnemonics, count, sizeof(*mnemonics), compare_mnemonics);
+
+    printf("\nInstructions:\n");
+    for (size_t i = 0; i < count; ++i)
+        printf("  %12llu  %5.1f%%  %s\n",
+               (unsigned long long)mnemonics[i].count,
+               100.0 * mnemonics[i].count / total, mnemonics[i].name);
+}
+
+static int summarize()
+{
+    static u64 opcodes[OPCODE_KEYS];
+    u64 total = 0;
+    u64 first_cycle = 0;
+    u64 last_cycle = 0;
+
+    for (size_t i = 0; i < g_trace_tool.count; ++i) {
+        const struct trace_record *record_ptr = &g_trace_tool.records[i];
+        if (!is_selected(record_ptr))
+            continue;
+
+        if (!total)
+            first_cycle = record_ptr->cycle;
+        last_cycle = record_ptr->cycle;
+        total += 1;
+
+        if (record_ptr->bytes[0] == 0xCB)
+            opcodes[256 + record_ptr->bytes[1]] += 1;
+        else
+            opcodes[record_ptr->bytes[0]] += 1;
+    }
+
+    printf("%llu instructions (%llu in the trace), cycles %llu to %llu\n",
+           (unsigned long long)total, (unsigned long long)g_trace_tool.count,
+           (unsigned long long)first_cycle, (unsigned long long)last_cycle);
+    if (!total)
+        return 0;
+
+    print_mnemonics(opcodes, total);
+
+    size_t size;
+    struct address_count *table = count_addresses(&size);
+    qsort(table, size, sizeof(*table), compare_counts);
+
+    printf("\nAddresses:\n");
+    for (size_t i = 0; i < MIN(size, g_trace_tool.top) && table[i].key; ++i) {
+        char disassembly[DISASSEMBLY_SIZE];
+        const struct trace_record *record_ptr = table[i].first;
+
+        disassemble_instruction(record_ptr->bytes, disassembly,
+                                sizeof(disassembly));
+        printf("  %12llu  %5.1f%%  %03X:%04X  %s\n",
+               (unsigned long long)table[i].count,
+               100.0 * table[i].count / total, record_ptr->bank,
+               record_ptr->pc, disassembly);
+    }
+
+    free(table);
+    return 0;
+}
+
+// RANGE is either a single value, or FIRST-LAST (both included)
+static bool parse_range(const char *value, int base, struct range *range_ptr)
+{
+    char *end_ptr;
+
+    range_ptr->first = strtoull(value, &end_ptr, base);
+    if (end_ptr == value)
+        return false;
+
+    if (*end_ptr == '\0') {
+        range_ptr->last = range_ptr->first;
+        return true;
+    }
+
+    if (*end_ptr != '-')
+        return false;
+
+    value = end_ptr + 1;
+    range_ptr->last = strtoull(value, &end_ptr, base);
+    return end_ptr != value && *end_ptr == '\0' &&
+           range_ptr->first <= range_ptr->last;
+}
+
+static error_t parse_opt(int key, char *value, struct argp_state *state)
+{
+    char *end_ptr;
+
+    switch (key) {
+    case 'p':
+        if (!parse_range(value, 16, &g_trace_tool.pc) ||
+            g_trace_tool.pc.last > 0xFFFF)
+            argp_error(state, "Invalid argument for option --pc: %s", value);
+        break;
+    case 'b':
+        g_trace_tool.bank = strtol(value, &end_ptr, 0);
+        if (*value == '\0' || *end_ptr != '\0' ||
+            !BETWEEN(g_trace_tool.bank, 0, 0xFFFF))
+            argp_error(state, "Invalid argument for option --bank: %s", value);
+        break;
+    case 'c':
+        if (!parse_range(value, 10, &g_trace_tool.cycles))
+            argp_error(state, "Invalid argument for option --cycles: %s",
+                       value);
+        break;
+    case 'n':
+        g_trace_tool.limit = strtoull(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0')
+            argp_error(state, "Invalid argument for option --limit: %s",
+                       value);
+        break;
+    case 's':
+        g_trace_tool.summary = true;
+        break;
+    case 't':
+        g_trace_tool.top = strtoul(value, &end_ptr, 10);
+        if (*value == '\0' || *end_ptr != '\0')
+            argp_error(state, "Invalid argument for option --top: %s", value);
+        break;
+
+    case ARGP_KEY_ARG:
+        if (state->arg_num >= 1)
+            argp_usage(state);
+        g_trace_tool.path = value;
+        break;
+    case ARGP_KEY_END:
+        if (state->arg_num < 1)
+            argp_usage(state);
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp_option g_options[] = {
+    {"pc", 'p', "RANGE", 0,
+     "Only keep the instructions at these addresses (hexadecimal, e.g. "
+     "0x0100-0x01FF)",
+     0},
+    {"bank", 'b', "BANK", 0, "Only keep the instructions of a ROM bank", 0},
+    {"cycles", 'c', "RANGE", 0,
+     "Only keep the instructions executed during these machine cycles", 0},
+    {"limit", 'n', "N", 0, "Display at most N instructions", 0},
+    {"summary", 's', 0, 0,
+     "Display the most executed instructions and addresses instead", 0},
+    {"top", 't', "N", 0,
+     "Number of addresses displayed by --summary (default: 10)", 0},
+    {0},
+};
+
+int main(int argc, char **argv)
+{
+    static struct argp argp = {
+        g_options, parse_opt, "TRACE",
+        "Disassemble and summarize a binary trace (--trace-format=binary)"};
+
+    argp_parse(&argp, argc, argv, 0, 0, NULL);
+    map_trace(g_trace_tool.path);
+
+    return g_trace_tool.summary ? summarize() : disassemble();
+}